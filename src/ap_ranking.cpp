@@ -0,0 +1,168 @@
+/**************************************************************************
+ * Ranking of the access points for the floor map
+ *
+ * Each AP of the floor map adds one row to the IILTM and to the cost
+ * of the matching. In a crowded RF environment there are many more
+ * usable APs than needed. Only the APs with the most information
+ * about the position should be used:
+ *
+ *   gradient:  the mean change of the fitted RSSI along the learned
+ *              range of the AP. An AP with a flat profile can't
+ *              distinguish positions. Outside of its learned range an
+ *              AP has no profile: the step to the -95dBm of the IILTM
+ *              at the end of the range is not a gradient.
+ *   residual:  the RMS of the measured RSSI values around the fit.
+ *              A noisy AP gives a wrong position for a small change
+ *              of its RSSI value.
+ *   overlap:   the similarity (|cosine|) of the gradient profile to
+ *              an AP that is already selected. An AP that changes at
+ *              the same positions adds little new information.
+ *
+ * The APs are selected greedily: the AP with the best score
+ *
+ *     score = gradient / residual * (1 - overlap/2)
+ *
+ * is selected next, then the overlaps of the other APs are updated.
+ * An AP with the same profile as a selected AP still has half of its
+ * score: like a second scan, it halves the noise variance of the
+ * same information.
+ * The profiles are calculated with ap_profile_points points along
+ * the floor, so the memory is small (ap_profile_points floats per
+ * AP), independent of the size of the grid. The points are limited
+ * to the learned range of each AP, so the sections outside of the
+ * range have a profile of 0.
+ *
+ * Hague Nusseck @ electricidea
+ * v1.0
+ * https://github.com/electricidea/M5Stack-Hotel-room-finder
+ *
+ * Distributed as-is; no warranty is given.
+ *
+ **************************************************************************
+ *
+ * ==== How to use it: ====
+ *
+ * 1.) rank the used fits and keep the best max_aps:
+ *
+ *          ap_rank *ranks = (ap_rank*) malloc(fits.size()*sizeof(ap_rank));
+ *          int n = rank_aps(fits, min_pos, max_pos, max_aps, ranks);
+ *
+ *     ranks[0 .. n-1] are the selected APs in the order of their
+ *     selection, ranks[n .. fits.size()-1] the other APs
+ *
+ ***************************************************************************/
+
+#include <stdlib.h>
+#include <math.h>
+#include "ap_ranking.h"
+
+//==============================================================
+// |cosine| of two gradient profiles
+static float ap_similarity(const float *a, const float *b, float norm_a, float norm_b) {
+    if(norm_a <= 0 || norm_b <= 0)
+        return 1.0;
+    float dot = 0;
+    for(int i = 0; i < ap_profile_points; ++i)
+        dot += a[i] * b[i];
+    float similarity = fabsf(dot) / (norm_a * norm_b);
+    return (similarity < 1) ? similarity : 1;
+}
+
+//==============================================================
+// score of an AP without overlap: gradient / residual
+static float ap_base_score(const ap_rank &rank) {
+    return rank.gradient / ((rank.residual > ap_min_residual) ? rank.residual : ap_min_residual);
+}
+
+//==============================================================
+// rank all used fits of the bank over the range [min_x, max_x]
+// ranks needs fits.size() entries
+// return the number of selected APs (at most max_aps), or -1 if
+// the memory allocation fails
+int rank_aps(fit_bank &fits, double min_x, double max_x, int max_aps, ap_rank *ranks) {
+    int n_aps = fits.size();
+    if(n_aps == 0)
+        return 0;
+    // gradient profile and its norm of each AP
+    float *profiles = (float*) malloc((size_t) n_aps * (ap_profile_points+1) * sizeof(float));
+    fit_scalar *xs = (fit_scalar*) malloc((ap_profile_points+1) * sizeof(fit_scalar));
+    fit_scalar *ys = (fit_scalar*) malloc((ap_profile_points+1) * sizeof(fit_scalar));
+    if(!profiles || !xs || !ys) {
+        free(profiles);
+        free(xs);
+        free(ys);
+        return -1;
+    }
+    float *norms = &profiles[(size_t) n_aps * ap_profile_points];
+    double step = (max_x - min_x) / ap_profile_points;
+    int n = 0;
+    for(int ap = 0; ap < fits.capacity(); ++ap) {
+        if(!fits.used(ap))
+            continue;
+        // the points of the profile within the learned range:
+        // a section outside of the range has two equal points
+        double lo = fits.min_x(ap);
+        double hi = fits.max_x(ap);
+        for(int i = 0; i <= ap_profile_points; ++i) {
+            double x = min_x + i * step;
+            xs[i] = (x < lo) ? lo : ((x > hi) ? hi : x);
+        }
+        fits.predict_many(ap, xs, ys, ap_profile_points+1, -95.0);
+        float *profile = &profiles[(size_t) n * ap_profile_points];
+        float sum = 0;
+        float square_sum = 0;
+        for(int i = 0; i < ap_profile_points; ++i) {
+            profile[i] = (float) (ys[i+1] - ys[i]);
+            sum += fabsf(profile[i]);
+            square_sum += profile[i] * profile[i];
+        }
+        norms[n] = sqrtf(square_sum);
+        // the mean over the learned part of the floor
+        double length = (double) xs[ap_profile_points] - (double) xs[0];
+        ap_rank &rank = ranks[n];
+        rank.ap = ap;
+        rank.gradient = (length > 0) ? (float) (sum / length) : 0;
+        rank.residual = (float) fits.residual(ap);
+        rank.overlap = 0;
+        rank.score = ap_base_score(rank);
+        ++n;
+    }
+    free(xs);
+    free(ys);
+    // greedy selection: ranks[0 .. selected-1] are selected
+    // the profiles are swapped together with the ranks
+    int selected = 0;
+    while(selected < max_aps && selected < n_aps) {
+        int best = selected;
+        for(int i = selected+1; i < n_aps; ++i)
+            if(ranks[i].score > ranks[best].score)
+                best = i;
+        if(best != selected) {
+            ap_rank rank = ranks[best];
+            ranks[best] = ranks[selected];
+            ranks[selected] = rank;
+            float *a = &profiles[(size_t) best * ap_profile_points];
+            float *b = &profiles[(size_t) selected * ap_profile_points];
+            for(int i = 0; i < ap_profile_points; ++i) {
+                float value = a[i];
+                a[i] = b[i];
+                b[i] = value;
+            }
+            float norm = norms[best];
+            norms[best] = norms[selected];
+            norms[selected] = norm;
+        }
+        // the overlap of the other APs with the new selected AP
+        const float *profile = &profiles[(size_t) selected * ap_profile_points];
+        for(int i = selected+1; i < n_aps; ++i) {
+            float overlap = ap_similarity(profile, &profiles[(size_t) i * ap_profile_points], norms[selected], norms[i]);
+            if(overlap > ranks[i].overlap) {
+                ranks[i].overlap = overlap;
+                ranks[i].score = ap_base_score(ranks[i]) * (1 - overlap/2);
+            }
+        }
+        ++selected;
+    }
+    free(profiles);
+    return selected;
+}
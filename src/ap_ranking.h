@@ -0,0 +1,43 @@
+/***************************************************
+ *
+ * Ranking of the access points for the floor map
+ * (discriminative power, noise and redundancy)
+ *
+ * Hague Nusseck @ electricidea
+ *
+ * --> see ap_ranking.cpp for more details on how it
+ * works and how to use it.
+ *
+ * Distributed as-is; no warranty is given.
+ *
+ * ************************************************/
+
+#ifndef AP_RANKING_H
+#define AP_RANKING_H
+
+#include <stdint.h>
+#include "numeric_types.h"
+#include "fit_bank.h"
+
+// number of points of the RSSI profile of an AP
+const int ap_profile_points = 32;
+// the residual of a fit is at least the resolution of the RSSI values
+const float ap_min_residual = 1.0;
+
+// the ranking values of one AP
+struct ap_rank {
+    // index of the fit
+    int ap;
+    // mean RSSI change along the learned range in dBm per position unit
+    float gradient;
+    // RMS of the RSSI values around the fit in dBm
+    float residual;
+    // similarity to the profile of an AP ranked before (0 ... 1)
+    float overlap;
+    // gradient / residual * (1 - overlap/2)
+    float score;
+};
+
+int rank_aps(fit_bank &fits, double min_x, double max_x, int max_aps, ap_rank *ranks);
+
+#endif
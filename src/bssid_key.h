@@ -0,0 +1,103 @@
+/***************************************************
+ *
+ * BSSIDs as packed 48 bit keys
+ *
+ * Hague Nusseck @ electricidea
+ *
+ * A BSSID (MAC address of an access point) is stored in
+ * the lower 6 bytes of a uint64_t instead of a string:
+ *
+ *          "AA:BB:CC:DD:EE:FF" --> 0x0000AABBCCDDEEFF
+ *
+ *          uint64_t key = bssid_parse("AA:BB:CC:DD:EE:FF");
+ *          uint64_t key = bssid_pack(WiFi.BSSID(i));
+ *          char text[bssid_text_size];
+ *          bssid_format(key, text);
+ *
+ * bssid_hash() maps a key to a slot of a hash table with
+ * 2^bits slots (Fibonacci hashing).
+ *
+ * Distributed as-is; no warranty is given.
+ *
+ * ************************************************/
+
+#ifndef BSSID_KEY_H
+#define BSSID_KEY_H
+
+#include <stdint.h>
+
+// key of an invalid or unused BSSID (not a 48 bit value)
+const uint64_t bssid_none = 0xFFFFFFFFFFFFFFFFULL;
+// length of a BSSID string "AA:BB:CC:DD:EE:FF" + 0
+const int bssid_text_size = 18;
+
+//==============================================================
+// value of a hex digit or -1
+inline int bssid_hex_digit(char c) {
+    if(c >= '0' && c <= '9')
+        return c - '0';
+    if(c >= 'A' && c <= 'F')
+        return c - 'A' + 10;
+    if(c >= 'a' && c <= 'f')
+        return c - 'a' + 10;
+    return -1;
+}
+
+//==============================================================
+// convert a BSSID string into a key
+// the bytes can be separated by ':' or '-'
+// return bssid_none if the string is no BSSID
+inline uint64_t bssid_parse(const char *text) {
+    uint64_t key = 0;
+    for(int i = 0; i < 6; ++i) {
+        if(i > 0) {
+            if(*text != ':' && *text != '-')
+                return bssid_none;
+            ++text;
+        }
+        int high = bssid_hex_digit(text[0]);
+        if(high < 0)
+            return bssid_none;
+        int low = bssid_hex_digit(text[1]);
+        if(low < 0)
+            return bssid_none;
+        key = (key << 8) | (uint64_t) ((high << 4) | low);
+        text += 2;
+    }
+    if(*text != 0)
+        return bssid_none;
+    return key;
+}
+
+//==============================================================
+// convert the 6 bytes of a MAC address into a key
+// (e.g. the result of WiFi.BSSID(i))
+inline uint64_t bssid_pack(const uint8_t *mac) {
+    if(!mac)
+        return bssid_none;
+    uint64_t key = 0;
+    for(int i = 0; i < 6; ++i)
+        key = (key << 8) | mac[i];
+    return key;
+}
+
+//==============================================================
+// write the key as BSSID string "AA:BB:CC:DD:EE:FF" into text
+// text needs space for bssid_text_size characters
+inline void bssid_format(uint64_t key, char *text) {
+    const char digits[] = "0123456789ABCDEF";
+    for(int i = 0; i < 6; ++i) {
+        uint8_t byte = (uint8_t) (key >> (8*(5-i)));
+        text[3*i] = digits[byte >> 4];
+        text[(3*i)+1] = digits[byte & 0x0F];
+        text[(3*i)+2] = (i < 5) ? ':' : 0;
+    }
+}
+
+//==============================================================
+// slot of the key in a hash table with 2^bits slots
+inline uint32_t bssid_hash(uint64_t key, uint8_t bits) {
+    return (uint32_t) ((key * 0x9E3779B97F4A7C15ULL) >> (64 - bits));
+}
+
+#endif
@@ -1,504 +1,572 @@
-/**************************************************************************
- * Library to calculate polynomial regression in Arduino.
- * 
- * Simple, efficient and memory efficient method to 
- * calculate mean values, linear regressions or 
- * parabolas from pairs of values.
- * 
- * Based on Cramers rule  for fitting of a polynomial 
- * regression model using least square method.
- * For a very good explanation, please see:
- * https://neutrium.net/mathematics/least-squares-fitting-of-a-polynomial/
- * 
- * and thanks to Cubiwan:
- * https://github.com/cubiwan/LinearRegressino
- * and Chandu yadav:
- * https://www.tutorialspoint.com/cplusplus-program-to-compute-determinant-of-a-matrix
- * for the inspiration on how to implement it
- * and Martin R.
- * https://codereview.stackexchange.com/questions/204135/determinant-using-gauss-elimination
- * for the tip about partial pivoting...
- * 
- * 
- * Hague Nusseck @ electricidea
- * v1.4 24.May.2020
- * https://github.com/electricidea/xxxx
- * 
- * Changelog:
- * v1.2 = - first version ready with "Laplace expansion" Method to calculate determinants
- * v1.3 = - Gaussian triangular method for the determination of determinants (faster!)
- *        - added name and tag
- *        - added max_x and min_x
- *        - established aij Matrix notation
- *        - String output for formular
- * v1.4 = - dynamic matrix sizes according to initialized order
- *        - functions to estimate max and min y values over the known range of x
- *        - add function count() to return N
- * 
- * 
- * Distributed as-is; no warranty is given.
- * 
- **************************************************************************
- * 
- * ==== How to use it: ====
- * 
- * 1.) intitialize the fitting object:
- * 
- *          curve_fit fit_1 = curve_fit(1);
- * NOTE:
- * degree = 0 --> A constant (or: The Average of y values)
- * degree = 1 --> A first order polynomial (or: linear regression)
- * degree = 2 --> A second order polynomial (or: parabolic curve)
- * degree = 3 --> A third order polynomial
- * Note: 
- * Generally the degree is not limited, but from the 6th or 7th 
- * degree the floating-point arithmetic reaches its limits and 
- * there may be inaccuracies.
- * 
- * In principle, there is no limit for the degree of polynomials, 
- * but from the 6th or 7th degree on, first calculation errors appear
- * due to the inaccurate floating-point arithmetic. 
- * 
- * 2.) Let the function solve the polynomial regression model 
- *     by adding pairs of x and y values:
- * 
- *          fit_1.learn(0,5);
- *          fit_1.learn(1,18.65);
- *              ...
- *          fit_1.learn(10,52.4);
- * 
- * During each of these steps the polynomial representation is calculated. 
- * The value pairs are not stored. As a result, the computing time is 
- * higher, but the class can be used more flexible.
- * 
- * 3.) print out the calculated coefficients:
- * 
- *          double coeff_values[2];
- *          fit_1.get_coefficients(coeff_values);
- *          Serial.printf("y= a1*x + a0\n\na1= %.2f\na0= %.2f", 
- *                        coeff_values[1], coeff_values[0]);
- * 
- * 4.) Calculate the y values for a new x value:
- * 
- *          new_y = fit_1.predict(new_x);
- * 
- * Some NOTES:
- * At any time additional pairs of values can be added to improve 
- * the calculation / allow further learning.....
- * The value pairs are not stored. They cannot be read out again 
- * or changed afterwards.
- * 
- * 
- * ==== How the Math works: ==== 
- * 
- * Representation of a kth order polynomial
- * y = ak*x^k +⋯+ a1*x + a0
- * 
- * with
- * a	:	Polynomial coefficient
- * k	:	The degree of the polynomial
- * N	:	The number of points to be regressed
- *  
- * The coefficients of the polynomial regression model (ak,ak−1,⋯,a1) may be 
- * determined by solving the following system of linear equations:
- * 
- * |                                             |   |    |   |              |
- * |    N          SUM(xi)     ...    SUM(xi^k)  |   | a0 |   |    SUM(yi)   |
- * |  SUM(xi)     SUM(xi^2 )   ...   SUM(xi^k+1) |   | a1 |   |  SUM(xi*yi)  |
- * |    ...         ...        ...       ...     | * | .. | = |     ...      |
- * | SUM(xi^k)  SUM(xi^k+1)    ...    SUM(xi^2k) |   | ak |   | SUM(xi^k*yi) |
- * |                                             |   |    |   |              |
- * 
- * Cramer's rule allows you to solve the linear system of equations to find the 
- * regression coefficients using the determinants of the square matrix M. Each 
- * of the coefficients ak may be determined using the following equation:
- * 
- * ak = det(Mi) / det(M)
- * 
- * Where Mi is the matrix M with the ith column replaced with the column 
- * vector b (remembering the system is presented in the form Ma=b). 
- * For example M0 could be calculated as follows:
- * 
- * 
- *      |                                                |  
- *      |     SUM(yi)     SUM(xi)      ...    SUM(xi^k)  | 
- *      |   SUM(xi*yi)   SUM(xi^2 )    ...   SUM(xi^k+1) | 
- * M0 = |      ...          ...        ...       ...     | 
- *      | SUM(xi^k*yi)   SUM(xi^k+1)   ...    SUM(xi^2k) |  
- *      |                                                |  
- * 
- * Example for an linear regression (polynominal 1th order)
- * 
- *  y = a1*x + a0
- * 
- * |                     |   |    |   |            |
- * |   N       SUM(xi)   |   | a0 |   |   SUM(yi)  |
- * | SUM(xi)  SUM(xi^2)  | * | a1 | = | SUM(xi*yi) |
- * |                     |   |    |   |            | 
- * 
- * 
- *      |                     | 
- *      |   N       SUM(xi)   | 
- *  M = | SUM(xi)  SUM(xi^2)  | 
- *      |                     |  
- * 
- *      |                        | 
- *      |   SUM(yi)    SUM(xi)   | 
- * M0 = | SUM(xi*yi)  SUM(xi^2)  | 
- *      |                        |  
- * 
- *      |                      | 
- *      |   N       SUM(yi)    | 
- * M1 = | SUM(xi)  SUM(xi*yi)  | 
- *      |                      |  
- * 
- * a0 = det(M0) / det(M)
- * a1 = det(M1) / det(M)
- * 
- * How to calculate the determinants of a 2x2 matrix M:
- * 
- *     |         |
- *     | a11 a12 |
- * det | a21 a22 | = a11*a22 – a12*a21
- *     |         |  
- * 
- ***************************************************************************/
-
-#include "Arduino.h"
-#include "curve_fit.h"
-
-//==============================================================
-// the constructor
-curve_fit::curve_fit(uint8_t degree) {
-    tag = 0;
-    name = "";
-    curve_fit::init(degree);
-}
-
-//==============================================================
-// Initialization of the fit object
-// degree = 0 --> A constant (or: The Average of y values)
-// degree = 1 --> A first order polynomial (or: linear regression)
-// degree = 2 --> A second order polynomial (or: parabolic curve)
-// degree = 3 --> A third order polynomial
-// Note: 
-// Generally the degree is not limited, but from the 6th or 7th 
-// degree the floating-point arithmetic reaches its limits and 
-// there may be inaccuracies.
-// this function can be used to change the degree at runtime
-bool curve_fit::init(uint8_t degree) {
-    order = degree;
-    free(a);
-    free(b);
-    free(M);
-    // the matrix dimension need to order + 1 for the calculations
-    a = (double*) malloc((order+1)*sizeof(double));
-    b = (double*) malloc((order+1)*sizeof(double));
-    M = (double*) malloc((order+1)*(order+1)*sizeof(double));
-    // if malloc fails, set order to -1
-    // and return false
-    if(!a || !b || !M) {
-		order = -1;
-        N = 0;
-        return false;
-	}
-    curve_fit::reset();
-    return true;
-}
-
-//==============================================================
-// clear all calculated coefficients and buffered values 
-// set all values back to 0.0 to start a new calculation
-void curve_fit::reset() {
-    // initialize the matrices with 0.0
-    for(int i = 0; i <= order; i++) {
-        for(int j = 0; j <= order; j++)
-            M[Mindex(i,j)] = 0.0;
-        a[i] = 0.0;
-        b[i] = 0.0;
-    }
-    // reset the number of used x, y pairs
-    N = 0;
-    max_x_ = 0.0;
-    min_x_ = 0.0;
-}
-
-//==============================================================
-// calculate the determinant by following Gaussian Method:
-// Use elementary row operations to bring the matrix into 
-// a row echelon form, to be able to calculated the determinant 
-// by using the diagonal values.
-double curve_fit::determinant( double *mainmatrix) {   
-    double det = 1;
-    // order < 2 = matrix dimention up to 2x2
-    // for these matrix sizes, the determinants can be calculate directly
-    if (order < 2) {
-        if(order == -1)
-            // A matrix without dimension?
-            // would say the deteminat is zero....
-            det = 0;
-        if(order == 0)
-            // The determinant of a 1x1 matrix is the element of the matrix itself
-            det = mainmatrix[0];
-        if(order == 1)
-            // a 2x2 matrix can be calculated directly:
-            //       |         |                       |            |
-            //       | a11 a12 |                       | M[0]  M[1] |
-            //   det | a21 a22 | = a11*a22 – a12*a21 = | M[2]  M[3] | = M[0]*M[3] - M[1]*M[2]
-            //       |         |                       |            | 
-            det = ((mainmatrix[0] * mainmatrix[3]) - (mainmatrix[1] * mainmatrix[2]));
-    } else {   
-        // otherwise, elementary row operations are required to bring the 
-        // matrix into a row echelon form.
-        // First, create a work-matrix with the same dimensions
-        // and fill it with the data from the main matrix
-        double workmatrix[(order+1)*(order+1)];
-        for(int i = 0; i < order+1; ++i)
-            for(int j = 0; j < order+1; ++j)
-                workmatrix[Mindex(i,j)] = mainmatrix[Mindex(i,j)];
-        // here are some hints about Gaussian Elimination with Partial Pivoting:
-        // https://youtu.be/euIXYdyjlqo
-        // https://www.youtube.com/watch?v=SQ98-eImrgA
-        // Now, go throw each column
-        for (int i = 0; i < order+1; ++i) {
-            // find the largest element for partial pivoting
-            double pivotElement = workmatrix[Mindex(i,i)];
-            int pivotRow = i;
-            for (int row = i + 1; row < order+1; ++row) {
-                if (fabs(workmatrix[Mindex(row,i)]) > fabs(pivotElement)) {
-                    pivotElement = workmatrix[Mindex(row,i)];
-                    pivotRow = row;
-                }
-            }
-            // important:
-            // there is no solution, if the pivot element is zero!
-            if (pivotElement == 0.0) {
-                return 0.0;
-            }
-            // if the found pivot element is not in the actual row,
-            // we need to swap the rows..
-            if (pivotRow != i) {
-                // swapping
-                for (int k = 0; k < order+1; ++k) { 
-                    double t = workmatrix[Mindex(i,k)]; 
-                    workmatrix[Mindex(i,k)] = workmatrix[Mindex(pivotRow,k)];
-                    workmatrix[Mindex(pivotRow,k)] = t;
-                }
-                // change the sign of the determinant after swapping a line!
-                det *= -1.0;
-            }
-            // The determinant is calculated by a multiplication of the diagonal
-            // values of the upper triangle matrix part.
-            // in this case, the pivot element of each column
-            det *= pivotElement;
-            // Gaussian triangular steps to reach a row echelon form of the matrix
-            for (int row = i + 1; row < order+1; ++row) {
-                for (int col = i + 1; col < order+1; ++col) {
-                    workmatrix[Mindex(row,col)] -= workmatrix[Mindex(row,i)] * workmatrix[Mindex(i,col)] / pivotElement;
-                }
-            }
-        }
-
-    }
-    return det;
-}
-
-//==============================================================
-// learn:
-// Adding a new pair of x and y values and
-// solving the polynomial regression model with Cramers rule
-void curve_fit::learn(double x, double y) {
-    ++N;
-    // find min and max values for x
-    if(N == 1) {
-        max_x_ = x;
-        min_x_ = x;
-    } else {
-        if(x < min_x_)
-            min_x_ = x;
-        if(x > max_x_)
-            max_x_ = x;
-    }
-    // order is -1 when the matrices are not allocated (undefines)
-    if(order > -1) {
-        // Example for matrix values
-        // A second-order polynomial (or: parabolic curve)
-        //      |                                 |  
-        //      |     N       SUM(xi)   SUM(xi^2) |    M[0] M[1] M[2] 
-        //  M = |  SUM(xi)   SUM(xi^2)  SUM(xi^3) |  = M[3] M[4] M[5] 
-        //      | SUM(xi^2)  SUM(xi^3)  SUM(xi^4) |    M[6] M[7] M[8] 
-        //      |                                 |  
-        // Matrix notation:
-        // aij for each element of the matrix:
-        //       |                         |   |             |   |                |
-        //       | a_i1_j1 a_i1_j2 a_i1_j3 |   | a11 a12 a13 |   | M[0] M[1] M[2] |
-        //   M = | a_i2_j1 a_i2_j2 a_i2_j3 | = | a21 a22 a23 | = | M[3] M[4] M[5] |
-        //       | a_i3_j1 a_i3_j2 a_i3_j3 |   | a31 a32 a33 |   | M[6] M[7] M[8] |
-        //       |                         |   |             |   |                |  
-        // to calculate the matrix index based on i and j, the function Mindex(i, j)
-        // can be used..
-        // 
-        // First, add the new x values to the existing values of the matrix M[]:
-        for(int j = 0; j < order+1; j++) {
-            for(int i = 0; i < order+1; i++) {
-                // fill the first column with pow() for each element
-                if(j==0) {
-                    M[Mindex(i, j)] += pow(x, i);
-                } else {
-                    if(i < order){
-                        // fill with already calculated values from 
-                        // the previous column to save calulation power
-                        M[Mindex(i, j)] = M[Mindex(i+1, j-1)];
-                    } else {
-                        // calculate only last element of the column with pow()
-                        M[Mindex(i, j)] += pow(x, i+j);
-                    }
-                }
-            }
-        }
-        // fill the first element with the number of samples
-        M[0] = N;
-
-        // Secondly add the new y value to the vector b[]
-        //      |              |
-        //      |    SUM(yi)   |   b[0]
-        //  b = |  SUM(xi*yi)  | = b[1]
-        //      | SUM(xi^2*yi) |   b[2]
-        //      |              | 
-        for(int n = 0; n < order+1; n++) {
-            b[n] += (pow(x, n)*y);
-        }
-
-        // Thirdly calculate the coefficients by dividing the determinants
-        //  a0=det(M0)/det(M)
-        //  a1=det(M1)/det(M)
-        //  ...
-        //  an=det(Mn)/det(M)
-    
-        double det_M = determinant(M);
-        // create a work-matrix to calculate M0, M1, ... , Mn
-        // according to Cramer's rule
-        double Mn[(order+1)*(order+1)];
-        for(int n = 0; n < order+1; n++) {
-            for(int j = 0; j < order+1; j++) {
-                for(int i = 0; i < order+1; i++) {
-                    if(j == n)
-                        Mn[Mindex(i, j)] = b[i];
-                    else
-                        Mn[Mindex(i, j)] = M[Mindex(i, j)];
-                }
-            }
-            // calculate the coefficients by dividing the determinants
-            double det_Mn = determinant(Mn);
-            a[n] = det_Mn / det_M;
-        }
-    }
-}
-
-//==============================================================
-// predict:
-// returning the predicted y values of a given x values
-// based on the calculated (learned) polynomial regression model
-double curve_fit::predict(double x) {
-    double y = 0.0;
-    for(int i = 0; i <= order; i++)
-        y = y + pow(x, i) * a[i];
-    return y;
-}
-
-//==============================================================
-// predict:
-// returning the predicted y values of a given x values
-// based on the calculated (learned) polynomial regression model
-// if x is outside the learned range, y is replaced with outside_value
-double curve_fit::predict(double x, double outside_value) {
-    double y =0.0;
-    if(x >  max_x_ || x < min_x_){
-        y = outside_value;
-    } else {
-        y = predict(x);
-    }
-    return y;
-}
-
-//==============================================================
-// Fills the given field with the current coefficients. 
-// the values field need to have the right size!
-void curve_fit::get_coefficients(double values[]) {
-    // order 0 -->  y = a[0]
-    // order 1 -->  y = a[1]*x + a[0]
-    // order 2 -->  y = a[2]*x^2 + a[1]*x + a[0]
-    for(int i = 0; i <= order; ++i)
-        values[i] = a[i];
-}
-
-//==============================================================
-// Return the formula as String with all coefficients. 
-// The number of decimal places can be set the optional parameter.
-String curve_fit::get_formula(uint8_t decimals) {
-    // order n -->  y = a[n]*x^n + ... + a[1]*x + a[0]
-    String formula = "("+String(N)+") y= ";
-    for(int i = order; i >= 0; --i) {
-        // at a '+' if the value is positiv
-        if(a[i] > 0 && i < order)
-            formula += "+";
-        if(i > 1) {
-            formula += String(a[i],decimals)+"x^"+i+" ";
-        } else {
-            if(i== 1)
-                formula += String(a[i],decimals)+"x ";
-            else
-                formula += String(a[i],decimals);
-        }
-    }
-    return formula;
-}
-
-//==============================================================
-// return the actual order. 
-uint32_t curve_fit::get_order() {
-   return order; 
-}
-
-//==============================================================
-// return the matrix index based on i and j
-// M[0][0] = M[0]
-// M[0][3] = M[3]
-// M[i][j] = M[(i*(order+1))+j]
-uint32_t curve_fit::Mindex(uint32_t i, uint32_t j) {
-    return (i*(order+1))+j;
-}
-
-//==============================================================
-// return an estimation of the max y value over the existing x 
-// range (min_x .. max_x)
-// The optional parameter "steps" can be used to define the
-// number of steps between min_x and max_x (default = 100)
-double curve_fit::estimate_max_y(uint32_t steps) {
-    if(steps == 0)
-        steps = 1;
-    double stepwidth = (max_x_ - min_x_) / steps;
-    double max_y_ = predict(min_x_);
-    for(int i = 1; i <= steps; ++i) {
-        if(predict(min_x_ + (i*stepwidth)) > max_y_)
-            max_y_ = predict(min_x_ + (i*stepwidth));
-    }
-    return max_y_;
-}
-
-//==============================================================
-// return an estimation of the min y value over the existing x 
-// range (min_x .. max_x)
-// The optional parameter "steps" can be used to define the
-// number of steps between min_x and max_x (default = 100)
-double curve_fit::estimate_min_y(uint32_t steps) {
-    if(steps == 0)
-        steps = 1;
-    double stepwidth = (max_x_ - min_x_) / steps;
-    double min_y_ = predict(min_x_);
-    for(int i = 1; i <= steps; ++i) {
-        if(predict(min_x_ + (i*stepwidth)) < min_y_)
-            min_y_ = predict(min_x_ + (i*stepwidth));
-    }
-    return min_y_;
-}
+/**************************************************************************
+ * Library to calculate polynomial regression in Arduino.
+ * 
+ * Simple, efficient and memory efficient method to 
+ * calculate mean values, linear regressions or 
+ * parabolas from pairs of values.
+ * 
+ * Based on the normal equations for fitting of a polynomial 
+ * regression model using least square method.
+ * (up to v1.4 solved with Cramers rule, since v1.5 with a 
+ * LDL^T factorization)
+ * For a very good explanation, please see:
+ * https://neutrium.net/mathematics/least-squares-fitting-of-a-polynomial/
+ * 
+ * and thanks to Cubiwan:
+ * https://github.com/cubiwan/LinearRegressino
+ * and Chandu yadav:
+ * https://www.tutorialspoint.com/cplusplus-program-to-compute-determinant-of-a-matrix
+ * for the inspiration on how to implement it
+ * and Martin R.
+ * https://codereview.stackexchange.com/questions/204135/determinant-using-gauss-elimination
+ * for the tip about partial pivoting...
+ * 
+ * 
+ * Hague Nusseck @ electricidea
+ * v1.4 24.May.2020
+ * https://github.com/electricidea/xxxx
+ * 
+ * Changelog:
+ * v1.2 = - first version ready with "Laplace expansion" Method to calculate determinants
+ * v1.3 = - Gaussian triangular method for the determination of determinants (faster!)
+ *        - added name and tag
+ *        - added max_x and min_x
+ *        - established aij Matrix notation
+ *        - String output for formular
+ * v1.4 = - dynamic matrix sizes according to initialized order
+ *        - functions to estimate max and min y values over the known range of x
+ *        - add function count() to return N
+ * v1.5 = - learn() only accumulates the sums of the matrix M and vector b
+ *        - the coefficients are solved once on demand with a LDL^T
+ *          factorization instead of Cramer's rule on every learn()
+ * v1.6 = - no dynamic memory: the matrix M is stored as 2k+1 sums in 
+ *          fixed size arrays (max. degree = CURVE_FIT_MAX_DEGREE)
+ *        - polynomial math moved to poly_math.h, shared with the 
+ *          header only template static_curve_fit<Degree, Scalar>
+ * v1.7 = - predict() with Horner's scheme instead of pow()
+ *        - predict_many() to calculate many y values at once
+ * v1.8 = - estimate_max_y() and estimate_min_y() calculate the exact
+ *          values out of the roots of the derivative (cached)
+ * v1.9 = - learn_batch() to learn arrays of x and y values in one pass
+ * v1.10 = - merge() to add the learned values of an other fit
+ *         - curve_fit_learn_sharded() to learn in parallel on all cores
+ * v1.11 = - set_degree() and select_degree() to use a lower degree 
+ *           out of the same learned sums (e.g. with the best BIC)
+ * 
+ * 
+ * Distributed as-is; no warranty is given.
+ * 
+ **************************************************************************
+ * 
+ * ==== How to use it: ====
+ * 
+ * 1.) intitialize the fitting object:
+ * 
+ *          curve_fit fit_1 = curve_fit(1);
+ * 
+ * or, if the degree is known at compile time:
+ * 
+ *          static_curve_fit<1> fit_1;
+ * NOTE:
+ * degree = 0 --> A constant (or: The Average of y values)
+ * degree = 1 --> A first order polynomial (or: linear regression)
+ * degree = 2 --> A second order polynomial (or: parabolic curve)
+ * degree = 3 --> A third order polynomial
+ * Note: 
+ * The degree is limited by CURVE_FIT_MAX_DEGREE (default = 7). 
+ * From the 6th or 7th degree on, first calculation errors appear
+ * due to the inaccurate floating-point arithmetic. 
+ * 
+ * 2.) Let the function solve the polynomial regression model 
+ *     by adding pairs of x and y values:
+ * 
+ *          fit_1.learn(0,5);
+ *          fit_1.learn(1,18.65);
+ *              ...
+ *          fit_1.learn(10,52.4);
+ * 
+ *     or with arrays of x and y values in one pass:
+ * 
+ *          fit_1.learn_batch(x_values, y_values, n_values);
+ * 
+ * During each of these steps only the sums of the matrix M and the 
+ * vector b are updated. The polynomial representation is calculated 
+ * once, the next time predict(), get_coefficients() or get_formula() 
+ * is called. The value pairs are not stored.
+ * 
+ * 3.) print out the calculated coefficients:
+ * 
+ *          double coeff_values[2];
+ *          fit_1.get_coefficients(coeff_values);
+ *          Serial.printf("y= a1*x + a0\n\na1= %.2f\na0= %.2f", 
+ *                        coeff_values[1], coeff_values[0]);
+ * 
+ * 4.) Calculate the y values for a new x value:
+ * 
+ *          new_y = fit_1.predict(new_x);
+ * 
+ *     or for a whole array of x values:
+ * 
+ *          fit_1.predict_many(x_values, y_values, n_values);
+ * 
+ * 5.) Fits of the same order can be merged. This allows to learn 
+ *     parts of the values independently (e.g. on different cores):
+ * 
+ *          fit_1.merge(fit_2);
+ * 
+ *     or with all cores:
+ * 
+ *          curve_fit_learn_sharded(fit_1, x_values, y_values, n_values);
+ * 
+ * 6.) A fit learns all sums for the initialized degree and all lower 
+ *     degrees. The degree with the best score (residual sum of squares 
+ *     vs. number of coefficients) can be selected afterwards:
+ * 
+ *          uint8_t degree = fit_1.select_degree(FIT_CRITERION_BIC);
+ * 
+ * Some NOTES:
+ * At any time additional pairs of values can be added to improve 
+ * the calculation / allow further learning.....
+ * The value pairs are not stored. They cannot be read out again 
+ * or changed afterwards.
+ * 
+ * 
+ * ==== How the Math works: ==== 
+ * 
+ * Representation of a kth order polynomial
+ * y = ak*x^k +⋯+ a1*x + a0
+ * 
+ * with
+ * a	:	Polynomial coefficient
+ * k	:	The degree of the polynomial
+ * N	:	The number of points to be regressed
+ *  
+ * The coefficients of the polynomial regression model (ak,ak−1,⋯,a1) may be 
+ * determined by solving the following system of linear equations:
+ * 
+ * |                                             |   |    |   |              |
+ * |    N          SUM(xi)     ...    SUM(xi^k)  |   | a0 |   |    SUM(yi)   |
+ * |  SUM(xi)     SUM(xi^2 )   ...   SUM(xi^k+1) |   | a1 |   |  SUM(xi*yi)  |
+ * |    ...         ...        ...       ...     | * | .. | = |     ...      |
+ * | SUM(xi^k)  SUM(xi^k+1)    ...    SUM(xi^2k) |   | ak |   | SUM(xi^k*yi) |
+ * |                                             |   |    |   |              |
+ * 
+ * The matrix M is symmetric and positive definite (as long as there are 
+ * at least k+1 different x values). Therefore it can be split into 
+ * 
+ * M = L * D * L^T
+ * 
+ * with L as a lower triangle matrix with ones on the diagonal and D as a 
+ * diagonal matrix. The coefficients are then calculated by a forward 
+ * substitution, a division by the diagonal and a backward substitution:
+ * 
+ * L * z = b    -->  z
+ * D * w = z    -->  w = z / D
+ * L^T * a = w  -->  a
+ * 
+ * Example for an linear regression (polynominal 1th order)
+ * 
+ *  y = a1*x + a0
+ * 
+ * |                     |   |    |   |            |
+ * |   N       SUM(xi)   |   | a0 |   |   SUM(yi)  |
+ * | SUM(xi)  SUM(xi^2)  | * | a1 | = | SUM(xi*yi) |
+ * |                     |   |    |   |            | 
+ * 
+ *      |         |   |         |   |         | 
+ *      |  1    0 |   | d0   0  |   | 1   l10 | 
+ *  M = | l10   1 | * |  0   d1 | * | 0    1  | 
+ *      |         |   |         |   |         |  
+ * 
+ * d0  = N
+ * l10 = SUM(xi) / d0
+ * d1  = SUM(xi^2) - l10*l10*d0
+ * 
+ * Compared to Cramer's rule (k+2 determinants, each with a full Gaussian 
+ * elimination) only one factorization is needed to solve the system.
+ * 
+ ***************************************************************************/
+
+#include "Arduino.h"
+#include "curve_fit.h"
+#include "parallel.h"
+
+//==============================================================
+// the constructor
+curve_fit::curve_fit(uint8_t degree) {
+    tag = 0;
+    name = "";
+    curve_fit::init(degree);
+}
+
+//==============================================================
+// Initialization of the fit object
+// degree = 0 --> A constant (or: The Average of y values)
+// degree = 1 --> A first order polynomial (or: linear regression)
+// degree = 2 --> A second order polynomial (or: parabolic curve)
+// degree = 3 --> A third order polynomial
+// Note: 
+// The degree is limited by CURVE_FIT_MAX_DEGREE (default = 7), 
+// because from the 6th or 7th degree the floating-point arithmetic 
+// reaches its limits and there may be inaccuracies.
+// this function can be used to change the degree at runtime
+bool curve_fit::init(uint8_t degree) {
+    // the sums are stored in fixed size arrays
+    // if the degree is too large, set order to -1
+    // and return false
+    if(degree > CURVE_FIT_MAX_DEGREE) {
+        order = -1;
+        degree_ = -1;
+        N = 0;
+        return false;
+    }
+    order = degree;
+    degree_ = degree;
+    curve_fit::reset();
+    return true;
+}
+
+//==============================================================
+// clear all calculated coefficients and buffered values 
+// set all values back to 0.0 to start a new calculation
+void curve_fit::reset() {
+    // initialize the sums and coefficients with 0.0
+    Sx.fill(0.0);
+    Sxy.fill(0.0);
+    Syy = 0.0;
+    a.fill(0.0);
+    // predict with the full order again until a degree is selected
+    degree_ = order;
+    // reset the number of used x, y pairs
+    N = 0;
+    solved = true;
+    range_valid = false;
+    max_x_ = 0.0;
+    min_x_ = 0.0;
+}
+
+//==============================================================
+// solve the linear system of equations M*a = b with a LDL^T 
+// factorization of the symmetric matrix M. (see poly_math.h)
+// Is called on demand, if new pairs of values has been learned.
+void curve_fit::solve() {
+    solved = true;
+    // order is -1 when the object is not initialized
+    // the coefficients above the selected degree are 0.0
+    a.fill(0.0);
+    if(order > -1)
+        poly_solve(Sx.data(), Sxy.data(), a.data(), degree_);
+}
+
+//==============================================================
+// learn:
+// Adding a new pair of x and y values to the sums of the
+// polynomial regression model. The coefficients are solved 
+// the next time they are needed.
+void curve_fit::learn(double x, double y) {
+    ++N;
+    solved = false;
+    range_valid = false;
+    // find min and max values for x
+    if(N == 1) {
+        max_x_ = x;
+        min_x_ = x;
+    } else {
+        if(x < min_x_)
+            min_x_ = x;
+        if(x > max_x_)
+            max_x_ = x;
+    }
+    // order is -1 when the object is not initialized
+    if(order > -1) {
+        // Example for the sums
+        // A second-order polynomial (or: parabolic curve)
+        //      |                                 |  
+        //      |     N       SUM(xi)   SUM(xi^2) |    Sx[0] Sx[1] Sx[2] 
+        //  M = |  SUM(xi)   SUM(xi^2)  SUM(xi^3) |  = Sx[1] Sx[2] Sx[3] 
+        //      | SUM(xi^2)  SUM(xi^3)  SUM(xi^4) |    Sx[2] Sx[3] Sx[4] 
+        //      |                                 |  
+        //      |              |
+        //      |    SUM(yi)   |   Sxy[0]
+        //  b = |  SUM(xi*yi)  | = Sxy[1]
+        //      | SUM(xi^2*yi) |   Sxy[2]
+        //      |              | 
+        // Every element of M only depends on i+j. Therefore only
+        // the 2k+1 sums Sx[] and the k+1 sums Sxy[] are stored.
+        poly_accumulate(Sx.data(), Sxy.data(), order, x, y);
+        Syy += y*y;
+    }
+}
+
+//==============================================================
+// learn_batch:
+// Adding n pairs of x and y values to the sums of the
+// polynomial regression model in one pass.
+// Same result as n calls of learn(), but much faster for 
+// a large number of values. The coefficients are solved 
+// the next time they are needed.
+void curve_fit::learn_batch(const double *xs, const double *ys, size_t n) {
+    if(n == 0)
+        return;
+    solved = false;
+    range_valid = false;
+    // find min and max values for x
+    size_t i = 0;
+    if(N == 0) {
+        max_x_ = xs[0];
+        min_x_ = xs[0];
+        i = 1;
+    }
+    for(; i < n; ++i) {
+        if(xs[i] < min_x_)
+            min_x_ = xs[i];
+        if(xs[i] > max_x_)
+            max_x_ = xs[i];
+    }
+    N += n;
+    // order is -1 when the object is not initialized
+    if(order > -1) {
+        poly_accumulate_many(Sx.data(), Sxy.data(), order, xs, ys, n);
+        for(i = 0; i < n; ++i)
+            Syy += ys[i]*ys[i];
+    }
+}
+
+//==============================================================
+// merge:
+// Adding all learned values of an other fit with the same order.
+// All sums are additive, so the result is the same as if all 
+// values would have been learned by this fit (except of the 
+// rounding of the floating-point additions).
+// returns false if the order of the fits is different
+bool curve_fit::merge(const curve_fit &other) {
+    if(other.order != order)
+        return false;
+    if(other.N == 0)
+        return true;
+    if(N == 0) {
+        max_x_ = other.max_x_;
+        min_x_ = other.min_x_;
+    } else {
+        if(other.min_x_ < min_x_)
+            min_x_ = other.min_x_;
+        if(other.max_x_ > max_x_)
+            max_x_ = other.max_x_;
+    }
+    N += other.N;
+    for(int n = 0; n <= 2*order; ++n)
+        Sx[n] += other.Sx[n];
+    for(int n = 0; n <= order; ++n)
+        Sxy[n] += other.Sxy[n];
+    Syy += other.Syy;
+    solved = false;
+    range_valid = false;
+    return true;
+}
+
+//==============================================================
+// predict:
+// returning the predicted y values of a given x values
+// based on the calculated (learned) polynomial regression model
+double curve_fit::predict(double x) {
+    if(!solved)
+        solve();
+    return poly_eval(a.data(), degree_, x);
+}
+
+//==============================================================
+// predict:
+// returning the predicted y values of a given x values
+// based on the calculated (learned) polynomial regression model
+// if x is outside the learned range, y is replaced with outside_value
+double curve_fit::predict(double x, double outside_value) {
+    double y =0.0;
+    if(x >  max_x_ || x < min_x_){
+        y = outside_value;
+    } else {
+        y = predict(x);
+    }
+    return y;
+}
+
+//==============================================================
+// predict_many:
+// returning the predicted y values for n given x values
+// based on the calculated (learned) polynomial regression model.
+// Faster than calling predict() n times, because the loops
+// can be vectorized by the compiler.
+void curve_fit::predict_many(const double *xs, double *ys, size_t n) {
+    if(!solved)
+        solve();
+    poly_eval_many(a.data(), degree_, xs, ys, n);
+}
+
+//==============================================================
+// predict_many:
+// returning the predicted y values for n given x values
+// if x is outside the learned range, y is replaced with outside_value
+void curve_fit::predict_many(const double *xs, double *ys, size_t n, double outside_value) {
+    if(!solved)
+        solve();
+    poly_eval_many(a.data(), degree_, xs, ys, n, min_x_, max_x_, outside_value);
+}
+
+//==============================================================
+// Fills the given field with the current coefficients. 
+// the values field need to have the right size!
+void curve_fit::get_coefficients(double values[]) {
+    if(!solved)
+        solve();
+    // order 0 -->  y = a[0]
+    // order 1 -->  y = a[1]*x + a[0]
+    // order 2 -->  y = a[2]*x^2 + a[1]*x + a[0]
+    // (coefficients above the selected degree are 0.0)
+    for(int i = 0; i <= order; ++i)
+        values[i] = a[i];
+}
+
+//==============================================================
+// Return the formula as String with all coefficients. 
+// The number of decimal places can be set the optional parameter.
+String curve_fit::get_formula(uint8_t decimals) {
+    if(!solved)
+        solve();
+    // order n -->  y = a[n]*x^n + ... + a[1]*x + a[0]
+    String formula = "("+String(N)+") y= ";
+    for(int i = degree_; i >= 0; --i) {
+        // at a '+' if the value is positiv
+        if(a[i] > 0 && i < degree_)
+            formula += "+";
+        if(i > 1) {
+            formula += String(a[i],decimals)+"x^"+i+" ";
+        } else {
+            if(i== 1)
+                formula += String(a[i],decimals)+"x ";
+            else
+                formula += String(a[i],decimals);
+        }
+    }
+    return formula;
+}
+
+//==============================================================
+// return the actual order. 
+// (the selected degree, see set_degree() and select_degree())
+uint32_t curve_fit::get_order() {
+   return degree_; 
+}
+
+//==============================================================
+// return the order of the learned sums (as initialized)
+// this is the maximum for set_degree() and select_degree()
+uint32_t curve_fit::get_max_order() {
+   return order; 
+}
+
+//==============================================================
+// use only a polynomial of the given degree for the prediction
+// The learned sums of the initialized order contain all sums of 
+// the lower degrees. Therefore the degree can be reduced at any
+// time without learning the values again. (max. = initialized order)
+void curve_fit::set_degree(uint8_t degree) {
+    if(order < 0)
+        return;
+    degree_ = (degree > order) ? order : degree;
+    solved = false;
+    range_valid = false;
+}
+
+//==============================================================
+// calculate the residual sum of squares for all degrees up
+// to the initialized order out of the learned sums and
+// select the degree with the best score of the criterion:
+// FIT_CRITERION_AIC, FIT_CRITERION_BIC (default) or FIT_CRITERION_GCV
+// return the selected degree
+uint8_t curve_fit::select_degree(uint8_t criterion) {
+    if(order < 0 || N == 0)
+        return 0;
+    double rss[CURVE_FIT_MAX_DEGREE+1];
+    poly_rss(Sx.data(), Sxy.data(), Syy, order, rss);
+    set_degree(poly_select_degree(rss, order, N, criterion));
+    return degree_;
+}
+
+//==============================================================
+// calculate the exact min and max y values over the existing
+// x range (min_x .. max_x) out of the roots of the derivative.
+// The values are stored until the next learn() or reset()
+void curve_fit::update_range() {
+    if(!solved)
+        solve();
+    poly_range_extrema(a.data(), degree_, min_x_, max_x_, &min_y_, &max_y_);
+    range_valid = true;
+}
+
+//==============================================================
+// return the max y value over the existing x range (min_x .. max_x)
+// The parameter "steps" is not used anymore, because the value
+// is calculated exactly (kept for compatibility)
+double curve_fit::estimate_max_y(uint32_t /* steps */) {
+    if(!range_valid)
+        update_range();
+    return max_y_;
+}
+
+//==============================================================
+// return the min y value over the existing x range (min_x .. max_x)
+// The parameter "steps" is not used anymore, because the value
+// is calculated exactly (kept for compatibility)
+double curve_fit::estimate_min_y(uint32_t /* steps */) {
+    if(!range_valid)
+        update_range();
+    return min_y_;
+}
+
+//==============================================================
+// context of the shards for curve_fit_learn_sharded()
+struct curve_fit_shards {
+    curve_fit shard[parallel_max_jobs];
+    const double *xs;
+    const double *ys;
+    size_t n;
+    int n_shards;
+};
+
+//==============================================================
+// learn one shard of the values (parallel job)
+static void curve_fit_learn_shard(int index, void *context) {
+    curve_fit_shards *shards = (curve_fit_shards*) context;
+    size_t shard_size = shards->n / shards->n_shards;
+    size_t start = index * shard_size;
+    size_t end = (index == shards->n_shards-1) ? shards->n : start + shard_size;
+    shards->shard[index].learn_batch(shards->xs + start, shards->ys + start, end - start);
+}
+
+//==============================================================
+// Learn n pairs of x and y values split into n_shards parts.
+// Each part is learned in parallel on its own core and all 
+// parts are merged into the given fit afterwards (in the order
+// of the parts).
+// n_shards = 0 --> one part per core
+void curve_fit_learn_sharded(curve_fit &fit, const double *xs, const double *ys, size_t n, int n_shards) {
+    if(n_shards <= 0)
+        n_shards = parallel_workers();
+    if(n_shards > parallel_max_jobs)
+        n_shards = parallel_max_jobs;
+    // not worth the effort for a few values
+    if(n_shards == 1 || n < (size_t)n_shards * poly_lanes) {
+        fit.learn_batch(xs, ys, n);
+        return;
+    }
+    curve_fit_shards *shards = new curve_fit_shards;
+    shards->xs = xs;
+    shards->ys = ys;
+    shards->n = n;
+    shards->n_shards = n_shards;
+    for(int i = 0; i < n_shards; ++i)
+        shards->shard[i].init(fit.get_max_order());
+    parallel_for(n_shards, curve_fit_learn_shard, shards);
+    for(int i = 0; i < n_shards; ++i)
+        fit.merge(shards->shard[i]);
+    delete shards;
+}
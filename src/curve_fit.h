@@ -1,46 +1,69 @@
-
-/***************************************************
- * 
- * Fitting of a Polynomial using Cramer Rule
- * 
- * Hague Nusseck @ electricidea
- * 
- * --> see curve_fit.cpp for more details on how it 
- * works and how to use it.
- * 
- * Distributed as-is; no warranty is given.
- * 
- * ************************************************/
-
-// class definition
-class curve_fit {
-    public:
-        curve_fit(uint8_t degree=2);
-        bool init(uint8_t degree);
-        void learn(double x, double y);
-        double predict(double x);
-        double predict(double x, double outside_value);
-        void get_coefficients(double values[]);
-        String get_formula(uint8_t decimals = 6);
-        uint32_t get_order();
-        void reset();
-        double max_x() const { return max_x_; }
-        double min_x() const { return min_x_; }
-        int count() const { return N; }
-        double estimate_max_y(uint32_t steps = 100);
-        double estimate_min_y(uint32_t steps = 100);
-        int tag;
-        String name;
-    private:
-        // Mindex generates the index for adressing the matrices
-        uint32_t Mindex(uint32_t i, uint32_t j);
-        double determinant(double *mainmatrix);
-        int order = -1;
-        double *M;
-        double *b;
-        // y = a[n]*x^n + ... + a[1]*x + a[0]
-        double *a;
-        // Number of learned x, y pairs
-        uint32_t N = 0;
-        double max_x_, min_x_;
-};
\ No newline at end of file
+
+/***************************************************
+ * 
+ * Fitting of a Polynomial using the least square method
+ * 
+ * Hague Nusseck @ electricidea
+ * 
+ * --> see curve_fit.cpp for more details on how it 
+ * works and how to use it.
+ * 
+ * Distributed as-is; no warranty is given.
+ * 
+ * ************************************************/
+
+#include <array>
+#include "poly_math.h"
+
+// class definition
+class curve_fit {
+    public:
+        curve_fit(uint8_t degree=2);
+        bool init(uint8_t degree);
+        void learn(double x, double y);
+        void learn_batch(const double *xs, const double *ys, size_t n);
+        bool merge(const curve_fit &other);
+        double predict(double x);
+        double predict(double x, double outside_value);
+        void predict_many(const double *xs, double *ys, size_t n);
+        void predict_many(const double *xs, double *ys, size_t n, double outside_value);
+        void get_coefficients(double values[]);
+        String get_formula(uint8_t decimals = 6);
+        uint32_t get_order();
+        uint32_t get_max_order();
+        void set_degree(uint8_t degree);
+        uint8_t select_degree(uint8_t criterion = FIT_CRITERION_BIC);
+        void reset();
+        double max_x() const { return max_x_; }
+        double min_x() const { return min_x_; }
+        int count() const { return N; }
+        double estimate_max_y(uint32_t steps = 100);
+        double estimate_min_y(uint32_t steps = 100);
+        int tag;
+        String name;
+    private:
+        void solve();
+        void update_range();
+        // order of the learned sums
+        int order = -1;
+        // selected degree for the prediction (<= order)
+        int degree_ = -1;
+        // Sx[n] = SUM(xi^n) and Sxy[n] = SUM(xi^n*yi)
+        std::array<double, 2*CURVE_FIT_MAX_DEGREE+1> Sx;
+        std::array<double, CURVE_FIT_MAX_DEGREE+1> Sxy;
+        // Syy = SUM(yi^2) for the residual sum of squares
+        double Syy;
+        // y = a[n]*x^n + ... + a[1]*x + a[0]
+        std::array<double, CURVE_FIT_MAX_DEGREE+1> a;
+        // Number of learned x, y pairs
+        uint32_t N = 0;
+        // false, if new values are learned but not solved yet
+        bool solved = true;
+        // true, if min_y_ and max_y_ are up to date
+        bool range_valid = false;
+        double max_x_, min_x_;
+        double max_y_, min_y_;
+};
+
+// learn the values in parallel parts and merge the results
+void curve_fit_learn_sharded(curve_fit &fit, const double *xs, const double *ys, size_t n, int n_shards = 0);
\ No newline at end of file
@@ -0,0 +1,484 @@
+/**************************************************************************
+ * Matching of a scan with the fingerprints of the grid positions
+ *
+ * The matching of a scan needs for each grid position (cell) the sum
+ * of the squared differences between the RSSI values of the scan and
+ * the values of the cell. Therefore the IILTM of the floor map is
+ * cell-major (see floor_map.cpp): one fingerprint per cell, padded to
+ * a multiple of 16 bytes and aligned to 16 bytes. The matcher uses
+ * the fingerprints of the floor map in place, it only allocates the
+ * bound pyramid and the query.
+ *
+ * A fingerprint is processed in blocks of 16 bytes (16 APs with
+ * int8_t values). Each block is a loop without dependencies that the
+ * compiler can vectorize. APs which are not found by the scan have
+ * a mask value of 0, and blocks without any found AP are skipped.
+ * Blocks with only a few found APs (a big floor map with many APs,
+ * but only some of them in range) would waste most of the block,
+ * their APs are summed up one by one instead.
+ *
+ * Early abandon: the sum of a cell only grows from block to block.
+ * As soon as the partial sum of a cell is bigger than the best sum so
+ * far, the cell can't be the best one and the rest of its blocks is
+ * skipped. The blocks with the most found APs are summed up first
+ * and the search begins with a hint (e.g. the last position), which
+ * gives a small best sum early.
+ *
+ * Bound pyramid (coarse-to-fine search): 8 neighbouring cells are a
+ * group of level 1, 8 groups of level 1 are a group of level 2, and
+ * so on, until the top level has at most 8 groups. Each group stores
+ * the minimum and the maximum value of each AP over all its cells.
+ * The distance of a RSSI value to the range [min, max] is a lower
+ * bound of the difference to each cell of the group:
+ *
+ *     bound = sum of (min - rssi)^2 if rssi < min
+ *                    (rssi - max)^2 if rssi > max
+ *                    0              else
+ *
+ * The search goes from the top level down, the groups with the
+ * smallest bounds first. A group with a bound bigger than the best
+ * sum so far is skipped with all its cells. Neighbouring cells along
+ * a floor have similar fingerprints, therefore the bounds are tight
+ * and only the cells around the best position are calculated. The
+ * pyramid needs about 2/7 of the memory of the fingerprints.
+ *
+ * The result is the same cell as the brute force search over the
+ * whole IILTM (first cell with the smallest sum), the pruning never
+ * skips a better cell. With the integer map types also the sum is
+ * exactly the same, with float types the order of the additions
+ * differs (and a bound can differ in the last bit from the sum).
+ *
+ * Hague Nusseck @ electricidea
+ * v1.0
+ * https://github.com/electricidea/M5Stack-Hotel-room-finder
+ *
+ * Distributed as-is; no warranty is given.
+ *
+ **************************************************************************
+ *
+ * ==== How to use it: ====
+ *
+ * 1.) build the bound pyramid of the IILTM of the floor map
+ *     (the floor map must stay in the memory):
+ *
+ *          fingerprint_matcher matcher;
+ *          matcher.init(map.values(), map.n_x(), map.n_aps(), map.stride());
+ *
+ * 2.) set the RSSI values of the found APs and search the best cell:
+ *
+ *          matcher.clear_query();
+ *          matcher.set_rssi(AP_index, map_encode(RSSI));
+ *          map_accum best_sum;
+ *          int best_x = matcher.match(last_x, &best_sum);
+ *
+ * 3.) or calculate the sums of all cells (e.g. for a tracker):
+ *
+ *          matcher.square_sums(sums);
+ *
+ ***************************************************************************/
+
+#include <stdlib.h>
+#include <string.h>
+#include "fingerprint_matcher.h"
+
+//==============================================================
+// round up to the next multiple of the alignment
+static size_t matcher_align(size_t size) {
+    return (size + matcher_alignment - 1) & ~(matcher_alignment - 1);
+}
+
+//==============================================================
+// sum of the squared differences of one block of APs
+// fixed length loop over aligned values, the compiler can
+// vectorize it
+static inline map_accum matcher_block_ssd(const map_scalar * __restrict cell,
+                                          const map_scalar * __restrict query,
+                                          const map_scalar * __restrict mask) {
+    map_accum sum = 0;
+    for(int i = 0; i < matcher_block; ++i) {
+        map_accum diff = ((map_accum) query[i] - (map_accum) cell[i]) * (map_accum) mask[i];
+        sum += diff * diff;
+    }
+    return sum;
+}
+
+//==============================================================
+// sum of the squared differences of the fingerprint of the cell x
+// the sum is abandoned as soon as it can't be better than the best
+// sum (bigger, or the same for a cell behind the best one)
+// select_blocks() must be called after the last set_rssi()
+// return false if the cell was abandoned
+bool fingerprint_matcher::fingerprint_ssd(const map_scalar *fingerprint, int x, map_accum best, int best_x,
+                                          map_accum *cell_sum) const {
+    map_accum sum = 0;
+    for(int b = 0; b < n_active; ++b) {
+        int offset = active[b] * matcher_block;
+        sum += matcher_block_ssd(&fingerprint[offset], &query[offset], &mask[offset]);
+        if(sum > best || (sum == best && x > best_x))
+            return false;
+    }
+    for(int i = 0; i < n_sparse; ++i) {
+        map_accum diff = (map_accum) query[sparse[i]] - (map_accum) fingerprint[sparse[i]];
+        sum += diff * diff;
+        // check the bound after each group of APs
+        if((i & 3) == 3 && (sum > best || (sum == best && x > best_x)))
+            return false;
+    }
+    if(sum > best || (sum == best && x > best_x))
+        return false;
+    *cell_sum = sum;
+    return true;
+}
+
+//==============================================================
+// lower bound of the squared differences of one block of APs
+// to the ranges [lo, hi] of a group
+static inline map_accum matcher_block_bound(const map_scalar * __restrict lo,
+                                            const map_scalar * __restrict hi,
+                                            const map_scalar * __restrict query,
+                                            const map_scalar * __restrict mask) {
+    map_accum sum = 0;
+    for(int i = 0; i < matcher_block; ++i) {
+        map_accum below = (map_accum) lo[i] - (map_accum) query[i];
+        map_accum above = (map_accum) query[i] - (map_accum) hi[i];
+        map_accum diff = ((below > 0) ? below : 0) + ((above > 0) ? above : 0);
+        diff *= (map_accum) mask[i];
+        sum += diff * diff;
+    }
+    return sum;
+}
+
+//==============================================================
+// lower bound of the sums of all cells of a group with the
+// ranges [lo, hi] and the first cell x
+// the bound is abandoned like the sum of a cell
+// return false if the whole group can be skipped
+bool fingerprint_matcher::range_bound(const map_scalar *lo, const map_scalar *hi, int x, map_accum best, int best_x,
+                                      map_accum *bound) const {
+    map_accum sum = 0;
+    for(int b = 0; b < n_active; ++b) {
+        int offset = active[b] * matcher_block;
+        sum += matcher_block_bound(&lo[offset], &hi[offset], &query[offset], &mask[offset]);
+        if(sum > best || (sum == best && x > best_x))
+            return false;
+    }
+    for(int i = 0; i < n_sparse; ++i) {
+        map_accum q = query[sparse[i]];
+        map_accum diff = 0;
+        if(q < lo[sparse[i]])
+            diff = lo[sparse[i]] - q;
+        else if(q > hi[sparse[i]])
+            diff = q - hi[sparse[i]];
+        sum += diff * diff;
+        if((i & 3) == 3 && (sum > best || (sum == best && x > best_x)))
+            return false;
+    }
+    if(sum > best || (sum == best && x > best_x))
+        return false;
+    *bound = sum;
+    return true;
+}
+
+//==============================================================
+// search the cells or groups [begin, end) of a level
+// best and best_x are the best sum and cell so far
+void fingerprint_matcher::search(int level, int begin, int end, map_accum &best, int &best_x) {
+    if(level == 0) {
+        for(int x = begin; x < end; ++x) {
+            map_accum sum;
+            ++n_evaluated;
+            if(fingerprint_ssd(&fingerprints[(size_t) x * ap_stride], x, best, best_x, &sum)) {
+                best = sum;
+                best_x = x;
+            } else {
+                ++n_abandoned;
+            }
+        }
+        return;
+    }
+    // the bounds of the groups, sorted (insertion sort, max. 8 groups)
+    int order[matcher_fanout];
+    map_accum order_bound[matcher_fanout];
+    int n_order = 0;
+    for(int group = begin; group < end; ++group) {
+        map_accum bound;
+        const map_scalar *lo = &bounds[level][(size_t) 2 * group * ap_stride];
+        if(!range_bound(lo, lo + ap_stride, group * group_cells[level], best, best_x, &bound)) {
+            n_pruned += ((group+1 < n_groups[level]) ? group_cells[level] : n_x - group * group_cells[level]);
+            continue;
+        }
+        int j = n_order++;
+        while(j > 0 && order_bound[j-1] > bound) {
+            order[j] = order[j-1];
+            order_bound[j] = order_bound[j-1];
+            --j;
+        }
+        order[j] = group;
+        order_bound[j] = bound;
+    }
+    for(int i = 0; i < n_order; ++i) {
+        int group = order[i];
+        // the best sum may be smaller now
+        if(order_bound[i] > best || (order_bound[i] == best && group * group_cells[level] > best_x)) {
+            n_pruned += ((group+1 < n_groups[level]) ? group_cells[level] : n_x - group * group_cells[level]);
+            continue;
+        }
+        int child_end = (group+1) * matcher_fanout;
+        if(child_end > n_groups[level-1])
+            child_end = n_groups[level-1];
+        search(level-1, group * matcher_fanout, child_end, best, best_x);
+    }
+}
+
+//==============================================================
+// the constructor
+fingerprint_matcher::fingerprint_matcher() {
+    memory = NULL;
+    release();
+}
+
+//==============================================================
+// the destructor
+fingerprint_matcher::~fingerprint_matcher() {
+    release();
+}
+
+//==============================================================
+// free the memory
+void fingerprint_matcher::release() {
+    free(memory);
+    memory = NULL;
+    memory_size = 0;
+    fingerprints = NULL;
+    query = NULL;
+    mask = NULL;
+    active = NULL;
+    found = NULL;
+    sparse = NULL;
+    n_x = n_aps = ap_stride = n_blocks = 0;
+    n_active = 0;
+    n_sparse = 0;
+    for(int level = 0; level <= matcher_max_levels; ++level) {
+        bounds[level] = NULL;
+        n_groups[level] = 0;
+        group_cells[level] = 0;
+    }
+    n_levels = 0;
+    n_abandoned = 0;
+    n_evaluated = 0;
+    n_pruned = 0;
+}
+
+//==============================================================
+// allocate the memory block for the bound pyramid of the cells
+// and the query (cells = 0: only the query)
+bool fingerprint_matcher::allocate(int cells, int aps) {
+    int stride_aps = matcher_stride(aps);
+    int blocks = stride_aps / matcher_block;
+    size_t query_bytes = matcher_align(stride_aps * sizeof(map_scalar));
+    size_t block_bytes = matcher_align(blocks * sizeof(int));
+    size_t sparse_bytes = matcher_align(stride_aps * sizeof(int));
+    size_t size = 2*query_bytes + 2*block_bytes + sparse_bytes;
+    // the levels of the bound pyramid
+    n_groups[0] = cells;
+    group_cells[0] = 1;
+    int levels = 0;
+    while(n_groups[levels] > matcher_fanout && levels < matcher_max_levels) {
+        ++levels;
+        n_groups[levels] = (n_groups[levels-1] + matcher_fanout - 1) / matcher_fanout;
+        group_cells[levels] = group_cells[levels-1] * matcher_fanout;
+        size += matcher_align((size_t) 2 * n_groups[levels] * stride_aps * sizeof(map_scalar));
+    }
+    // malloc only guarantees an 8 byte alignment
+    memory = (uint8_t*) malloc(size + matcher_alignment);
+    if(!memory)
+        return false;
+    memory_size = size + matcher_alignment;
+    uint8_t *base = (uint8_t*) matcher_align((size_t) memory);
+    query = (map_scalar*) base;
+    mask = (map_scalar*) (base + query_bytes);
+    active = (int*) (base + 2*query_bytes);
+    found = (int*) (base + 2*query_bytes + block_bytes);
+    sparse = (int*) (base + 2*query_bytes + 2*block_bytes);
+    size_t offset = 2*query_bytes + 2*block_bytes + sparse_bytes;
+    for(int level = 1; level <= levels; ++level) {
+        bounds[level] = (map_scalar*) (base + offset);
+        offset += matcher_align((size_t) 2 * n_groups[level] * stride_aps * sizeof(map_scalar));
+    }
+    n_levels = levels;
+    n_x = cells;
+    n_aps = aps;
+    ap_stride = stride_aps;
+    n_blocks = blocks;
+    return true;
+}
+
+//==============================================================
+// use the fingerprints of a cell-major IILTM (see floor_map.cpp)
+// and build the bound pyramid
+// cells fingerprints of stride = matcher_stride(aps) values, 16 byte
+// aligned, the padding values are 0. The fingerprints are not
+// copied, they must stay valid until release()
+// return false if the layout does not fit or the memory
+// allocation fails
+bool fingerprint_matcher::init(const map_scalar *values, int cells, int aps, int stride) {
+    release();
+    if(cells < 1 || aps < 1 || stride != matcher_stride(aps) ||
+       ((size_t) values & (matcher_alignment - 1)) != 0 || !allocate(cells, aps))
+        return false;
+    fingerprints = values;
+    // the ranges of the groups, level after level
+    for(int level = 1; level <= n_levels; ++level) {
+        for(int group = 0; group < n_groups[level]; ++group) {
+            map_scalar *lo = &bounds[level][(size_t) 2 * group * ap_stride];
+            map_scalar *hi = lo + ap_stride;
+            int begin = group * matcher_fanout;
+            int end = (begin + matcher_fanout < n_groups[level-1]) ? begin + matcher_fanout : n_groups[level-1];
+            for(int child = begin; child < end; ++child) {
+                // a cell is a range with lo = hi
+                const map_scalar *child_lo = (level == 1) ? &fingerprints[(size_t) child * ap_stride]
+                                                          : &bounds[level-1][(size_t) 2 * child * ap_stride];
+                const map_scalar *child_hi = (level == 1) ? child_lo : child_lo + ap_stride;
+                for(int ap = 0; ap < ap_stride; ++ap) {
+                    if(child == begin || child_lo[ap] < lo[ap])
+                        lo[ap] = child_lo[ap];
+                    if(child == begin || child_hi[ap] > hi[ap])
+                        hi[ap] = child_hi[ap];
+                }
+            }
+        }
+    }
+    clear_query();
+    return true;
+}
+
+//==============================================================
+// allocate only the query for n_aps APs
+// the fingerprints are stored somewhere else (e.g. tiled_map)
+// and are given to fingerprint_ssd() and range_bound()
+bool fingerprint_matcher::init_query(int aps) {
+    release();
+    if(aps < 1 || !allocate(0, aps))
+        return false;
+    clear_query();
+    return true;
+}
+
+//==============================================================
+// forget all RSSI values of the last scan
+void fingerprint_matcher::clear_query() {
+    for(int ap = 0; ap < ap_stride; ++ap) {
+        query[ap] = 0;
+        mask[ap] = 0;
+    }
+}
+
+//==============================================================
+// set the RSSI value (map_encode()) of a found AP
+void fingerprint_matcher::set_rssi(int ap, map_scalar value) {
+    if(ap < 0 || ap >= n_aps)
+        return;
+    query[ap] = value;
+    mask[ap] = 1;
+}
+
+//==============================================================
+// select the blocks with found APs
+// sorted by the number of found APs (insertion sort, only a few blocks)
+// the APs of blocks with less than matcher_min_found found APs
+// are added to the sparse list
+void fingerprint_matcher::select_blocks() {
+    n_active = 0;
+    n_sparse = 0;
+    for(int b = 0; b < n_blocks; ++b) {
+        int n_found = 0;
+        for(int i = 0; i < matcher_block; ++i)
+            if(mask[b*matcher_block + i])
+                ++n_found;
+        if(n_found == 0)
+            continue;
+        if(n_found < matcher_min_found) {
+            // strongest APs first: the biggest differences between
+            // the cells are near the APs
+            for(int i = 0; i < matcher_block; ++i) {
+                int ap = b*matcher_block + i;
+                if(!mask[ap])
+                    continue;
+                int j = n_sparse++;
+                while(j > 0 && query[sparse[j-1]] < query[ap]) {
+                    sparse[j] = sparse[j-1];
+                    --j;
+                }
+                sparse[j] = ap;
+            }
+            continue;
+        }
+        int j = n_active++;
+        while(j > 0 && found[j-1] < n_found) {
+            active[j] = active[j-1];
+            found[j] = found[j-1];
+            --j;
+        }
+        active[j] = b;
+        found[j] = n_found;
+    }
+}
+
+//==============================================================
+// search the cell with the smallest sum of squared differences
+// hint: the cell which is calculated first (e.g. the last result)
+// return the index of the cell and its sum in best_sum
+int fingerprint_matcher::match(int hint, map_accum *best_sum) {
+    n_abandoned = 0;
+    n_evaluated = 0;
+    n_pruned = 0;
+    if(n_x == 0) {
+        if(best_sum)
+            *best_sum = 0;
+        return 0;
+    }
+    select_blocks();
+    if(hint < 0 || hint >= n_x)
+        hint = 0;
+    // the full sum of the hint cell is the first bound
+    // (the bound of the hint itself is never reached)
+    int best_x = hint;
+    map_accum best = 0;
+    fingerprint_ssd(&fingerprints[(size_t) hint * ap_stride], hint, map_accum_max, n_x, &best);
+    ++n_evaluated;
+    // coarse-to-fine search from the top level of the pyramid
+    // a cell behind the best one needs a smaller sum
+    // (same result as the first minimum of a brute force search)
+    search(n_levels, 0, n_groups[n_levels], best, best_x);
+    if(best_sum)
+        *best_sum = best;
+    return best_x;
+}
+
+//==============================================================
+// full sums of the squared differences of all cells (no pruning,
+// no early abandon), sums needs n_x values
+// the same sums as a brute force search over the IILTM
+void fingerprint_matcher::square_sums(map_accum *sums) {
+    select_blocks();
+    for(int x = 0; x < n_x; ++x) {
+        const map_scalar *fingerprint = &fingerprints[(size_t) x * ap_stride];
+        map_accum sum = 0;
+        for(int b = 0; b < n_active; ++b) {
+            int offset = active[b] * matcher_block;
+            sum += matcher_block_ssd(&fingerprint[offset], &query[offset], &mask[offset]);
+        }
+        for(int i = 0; i < n_sparse; ++i) {
+            map_accum diff = (map_accum) query[sparse[i]] - (map_accum) fingerprint[sparse[i]];
+            sum += diff * diff;
+        }
+        sums[x] = sum;
+    }
+}
+
+//==============================================================
+// return the memory footprint in bytes
+// (without the fingerprints of the floor map)
+size_t fingerprint_matcher::memory_bytes() const {
+    return sizeof(fingerprint_matcher) + memory_size;
+}
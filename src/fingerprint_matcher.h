@@ -0,0 +1,103 @@
+/***************************************************
+ *
+ * Matching of a scan with the fingerprints of the
+ * grid positions (cell-major, bound pyramid,
+ * early abandon)
+ *
+ * Hague Nusseck @ electricidea
+ *
+ * --> see fingerprint_matcher.cpp for more details on how it
+ * works and how to use it.
+ *
+ * Distributed as-is; no warranty is given.
+ *
+ * ************************************************/
+
+#ifndef FINGERPRINT_MATCHER_H
+#define FINGERPRINT_MATCHER_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "numeric_types.h"
+
+// alignment of the fingerprints (one block of APs)
+const size_t matcher_alignment = 16;
+// number of APs in one block
+const int matcher_block = matcher_alignment / sizeof(map_scalar);
+// blocks with less found APs are summed up AP by AP
+const int matcher_min_found = matcher_block * 3 / 4;
+// number of cells (or groups) in one group of the bound pyramid
+const int matcher_fanout = 8;
+// maximum number of levels of the bound pyramid
+const int matcher_max_levels = 8;
+
+//==============================================================
+// number of values of one fingerprint (n_aps + padding)
+inline int matcher_stride(int n_aps) {
+    return ((n_aps + matcher_block - 1) / matcher_block) * matcher_block;
+}
+
+// class definition
+class fingerprint_matcher {
+    public:
+        fingerprint_matcher();
+        ~fingerprint_matcher();
+        bool init(const map_scalar *fingerprints, int n_x, int n_aps, int stride);
+        bool init_query(int n_aps);
+        void release();
+        int cells() const { return n_x; }
+        int stride() const { return ap_stride; }
+        void clear_query();
+        void set_rssi(int ap, map_scalar value);
+        int match(int hint, map_accum *best_sum);
+        void square_sums(map_accum *sums);
+        int abandoned() const { return n_abandoned; }
+        int evaluated() const { return n_evaluated; }
+        int pruned() const { return n_pruned; }
+        int levels() const { return n_levels; }
+        size_t memory_bytes() const;
+        // matching with fingerprints outside of the matcher
+        void select_blocks();
+        bool fingerprint_ssd(const map_scalar *fingerprint, int x, map_accum best, int best_x,
+                             map_accum *cell_sum) const;
+        bool range_bound(const map_scalar *lo, const map_scalar *hi, int x, map_accum best, int best_x,
+                         map_accum *bound) const;
+    private:
+        bool allocate(int n_x, int n_aps);
+        void search(int level, int begin, int end, map_accum &best, int &best_x);
+        int n_x;
+        int n_aps;
+        // number of values of one fingerprint (n_aps + padding)
+        int ap_stride;
+        int n_blocks;
+        // one memory block for all arrays
+        uint8_t *memory;
+        size_t memory_size;
+        // one fingerprint of ap_stride values for each grid position
+        // (the IILTM of the floor map, not owned by the matcher)
+        const map_scalar *fingerprints;
+        // the RSSI values of the scan and 1 for the found APs
+        map_scalar *query;
+        map_scalar *mask;
+        // the blocks with found APs, most found APs first
+        int *active;
+        int *found;
+        int n_active;
+        // the found APs of the other blocks
+        int *sparse;
+        int n_sparse;
+        // bound pyramid: level 0 are the cells, each group of the
+        // level l has matcher_fanout groups of the level l-1.
+        // The minimum and the maximum values of all cells of a group
+        // are stored in 2*ap_stride values
+        map_scalar *bounds[matcher_max_levels+1];
+        int n_groups[matcher_max_levels+1];
+        int group_cells[matcher_max_levels+1];
+        int n_levels;
+        // statistics of the last match
+        int n_abandoned;
+        int n_evaluated;
+        int n_pruned;
+};
+
+#endif
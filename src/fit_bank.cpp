@@ -0,0 +1,616 @@
+/**************************************************************************
+ * Polynomial fits of many access points in one memory block
+ *
+ * Same math as curve_fit (see curve_fit.cpp and poly_math.h), but the
+ * sums, coefficients, counts, x-ranges and BSSIDs of all access points
+ * are stored in contiguous arrays ("structure of arrays") inside of
+ * one single memory allocation. There is no allocation per fit and
+ * no String object, and the memory footprint is known exactly.
+ *
+ * The BSSIDs are stored as packed 48 bit keys (see bssid_key.h).
+ * A hash index (open addressing, linear probing, at least two slots
+ * per fit) finds the fit of a BSSID in O(1). Each slot is only the
+ * 16 bit index of the fit, the key is compared in the key array.
+ *
+ * With a forgetting factor below 1.0, the sums of a fit are weighted
+ * with it before each new value of that fit is added (exponentially
+ * weighted least squares). Older values fade out and the fits follow
+ * a drifting radio map.
+ *
+ * The capacity is only the start size: if all fits are used, add()
+ * moves all fits into a memory block of the double size (up to
+ * INT16_MAX fits). Therefore no BSSID is dropped in a crowded RF
+ * environment, as long as there is enough memory.
+ *
+ * Hague Nusseck @ electricidea
+ * v1.0
+ * https://github.com/electricidea/M5Stack-Hotel-room-finder
+ *
+ * Distributed as-is; no warranty is given.
+ *
+ **************************************************************************
+ *
+ * ==== How to use it: ====
+ *
+ * 1.) allocate the memory for 40 fits of the 5th order:
+ *
+ *          fit_bank fits;
+ *          fits.init(40, 5);
+ *
+ * 2.) add a fit for a BSSID (or find the existing one) and learn:
+ *
+ *          uint64_t key = bssid_parse("AA:BB:CC:DD:EE:FF");
+ *          int ap = fits.add(key);
+ *          if(ap > -1)
+ *              fits.learn(ap, x, RSSI);
+ *
+ *     all values of one WiFi scan have the same x value. They can
+ *     be learned together, the powers of x are calculated once:
+ *
+ *          fits.learn_scan(x, ap_indices, RSSI_values, n_values);
+ *
+ * 3.) use the fits like curve_fit, with the index of the fit:
+ *
+ *          fits.select_degree(ap);
+ *          y = fits.predict(ap, x);
+ *
+ * The numeric type of all sums and coefficients is fit_scalar
+ * (double or float, see numeric_types.h). To keep float accurate for
+ * the 5th order, each fit learns its x values around the middle of
+ * its own learned range: v = (x - origin) / span. The span is the
+ * smallest power of two (at least 1.0) above the range and the origin
+ * is the middle of the range in steps of span/4. If the range grows
+ * out of the window, the sums are moved into the new window (see
+ * poly_shift_sums). Nothing has to be set for it, a survey can start
+ * at x = 0 and walk into one direction only.
+ *
+ * All functions use the original x values. The coefficients are
+ * the coefficients of the polynomial in v (see x_origin(), x_span()).
+ *
+ * 4.) fade out older values (0.0 < forgetting_factor <= 1.0):
+ *
+ *          fits.set_forgetting_factor(0.98);
+ *
+ *     the default 1.0 gives all values the same weight.
+ *
+ ***************************************************************************/
+
+#include <string.h>
+#include "Arduino.h"
+#include "fit_bank.h"
+
+// alignment of the arrays inside of the memory block
+const size_t fit_bank_alignment = 16;
+
+// flags of the state of each fit
+#define FIT_BANK_SOLVED 0x01
+#define FIT_BANK_RANGE 0x02
+
+//==============================================================
+// round up to the next multiple of the alignment
+static size_t fit_bank_align(size_t size) {
+    return (size + fit_bank_alignment - 1) & ~(fit_bank_alignment - 1);
+}
+
+//==============================================================
+// the constructor
+fit_bank::fit_bank() {
+    order = -1;
+    capacity_ = 0;
+    first_free = 0;
+    arena = NULL;
+    arena_size = 0;
+    lambda = 1;
+}
+
+//==============================================================
+// the destructor
+fit_bank::~fit_bank() {
+    free(arena);
+}
+
+//==============================================================
+// allocate one memory block for "capacity" fits of the given degree
+// all fits are cleared
+// return false if the memory allocation fails
+bool fit_bank::init(uint16_t capacity, uint8_t fit_degree) {
+    free(arena);
+    arena = NULL;
+    arena_size = 0;
+    capacity_ = 0;
+    first_free = 0;
+    order = -1;
+    // the hash index stores the fit indices as int16_t
+    if(fit_degree > CURVE_FIT_MAX_DEGREE || capacity > INT16_MAX)
+        return false;
+    if(!allocate(capacity, fit_degree))
+        return false;
+    for(int ap = 0; ap < capacity; ++ap)
+        bssid_[ap] = bssid_none;
+    for(uint32_t i = 0; i < (1UL << index_bits); ++i)
+        index[i] = -1;
+    lambda = 1;
+    reset();
+    return true;
+}
+
+//==============================================================
+// allocate the memory block for "capacity" fits and set the
+// pointers of the arrays (the arrays are not initialized)
+// the members are only changed if the allocation succeeds
+bool fit_bank::allocate(int capacity, int fit_degree) {
+    const int k = fit_degree + 1;
+    // hash index with at least two slots per fit
+    uint8_t bits = 1;
+    while((1UL << bits) < 2UL * capacity)
+        ++bits;
+    // size of all arrays, each one aligned
+    size_t sizes[16] = {
+        (2*k-1) * capacity * sizeof(fit_scalar),   // Sx
+        k * capacity * sizeof(fit_scalar),         // Sxy
+        capacity * sizeof(fit_scalar),             // Syy
+        k * capacity * sizeof(fit_scalar),         // a
+        capacity * sizeof(fit_scalar),             // min_x_
+        capacity * sizeof(fit_scalar),             // max_x_
+        capacity * sizeof(fit_scalar),             // min_y_
+        capacity * sizeof(fit_scalar),             // max_y_
+        capacity * sizeof(uint32_t),           // N
+        capacity * sizeof(uint8_t),            // degree
+        capacity * sizeof(uint8_t),            // state
+        capacity * sizeof(uint64_t),           // bssid_
+        (1UL << bits) * sizeof(int16_t),       // index
+        capacity * sizeof(uint8_t),            // channel_
+        capacity * sizeof(fit_scalar),             // origin
+        capacity * sizeof(fit_scalar)              // span
+    };
+    size_t offsets[16];
+    size_t size = 0;
+    for(int i = 0; i < 16; ++i) {
+        offsets[i] = size;
+        size += fit_bank_align(sizes[i]);
+    }
+    // malloc only guarantees an 8 byte alignment
+    uint8_t *block = (uint8_t*) malloc(size + fit_bank_alignment);
+    if(!block)
+        return false;
+    arena = block;
+    arena_size = size + fit_bank_alignment;
+    uint8_t *base = (uint8_t*) fit_bank_align((size_t) arena);
+    Sx     = (fit_scalar*)   (base + offsets[0]);
+    Sxy    = (fit_scalar*)   (base + offsets[1]);
+    Syy    = (fit_scalar*)   (base + offsets[2]);
+    a      = (fit_scalar*)   (base + offsets[3]);
+    min_x_ = (fit_scalar*)   (base + offsets[4]);
+    max_x_ = (fit_scalar*)   (base + offsets[5]);
+    min_y_ = (fit_scalar*)   (base + offsets[6]);
+    max_y_ = (fit_scalar*)   (base + offsets[7]);
+    N      = (uint32_t*) (base + offsets[8]);
+    degree = (uint8_t*)  (base + offsets[9]);
+    state  = (uint8_t*)  (base + offsets[10]);
+    bssid_ = (uint64_t*) (base + offsets[11]);
+    index  = (int16_t*)  (base + offsets[12]);
+    channel_ = (uint8_t*) (base + offsets[13]);
+    origin = (fit_scalar*)   (base + offsets[14]);
+    span   = (fit_scalar*)   (base + offsets[15]);
+    index_bits = bits;
+    order = fit_degree;
+    capacity_ = capacity;
+    return true;
+}
+
+//==============================================================
+// move all fits into a bigger memory block
+// the indices of the fits stay the same
+// return false if the memory allocation fails (the fits are
+// not changed)
+bool fit_bank::grow(int new_capacity) {
+    if(order < 0 || new_capacity <= capacity_ || new_capacity > INT16_MAX)
+        return false;
+    // the arrays of the old memory block
+    uint8_t *old_arena = arena;
+    int old_capacity = capacity_;
+    fit_scalar *old_Sx = Sx, *old_Sxy = Sxy, *old_Syy = Syy, *old_a = a;
+    fit_scalar *old_min_x = min_x_, *old_max_x = max_x_;
+    fit_scalar *old_min_y = min_y_, *old_max_y = max_y_;
+    fit_scalar *old_origin = origin, *old_span = span;
+    uint32_t *old_N = N;
+    uint8_t *old_degree = degree, *old_state = state, *old_channel = channel_;
+    uint64_t *old_bssid = bssid_;
+    if(!allocate(new_capacity, order))
+        return false;
+    // the sums are moment major: each moment is one row of capacity values
+    const int k = order + 1;
+    for(int n = 0; n < 2*k-1; ++n)
+        memcpy(&Sx[n*capacity_], &old_Sx[n*old_capacity], old_capacity * sizeof(fit_scalar));
+    for(int n = 0; n < k; ++n)
+        memcpy(&Sxy[n*capacity_], &old_Sxy[n*old_capacity], old_capacity * sizeof(fit_scalar));
+    memcpy(Syy, old_Syy, old_capacity * sizeof(fit_scalar));
+    memcpy(a, old_a, old_capacity * k * sizeof(fit_scalar));
+    memcpy(min_x_, old_min_x, old_capacity * sizeof(fit_scalar));
+    memcpy(max_x_, old_max_x, old_capacity * sizeof(fit_scalar));
+    memcpy(min_y_, old_min_y, old_capacity * sizeof(fit_scalar));
+    memcpy(max_y_, old_max_y, old_capacity * sizeof(fit_scalar));
+    memcpy(origin, old_origin, old_capacity * sizeof(fit_scalar));
+    memcpy(span, old_span, old_capacity * sizeof(fit_scalar));
+    memcpy(N, old_N, old_capacity * sizeof(uint32_t));
+    memcpy(degree, old_degree, old_capacity * sizeof(uint8_t));
+    memcpy(state, old_state, old_capacity * sizeof(uint8_t));
+    memcpy(channel_, old_channel, old_capacity * sizeof(uint8_t));
+    memcpy(bssid_, old_bssid, old_capacity * sizeof(uint64_t));
+    free(old_arena);
+    // the new fits are unused
+    for(int ap = old_capacity; ap < capacity_; ++ap) {
+        bssid_[ap] = bssid_none;
+        clear(ap);
+    }
+    // the hash index has a new size
+    for(uint32_t i = 0; i < (1UL << index_bits); ++i)
+        index[i] = -1;
+    for(int ap = 0; ap < old_capacity; ++ap)
+        if(used(ap))
+            insert(ap);
+    return true;
+}
+
+//==============================================================
+// clear all fits
+void fit_bank::reset() {
+    for(int ap = 0; ap < capacity_; ++ap)
+        clear(ap);
+}
+
+//==============================================================
+// set the forgetting factor (0.0 < forgetting_factor <= 1.0)
+// 1.0 = all values have the same weight
+// otherwise the factor is set to 1.0
+void fit_bank::set_forgetting_factor(fit_scalar forgetting_factor) {
+    if(forgetting_factor > 0 && forgetting_factor <= 1)
+        lambda = forgetting_factor;
+    else
+        lambda = 1;
+}
+
+//==============================================================
+// clear all sums and the BSSID of one fit
+// the fit can be used for a new BSSID afterwards
+void fit_bank::clear(int ap) {
+    for(int n = 0; n <= 2*order; ++n)
+        Sx[(n*capacity_)+ap] = 0.0;
+    for(int n = 0; n <= order; ++n) {
+        Sxy[(n*capacity_)+ap] = 0.0;
+        a[(ap*(order+1))+n] = 0.0;
+    }
+    Syy[ap] = 0.0;
+    min_x_[ap] = max_x_[ap] = 0.0;
+    min_y_[ap] = max_y_[ap] = 0.0;
+    origin[ap] = 0.0;
+    span[ap] = 1.0;
+    N[ap] = 0;
+    degree[ap] = order;
+    state[ap] = FIT_BANK_SOLVED;
+    if(used(ap))
+        unindex(ap);
+    bssid_[ap] = bssid_none;
+    channel_[ap] = 0;
+    if(ap < first_free)
+        first_free = ap;
+}
+
+//==============================================================
+// return the index of the fit of the BSSID or -1
+int fit_bank::find(uint64_t bssid) const {
+    if(order < 0 || bssid == bssid_none)
+        return -1;
+    const uint32_t mask = (1UL << index_bits) - 1;
+    for(uint32_t slot = bssid_hash(bssid, index_bits); index[slot] > -1; slot = (slot + 1) & mask) {
+        if(bssid_[index[slot]] == bssid)
+            return index[slot];
+    }
+    return -1;
+}
+
+//==============================================================
+// return the index of the fit of the BSSID
+// if the BSSID is unknown, the first unused fit is used for it
+// (the search starts at first_free: a survey only adds fits,
+// so the next fit is found without a search)
+// if all fits are used, the capacity is doubled
+// return -1 if there is no memory for a new fit
+int fit_bank::add(uint64_t bssid) {
+    int ap = find(bssid);
+    if(ap > -1 || order < 0 || bssid == bssid_none)
+        return ap;
+    for(ap = first_free; ap < capacity_; ++ap) {
+        if(!used(ap))
+            break;
+    }
+    if(ap == capacity_) {
+        int new_capacity = (capacity_ > 0) ? 2*capacity_ : 8;
+        if(new_capacity > INT16_MAX)
+            new_capacity = INT16_MAX;
+        if(!grow(new_capacity))
+            return -1;
+    }
+    clear(ap);
+    bssid_[ap] = bssid;
+    insert(ap);
+    first_free = ap + 1;
+    return ap;
+}
+
+//==============================================================
+// add a used fit to the hash index
+void fit_bank::insert(int ap) {
+    const uint32_t mask = (1UL << index_bits) - 1;
+    uint32_t slot = bssid_hash(bssid_[ap], index_bits);
+    while(index[slot] > -1)
+        slot = (slot + 1) & mask;
+    index[slot] = ap;
+}
+
+//==============================================================
+// remove a fit from the hash index
+// the following entries of the probe sequence are moved back
+// into the gap, so no deleted markers are needed
+void fit_bank::unindex(int ap) {
+    const uint32_t mask = (1UL << index_bits) - 1;
+    uint32_t gap = bssid_hash(bssid_[ap], index_bits);
+    while(index[gap] != ap) {
+        if(index[gap] < 0)
+            return;
+        gap = (gap + 1) & mask;
+    }
+    index[gap] = -1;
+    for(uint32_t slot = (gap + 1) & mask; index[slot] > -1; slot = (slot + 1) & mask) {
+        uint32_t home = bssid_hash(bssid_[index[slot]], index_bits);
+        // move the entry, if the gap is between its home slot and its slot
+        if(((slot - home) & mask) >= ((slot - gap) & mask)) {
+            index[gap] = index[slot];
+            index[slot] = -1;
+            gap = slot;
+        }
+    }
+}
+
+//==============================================================
+// return the number of used fits
+int fit_bank::size() const {
+    int n = 0;
+    for(int ap = 0; ap < capacity_; ++ap)
+        if(used(ap))
+            ++n;
+    return n;
+}
+
+//==============================================================
+// return the exact memory footprint in bytes
+// (object + memory block)
+size_t fit_bank::memory_bytes() const {
+    return sizeof(fit_bank) + arena_size;
+}
+
+//==============================================================
+// learn:
+// Adding a new pair of x and y values to the sums of a fit
+void fit_bank::learn(int ap, fit_scalar x, fit_scalar y) {
+    if(order < 0 || ap < 0 || ap >= capacity_)
+        return;
+    learn_scan(x, &ap, &y, 1);
+}
+
+//==============================================================
+// learn_scan:
+// Adding n values with the same x value (e.g. the RSSI values
+// of one WiFi scan at one position) to the fits aps[0..n-1]
+// The powers of x are calculated only once for all fits with
+// the same window (see move_window).
+void fit_bank::learn_scan(fit_scalar x, const int *aps, const fit_scalar *ys, size_t n) {
+    if(order < 0)
+        return;
+    fit_scalar xn[2*CURVE_FIT_MAX_DEGREE+1];
+    // window of the powers in xn (span 0 = no powers yet)
+    fit_scalar xn_origin = 0, xn_span = 0;
+    for(size_t i = 0; i < n; ++i) {
+        int ap = aps[i];
+        ++N[ap];
+        move_window(ap, x);
+        state[ap] = 0;
+        if(origin[ap] != xn_origin || span[ap] != xn_span) {
+            xn_origin = origin[ap];
+            xn_span = span[ap];
+            fit_scalar v = (x - xn_origin) / xn_span;
+            xn[0] = 1.0;
+            for(int p = 1; p <= 2*order; ++p)
+                xn[p] = xn[p-1] * v;
+        }
+        fit_scalar y = ys[i];
+        if(lambda < 1) {
+            // weight the older values of the fit before the new value
+            // is added (each value in turn, a fit can be in aps twice)
+            for(int p = 0; p <= 2*order; ++p)
+                Sx[(p*capacity_)+ap] = lambda * Sx[(p*capacity_)+ap] + xn[p];
+            for(int p = 0; p <= order; ++p)
+                Sxy[(p*capacity_)+ap] = lambda * Sxy[(p*capacity_)+ap] + xn[p] * y;
+            Syy[ap] = lambda * Syy[ap] + y * y;
+        } else {
+            for(int p = 0; p <= 2*order; ++p)
+                Sx[(p*capacity_)+ap] += xn[p];
+            for(int p = 0; p <= order; ++p)
+                Sxy[(p*capacity_)+ap] += xn[p] * y;
+            Syy[ap] += y * y;
+        }
+    }
+}
+
+//==============================================================
+// add x to the learned range of one fit (N already counts x)
+// The window of the fit is the smallest power of two span
+// (at least 1.0) above the range, with the origin in the middle
+// of the range in steps of span/4 (|v| <= 0.625). If the window
+// changes, the sums are moved into the new window.
+// Only the fit ap is changed: fits of different tasks don't share
+// anything.
+void fit_bank::move_window(int ap, fit_scalar x) {
+    if(N[ap] == 1) {
+        min_x_[ap] = x;
+        max_x_[ap] = x;
+    } else if(x < min_x_[ap]) {
+        min_x_[ap] = x;
+    } else if(x > max_x_[ap]) {
+        max_x_[ap] = x;
+    } else {
+        return;
+    }
+    fit_scalar new_span = 1;
+    while(new_span < max_x_[ap] - min_x_[ap])
+        new_span *= 2;
+    fit_scalar step = new_span / 4;
+    fit_scalar new_origin = floor((min_x_[ap] + max_x_[ap]) / 2 / step + (fit_scalar) 0.5) * step;
+    if(new_origin == origin[ap] && new_span == span[ap])
+        return;
+    // the first value: no sums to move
+    if(N[ap] > 1) {
+        fit_scalar ap_Sx[2*CURVE_FIT_MAX_DEGREE+1];
+        fit_scalar ap_Sxy[CURVE_FIT_MAX_DEGREE+1];
+        gather_sums(ap, ap_Sx, ap_Sxy);
+        poly_shift_sums(ap_Sx, ap_Sxy, order, ((double) new_origin - origin[ap]) / span[ap],
+                        (double) new_span / span[ap]);
+        for(int n = 0; n <= 2*order; ++n)
+            Sx[(n*capacity_)+ap] = ap_Sx[n];
+        for(int n = 0; n <= order; ++n)
+            Sxy[(n*capacity_)+ap] = ap_Sxy[n];
+    }
+    origin[ap] = new_origin;
+    span[ap] = new_span;
+}
+
+//==============================================================
+// number of values of one fit for the statistics
+// with a forgetting factor the sum of the weights (= Sx[0])
+fit_scalar fit_bank::weight(int ap) const {
+    return (lambda < 1) ? Sx[ap] : (fit_scalar) N[ap];
+}
+
+//==============================================================
+// copy the sums of one fit into continuous arrays
+// (2*order+1 values of Sx, order+1 values of Sxy, the powers of
+// v = (x - x_origin) / x_span)
+void fit_bank::gather_sums(int ap, fit_scalar *ap_Sx, fit_scalar *ap_Sxy) const {
+    for(int n = 0; n <= 2*order; ++n)
+        ap_Sx[n] = Sx[(n*capacity_)+ap];
+    for(int n = 0; n <= order; ++n)
+        ap_Sxy[n] = Sxy[(n*capacity_)+ap];
+}
+
+//==============================================================
+// solve the coefficients of one fit (see poly_solve)
+// the coefficients above the selected degree are 0.0
+void fit_bank::solve(int ap) {
+    fit_scalar ap_Sx[2*CURVE_FIT_MAX_DEGREE+1];
+    fit_scalar ap_Sxy[CURVE_FIT_MAX_DEGREE+1];
+    gather_sums(ap, ap_Sx, ap_Sxy);
+    fit_scalar *ap_a = &a[ap*(order+1)];
+    for(int n = 0; n <= order; ++n)
+        ap_a[n] = 0.0;
+    poly_solve(ap_Sx, ap_Sxy, ap_a, (int) degree[ap]);
+    state[ap] |= FIT_BANK_SOLVED;
+}
+
+//==============================================================
+// select the degree of one fit with the best score of the
+// criterion out of the learned sums (see curve_fit::select_degree)
+uint8_t fit_bank::select_degree(int ap, uint8_t criterion) {
+    if(order < 0 || N[ap] == 0)
+        return 0;
+    fit_scalar ap_Sx[2*CURVE_FIT_MAX_DEGREE+1];
+    fit_scalar ap_Sxy[CURVE_FIT_MAX_DEGREE+1];
+    fit_scalar rss[CURVE_FIT_MAX_DEGREE+1];
+    gather_sums(ap, ap_Sx, ap_Sxy);
+    poly_rss(ap_Sx, ap_Sxy, Syy[ap], order, rss);
+    uint32_t n = (uint32_t) (weight(ap) + (fit_scalar) 0.5);
+    degree[ap] = poly_select_degree(rss, order, (n > 0) ? n : 1, criterion);
+    state[ap] = 0;
+    return degree[ap];
+}
+
+//==============================================================
+// root mean square of the residuals of one fit with the
+// selected degree (noise of the RSSI values around the fit)
+fit_scalar fit_bank::residual(int ap) const {
+    if(order < 0 || N[ap] == 0)
+        return 0.0;
+    fit_scalar ap_Sx[2*CURVE_FIT_MAX_DEGREE+1];
+    fit_scalar ap_Sxy[CURVE_FIT_MAX_DEGREE+1];
+    fit_scalar rss[CURVE_FIT_MAX_DEGREE+1];
+    gather_sums(ap, ap_Sx, ap_Sxy);
+    poly_rss(ap_Sx, ap_Sxy, Syy[ap], order, rss);
+    return sqrt(rss[degree[ap]] / weight(ap));
+}
+
+//==============================================================
+// predict:
+// returning the predicted y value of one fit for a given x value
+fit_scalar fit_bank::predict(int ap, fit_scalar x) {
+    if(!(state[ap] & FIT_BANK_SOLVED))
+        solve(ap);
+    return poly_eval(&a[ap*(order+1)], (int) degree[ap], (x - origin[ap]) / span[ap]);
+}
+
+//==============================================================
+// the coefficients of one fit
+// (polynomial in v = (x - x_origin(ap)) / x_span(ap))
+// get_order(ap)+1 values
+const fit_scalar *fit_bank::coefficients(int ap) {
+    if(!(state[ap] & FIT_BANK_SOLVED))
+        solve(ap);
+    return &a[ap*(order+1)];
+}
+
+//==============================================================
+// predict_many:
+// returning the predicted y values of one fit for n given x values
+// if x is outside the learned range, y is replaced with outside_value
+void fit_bank::predict_many(int ap, const fit_scalar *xs, fit_scalar *ys, size_t n, fit_scalar outside_value) {
+    if(!(state[ap] & FIT_BANK_SOLVED))
+        solve(ap);
+    const fit_scalar *ap_a = &a[ap*(order+1)];
+    // the x values are transformed in blocks
+    const size_t block_size = 32;
+    fit_scalar us[block_size];
+    for(size_t start = 0; start < n; start += block_size) {
+        size_t m = (n - start < block_size) ? n - start : block_size;
+        for(size_t i = 0; i < m; ++i)
+            us[i] = (xs[start+i] - origin[ap]) / span[ap];
+        poly_eval_many(ap_a, (int) degree[ap], us, &ys[start], m);
+        for(size_t i = 0; i < m; ++i)
+            ys[start+i] = (xs[start+i] > max_x_[ap] || xs[start+i] < min_x_[ap]) ? outside_value : ys[start+i];
+    }
+}
+
+//==============================================================
+// calculate the exact min and max y values of one fit
+// (cached until the next learn)
+void fit_bank::update_range(int ap) {
+    if(!(state[ap] & FIT_BANK_SOLVED))
+        solve(ap);
+    poly_range_extrema(&a[ap*(order+1)], (int) degree[ap],
+                       (min_x_[ap] - origin[ap]) / span[ap], (max_x_[ap] - origin[ap]) / span[ap],
+                       &min_y_[ap], &max_y_[ap]);
+    state[ap] |= FIT_BANK_RANGE;
+}
+
+//==============================================================
+// return the max y value of one fit over its learned x range
+fit_scalar fit_bank::estimate_max_y(int ap) {
+    if(!(state[ap] & FIT_BANK_RANGE))
+        update_range(ap);
+    return max_y_[ap];
+}
+
+//==============================================================
+// return the min y value of one fit over its learned x range
+fit_scalar fit_bank::estimate_min_y(int ap) {
+    if(!(state[ap] & FIT_BANK_RANGE))
+        update_range(ap);
+    return min_y_[ap];
+}
@@ -0,0 +1,104 @@
+/***************************************************
+ *
+ * Polynomial fits of many access points in one memory block
+ *
+ * Hague Nusseck @ electricidea
+ *
+ * --> see fit_bank.cpp for more details on how it
+ * works and how to use it.
+ *
+ * Distributed as-is; no warranty is given.
+ *
+ * ************************************************/
+
+#ifndef FIT_BANK_H
+#define FIT_BANK_H
+
+#include "poly_math.h"
+#include "numeric_types.h"
+#include "bssid_key.h"
+
+// class definition
+class fit_bank {
+    public:
+        fit_bank();
+        ~fit_bank();
+        bool init(uint16_t capacity, uint8_t fit_degree);
+        void reset();
+        void set_forgetting_factor(fit_scalar forgetting_factor);
+        fit_scalar forgetting_factor() const { return lambda; }
+        void clear(int ap);
+        int find(uint64_t bssid) const;
+        int find(const char *bssid) const { return find(bssid_parse(bssid)); }
+        int add(uint64_t bssid);
+        int add(const char *bssid) { return add(bssid_parse(bssid)); }
+        bool grow(int new_capacity);
+        void learn(int ap, fit_scalar x, fit_scalar y);
+        void learn_scan(fit_scalar x, const int *aps, const fit_scalar *ys, size_t n);
+        uint8_t select_degree(int ap, uint8_t criterion = FIT_CRITERION_BIC);
+        fit_scalar residual(int ap) const;
+        fit_scalar predict(int ap, fit_scalar x);
+        const fit_scalar *coefficients(int ap);
+        void predict_many(int ap, const fit_scalar *xs, fit_scalar *ys, size_t n, fit_scalar outside_value);
+        fit_scalar estimate_max_y(int ap);
+        fit_scalar estimate_min_y(int ap);
+        bool used(int ap) const { return bssid_[ap] != bssid_none; }
+        uint64_t bssid(int ap) const { return bssid_[ap]; }
+        void set_channel(int ap, uint8_t channel) { channel_[ap] = channel; }
+        uint8_t channel(int ap) const { return channel_[ap]; }
+        int count(int ap) const { return N[ap]; }
+        fit_scalar max_x(int ap) const { return max_x_[ap]; }
+        fit_scalar min_x(int ap) const { return min_x_[ap]; }
+        fit_scalar x_origin(int ap) const { return origin[ap]; }
+        fit_scalar x_span(int ap) const { return span[ap]; }
+        void gather_sums(int ap, fit_scalar *ap_Sx, fit_scalar *ap_Sxy) const;
+        uint32_t get_order(int ap) const { return degree[ap]; }
+        int capacity() const { return capacity_; }
+        int size() const;
+        size_t memory_bytes() const;
+    private:
+        bool allocate(int capacity, int fit_degree);
+        void insert(int ap);
+        void solve(int ap);
+        void update_range(int ap);
+        void move_window(int ap, fit_scalar x);
+        void unindex(int ap);
+        fit_scalar weight(int ap) const;
+        // weight of the older values of a fit with every new value
+        fit_scalar lambda;
+        // order of the learned sums of all fits
+        int order;
+        // number of fits in the memory block
+        int capacity_;
+        // all fits below this index are used (start of the
+        // search for an unused fit in add())
+        int first_free;
+        // one memory block for all arrays (arena)
+        uint8_t *arena;
+        size_t arena_size;
+        // sums, moment major: Sx[(n*capacity)+ap] = SUM(xi^n) of fit ap
+        fit_scalar *Sx;
+        fit_scalar *Sxy;
+        fit_scalar *Syy;
+        // coefficients, fit major: a[(ap*(order+1))+n]
+        fit_scalar *a;
+        fit_scalar *min_x_, *max_x_;
+        // window of each fit: x is learned as v = (x - origin) / span
+        fit_scalar *origin, *span;
+        fit_scalar *min_y_, *max_y_;
+        uint32_t *N;
+        // selected degree of each fit
+        uint8_t *degree;
+        // FIT_BANK_SOLVED and FIT_BANK_RANGE flags
+        uint8_t *state;
+        // primary WiFi channel of each AP (0 = unknown)
+        uint8_t *channel_;
+        // BSSID keys of the fits (bssid_none = unused)
+        uint64_t *bssid_;
+        // hash index: open addressing with linear probing,
+        // 2^index_bits slots with the index of a fit or -1
+        int16_t *index;
+        uint8_t index_bits;
+};
+
+#endif
@@ -0,0 +1,277 @@
+/**************************************************************************
+ * Binary floor map (grid, BSSIDs and IILTM)
+ *
+ * The floor map is one memory block with the same layout as the
+ * file (/floor_map.bin). It can be loaded with one single read, or
+ * mapped into memory by host tools, without any parsing:
+ *
+ *   offset 0:  floor_map_header (32 bytes)
+ *              magic, version, type of the IILTM values,
+ *              dimensions, offset/step of the values, checksum
+ *   grid:      n_x double values, the positions along the floor
+ *   BSSIDs:    n_aps uint64_t values, packed BSSIDs (bssid_key.h)
+ *   channels:  n_aps uint8_t values, primary WiFi channels of
+ *              the APs (0 = unknown)
+ *   IILTM:     n_x fingerprints of stride map_scalar values
+ *              (cell-major: one fingerprint per grid position,
+ *              one value per AP)
+ *
+ * Each section and each fingerprint begins at a 16 byte boundary,
+ * the padding values of the fingerprints are 0. This is the layout
+ * of the fingerprint_matcher: the matcher uses the IILTM in place,
+ * there is no second copy of the map in the memory. Files of the
+ * older AP-major layout (version 2) are not loaded, the floor map
+ * is imported again from the text file.
+ *
+ * All numbers are stored little endian (ESP32 and x86 hosts).
+ * A map is only loaded if the value type, offset and step are the
+ * same as the map_scalar of the build (see numeric_types.h).
+ *
+ * Hague Nusseck @ electricidea
+ * v1.0
+ * https://github.com/electricidea/M5Stack-Hotel-room-finder
+ *
+ * Distributed as-is; no warranty is given.
+ *
+ **************************************************************************
+ *
+ * ==== How to use it: ====
+ *
+ * 1.) allocate a map and fill it:
+ *
+ *          floor_map map;
+ *          map.init(n_x, n_aps);
+ *          map.x()[i] = ...;
+ *          map.bssids()[ap] = ...;
+ *          map.channels()[ap] = ...;
+ *          map.cell(i)[ap] = map_encode(RSSI);
+ *
+ * 2.) save and load the map:
+ *
+ *          File file = SD.open("/floor_map.bin", FILE_WRITE);
+ *          map.save(file);
+ *
+ *          File file = SD.open("/floor_map.bin");
+ *          if(!map.load(file))
+ *              ... import the text file
+ *
+ * 3.) host tools map the file into the memory:
+ *
+ *          map.map_file("floor_map.bin");
+ *
+ ***************************************************************************/
+
+#include <stdlib.h>
+#include <string.h>
+#include "floor_map.h"
+
+#ifndef ARDUINO
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+//==============================================================
+// round up to the next multiple of the alignment
+static size_t floor_map_align(size_t size) {
+    return (size + floor_map_alignment - 1) & ~(floor_map_alignment - 1);
+}
+
+// largest map: the sum of the sections can't overflow size_t
+// (also with the 32 bit size_t of the ESP32)
+const size_t floor_map_max_size = SIZE_MAX / 4;
+
+//==============================================================
+// number of values of one fingerprint
+// (the same as matcher_stride(n_aps))
+static uint32_t floor_map_stride(uint32_t n_aps) {
+    const uint32_t block_values = floor_map_alignment / sizeof(map_scalar);
+    return (uint32_t) (((uint64_t) n_aps + block_values - 1) / block_values) * block_values;
+}
+
+//==============================================================
+// size of a floor map in bytes (= file size)
+// stride returns the number of values of one fingerprint
+// (the same as matcher_stride(n_aps))
+size_t floor_map_size(uint32_t n_x, uint32_t n_aps, uint32_t *stride) {
+    uint32_t s = floor_map_stride(n_aps);
+    if(stride)
+        *stride = s;
+    return floor_map_align(sizeof(floor_map_header))
+         + floor_map_align(n_x * sizeof(double))
+         + floor_map_align(n_aps * sizeof(uint64_t))
+         + floor_map_align(n_aps * sizeof(uint8_t))
+         + floor_map_align((size_t) n_x * s * sizeof(map_scalar));
+}
+
+//==============================================================
+// check the header of a file of file_size bytes
+// n_x and n_aps are checked against the file size before any
+// size is calculated: a broken header can't overflow the sizes
+// return the size of the map or 0 if the file is no valid floor
+// map of the map_scalar type of this build
+static size_t floor_map_check(const floor_map_header &file_header, size_t file_size) {
+    if(file_header.magic != floor_map_magic ||
+       file_header.version != floor_map_version ||
+       file_header.header_size != sizeof(floor_map_header) ||
+       file_header.value_type != map_type_id ||
+       file_header.value_offset != (float) map_offset ||
+       file_header.value_step != (float) map_step)
+        return 0;
+    if(file_size > floor_map_max_size)
+        file_size = floor_map_max_size;
+    uint32_t stride = floor_map_stride(file_header.n_aps);
+    if(file_header.stride != stride ||
+       file_header.n_x > file_size / sizeof(double) ||
+       file_header.n_aps > file_size / sizeof(uint64_t) ||
+       (stride > 0 && file_header.n_x > file_size / sizeof(map_scalar) / stride))
+        return 0;
+    size_t map_size = floor_map_size(file_header.n_x, file_header.n_aps, NULL);
+    return (map_size <= file_size) ? map_size : 0;
+}
+
+//==============================================================
+// the constructor
+floor_map::floor_map() {
+    block = NULL;
+    base = NULL;
+    size = 0;
+    mapped = false;
+    header = NULL;
+    x_ = NULL;
+    bssids_ = NULL;
+    channels_ = NULL;
+    values_ = NULL;
+}
+
+//==============================================================
+// the destructor
+floor_map::~floor_map() {
+    release();
+}
+
+//==============================================================
+// free the memory (or unmap the file)
+void floor_map::release() {
+#ifndef ARDUINO
+    if(mapped)
+        munmap(block, size);
+    else
+#endif
+        free(block);
+    block = NULL;
+    base = NULL;
+    size = 0;
+    mapped = false;
+    header = NULL;
+    x_ = NULL;
+    bssids_ = NULL;
+    channels_ = NULL;
+    values_ = NULL;
+}
+
+//==============================================================
+// allocate the memory block for a new, empty map
+// return false if the memory allocation fails
+bool floor_map::init(uint32_t n_x, uint32_t n_aps) {
+    floor_map_header new_header;
+    memset(&new_header, 0, sizeof(new_header));
+    new_header.magic = floor_map_magic;
+    new_header.version = floor_map_version;
+    new_header.value_type = map_type_id;
+    new_header.header_size = sizeof(floor_map_header);
+    new_header.n_x = n_x;
+    new_header.n_aps = n_aps;
+    floor_map_size(n_x, n_aps, &new_header.stride);
+    new_header.value_offset = map_offset;
+    new_header.value_step = map_step;
+    if(!allocate(new_header, floor_map_max_size))
+        return false;
+    memset(base + sizeof(floor_map_header), 0, size - sizeof(floor_map_header));
+    return true;
+}
+
+//==============================================================
+// check a header and allocate the memory block for it
+// (file_size: size of the file of the header)
+// the header is copied to the begin of the block
+bool floor_map::allocate(const floor_map_header &file_header, size_t file_size) {
+    release();
+    size_t map_size = floor_map_check(file_header, file_size);
+    if(map_size == 0)
+        return false;
+    // malloc only guarantees an 8 byte alignment
+    block = (uint8_t*) malloc(map_size + floor_map_alignment);
+    if(!block)
+        return false;
+    memcpy((uint8_t*) floor_map_align((size_t) block), &file_header, sizeof(floor_map_header));
+    attach((uint8_t*) floor_map_align((size_t) block), map_size);
+    return true;
+}
+
+//==============================================================
+// set the pointers of the sections
+// begin points to the header of the map
+void floor_map::attach(uint8_t *begin, size_t map_size) {
+    base = begin;
+    size = map_size;
+    header = (floor_map_header*) base;
+    size_t offset = floor_map_align(sizeof(floor_map_header));
+    x_ = (double*) (base + offset);
+    offset += floor_map_align(header->n_x * sizeof(double));
+    bssids_ = (uint64_t*) (base + offset);
+    offset += floor_map_align(header->n_aps * sizeof(uint64_t));
+    channels_ = (uint8_t*) (base + offset);
+    offset += floor_map_align(header->n_aps * sizeof(uint8_t));
+    values_ = (map_scalar*) (base + offset);
+}
+
+//==============================================================
+// FNV-1a checksum of all data behind the header
+uint32_t floor_map::checksum() const {
+    uint32_t hash = 2166136261UL;
+    for(size_t i = sizeof(floor_map_header); i < size; ++i) {
+        hash ^= base[i];
+        hash *= 16777619UL;
+    }
+    return hash;
+}
+
+//==============================================================
+// map a floor map file into the memory (host tools only)
+// the pages are private: changes are not written to the file
+// return false if the file is no valid floor map
+bool floor_map::map_file(const char *path) {
+    release();
+#ifdef ARDUINO
+    (void) path;
+    return false;
+#else
+    int fd = open(path, O_RDONLY);
+    if(fd < 0)
+        return false;
+    struct stat file_stat;
+    if(fstat(fd, &file_stat) != 0 || (size_t) file_stat.st_size < sizeof(floor_map_header)) {
+        close(fd);
+        return false;
+    }
+    void *memory = mmap(NULL, file_stat.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if(memory == MAP_FAILED)
+        return false;
+    size_t map_size = floor_map_check(*(floor_map_header*) memory, file_stat.st_size);
+    if(map_size == 0 || map_size != (size_t) file_stat.st_size) {
+        munmap(memory, file_stat.st_size);
+        return false;
+    }
+    block = (uint8_t*) memory;
+    mapped = true;
+    attach(block, map_size);
+    if(checksum() != header->checksum) {
+        release();
+        return false;
+    }
+    return true;
+#endif
+}
@@ -0,0 +1,121 @@
+/***************************************************
+ *
+ * Binary floor map (grid, BSSIDs and IILTM)
+ *
+ * Hague Nusseck @ electricidea
+ *
+ * --> see floor_map.cpp for more details on how it
+ * works and how to use it.
+ *
+ * Distributed as-is; no warranty is given.
+ *
+ * ************************************************/
+
+#ifndef FLOOR_MAP_H
+#define FLOOR_MAP_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "numeric_types.h"
+
+// "FMAP" as little endian number
+const uint32_t floor_map_magic = 0x50414D46;
+const uint16_t floor_map_version = 3;
+// alignment of the sections and of the fingerprints
+const size_t floor_map_alignment = 16;
+
+// header at the begin of the file (32 bytes)
+struct floor_map_header {
+    uint32_t magic;
+    uint16_t version;
+    // map_type_id of the IILTM values
+    uint8_t value_type;
+    uint8_t header_size;
+    // number of grid positions and access points
+    uint32_t n_x;
+    uint32_t n_aps;
+    // number of values of one fingerprint (n_aps + padding)
+    uint32_t stride;
+    // rssi = value_offset + (value * value_step)
+    float value_offset;
+    float value_step;
+    // FNV-1a checksum of all data behind the header
+    uint32_t checksum;
+};
+
+// class definition
+class floor_map {
+    public:
+        floor_map();
+        ~floor_map();
+        bool init(uint32_t n_x, uint32_t n_aps);
+        void release();
+        template<typename Source> bool load(Source &file);
+        template<typename Sink> bool save(Sink &file);
+        bool map_file(const char *path);
+        uint32_t n_x() const { return header ? header->n_x : 0; }
+        uint32_t n_aps() const { return header ? header->n_aps : 0; }
+        uint32_t stride() const { return header ? header->stride : 0; }
+        double *x() const { return x_; }
+        uint64_t *bssids() const { return bssids_; }
+        uint8_t *channels() const { return channels_; }
+        map_scalar *values() const { return values_; }
+        map_scalar *cell(int x) const { return &values_[(size_t) x*header->stride]; }
+        size_t file_size() const { return size; }
+        size_t memory_bytes() const { return sizeof(floor_map) + (mapped ? 0 : size + floor_map_alignment); }
+        bool is_mapped() const { return mapped; }
+    private:
+        bool allocate(const floor_map_header &file_header, size_t file_size);
+        void attach(uint8_t *begin, size_t map_size);
+        uint32_t checksum() const;
+        // the memory block (or the mapped file)
+        uint8_t *block;
+        // the aligned begin of the map = begin of the file
+        uint8_t *base;
+        size_t size;
+        bool mapped;
+        floor_map_header *header;
+        double *x_;
+        uint64_t *bssids_;
+        uint8_t *channels_;
+        map_scalar *values_;
+};
+
+size_t floor_map_size(uint32_t n_x, uint32_t n_aps, uint32_t *stride);
+
+//==============================================================
+// load the map from a file with one bulk read
+// Source needs a function read(uint8_t *data, size_t size)
+// that returns the number of bytes read and a function size()
+// that returns the size of the file (e.g. File)
+// return false if the file is no valid floor map of the
+// map_scalar type of this build
+template<typename Source>
+bool floor_map::load(Source &file) {
+    floor_map_header file_header;
+    if(file.read((uint8_t*) &file_header, sizeof(file_header)) != sizeof(file_header))
+        return false;
+    if(!allocate(file_header, file.size()))
+        return false;
+    size_t rest = size - sizeof(floor_map_header);
+    if(file.read(base + sizeof(floor_map_header), rest) != rest ||
+       checksum() != header->checksum) {
+        release();
+        return false;
+    }
+    return true;
+}
+
+//==============================================================
+// save the map into a file with one bulk write
+// Sink needs a function write(const uint8_t *data, size_t size)
+// that returns the number of bytes written (e.g. File)
+template<typename Sink>
+bool floor_map::save(Sink &file) {
+    if(!header)
+        return false;
+    header->checksum = checksum();
+    return file.write(base, size) == size;
+}
+
+#endif
@@ -1,831 +1,1499 @@
-/**************************************************************************
- * WiFi based location system to find home.
- * 
- * A Indoor Positioning System based on WiFi RSSI data to return to the 
- * right room of a hotel corridor. Maybe useless, but it works just fine!
- * 
- * Hague Nusseck @ electricidea
- * v1.1 05.June.2020
- * https://github.com/electricidea/M5Stack-Hotel-room-finder
- * 
- * Changelog:
- * v1.1 = - first published version
- * 
- * Distributed as-is; no warranty is given.
- * 
- ***************************************************************************/
-#include <Arduino.h>
-
-#include <M5Stack.h>
-// install the library:
-// pio lib install "M5Stack"
-
-#include "WiFi.h"
-
-// Free Fonts for nice looking fonts on the screen
-#include "Free_Fonts.h"
-
-// library for liniear and nonlinear fits
-#include "curve_fit.h"
-
-// maximum number of access points = maximum number of fits
-const int max_fits = 40;
-// array of of a number of fits 
-curve_fit fits[max_fits] = curve_fit();
-
-// position on the floor
-double min_pos = 99999;
-double max_pos = -99999;
-// array for the calculated x positions along the floor
-double *newx_array;
-int n_newx = 0;
-
-// the inverse intensity lookup table Map
-double *IILTM;
-int n_usable_APs = 0;
-
-// the BSSID lookup table
-typedef char cstring[100];  
-cstring *BSSIDLT;
-// the array for the square sums
-double *square_sum_array;
-
-// state machine index to switch between the menu states
-int menu_state = 0;
-
-#define STATE_START 1
-#define STATE_MEASURE 2
-#define STATE_GET_DATA 3
-#define STATE_DATA 4
-#define STATE_RUN 5
-
-// value for the measurement along the floor
-int measure_position = 0;
-
-//==============================================================
-// function forward declaration
-uint16_t RGB2Color(uint8_t r, uint8_t g, uint8_t b);
-void writeFile(fs::FS &fs, const char * path, const char * message);
-void Clear_Screen();
-void print_menu(int menu_index);
-String split(String source, char delimiter, int location);
-uint8_t collect_WiFi_data(String filename, bool append = true);
-bool load_measurement(String filename);
-bool load_floor_data();
-String calculate_position();
-bool analyze_measurements();
-
-
-void setup() {
-    // initialize the M5Stack object
-    M5.begin();
-    // configure the Lcd display
-    M5.Lcd.setBrightness(100); //Brightness (0: Off - 255: Full)
-    M5.Lcd.setTextColor(TFT_WHITE);
-    M5.Lcd.setTextSize(1);
-    Clear_Screen();
-    // configure centered String output
-    M5.Lcd.setTextDatum(CC_DATUM);
-    M5.Lcd.setFreeFont(FF2);
-    M5.Lcd.drawString("Hotel room Finder", (int)(M5.Lcd.width()/2), (int)(M5.Lcd.height()/2), 1);
-    M5.Lcd.setFreeFont(FF1);
-    M5.Lcd.setTextColor(TFT_RED);
-    M5.Lcd.drawString("Version 1.1 | 05.06.2020", (int)(M5.Lcd.width()/2), (int)(M5.Lcd.height()/2)+50, 1);
-    // configure Top-Left oriented String output
-    M5.Lcd.setTextDatum(TL_DATUM);
-    M5.Lcd.setTextColor(TFT_WHITE);
-    // Start Menu
-    menu_state = 1;
-    print_menu(menu_state);
-}
-
-void loop() {
-  M5.update();
-
-  // left Button
-  if (M5.BtnA.wasPressed()){
-    switch (menu_state) {
-        case STATE_START: {   //  START -> MEASURE 
-            Clear_Screen();
-            menu_state = STATE_MEASURE;
-            print_menu(menu_state);
-            break;       
-        }
-        case STATE_MEASURE: {   //  MEASURE -> ADD
-            Clear_Screen();
-            M5.Lcd.println("Stand in front of the door\nand face the door.\n");
-            M5.Lcd.println("got to the LEFT and press (<)");
-            M5.Lcd.println("or to the RIGHT and press (>)");
-            measure_position = 0;
-            menu_state = STATE_GET_DATA;
-            print_menu(menu_state);
-            break;       
-        }
-        case STATE_GET_DATA: {   //  NEW -> < (-)
-            Clear_Screen();
-            ++measure_position;
-            M5.Lcd.printf("measure %i steps away\n", measure_position);
-            int n_WiFi_networks = collect_WiFi_data("/WiFi_data.txt");
-            if(n_WiFi_networks > 0)
-                M5.Lcd.printf("[OK] %i Networks found\n", n_WiFi_networks);
-            else
-                M5.Lcd.println("[ERR] unable to scan WiFi");
-            print_menu(menu_state);
-            break;       
-        }
-        case STATE_DATA: {   //  DATA -> DELETE
-            Clear_Screen();
-            M5.Lcd.println("Delete all measured data...");
-            if(SD.remove("/WiFi_data.txt"))
-              M5.Lcd.println("[OK] data deleted");
-            else
-              M5.Lcd.println("\n\n[ERR] unable to deleted data");
-            writeFile(SD, "/WiFi_data.txt","pos;n;name;id;RSSI");
-            measure_position = 0;
-            n_usable_APs = 0;
-            n_newx = 0;
-            min_pos = 99999;
-            max_pos = -99999;
-            print_menu(menu_state);
-            break;       
-        }
-        case STATE_RUN: {   //  RUN -> CHECK
-            // check my position
-            Clear_Screen();
-            M5.Lcd.setTextDatum(CC_DATUM);
-            M5.Lcd.setFreeFont(FF3); 
-            M5.Lcd.drawString("Let me check...", (int)(M5.Lcd.width()/2), (int)(M5.Lcd.height()/2), 1);
-            String pos_result = calculate_position();
-            Clear_Screen();
-            M5.Lcd.setTextDatum(CC_DATUM);
-            M5.Lcd.setFreeFont(FF4); 
-            M5.Lcd.drawString(pos_result.c_str(), (int)(M5.Lcd.width()/2), (int)(M5.Lcd.height()/2), 1);
-            print_menu(menu_state);
-            break;       
-        }
-    } 
-  }
-
-
-  // center Button
-  if (M5.BtnB.wasPressed()){
-    switch (menu_state) {
-        case STATE_START: {   //  START -> RUN 
-            Clear_Screen();
-            M5.Lcd.setTextDatum(TL_DATUM);
-            M5.Lcd.setFreeFont(FF1);
-            // load floor data from SD card
-            if(load_floor_data()) {
-                Clear_Screen();
-                M5.Lcd.println("\n\n      OK, ready to run");
-                menu_state = STATE_RUN;
-            } else
-                M5.Lcd.println("Failed to load data");   
-            print_menu(menu_state);
-            break;       
-        }
-        case STATE_MEASURE: {   //  MEASURE -> BACK
-            Clear_Screen();
-            menu_state = STATE_START;
-            print_menu(menu_state);
-            break;       
-        }
-        case STATE_GET_DATA: {   //  MEASURE -> DONE
-            Clear_Screen();
-            // analyze measured data
-            M5.Lcd.println("let's analyze the data");
-            if(analyze_measurements())
-                M5.Lcd.println("\n\n         OK, Success!");
-            else
-                M5.Lcd.println("\nSorry\nSomething went wrong.. :-(");
-            menu_state = STATE_START;
-            print_menu(menu_state);
-            break;       
-        }
-        case STATE_DATA: {   //  DATA -> BACK
-            Clear_Screen();
-            menu_state = STATE_START;
-            print_menu(menu_state);
-            break;       
-        }
-        case STATE_RUN: {   //  RUN -> DONE
-            Clear_Screen();
-            menu_state = STATE_START;
-            print_menu(menu_state);
-            break;       
-        }
-    } 
-  }
-
-  
-  // right Button
-  if (M5.BtnC.wasPressed()){
-    switch (menu_state) {
-        case 1: {   //  START -> DATA 
-            menu_state = STATE_DATA;
-            print_menu(menu_state);
-            break;       
-        }
-        case STATE_MEASURE: {   //  MEASURE -> NEW
-            Clear_Screen();
-            M5.Lcd.println("Delete all measured data...");
-            if(!SD.remove("/WiFi_data.txt"))
-              M5.Lcd.println("[ERR] unable to deleted data");
-            writeFile(SD, "/WiFi_data.txt","pos;n;name;id;RSSI");
-            M5.Lcd.println("\nReady for new measurements");
-            M5.Lcd.println("\nStand in front of the door\nand face the door.\n");
-            M5.Lcd.println("got to the LEFT and press (<)");
-            M5.Lcd.println("or to the RIGHT and press (>)");
-            measure_position = 0;
-            menu_state = STATE_GET_DATA;
-            print_menu(menu_state);
-            break;       
-        }
-        case STATE_GET_DATA: {   //  NEW ->  > (+)
-            Clear_Screen();
-            --measure_position;
-            M5.Lcd.printf("measure %i steps away\n", measure_position);
-            int n_WiFi_networks = collect_WiFi_data("/WiFi_data.txt");
-            if(n_WiFi_networks > 0)
-              M5.Lcd.printf("[OK] %i Networks found\n", n_WiFi_networks);
-            else
-              M5.Lcd.println("\n\n[ERR] unable to scan WiFi");
-            print_menu(menu_state);
-            break;       
-        }
-        case STATE_DATA: {   //  DATA -> INFO
-            Clear_Screen();
-            M5.Lcd.printf("Data Info:\n\n");
-            M5.Lcd.printf("usable APs: %i\n", n_usable_APs);
-            M5.Lcd.printf("min x pos: %.1f\n", min_pos);
-            M5.Lcd.printf("max x pos: %.1f\n", max_pos);
-            print_menu(menu_state);
-            break;       
-        }
-        case STATE_RUN: {   //  RUN -> Nothing
-            break;       
-        }
-    } 
-  }
-
-  delay(50);
-}
-
-//==============================================================
-// convert a RGB color into a LCD color value
-uint16_t RGB2Color(uint8_t r, uint8_t g, uint8_t b) {
-  return ((r / 8) << 11) | ((g / 4) << 5) | (b / 8);
-}
-
-//==============================================================
-// split() returns a substring out of a source string
-// defined by a delimiter and a location
-// inspired by:
-// http://wp.scalesoft.de/arduino-split/
-String split(String source, char delimiter, int location) {
-  String result = "";
-  int locationCount = 0;
-  int FromIndex = 0, ToIndex = -1;
-  while (location >= locationCount) {
-    FromIndex = ToIndex + 1;
-    ToIndex = source.indexOf(delimiter,FromIndex);
-    // if there is no delimiter anymore within the source string
-    if(ToIndex == -1){
-      // return the end of the string starting from the last delimiter
-      // if the actual location is the target location
-      if (location == locationCount) {
-        result = source.substring(FromIndex);
-      } else {
-        // if not, return a empty string
-        return "";
-      }
-    } else {
-      // if it is not the last delimiter, but the actual
-      // loacation is the target location, return the sub String
-      if (location == locationCount)
-        result = source.substring(FromIndex,ToIndex);
-    }
-    ++locationCount;
-  }
-  return result;
-}
-
-//==============================================================
-// Scan for WiFi networks and save the SSID, BSSID and RSSI
-// into a file on the SD card
-// fix file name: "pos_data.txt"
-uint8_t collect_WiFi_data(String filename, bool append){
-    File file;
-    if(append)
-      file = SD.open(filename.c_str(), FILE_APPEND);
-    else
-      file = SD.open(filename.c_str(), FILE_WRITE);
-    int n = WiFi.scanNetworks();
-    if (n == 0) {
-        M5.Lcd.println("[ERR] no networks found");
-    } else {
-        for (int i = 0; i < n; ++i) {
-            // Print SSID, BSSID and RSSI for each network found
-            file.printf("%i;%i;%s;%s;%i\n",measure_position , i+1, WiFi.SSID(i).c_str(), WiFi.BSSIDstr(i).c_str(), WiFi.RSSI(i));
-            delay(10);
-        }
-    }
-    file.close();
-    return n;
-}
-
-//==============================================================
-// Write Text into a file
-void writeFile(fs::FS &fs, const char * path, const char * message){
-    File file = fs.open(path, FILE_APPEND);
-    if(!file){
-        M5.Lcd.println("\n\n[ERR] Failed to open file");
-        return;
-    } else {
-        if(!file.println(message))
-            M5.Lcd.println("\n\n[ERR] Write failed");
-        file.close();
-    }
-} 
-
-
-//==============================================================
-// Print a small menu at the bottom of the display above the buttons
-void print_menu(int menu_index){
-    M5.Lcd.fillRect(0, M5.Lcd.height()-25, M5.Lcd.width(), 25, RGB2Color(50,50,50));
-    M5.Lcd.setCursor(0, 230);    
-    M5.Lcd.setFreeFont(FF1);
-    M5.Lcd.setTextColor(TFT_WHITE);
-    switch (menu_index) {
-      case 0: { // never used 
-        M5.Lcd.print("      -       -        - ");
-        break;       
-      }
-      case STATE_START: { // start menu
-        M5.Lcd.print("   MEASURE   RUN     DATA"); 
-        break;
-      }
-      case STATE_MEASURE: { // Submenu 1 for new Data collection  
-        M5.Lcd.print("     ADD    BACK      NEW ");
-        break;
-      }
-      case STATE_GET_DATA: { // Submenu 2 for new Data collection 
-        M5.Lcd.print("      <     DONE       > ");
-        break;
-      }
-      case STATE_DATA: { // DATA Submenu 
-        M5.Lcd.print("   DELETE    BACK     INFO"); 
-        break;
-      }
-      case STATE_RUN: { // RUN Submenu 
-        M5.Lcd.print("    CHECK   DONE         "); 
-        break;
-      }
-      default: { // should never been called
-        M5.Lcd.print("      -       -        - ");
-        break;
-      }
-    }
-}
-
-
-//==============================================================
-// Clear the entire screen and add one row
-// The added row is important. Otherwise the first row is not visible
-void Clear_Screen(){
-  M5.Lcd.fillScreen(BLACK);
-  M5.Lcd.setCursor(0, 0);
-  M5.Lcd.println("");
-}
-
-
-//==============================================================
-// loads a stored measurement of positions and BSSID, RSSI data
-// the data is used to learn the fits for each WiFi access point
-// fix file name: "WiFi_data.txt"
-bool load_measurement(String filename){
-  // reset min and max for new measurements
-  min_pos = 99999;
-  max_pos = -99999;
-  // reset all fits
-  // and set the tag to -1 = not learned
-  for(int i = 0; i < max_fits; ++i){
-    // init as fith order polynomial
-    fits[i].init(5);
-    fits[i].reset();
-    fits[i].tag = -1;
-  }
-  File file = SD.open("/WiFi_data.txt");
-  if(!file){
-      M5.Lcd.println("Failed to open file");
-  } else {
-      String line = "";
-      while(file.available()){
-        // file format:
-        // pos;n;name;id;RSSI
-        char chread = file.read();
-        // ASCII printable characters (character code 32-127)
-        if((chread >= 32) && (chread <= 127))
-          line = line + String(chread);
-        // CRLF = \r\n = ASCII code 13 and then ASCII code 10
-        if((chread == '\r' || chread == '\n') && (line.length() > 0)){
-          // get the BSSID at index 3
-          String BSSID = split(line, ';', 3);
-          // skip the header line
-          if(BSSID != "id"){
-            // get the position at index 0
-            double pos = split(line, ';', 0).toDouble();
-            if(pos > max_pos)
-              max_pos = pos;
-            if(pos < min_pos)
-              min_pos = pos;
-            // get the RSSI at index 4
-            double RSSI = split(line, ';', 4).toDouble();
-            int i = 0;
-            bool OK_Flag = false;
-            // check all fits if the BSSID exist
-            // then let this fit learn the new data pair
-            // otherwise, use the next unused fit for this BSSID
-            do {
-              if(fits[i].name == BSSID){
-                fits[i].learn(pos, RSSI);
-                OK_Flag = true;
-              }
-              if(fits[i].tag == -1){
-                fits[i].tag = i;
-                fits[i].name = BSSID;
-                Serial.print(i);
-                Serial.print(": ");
-                Serial.println(BSSID);
-                fits[i].learn(pos, RSSI);
-                OK_Flag = true;
-              }
-              if(++i == max_fits){
-                OK_Flag = true;
-              }
-            } while (!OK_Flag);
-          }
-          line = "";
-        }
-    }
-    file.close();
-    return true;
-  }
-  return false;
-}
-
-
-//==============================================================
-// loads a stored floor data from SD card
-// the data is used to find the room
-// fix file name: "floor_data.txt"
-bool load_floor_data(){
-// load floor data from file
-    M5.Lcd.printf("loading from file:\n  -->  /floor_data.txt\n");
-    File file = SD.open("/floor_data.txt");
-    if(!file){
-      return false;
-    } else {
-      // File format:
-      // n_newx
-      // n_usable_APs
-      // newx_array[0] ... newx_array[n_newx-1]
-      // BSSIDLT[0] ... BSSIDLT[n_usable_APs-1]
-      // IILTM[0] ... IILTM[((n_usable_APs-1)*n_newx)+(n_newx-1)]
-      String line = "";
-      int File_Block_index = 0;
-      // 0 = header information with array dimensions
-      // 1 = newx_array
-      // 2 = BSSIDLT
-      // 3 = IILTM
-      int line_count = 0;
-      while(file.available()){
-          char chread = file.read();
-          if(chread != '\n'){
-            line = line + String(chread);
-          } else {
-            switch (File_Block_index) {
-            // 0 = header information with array dimensions
-            case 0:
-              n_newx = split(line, ';', 0).toInt();
-              n_usable_APs = split(line, ';', 1).toInt();     
-              // free all daynamic arrays           
-              free(newx_array);
-              free(square_sum_array);
-              free(BSSIDLT);
-              free(IILTM);
-              M5.Lcd.printf("new_x array size: %i \n", n_newx);
-              M5.Lcd.printf("n_usable_APs: %i \n", n_usable_APs);
-              Serial.printf("new_x array size: %i \n", n_newx);
-              Serial.printf("n_usable_APs: %i \n", n_usable_APs);
-              // allocate all dynamic arrays with the dimensions from the file
-              newx_array = (double*) malloc(n_newx*sizeof(double));
-              square_sum_array = (double*) malloc(n_newx*sizeof(double));
-              BSSIDLT = (cstring*) malloc(n_usable_APs*sizeof(cstring));
-              IILTM = (double*) malloc(n_newx*n_usable_APs*sizeof(double));
-              // stop, if allocation fails
-              if(!newx_array || !square_sum_array || !IILTM || !BSSIDLT){
-                M5.Lcd.printf("[ERR] unable to allocate memory\n");
-                delay(5000);
-                // stop processing readed data from file
-                File_Block_index = -1;
-                file.close();
-                return false;
-              } else{
-                Serial.println("done: header!");
-                Serial.println("read newx_array data...");
-                File_Block_index = 1;
-              }
-              break;
-            
-            // 1 = newx_array data
-            case 1:
-              if(line != ""){
-                // read the new-x values line by line
-                newx_array[line_count++] = split(line, ';', 0).toDouble();
-                if(line_count == n_newx){
-                  Serial.println("done: read newx_array!");
-                  Serial.println("read BSSIDLT data...");
-                  File_Block_index = 2;
-                  line_count = 0;
-                }
-              }
-              break;
-              
-            // 2 = BSSIDLT data
-            case 2:
-              if(line != ""){
-                // read the BSSID values line by line
-                strcpy(BSSIDLT[line_count++], split(line, ';', 0).c_str());
-                if(line_count == n_usable_APs){
-                  Serial.println("done: read BSSIDLT!");
-                  Serial.println("read IILTM data...");
-                  File_Block_index = 3;
-                  line_count = 0;
-                }
-              }
-              break;
-              
-            // 3 = IILTM data
-            case 3:
-              if(line != ""){
-                // read the IILTM data
-                for(int i=0; i < n_usable_APs; ++i){
-                  IILTM[(i*n_newx)+line_count] = split(line, ';', i).toDouble();
-                }
-                ++line_count;
-                if(line_count == n_newx){
-                  Serial.println("done: read IILTM!");
-                  File_Block_index = -1;
-                  line_count = 0;
-                }
-              }
-              break;
-            
-            default:
-              break;
-            }
-            line = "";
-          }
-      }
-      file.close();
-    } 
-    return true; 
-}
-
-//==============================================================
-// scan fout times the available APS
-// Calculate the best fitting positon based on the IILTM
-// Return the number as text, or text if the position can't be calculated
-String calculate_position(){
-  String result = "...";
-  // scan APs and save to File "pos_data.txt"
-  // four times...
-  int n_WiFi_networks = collect_WiFi_data("/pos_data.txt", false);
-  collect_WiFi_data("/pos_data.txt");
-  collect_WiFi_data("/pos_data.txt");
-  collect_WiFi_data("/pos_data.txt");
-
-  // open the file and go throw all APs...
-  File file = SD.open("/pos_data.txt");
-  if(!file || n_newx == 0 || n_usable_APs == 0 || n_WiFi_networks == 0){
-    // without a file or without any APs, we are unable to find the room
-    return "No idea :-(";
-  } else {
-    // Because we scanned four times, we have to average the RSSI data
-    // This can be done with the fit-class ()
-    // reset all fits
-    // and set the tag to -1 = not learned
-    for(int i = 0; i < max_fits; ++i){
-      fits[i].init(0);
-      fits[i].reset();
-      fits[i].tag = -1;
-    }
-    String line = "";
-    while(file.available()){
-      char chread = file.read();
-      // ASCII printable characters (character code 32-127)
-      if((chread >= 32) && (chread <= 127))
-        line = line + String(chread);
-      // CRLF = \r\n = ASCII code 13 and then ASCII code 10
-      if((chread == '\r' || chread == '\n') && (line.length() > 0)){
-        // file format:
-        // pos;n;name;BSSID;RSSI
-        String BSSID = split(line, ';', 3);
-        // skip the header line
-        if(BSSID != "id"){
-          double RSSI = split(line, ';', 4).toDouble();
-          // find AP in BSSIDLT
-          int AP_index = -1;
-          for(int i = 0; i < n_usable_APs; ++i){
-            if(strcmp(BSSIDLT[i], BSSID.c_str()) == 0)
-              AP_index = i;
-          }
-          if(AP_index > -1){
-            fits[AP_index].learn(0.0, RSSI);
-            fits[AP_index].tag = AP_index;
-          }
-        }
-        line = "";
-      }
-    }
-    file.close();
-    // Now, the fits are filled with the average RSSI data from the APs
-    // Time to calculate the square sum array:
-    for(int x = 0; x < n_newx; ++x)
-      square_sum_array[x] = 0.0;
-    for(int AP_index = 0; AP_index < n_usable_APs; ++AP_index){
-      if(fits[AP_index].tag > -1){
-        for(int x = 0; x < n_newx; ++x){
-          // predict(0.0) will return the average value because 
-          // the fit is initialized with degree = 0
-          double RSSI_diff = (fits[AP_index].predict(0.0) - IILTM[(AP_index*n_newx)+x]);
-          square_sum_array[x] += (RSSI_diff*RSSI_diff);
-        }
-      }
-    }
-    // Finally find the minimum of the square sums:
-    double best_pos = newx_array[0];
-    double min_sum = square_sum_array[0];
-    for(int x = 0; x < n_newx; ++x){
-      if(square_sum_array[x] < min_sum){
-        min_sum = square_sum_array[x];
-        best_pos = newx_array[x];
-      }
-    }
-    // If best pos is the first or the last position of the new x array
-    // then we can say that we are far away, because we might don't know 
-    // the right value of the distance
-    if(best_pos == newx_array[0] || best_pos == newx_array[n_newx-1])
-      result = "far away...";
-    else
-      result = String(best_pos).c_str();
-  }
-  return result;
-}
-
-//==============================================================
-// load the measurements from SD card (file: /WiFi_data.txt)
-// build the new-x array, the BSSIDLT and the IILTM
-// return true if the procedure was succesfull
-bool analyze_measurements(){
-  bool result = false;
-  M5.Lcd.printf("Reading file:\n --> /WiFi_data.txt\n");
-  // load measured data from file and let the fits learn...
-  if(load_measurement("/WiFi_data.txt")){
-    M5.Lcd.printf("Analyze AP data\n");
-    // build new_x array....
-    // free the daynamic arrays
-    free(newx_array);
-    free(square_sum_array);
-    // get the position range out of the data
-    int x_range = round(max_pos - min_pos);
-    n_newx = x_range *2;
-    // allocate the memory for the array with the new size
-    newx_array = (double*) malloc(n_newx*sizeof(double));
-    square_sum_array = (double*) malloc(n_newx*sizeof(double));
-    // if the memory allocation failed
-    if(!newx_array || !square_sum_array)
-      return false;
-    else {
-      // fill the newx_array with the fine position steps
-      for(int i=0; i < n_newx; ++i){
-        newx_array[i] = min_pos + (i*((double)x_range / (double)n_newx));
-      }
-      // check for usable APs out of the fits
-      // criteria:
-      // at least 6 valid data points
-      //    --> fith order polynome should have at least 6 values
-      // estimated min and max y values should not be out of bounds [-25 .. -95]
-      // a minimum of 15dBm amplitude over the data range is required
-      n_usable_APs = 0;
-      for(int i = 0; i < max_fits; ++i){
-        // check all fits for criteria
-        double min_y = fits[i].estimate_min_y();
-        double max_y = fits[i].estimate_max_y();
-        if(fits[i].tag > -1){
-          if((fits[i].count() < 6) ||               
-              (min_y < -95.0) || (max_y > -25.0) ||  
-              (fabs(max_y - min_y) < 15)) {          
-                fits[i].reset();
-                fits[i].name = "";
-                fits[i].tag = -1;
-          }
-        }
-        if(fits[i].tag > -1){
-          Serial.printf("%i: N: %i min: %.2f max: %.2f\n", i, fits[i].count(), fits[i].estimate_min_y(), fits[i].estimate_max_y());
-          ++n_usable_APs;
-        }
-      }
-
-      // build Inverse Intensity Lookup Table Map (IILTM)
-      // ....
-      M5.Lcd.printf("Build IILTM and BSSIDLT\n");
-      Serial.println("Build the IILTM and the BSSIDLT:");
-      if(n_usable_APs > 0){
-        Serial.printf("number of usable APs: %i \n", n_usable_APs);
-        // free the daynamic arrays
-        free(IILTM);
-        free(BSSIDLT);
-        // allocate the memory for the array with the new size
-        BSSIDLT = (cstring*) malloc(n_usable_APs*sizeof(cstring));
-        IILTM = (double*) malloc(n_newx*n_usable_APs*sizeof(double));
-        // if the memory allocation failed
-        if(!IILTM || !BSSIDLT) {
-          Serial.println("[ERR] malloc failed");
-          return false;
-        } else {
-          int AP_count = 0;
-          for(int i = 0; i < max_fits; ++i){
-            //Serial.printf("check: %i: \n", i);
-            if(fits[i].tag > -1){
-              //Serial.printf("tag > -1 --> %i: %s\n", AP_count, fits[i].name.c_str());
-              strcpy(BSSIDLT[AP_count], fits[i].name.c_str());
-              for(int x = 0; x < n_newx; ++x){
-                // -95dBm for x values outside the learned range
-                IILTM[(AP_count*n_newx)+x] = fits[i].predict(newx_array[x], -95.0);
-              }
-              ++AP_count;
-            }
-          }
-        }
-      } else {
-        M5.Lcd.printf("no usable APs found!\n");
-        Serial.println("no usable APs found!");
-        return false;
-      }
-
-      Serial.println("the BSSIDLT:");
-      for(int i = 0; i < n_usable_APs; ++i){
-        Serial.printf("%i: %s\n", i, BSSIDLT[i]);
-      }
-
-      Serial.println("the IILTM:");
-      for(int x = 0; x < n_newx; ++x){
-        Serial.printf("\n%.2f", newx_array[x]);
-        for(int i = 0; i < n_usable_APs; ++i){
-          Serial.printf(" %.2f", IILTM[(i*n_newx)+x]);
-        }
-      }
-      // save floor data to file
-      M5.Lcd.printf("Writing to file:\n --> /floor_data.txt\n");
-      File file = SD.open("/floor_data.txt", FILE_WRITE);
-      if(!file){
-          M5.Lcd.println("Failed to open file");
-          return false;
-      } else {
-        // File format:
-        // n_newx
-        // n_usable_APs
-        // newx_array[0] ... newx_array[n_newx-1]
-        // BSSIDLT[0] ... BSSIDLT[n_usable_APs-1]
-        // IILTM[0] ... IILTM[((n_usable_APs-1)*n_newx)+(n_newx-1)]
-        // header with dimensions
-        file.printf("%i;%i\n",n_newx, n_usable_APs);
-        // save newx_array
-        for(int x=0; x < n_newx; ++x){
-          file.printf("%.6f\n",newx_array[x]);
-        }
-        // save BSSIDLT array
-        for(int i=0; i < n_usable_APs; ++i){
-          file.printf("%s\n",BSSIDLT[i]);
-        }
-        // save IILTM array
-        for(int x=0; x < n_newx; ++x){
-          file.printf("\n%.6f",IILTM[(0*n_newx)+x]);
-        for(int i=1; i < n_usable_APs; ++i){
-            file.printf(";%.6f",IILTM[(i*n_newx)+x]);
-          }
-        }
-        file.printf("\n");
-        file.close();
-      }
-
-      M5.Lcd.println("done..");
-      Serial.println("");
-      Serial.println("done!");
-    }
-    result = true;
-  }
-  return result;
-}
+/**************************************************************************
+ * WiFi based location system to find home.
+ * 
+ * A Indoor Positioning System based on WiFi RSSI data to return to the 
+ * right room of a hotel corridor. Maybe useless, but it works just fine!
+ * 
+ * Hague Nusseck @ electricidea
+ * v1.1 05.June.2020
+ * https://github.com/electricidea/M5Stack-Hotel-room-finder
+ * 
+ * Changelog:
+ * v1.1 = - first published version
+ * 
+ * Distributed as-is; no warranty is given.
+ * 
+ ***************************************************************************/
+#include <Arduino.h>
+
+#include <M5Stack.h>
+// install the library:
+// pio lib install "M5Stack"
+
+#include "WiFi.h"
+
+// Free Fonts for nice looking fonts on the screen
+#include "Free_Fonts.h"
+
+// library for liniear and nonlinear fits
+// of all access points in one memory block
+#include "fit_bank.h"
+// numeric types of the fits and the IILTM
+// (double, float or fixed point, see numeric_types.h)
+#include "numeric_types.h"
+// buffered reader for the survey files
+#include "survey_reader.h"
+// binary file and memory block of the grid, BSSIDLT and IILTM
+#include "floor_map.h"
+// WiFi scans (hardware or replay of recorded scans)
+#include "wifi_scanner.h"
+// continuous tracking of the position
+#include "position_tracker.h"
+// cell-major matching of the position check
+#include "fingerprint_matcher.h"
+// floor maps bigger than the memory, paged from the SD card
+#include "tiled_map.h"
+// selection of the APs of the floor map
+#include "ap_ranking.h"
+// parallel learning and building of the floor map
+#include "survey_pipeline.h"
+// position check directly on the polynomials of the fits
+#include "poly_map.h"
+
+// the WiFi scanner
+// -D SCANNER_REPLAY: replay the scans of the file "/replay_data.txt"
+#ifdef SCANNER_REPLAY
+replay_scanner scanner;
+#else
+hardware_scanner scanner;
+#endif
+// the results of one scan
+scan_result scan_results[scanner_max_results];
+// time per channel of the position scans
+// (only the channels of the APs of the floor map are scanned)
+const uint32_t position_dwell_ms = 120;
+
+// start capacity of the fits
+// (the fit bank grows, if more access points are found)
+const int initial_fits = 40;
+// only the most discriminative APs are used, at most max_map_APs
+// (the latency budget: the matching time per position grows with
+// the number of APs)
+// map_memory_budget doesn't limit the number of APs, a floor map
+// bigger than map_memory_budget bytes is saved as tiled map only
+// and paged from the SD card
+const int max_map_APs = 40;
+const size_t map_memory_budget = 48*1024;
+// weight of the older values of an access point with every new
+// value (1.0 = all values have the same weight, e.g. 0.98 to follow
+// a drifting radio map, build with -D SURVEY_FORGETTING_FACTOR=0.98)
+#ifndef SURVEY_FORGETTING_FACTOR
+#define SURVEY_FORGETTING_FACTOR 1.0
+#endif
+const double survey_forgetting_factor = SURVEY_FORGETTING_FACTOR;
+// the fits of all access points of the survey
+// each scan of the survey is learned online (ADD), the file
+// "/WiFi_data.txt" is only read again if the fits are not in sync
+// with it (e.g. after a restart)
+fit_bank fits;
+bool survey_synced = false;
+// the fits of the scans of a position check (average of the RSSI
+// values) or the index of the BSSIDs while tracking
+fit_bank check_fits;
+
+// position on the floor
+double min_pos = 99999;
+double max_pos = -99999;
+// the floor map: one memory block with the new-x array,
+// the BSSIDLT and the IILTM (see floor_map.cpp)
+floor_map floor_data;
+// array for the calculated x positions along the floor
+double *newx_array;
+int n_newx = 0;
+
+// the inverse intensity lookup table Map (cell-major)
+// one fingerprint of IILTM_stride values for each grid position
+map_scalar *IILTM;
+int IILTM_stride = 0;
+int n_usable_APs = 0;
+
+// the BSSID lookup table (packed 48 bit keys, see bssid_key.h)
+uint64_t *BSSIDLT;
+// the array for the square sums
+map_accum *square_sum_array;
+// the matching of the fingerprints for the check and the tracking
+// (uses the IILTM in place, the bound pyramid is built at the
+// first check)
+fingerprint_matcher matcher;
+// the result of the last check is the first candidate of the next one
+int check_best_x = 0;
+
+// the tiled floor map, if the floor map is too big for the memory
+// only the tiles around the position are read from the SD card
+// (the grid, the BSSIDs, the channels and the index of the tiles
+// stay in the memory, see tiled_map.cpp)
+tiled_map floor_tiles;
+File tiles_file;
+bool use_tiles = false;
+// memory of the tile cache
+const size_t tile_cache_bytes = 32768;
+// the WiFi channels of the APs
+uint8_t *AP_channels;
+
+// the coefficients of the fits (file "/floor_poly.bin")
+// -D POSITION_SOLVER_POLY: the position check solves the position
+// directly on the polynomials, without the grid of the IILTM
+poly_map floor_poly;
+bool use_poly = false;
+
+// state machine index to switch between the menu states
+int menu_state = 0;
+
+#define STATE_START 1
+#define STATE_MEASURE 2
+#define STATE_GET_DATA 3
+#define STATE_DATA 4
+#define STATE_RUN 5
+
+// value for the measurement along the floor
+int measure_position = 0;
+
+// number of WiFi scans for one position check
+const int position_scans = 4;
+// debug trace of the scans of a position check
+// written into "/pos_data.txt" after the result is shown
+const bool position_trace = false;
+String position_trace_text = "";
+
+// continuous tracking in the RUN menu
+// each scan updates the probability of each position
+position_tracker tracker;
+bool tracking = false;
+// movement between two scans in grid cells (1 cell = 0.5 steps)
+const float tracking_step_sigma = 2.0;
+// noise of the RSSI values in dBm
+const float tracking_rssi_sigma = 6.0;
+
+//==============================================================
+// function forward declaration
+uint16_t RGB2Color(uint8_t r, uint8_t g, uint8_t b);
+void writeFile(fs::FS &fs, const char * path, const char * message);
+void Clear_Screen();
+void print_menu(int menu_index);
+String split(String source, char delimiter, int location);
+int collect_WiFi_data(String filename, bool append = true);
+void report_dropped_networks();
+bool start_survey();
+void learn_survey_scan(int n);
+bool load_measurement(String filename);
+bool use_floor_map();
+bool use_tiled_map();
+void close_tiled_map();
+bool use_poly_map();
+bool load_poly_map();
+bool read_tiles_file(void *context, uint32_t offset, uint8_t *data, size_t size);
+bool build_tile_cells(void *context, int begin, int end, int stride, map_scalar *cells);
+bool build_tiled_map(int n_x, int x_range, int n_APs);
+bool save_poly_map();
+bool load_floor_data();
+bool import_floor_text();
+bool export_floor_text();
+String calculate_position();
+String position_text(int best_x);
+bool start_tracking();
+void stop_tracking();
+void track_position();
+void select_scan_channels(bool floor_map_channels);
+void write_position_trace();
+bool analyze_measurements();
+
+
+void setup() {
+    // initialize the M5Stack object
+    M5.begin();
+    // configure the Lcd display
+    M5.Lcd.setBrightness(100); //Brightness (0: Off - 255: Full)
+    M5.Lcd.setTextColor(TFT_WHITE);
+    M5.Lcd.setTextSize(1);
+    Clear_Screen();
+    // configure centered String output
+    M5.Lcd.setTextDatum(CC_DATUM);
+    M5.Lcd.setFreeFont(FF2);
+    M5.Lcd.drawString("Hotel room Finder", (int)(M5.Lcd.width()/2), (int)(M5.Lcd.height()/2), 1);
+    M5.Lcd.setFreeFont(FF1);
+    M5.Lcd.setTextColor(TFT_RED);
+    M5.Lcd.drawString("Version 1.1 | 05.06.2020", (int)(M5.Lcd.width()/2), (int)(M5.Lcd.height()/2)+50, 1);
+    // configure Top-Left oriented String output
+    M5.Lcd.setTextDatum(TL_DATUM);
+    M5.Lcd.setTextColor(TFT_WHITE);
+#ifdef SCANNER_REPLAY
+    File replay_file = SD.open("/replay_data.txt");
+    if(!replay_file || !scanner.load(replay_file))
+      Serial.println("[ERR] unable to load /replay_data.txt");
+    else
+      Serial.printf("replay of %i scans\n", scanner.scans());
+    replay_file.close();
+#endif
+    // Start Menu
+    menu_state = 1;
+    print_menu(menu_state);
+}
+
+void loop() {
+  M5.update();
+
+  // left Button
+  if (M5.BtnA.wasPressed()){
+    switch (menu_state) {
+        case STATE_START: {   //  START -> MEASURE 
+            Clear_Screen();
+            menu_state = STATE_MEASURE;
+            print_menu(menu_state);
+            break;       
+        }
+        case STATE_MEASURE: {   //  MEASURE -> ADD
+            Clear_Screen();
+            M5.Lcd.println("Stand in front of the door\nand face the door.\n");
+            M5.Lcd.println("got to the LEFT and press (<)");
+            M5.Lcd.println("or to the RIGHT and press (>)");
+            measure_position = 0;
+            menu_state = STATE_GET_DATA;
+            print_menu(menu_state);
+            break;       
+        }
+        case STATE_GET_DATA: {   //  NEW -> < (-)
+            Clear_Screen();
+            ++measure_position;
+            M5.Lcd.printf("measure %i steps away\n", measure_position);
+            int n_WiFi_networks = collect_WiFi_data("/WiFi_data.txt");
+            if(n_WiFi_networks > 0)
+                M5.Lcd.printf("[OK] %i Networks found\n", n_WiFi_networks);
+            else
+                M5.Lcd.println("[ERR] unable to scan WiFi");
+            print_menu(menu_state);
+            break;       
+        }
+        case STATE_DATA: {   //  DATA -> DELETE
+            Clear_Screen();
+            M5.Lcd.println("Delete all measured data...");
+            if(SD.remove("/WiFi_data.txt"))
+              M5.Lcd.println("[OK] data deleted");
+            else
+              M5.Lcd.println("\n\n[ERR] unable to deleted data");
+            writeFile(SD, "/WiFi_data.txt","pos;n;name;id;RSSI;channel");
+            measure_position = 0;
+            start_survey();
+            floor_data.release();
+            close_tiled_map();
+            floor_poly.release();
+            use_poly = false;
+            n_usable_APs = 0;
+            n_newx = 0;
+            print_menu(menu_state);
+            break;       
+        }
+        case STATE_RUN: {   //  RUN -> CHECK
+            // check my position
+            stop_tracking();
+            Clear_Screen();
+            M5.Lcd.setTextDatum(CC_DATUM);
+            M5.Lcd.setFreeFont(FF3); 
+            M5.Lcd.drawString("Let me check...", (int)(M5.Lcd.width()/2), (int)(M5.Lcd.height()/2), 1);
+            String pos_result = calculate_position();
+            Clear_Screen();
+            M5.Lcd.setTextDatum(CC_DATUM);
+            M5.Lcd.setFreeFont(FF4); 
+            M5.Lcd.drawString(pos_result.c_str(), (int)(M5.Lcd.width()/2), (int)(M5.Lcd.height()/2), 1);
+            print_menu(menu_state);
+            // the SD card is only used after the result is shown
+            write_position_trace();
+            break;       
+        }
+    } 
+  }
+
+
+  // center Button
+  if (M5.BtnB.wasPressed()){
+    switch (menu_state) {
+        case STATE_START: {   //  START -> RUN 
+            Clear_Screen();
+            M5.Lcd.setTextDatum(TL_DATUM);
+            M5.Lcd.setFreeFont(FF1);
+            // load floor data from SD card
+            if(load_floor_data()) {
+                Clear_Screen();
+                M5.Lcd.println("\n\n      OK, ready to run");
+                menu_state = STATE_RUN;
+            } else
+                M5.Lcd.println("Failed to load data");   
+            print_menu(menu_state);
+            break;       
+        }
+        case STATE_MEASURE: {   //  MEASURE -> BACK
+            Clear_Screen();
+            menu_state = STATE_START;
+            print_menu(menu_state);
+            break;       
+        }
+        case STATE_GET_DATA: {   //  MEASURE -> DONE
+            Clear_Screen();
+            // analyze measured data
+            M5.Lcd.println("let's analyze the data");
+            if(analyze_measurements())
+                M5.Lcd.println("\n\n         OK, Success!");
+            else
+                M5.Lcd.println("\nSorry\nSomething went wrong.. :-(");
+            menu_state = STATE_START;
+            print_menu(menu_state);
+            break;       
+        }
+        case STATE_DATA: {   //  DATA -> BACK
+            Clear_Screen();
+            menu_state = STATE_START;
+            print_menu(menu_state);
+            break;       
+        }
+        case STATE_RUN: {   //  RUN -> DONE
+            stop_tracking();
+            Clear_Screen();
+            menu_state = STATE_START;
+            print_menu(menu_state);
+            break;       
+        }
+    } 
+  }
+
+  
+  // right Button
+  if (M5.BtnC.wasPressed()){
+    switch (menu_state) {
+        case 1: {   //  START -> DATA 
+            menu_state = STATE_DATA;
+            print_menu(menu_state);
+            break;       
+        }
+        case STATE_MEASURE: {   //  MEASURE -> NEW
+            Clear_Screen();
+            M5.Lcd.println("Delete all measured data...");
+            if(!SD.remove("/WiFi_data.txt"))
+              M5.Lcd.println("[ERR] unable to deleted data");
+            writeFile(SD, "/WiFi_data.txt","pos;n;name;id;RSSI;channel");
+            if(!start_survey())
+              M5.Lcd.println("[ERR] unable to allocate memory");
+            M5.Lcd.println("\nReady for new measurements");
+            M5.Lcd.println("\nStand in front of the door\nand face the door.\n");
+            M5.Lcd.println("got to the LEFT and press (<)");
+            M5.Lcd.println("or to the RIGHT and press (>)");
+            measure_position = 0;
+            menu_state = STATE_GET_DATA;
+            print_menu(menu_state);
+            break;       
+        }
+        case STATE_GET_DATA: {   //  NEW ->  > (+)
+            Clear_Screen();
+            --measure_position;
+            M5.Lcd.printf("measure %i steps away\n", measure_position);
+            int n_WiFi_networks = collect_WiFi_data("/WiFi_data.txt");
+            if(n_WiFi_networks > 0)
+              M5.Lcd.printf("[OK] %i Networks found\n", n_WiFi_networks);
+            else
+              M5.Lcd.println("\n\n[ERR] unable to scan WiFi");
+            print_menu(menu_state);
+            break;       
+        }
+        case STATE_DATA: {   //  DATA -> INFO
+            Clear_Screen();
+            M5.Lcd.printf("Data Info:\n\n");
+            M5.Lcd.printf("usable APs: %i\n", n_usable_APs);
+            M5.Lcd.printf("min x pos: %.1f\n", min_pos);
+            M5.Lcd.printf("max x pos: %.1f\n", max_pos);
+            M5.Lcd.printf("fit memory: %u bytes\n", (unsigned) fits.memory_bytes());
+            if(use_poly)
+              M5.Lcd.printf("map memory: %u bytes (polynomials)\n", (unsigned) floor_poly.memory_bytes());
+            else if(use_tiles)
+              M5.Lcd.printf("map memory: %u bytes (%u tiles)\n", (unsigned) floor_tiles.memory_bytes(), floor_tiles.tiles());
+            else
+              M5.Lcd.printf("map memory: %u bytes\n", (unsigned) floor_data.memory_bytes());
+            print_menu(menu_state);
+            break;       
+        }
+        case STATE_RUN: {   //  RUN -> TRACK (on/off)
+            Clear_Screen();
+            M5.Lcd.setTextDatum(CC_DATUM);
+            M5.Lcd.setFreeFont(FF3); 
+            if(tracking){
+              stop_tracking();
+              M5.Lcd.drawString("tracking off", (int)(M5.Lcd.width()/2), (int)(M5.Lcd.height()/2), 1);
+            } else if(start_tracking()){
+              M5.Lcd.drawString("tracking...", (int)(M5.Lcd.width()/2), (int)(M5.Lcd.height()/2), 1);
+            } else {
+              M5.Lcd.drawString("No idea :-(", (int)(M5.Lcd.width()/2), (int)(M5.Lcd.height()/2), 1);
+            }
+            print_menu(menu_state);
+            break;       
+        }
+    } 
+  }
+
+  // continuous tracking: process finished scans in the background
+  if(tracking)
+    track_position();
+
+  delay(50);
+}
+
+//==============================================================
+// convert a RGB color into a LCD color value
+uint16_t RGB2Color(uint8_t r, uint8_t g, uint8_t b) {
+  return ((r / 8) << 11) | ((g / 4) << 5) | (b / 8);
+}
+
+//==============================================================
+// split() returns a substring out of a source string
+// defined by a delimiter and a location
+// inspired by:
+// http://wp.scalesoft.de/arduino-split/
+String split(String source, char delimiter, int location) {
+  String result = "";
+  int locationCount = 0;
+  int FromIndex = 0, ToIndex = -1;
+  while (location >= locationCount) {
+    FromIndex = ToIndex + 1;
+    ToIndex = source.indexOf(delimiter,FromIndex);
+    // if there is no delimiter anymore within the source string
+    if(ToIndex == -1){
+      // return the end of the string starting from the last delimiter
+      // if the actual location is the target location
+      if (location == locationCount) {
+        result = source.substring(FromIndex);
+      } else {
+        // if not, return a empty string
+        return "";
+      }
+    } else {
+      // if it is not the last delimiter, but the actual
+      // loacation is the target location, return the sub String
+      if (location == locationCount)
+        result = source.substring(FromIndex,ToIndex);
+    }
+    ++locationCount;
+  }
+  return result;
+}
+
+//==============================================================
+// Scan for WiFi networks and save the SSID, BSSID and RSSI
+// into a file on the SD card
+// fix file name: "pos_data.txt"
+int collect_WiFi_data(String filename, bool append){
+    File file;
+    if(append)
+      file = SD.open(filename.c_str(), FILE_APPEND);
+    else
+      file = SD.open(filename.c_str(), FILE_WRITE);
+    // the fits are only in sync, if the scan is in the file
+    if(!file)
+      survey_synced = false;
+    // the survey scans all channels
+    select_scan_channels(false);
+    int n = scanner.scan(scan_results, scanner_max_results);
+    report_dropped_networks();
+    if(scanner.dropped() > 0)
+        M5.Lcd.printf("[WARN] %i weak networks dropped\n", scanner.dropped());
+    if (n <= 0) {
+        M5.Lcd.println("[ERR] no networks found");
+        n = 0;
+    } else {
+        char BSSID[bssid_text_size];
+        for (int i = 0; i < n; ++i) {
+            // Print SSID, BSSID and RSSI for each network found
+            bssid_format(scan_results[i].bssid, BSSID);
+            file.printf("%i;%i;%s;%s;%i;%i\n",measure_position , i+1, scan_results[i].ssid, BSSID, scan_results[i].rssi, scan_results[i].channel);
+        }
+        // the file is the audit trail, the fits learn the scan now
+        learn_survey_scan(n);
+    }
+    file.close();
+    return n;
+}
+
+//==============================================================
+// report the networks of the last scan, that were dropped
+// because there were more than scanner_max_results networks
+// (the strongest networks are kept)
+void report_dropped_networks(){
+    if(scanner.dropped() > 0)
+        Serial.printf("[WARN] scan: %i weak networks dropped (SCANNER_MAX_RESULTS %i)\n",
+                      scanner.dropped(), scanner_max_results);
+}
+
+//==============================================================
+// start a new survey with empty fits
+// return false if the memory allocation failed
+bool start_survey(){
+  min_pos = 99999;
+  max_pos = -99999;
+  // init as fith order polynomials
+  survey_synced = fits.init(initial_fits, 5);
+  fits.set_forgetting_factor(survey_forgetting_factor);
+  return survey_synced;
+}
+
+//==============================================================
+// learn the networks of one survey scan (scan_results[0..n-1])
+// at the measure_position
+// same values and order as a read of the file: the fits are the
+// same, bit for bit, as the fits out of load_measurement()
+void learn_survey_scan(int n){
+  if(!survey_synced)
+    return;
+  if(measure_position > max_pos)
+    max_pos = measure_position;
+  if(measure_position < min_pos)
+    min_pos = measure_position;
+  int APs[scanner_max_results];
+  fit_scalar RSSI[scanner_max_results];
+  int n_APs = 0;
+  for(int i = 0; i < n; ++i){
+    int AP_index = fits.add(scan_results[i].bssid);
+    if(AP_index < 0){
+      // no memory for a new fit: the file is read again for the map
+      Serial.println("[ERR] unable to allocate memory, fits not in sync");
+      survey_synced = false;
+      return;
+    }
+    if(scan_results[i].channel > 0)
+      fits.set_channel(AP_index, scan_results[i].channel);
+    APs[n_APs] = AP_index;
+    RSSI[n_APs] = scan_results[i].rssi;
+    ++n_APs;
+  }
+  fits.learn_scan(measure_position, APs, RSSI, n_APs);
+}
+
+//==============================================================
+// Write Text into a file
+void writeFile(fs::FS &fs, const char * path, const char * message){
+    File file = fs.open(path, FILE_APPEND);
+    if(!file){
+        M5.Lcd.println("\n\n[ERR] Failed to open file");
+        return;
+    } else {
+        if(!file.println(message))
+            M5.Lcd.println("\n\n[ERR] Write failed");
+        file.close();
+    }
+} 
+
+
+//==============================================================
+// Print a small menu at the bottom of the display above the buttons
+void print_menu(int menu_index){
+    M5.Lcd.fillRect(0, M5.Lcd.height()-25, M5.Lcd.width(), 25, RGB2Color(50,50,50));
+    M5.Lcd.setCursor(0, 230);    
+    M5.Lcd.setFreeFont(FF1);
+    M5.Lcd.setTextColor(TFT_WHITE);
+    switch (menu_index) {
+      case 0: { // never used 
+        M5.Lcd.print("      -       -        - ");
+        break;       
+      }
+      case STATE_START: { // start menu
+        M5.Lcd.print("   MEASURE   RUN     DATA"); 
+        break;
+      }
+      case STATE_MEASURE: { // Submenu 1 for new Data collection  
+        M5.Lcd.print("     ADD    BACK      NEW ");
+        break;
+      }
+      case STATE_GET_DATA: { // Submenu 2 for new Data collection 
+        M5.Lcd.print("      <     DONE       > ");
+        break;
+      }
+      case STATE_DATA: { // DATA Submenu 
+        M5.Lcd.print("   DELETE    BACK     INFO"); 
+        break;
+      }
+      case STATE_RUN: { // RUN Submenu 
+        M5.Lcd.print("    CHECK   DONE    TRACK"); 
+        break;
+      }
+      default: { // should never been called
+        M5.Lcd.print("      -       -        - ");
+        break;
+      }
+    }
+}
+
+
+//==============================================================
+// Clear the entire screen and add one row
+// The added row is important. Otherwise the first row is not visible
+void Clear_Screen(){
+  M5.Lcd.fillScreen(BLACK);
+  M5.Lcd.setCursor(0, 0);
+  M5.Lcd.println("");
+}
+
+
+//==============================================================
+// loads a stored measurement of positions and BSSID, RSSI data
+// the data is used to learn the fits for each WiFi access point
+// file name: e.g. "/WiFi_data.txt"
+bool load_measurement(String filename){
+  // reset all fits
+  if(!start_survey()){
+    M5.Lcd.println("[ERR] unable to allocate memory");
+    return false;
+  }
+  survey_synced = false;
+  File file = SD.open(filename.c_str());
+  if(!file){
+      M5.Lcd.println("Failed to open file");
+  } else {
+    // file format:
+    // pos;n;name;id;RSSI;channel
+    // the file is parsed while the fits learn in parallel
+    survey_pipeline pipeline(fits);
+    bool learned = pipeline.learn(file);
+    file.close();
+    min_pos = pipeline.min_pos();
+    max_pos = pipeline.max_pos();
+    Serial.printf("%u records, %u lines skipped, %u batches\n", pipeline.records(),
+                  pipeline.skipped(), pipeline.batches());
+    if(!learned){
+      M5.Lcd.println("[ERR] unable to allocate memory");
+      return false;
+    }
+    survey_synced = true;
+    // the APs of the survey
+    char BSSID[bssid_text_size];
+    for(int i = 0; i < fits.capacity(); ++i){
+      if(fits.used(i)){
+        bssid_format(fits.bssid(i), BSSID);
+        Serial.printf("%i: %s\n", i, BSSID);
+      }
+    }
+    return true;
+  }
+  return false;
+}
+
+
+//==============================================================
+// use the arrays of the floor map
+// the dimensions and the pointers of the arrays are set
+// and the square sum array is allocated
+// return false if the memory allocation failed
+bool use_floor_map(){
+  close_tiled_map();
+  floor_poly.release();
+  use_poly = false;
+  n_newx = floor_data.n_x();
+  n_usable_APs = floor_data.n_aps();
+  IILTM_stride = floor_data.stride();
+  newx_array = floor_data.x();
+  BSSIDLT = floor_data.bssids();
+  AP_channels = floor_data.channels();
+  IILTM = floor_data.values();
+  matcher.release();
+  check_best_x = n_newx/2;
+  free(square_sum_array);
+  square_sum_array = (map_accum*) malloc(n_newx*sizeof(map_accum));
+  return square_sum_array != NULL;
+}
+
+//==============================================================
+// use the opened tiled floor map
+// the IILTM stays on the SD card: no tracking (needs the square
+// sums of all positions), the check searches the tiles
+bool use_tiled_map(){
+  floor_data.release();
+  floor_poly.release();
+  use_poly = false;
+  matcher.release();
+  free(square_sum_array);
+  square_sum_array = NULL;
+  n_newx = floor_tiles.n_x();
+  n_usable_APs = floor_tiles.n_aps();
+  IILTM_stride = 0;
+  newx_array = floor_tiles.x();
+  BSSIDLT = floor_tiles.bssids();
+  AP_channels = floor_tiles.channels();
+  IILTM = NULL;
+  check_best_x = n_newx/2;
+  use_tiles = true;
+  return true;
+}
+
+//==============================================================
+// close the tiled floor map and its file
+void close_tiled_map(){
+  floor_tiles.release();
+  if(tiles_file)
+    tiles_file.close();
+  use_tiles = false;
+}
+
+//==============================================================
+// use the polynomial map (floor_poly)
+// there is no grid: no IILTM, no tracking, the check solves the
+// position directly on the polynomials
+bool use_poly_map(){
+  close_tiled_map();
+  floor_data.release();
+  matcher.release();
+  free(square_sum_array);
+  square_sum_array = NULL;
+  n_newx = 0;
+  n_usable_APs = floor_poly.n_aps();
+  IILTM_stride = 0;
+  newx_array = NULL;
+  BSSIDLT = floor_poly.bssids();
+  AP_channels = floor_poly.channels();
+  IILTM = NULL;
+  use_poly = true;
+  return true;
+}
+
+//==============================================================
+// load the polynomial map "/floor_poly.bin" and use it
+// return false if there is no valid file
+bool load_poly_map(){
+  M5.Lcd.printf("loading from file:\n  -->  /floor_poly.bin\n");
+  File file = SD.open("/floor_poly.bin");
+  bool loaded = false;
+  if(file){
+    loaded = floor_poly.load(file);
+    file.close();
+  }
+  if(!loaded){
+    Serial.println("no valid /floor_poly.bin");
+    return false;
+  }
+  use_poly_map();
+  M5.Lcd.printf("n_usable_APs: %i \n", n_usable_APs);
+  Serial.printf("polynomial map: %i APs, %u bytes\n", n_usable_APs, (unsigned) floor_poly.memory_bytes());
+  return true;
+}
+
+//==============================================================
+// random access to the file of the tiled floor map
+bool read_tiles_file(void *context, uint32_t offset, uint8_t *data, size_t size){
+  File *file = (File*) context;
+  return file->seek(offset) && file->read(data, size) == size;
+}
+
+//==============================================================
+// loads a stored floor data from SD card
+// the data is used to find the room
+// fix file name: "floor_map.bin"
+// the tiled map "floor_tiles.bin" is used, if there is no valid
+// floor map (the analysis writes the tiled map instead of the
+// floor map for floors over map_memory_budget)
+// the text file "floor_data.txt" is imported, if there is
+// no valid binary file
+// -D POSITION_SOLVER_POLY: "floor_poly.bin" is loaded first
+bool load_floor_data(){
+#ifdef POSITION_SOLVER_POLY
+    if(load_poly_map())
+      return true;
+#endif
+    M5.Lcd.printf("loading from file:\n  -->  /floor_map.bin\n");
+    unsigned long start_time = millis();
+    File file = SD.open("/floor_map.bin");
+    bool loaded = false;
+    if(file){
+      // one read for the whole map
+      loaded = floor_data.load(file);
+      file.close();
+    }
+    if(!loaded){
+      Serial.println("no valid /floor_map.bin, open /floor_tiles.bin");
+      close_tiled_map();
+      tiles_file = SD.open("/floor_tiles.bin");
+      if(tiles_file && floor_tiles.open(read_tiles_file, &tiles_file, tile_cache_bytes)){
+        use_tiled_map();
+        M5.Lcd.printf("tiled map: %u tiles, %i in memory\n", floor_tiles.tiles(), floor_tiles.cache_tiles());
+        Serial.printf("tiled map: %u tiles, %i in memory, %u bytes\n", floor_tiles.tiles(),
+                      floor_tiles.cache_tiles(), (unsigned) floor_tiles.memory_bytes());
+        Serial.printf("floor map loaded after %lu ms\n", millis() - start_time);
+        return true;
+      }
+      close_tiled_map();
+      Serial.println("no valid /floor_tiles.bin, import /floor_data.txt");
+      if(!import_floor_text())
+        return false;
+    }
+    if(!use_floor_map()){
+      M5.Lcd.printf("[ERR] unable to allocate memory\n");
+      return false;
+    }
+    M5.Lcd.printf("new_x array size: %i \n", n_newx);
+    M5.Lcd.printf("n_usable_APs: %i \n", n_usable_APs);
+    Serial.printf("new_x array size: %i \n", n_newx);
+    Serial.printf("n_usable_APs: %i \n", n_usable_APs);
+    Serial.printf("floor map loaded after %lu ms\n", millis() - start_time);
+    return true;
+}
+
+//==============================================================
+// import the floor data from the text file "floor_data.txt"
+// into the floor map
+bool import_floor_text(){
+    M5.Lcd.printf("loading from file:\n  -->  /floor_data.txt\n");
+    File file = SD.open("/floor_data.txt");
+    if(!file){
+      return false;
+    } else {
+      // File format:
+      // n_newx
+      // n_usable_APs
+      // newx_array[0] ... newx_array[n_newx-1]
+      // BSSIDLT[0];channel ... BSSIDLT[n_usable_APs-1];channel
+      // IILTM[0] ... IILTM[((n_usable_APs-1)*n_newx)+(n_newx-1)]
+      String line = "";
+      int File_Block_index = 0;
+      // 0 = header information with array dimensions
+      // 1 = newx_array
+      // 2 = BSSIDLT
+      // 3 = IILTM
+      int line_count = 0;
+      int n_x = 0;
+      int n_APs = 0;
+      while(file.available()){
+          char chread = file.read();
+          if(chread != '\n'){
+            line = line + String(chread);
+          } else {
+            switch (File_Block_index) {
+            // 0 = header information with array dimensions
+            case 0:
+              n_x = split(line, ';', 0).toInt();
+              n_APs = split(line, ';', 1).toInt();     
+              // allocate the floor map with the dimensions from the file
+              // stop, if allocation fails
+              if(!floor_data.init(n_x, n_APs)){
+                M5.Lcd.printf("[ERR] unable to allocate memory\n");
+                delay(5000);
+                // stop processing readed data from file
+                File_Block_index = -1;
+                file.close();
+                return false;
+              } else{
+                Serial.println("done: header!");
+                Serial.println("read newx_array data...");
+                File_Block_index = 1;
+              }
+              break;
+            
+            // 1 = newx_array data
+            case 1:
+              if(line != ""){
+                // read the new-x values line by line
+                floor_data.x()[line_count++] = split(line, ';', 0).toDouble();
+                if(line_count == n_x){
+                  Serial.println("done: read newx_array!");
+                  Serial.println("read BSSIDLT data...");
+                  File_Block_index = 2;
+                  line_count = 0;
+                }
+              }
+              break;
+              
+            // 2 = BSSIDLT data
+            case 2:
+              if(line != ""){
+                // read the BSSID values (and channels) line by line
+                floor_data.bssids()[line_count] = bssid_parse(split(line, ';', 0).c_str());
+                floor_data.channels()[line_count++] = split(line, ';', 1).toInt();
+                if(line_count == n_APs){
+                  Serial.println("done: read BSSIDLT!");
+                  Serial.println("read IILTM data...");
+                  File_Block_index = 3;
+                  line_count = 0;
+                }
+              }
+              break;
+              
+            // 3 = IILTM data
+            case 3:
+              if(line != "" && line_count < n_x){
+                // read the IILTM data
+                // one pass over the line: strtod() returns the end of each value
+                const char *value = line.c_str();
+                for(int i=0; i < n_APs; ++i){
+                  char *end;
+                  floor_data.cell(line_count)[i] = map_encode(strtod(value, &end));
+                  value = (*end == ';') ? end + 1 : end;
+                }
+                ++line_count;
+                if(line_count == n_x){
+                  Serial.println("done: read IILTM!");
+                  File_Block_index = -1;
+                  line_count = 0;
+                }
+              }
+              break;
+            
+            default:
+              break;
+            }
+            line = "";
+          }
+      }
+      file.close();
+    } 
+    return true; 
+}
+
+//==============================================================
+// scan four times the available APS
+// Calculate the best fitting positon based on the IILTM
+// Return the number as text, or text if the position can't be calculated
+String calculate_position(){
+  String result = "...";
+  if((n_newx == 0 && !use_poly) || n_usable_APs == 0){
+    // without any APs, we are unable to find the room
+    return "No idea :-(";
+  } else {
+    // the latency of the check is reported on the Serial monitor
+    unsigned long start_time = millis();
+    // Because we scan four times, we have to average the RSSI data
+    // This can be done with the fits of degree = 0
+    // One fit for each AP of the BSSIDLT with the same index
+    if(!check_fits.init(n_usable_APs, 0))
+      return "No memory :-(";
+    for(int i = 0; i < n_usable_APs; ++i)
+      check_fits.add(BSSIDLT[i]);
+    if(!use_tiles && !use_poly && matcher.cells() == 0 && !matcher.init(IILTM, n_newx, n_usable_APs, IILTM_stride))
+      return "No memory :-(";
+    // scan only the channels of the APs of the floor map
+    select_scan_channels(true);
+    // the scans are pipelined: the next scan runs in the background
+    // while the results of the last scan are learned
+    int n_WiFi_networks = 0;
+    unsigned long learn_time = 0;
+    position_trace_text = "";
+    bool scanning = scanner.start();
+    for(int scan = 0; scan < position_scans && scanning; ++scan){
+      int n;
+      while((n = scanner.complete()) == scanner_running)
+        delay(10);
+      if(n > 0){
+        n = scanner.take(scan_results, scanner_max_results);
+        report_dropped_networks();
+      }
+      if(scan+1 < position_scans)
+        scanning = scanner.start();
+      unsigned long learn_start = millis();
+      for(int i = 0; i < n; ++i){
+        int AP_index = check_fits.find(scan_results[i].bssid);
+        if(AP_index > -1)
+          check_fits.learn(AP_index, 0.0, scan_results[i].rssi);
+        if(position_trace){
+          char BSSID[bssid_text_size];
+          char trace_line[128];
+          bssid_format(scan_results[i].bssid, BSSID);
+          snprintf(trace_line, sizeof(trace_line), "%i;%i;%s;%s;%i;%i\n", measure_position, i+1,
+                   scan_results[i].ssid, BSSID, scan_results[i].rssi, scan_results[i].channel);
+          position_trace_text += trace_line;
+        }
+      }
+      learn_time += millis() - learn_start;
+      if(n > 0)
+        n_WiFi_networks += n;
+    }
+    unsigned long scan_time = millis();
+    if(n_WiFi_networks == 0)
+      return "No idea :-(";
+    // Now, the fits are filled with the average RSSI data from the APs
+    // Time to find the position with the smallest square sum:
+    if(use_poly)
+      floor_poly.clear_query();
+    else if(use_tiles)
+      floor_tiles.clear_query();
+    else
+      matcher.clear_query();
+    for(int AP_index = 0; AP_index < n_usable_APs; ++AP_index){
+      if(check_fits.count(AP_index) > 0){
+        // predict(0.0) will return the average value because 
+        // the fit is initialized with degree = 0
+        if(use_poly){
+          floor_poly.set_rssi(AP_index, check_fits.predict(AP_index, 0.0));
+          continue;
+        }
+        map_scalar RSSI_mean = map_encode(check_fits.predict(AP_index, 0.0));
+        if(use_tiles)
+          floor_tiles.set_rssi(AP_index, RSSI_mean);
+        else
+          matcher.set_rssi(AP_index, RSSI_mean);
+      }
+    }
+    unsigned long match_start = micros();
+    if(use_poly){
+      // continuous position out of the polynomials
+      double pos = floor_poly.solve(NULL);
+      unsigned long match_time = micros() - match_start;
+      Serial.printf("CHECK: %i scans %lu ms (learning %lu ms), solving %lu us (%i segments)\n", position_scans,
+                    scan_time - start_time, learn_time, match_time, floor_poly.segments());
+      // at the borders of the floor, we might don't know the right distance
+      if(pos <= floor_poly.min_x() || pos >= floor_poly.max_x())
+        return "far away...";
+      return String(pos).c_str();
+    }
+    int best_x;
+    if(use_tiles){
+      // the tiles of the search are read from the SD card
+      floor_tiles.reset_counters();
+      best_x = floor_tiles.match(check_best_x, NULL);
+      if(best_x < 0)
+        return "SD error :-(";
+    } else {
+      best_x = matcher.match(check_best_x, NULL);
+    }
+    unsigned long match_time = micros() - match_start;
+    check_best_x = best_x;
+    result = position_text(best_x);
+    Serial.printf("CHECK: %i scans %lu ms (learning %lu ms), matching %lu us", position_scans,
+                  scan_time - start_time, learn_time, match_time);
+    if(use_tiles)
+      Serial.printf(" (%i of %u tiles, %u cache hits, %u page-ins in %u us)\n", floor_tiles.searched(),
+                    floor_tiles.tiles(), floor_tiles.hits(), floor_tiles.misses(), floor_tiles.page_in_us());
+    else
+      Serial.printf(" (%i of %i cells calculated)\n", matcher.evaluated(), n_newx);
+  }
+  return result;
+}
+
+//==============================================================
+// the text of the position at newx_array[best_x]
+String position_text(int best_x){
+  // If best pos is the first or the last position of the new x array
+  // then we can say that we are far away, because we might don't know 
+  // the right value of the distance
+  if(best_x == 0 || best_x == n_newx-1)
+    return "far away...";
+  else
+    return String(newx_array[best_x]).c_str();
+}
+
+//==============================================================
+// start the continuous tracking
+// the first scan is started in the background
+// return false without floor map or memory
+bool start_tracking(){
+  // the tracking needs the whole IILTM in the memory
+  if(n_newx == 0 || n_usable_APs == 0 || use_tiles)
+    return false;
+  // the fits are only used to find the index of a BSSID
+  if(!check_fits.init(n_usable_APs, 0) || !tracker.init(n_newx, tracking_step_sigma, tracking_rssi_sigma))
+    return false;
+  if(matcher.cells() == 0 && !matcher.init(IILTM, n_newx, n_usable_APs, IILTM_stride))
+    return false;
+  for(int i = 0; i < n_usable_APs; ++i)
+    check_fits.add(BSSIDLT[i]);
+  select_scan_channels(true);
+  tracking = scanner.start();
+  return tracking;
+}
+
+//==============================================================
+// stop the continuous tracking
+// a running scan is finished and the results are dropped
+void stop_tracking(){
+  if(!tracking)
+    return;
+  tracking = false;
+  while(scanner.complete() == scanner_running)
+    delay(10);
+  scanner.take(scan_results, scanner_max_results);
+}
+
+//==============================================================
+// update the tracker with a finished scan and show the position
+// the next scan is started before the scan is processed
+void track_position(){
+  int n = scanner.complete();
+  if(n == scanner_running)
+    return;
+  if(n > 0){
+    n = scanner.take(scan_results, scanner_max_results);
+    report_dropped_networks();
+  }
+  scanner.start();
+  unsigned long start_time = micros();
+  // square sums of this single scan
+  matcher.clear_query();
+  int n_matched = 0;
+  for(int i = 0; i < n; ++i){
+    int AP_index = check_fits.find(scan_results[i].bssid);
+    if(AP_index > -1){
+      matcher.set_rssi(AP_index, map_encode(scan_results[i].rssi));
+      ++n_matched;
+    }
+  }
+  if(n_matched == 0)
+    return;
+  matcher.square_sums(square_sum_array);
+  tracker.update(square_sum_array);
+  int best_x = tracker.best();
+  Serial.printf("TRACK: %i APs, %i grid cells, update %lu us, p = %.2f\n", n_matched, n_newx,
+                micros() - start_time, tracker.probability(best_x));
+  Clear_Screen();
+  M5.Lcd.setTextDatum(CC_DATUM);
+  M5.Lcd.setFreeFont(FF4); 
+  M5.Lcd.drawString(position_text(best_x).c_str(), (int)(M5.Lcd.width()/2), (int)(M5.Lcd.height()/2), 1);
+  print_menu(menu_state);
+}
+
+//==============================================================
+// select the channels of the next scans
+// floor_map_channels = true: only the channels of the APs of the
+// floor map with position_dwell_ms per channel
+// otherwise (or if a channel is unknown): all channels
+void select_scan_channels(bool floor_map_channels){
+  uint8_t channels[scanner_max_channels];
+  int n_channels = 0;
+  if(floor_map_channels){
+    for(int i = 0; i < n_usable_APs; ++i){
+      uint8_t channel = AP_channels[i];
+      if(channel == 0){
+        // unknown channel (map of an old survey)
+        n_channels = 0;
+        break;
+      }
+      bool found = false;
+      for(int c = 0; c < n_channels; ++c)
+        if(channels[c] == channel)
+          found = true;
+      if(!found && n_channels < scanner_max_channels)
+        channels[n_channels++] = channel;
+    }
+  }
+  if(n_channels > 0)
+    scanner.set_channels(channels, n_channels, position_dwell_ms);
+  else
+    scanner.set_channels(NULL, 0, scanner_default_dwell);
+}
+
+//==============================================================
+// write the debug trace of the last position check
+// into the file "/pos_data.txt"
+void write_position_trace(){
+  if(!position_trace || position_trace_text.length() == 0)
+    return;
+  File file = SD.open("/pos_data.txt", FILE_WRITE);
+  if(file){
+    file.write((const uint8_t*) position_trace_text.c_str(), position_trace_text.length());
+    file.close();
+  }
+  position_trace_text = "";
+}
+
+//==============================================================
+// load the measurements from SD card (file: /WiFi_data.txt)
+// build the new-x array, the BSSIDLT and the IILTM
+// return true if the procedure was succesfull
+bool analyze_measurements(){
+  bool result = false;
+  // the duration of learning and solving is reported on the Serial monitor
+  unsigned long start_time = millis();
+  // the fits learned the scans online during the survey
+  // the file is only read again, if the fits are not in sync with
+  // it (e.g. after a restart or a failed write)
+  bool learned = survey_synced;
+  if(!learned){
+    M5.Lcd.printf("Reading file:\n --> /WiFi_data.txt\n");
+    learned = load_measurement("/WiFi_data.txt");
+    Serial.printf("learning done after %lu ms\n", millis() - start_time);
+  }
+  if(learned){
+    // the selection of the APs changes the fits (degree, cleared fits)
+    survey_synced = false;
+    M5.Lcd.printf("Analyze AP data\n");
+    // build new_x array....
+    // get the position range out of the data
+    int x_range = round(max_pos - min_pos);
+    int n_x = x_range *2;
+    // check for usable APs out of the fits
+    // criteria:
+    // at least 6 valid data points
+    //    --> fith order polynome should have at least 6 values
+    // estimated min and max y values should not be out of bounds [-25 .. -95]
+    // a minimum of 15dBm amplitude over the data range is required
+    // use the degree with the best BIC out of the learned
+    // fith order sums (cheaper to evaluate, less overfitting)
+    // all fits are solved in parallel
+    fits_select_parallel(fits, FIT_CRITERION_BIC);
+    Serial.printf("fits solved after %lu ms\n", millis() - start_time);
+    int n_APs = 0;
+    for(int i = 0; i < fits.capacity(); ++i){
+      if(fits.used(i)){
+        // check all fits for criteria
+        double min_y = fits.estimate_min_y(i);
+        double max_y = fits.estimate_max_y(i);
+        if((fits.count(i) < 6) ||               
+            (min_y < -95.0) || (max_y > -25.0) ||  
+            (fabs(max_y - min_y) < 15)) {          
+              fits.clear(i);
+        }
+      }
+      if(fits.used(i)){
+        Serial.printf("%i: N: %i degree: %i min: %.2f max: %.2f\n", i, fits.count(i), fits.get_order(i), fits.estimate_min_y(i), fits.estimate_max_y(i));
+        ++n_APs;
+      }
+    }
+    // keep only the most discriminative APs
+    int max_APs = max_map_APs;
+    if(n_APs > max_APs){
+      ap_rank *ranks = (ap_rank*) malloc(n_APs*sizeof(ap_rank));
+      int n_selected = ranks ? rank_aps(fits, min_pos, max_pos, max_APs, ranks) : -1;
+      if(n_selected < 0){
+        free(ranks);
+        Serial.println("[ERR] malloc failed");
+        return false;
+      }
+      Serial.printf("%i of %i APs selected (gradient dBm/step, residual dBm, overlap, score):\n", n_selected, n_APs);
+      for(int i = 0; i < n_APs; ++i){
+        Serial.printf("%c %i: %.2f %.2f %.2f %.3f\n", (i < n_selected) ? '+' : '-', ranks[i].ap,
+                      ranks[i].gradient, ranks[i].residual, ranks[i].overlap, ranks[i].score);
+        if(i >= n_selected)
+          fits.clear(ranks[i].ap);
+      }
+      free(ranks);
+      n_APs = n_selected;
+    }
+    Serial.printf("memory of the fits: %u bytes\n", (unsigned) fits.memory_bytes());
+    Serial.printf("memory of the floor map: %u bytes\n", (unsigned) floor_map_size(n_x, n_APs, NULL));
+
+    // build Inverse Intensity Lookup Table Map (IILTM)
+    // ....
+    M5.Lcd.printf("Build IILTM and BSSIDLT\n");
+    Serial.println("Build the IILTM and the BSSIDLT:");
+    if(n_APs == 0){
+      M5.Lcd.printf("no usable APs found!\n");
+      Serial.println("no usable APs found!");
+      return false;
+    }
+    Serial.printf("number of usable APs: %i \n", n_APs);
+    // a floor map over the budget is built tile by tile on the SD card
+    if(floor_map_size(n_x, n_APs, NULL) > map_memory_budget){
+      Serial.printf("floor map over the budget of %u bytes: tiled map\n", (unsigned) map_memory_budget);
+      if(!build_tiled_map(n_x, x_range, n_APs) || !save_poly_map())
+        return false;
+      Serial.printf("tiled map build after %lu ms\n", millis() - start_time);
+      M5.Lcd.println("done..");
+      Serial.println("");
+      Serial.println("done!");
+      return true;
+    }
+    // allocate the floor map with the new size
+    // and buffers for the new-x array in the fit_scalar type
+    // and the fit index of each AP of the IILTM
+    fit_scalar *newx_fit = (fit_scalar*) malloc(n_x*sizeof(fit_scalar));
+    int *map_fits = (int*) malloc(n_APs*sizeof(int));
+    // if the memory allocation failed
+    if(!floor_data.init(n_x, n_APs) || !use_floor_map() || !newx_fit || !map_fits){
+      free(newx_fit);
+      free(map_fits);
+      Serial.println("[ERR] malloc failed");
+      return false;
+    } else {
+      // fill the newx_array with the fine position steps
+      for(int i=0; i < n_newx; ++i){
+        newx_array[i] = min_pos + (i*((double)x_range / (double)n_newx));
+        newx_fit[i] = newx_array[i];
+      }
+      int AP_count = 0;
+      for(int i = 0; i < fits.capacity(); ++i){
+        if(fits.used(i)){
+          BSSIDLT[AP_count] = fits.bssid(i);
+          floor_data.channels()[AP_count] = fits.channel(i);
+          map_fits[AP_count] = i;
+          ++AP_count;
+        }
+      }
+      // the fingerprints are calculated in parallel
+      // -95dBm for x values outside the learned range
+      fits_build_cells_parallel(fits, map_fits, n_APs, newx_fit, n_newx, -95.0, IILTM, IILTM_stride);
+      free(newx_fit);
+      free(map_fits);
+
+      Serial.printf("fits solved and IILTM build after %lu ms\n", millis() - start_time);
+
+      Serial.println("the BSSIDLT:");
+      char BSSID[bssid_text_size];
+      for(int i = 0; i < n_usable_APs; ++i){
+        bssid_format(BSSIDLT[i], BSSID);
+        Serial.printf("%i: %s\n", i, BSSID);
+      }
+
+      Serial.println("the IILTM:");
+      for(int x = 0; x < n_newx; ++x){
+        Serial.printf("\n%.2f", newx_array[x]);
+        for(int i = 0; i < n_usable_APs; ++i){
+          Serial.printf(" %.2f", map_decode(IILTM[(x*IILTM_stride)+i]));
+        }
+      }
+      // save floor map to file
+      M5.Lcd.printf("Writing to file:\n --> /floor_map.bin\n");
+      File file = SD.open("/floor_map.bin", FILE_WRITE);
+      if(!file || !floor_data.save(file)){
+          M5.Lcd.println("Failed to write file");
+          file.close();
+          return false;
+      }
+      file.close();
+      // export as text file for other tools
+      M5.Lcd.printf("Writing to file:\n --> /floor_data.txt\n");
+      if(!export_floor_text()){
+          M5.Lcd.println("Failed to open file");
+          return false;
+      }
+      if(!save_poly_map())
+        return false;
+
+      M5.Lcd.println("done..");
+      Serial.println("");
+      Serial.println("done!");
+    }
+    result = true;
+  }
+  return result;
+}
+
+//==============================================================
+// the grid and the fits of the tiled map of build_tiled_map()
+struct tile_fits {
+  const fit_scalar *newx;
+  const int *map_fits;
+  int n_APs;
+};
+
+//==============================================================
+// calculate the fingerprints of the cells begin..end-1 out of the
+// fits (function of tiled_map::save(), context: tile_fits)
+bool build_tile_cells(void *context, int begin, int end, int stride, map_scalar *cells){
+  const tile_fits *source = (const tile_fits*) context;
+  // -95dBm for x values outside the learned range
+  fits_build_cells_parallel(fits, source->map_fits, source->n_APs, &source->newx[begin], end - begin,
+                            -95.0, cells, stride);
+  return true;
+}
+
+//==============================================================
+// save the tiled map "/floor_tiles.bin" of a floor map over the
+// budget and use it
+// the fingerprints are calculated tile by tile out of the fits,
+// the whole floor map is never in the memory
+// the floor map and the text file of an older analysis are removed,
+// the next start opens the tiled map
+// return false if the memory allocation or the file failed
+bool build_tiled_map(int n_x, int x_range, int n_APs){
+  floor_data.release();
+  close_tiled_map();
+  matcher.release();
+  double *x = (double*) malloc(n_x*sizeof(double));
+  fit_scalar *newx_fit = (fit_scalar*) malloc(n_x*sizeof(fit_scalar));
+  uint64_t *bssids = (uint64_t*) malloc(n_APs*sizeof(uint64_t));
+  uint8_t *channels = (uint8_t*) malloc(n_APs*sizeof(uint8_t));
+  int *map_fits = (int*) malloc(n_APs*sizeof(int));
+  bool saved = false;
+  if(!x || !newx_fit || !bssids || !channels || !map_fits){
+    Serial.println("[ERR] malloc failed");
+  } else {
+    // the same grid as the floor map
+    for(int i = 0; i < n_x; ++i){
+      x[i] = min_pos + (i*((double)x_range / (double)n_x));
+      newx_fit[i] = x[i];
+    }
+    int AP_count = 0;
+    for(int i = 0; i < fits.capacity(); ++i){
+      if(fits.used(i)){
+        bssids[AP_count] = fits.bssid(i);
+        channels[AP_count] = fits.channel(i);
+        map_fits[AP_count] = i;
+        ++AP_count;
+      }
+    }
+    tile_fits source = {newx_fit, map_fits, n_APs};
+    M5.Lcd.printf("Writing to file:\n --> /floor_tiles.bin\n");
+    File file = SD.open("/floor_tiles.bin", FILE_WRITE);
+    saved = file && tiled_map::save(n_x, n_APs, x, bssids, channels, build_tile_cells, &source, file);
+    file.close();
+    if(!saved)
+      M5.Lcd.println("Failed to write file");
+  }
+  free(x);
+  free(newx_fit);
+  free(bssids);
+  free(channels);
+  free(map_fits);
+  if(!saved)
+    return false;
+  SD.remove("/floor_map.bin");
+  SD.remove("/floor_data.txt");
+  tiles_file = SD.open("/floor_tiles.bin");
+  if(!tiles_file || !floor_tiles.open(read_tiles_file, &tiles_file, tile_cache_bytes)){
+    close_tiled_map();
+    Serial.println("[ERR] unable to open /floor_tiles.bin");
+    return false;
+  }
+  use_tiled_map();
+  Serial.printf("tiled map: %u tiles, %i in memory, %u bytes\n", floor_tiles.tiles(),
+                floor_tiles.cache_tiles(), (unsigned) floor_tiles.memory_bytes());
+  return true;
+}
+
+//==============================================================
+// save the coefficients of the fits "/floor_poly.bin" for the
+// table-free position check
+// -D POSITION_SOLVER_POLY: the polynomial map is used
+// return false if the file can't be written
+bool save_poly_map(){
+  M5.Lcd.printf("Writing to file:\n --> /floor_poly.bin\n");
+  File file = SD.open("/floor_poly.bin", FILE_WRITE);
+  if(!file || !floor_poly.build(fits, min_pos, max_pos, -95.0) || !floor_poly.save(file)){
+      M5.Lcd.println("Failed to write file");
+      file.close();
+      return false;
+  }
+  file.close();
+  Serial.printf("memory of the polynomial map: %u bytes\n", (unsigned) floor_poly.memory_bytes());
+#ifdef POSITION_SOLVER_POLY
+  use_poly_map();
+#else
+  floor_poly.release();
+#endif
+  return true;
+}
+
+//==============================================================
+// export the floor map as text file "floor_data.txt"
+bool export_floor_text(){
+  File file = SD.open("/floor_data.txt", FILE_WRITE);
+  if(!file){
+      return false;
+  } else {
+    // File format:
+    // n_newx
+    // n_usable_APs
+    // newx_array[0] ... newx_array[n_newx-1]
+    // BSSIDLT[0];channel ... BSSIDLT[n_usable_APs-1];channel
+    // IILTM[0] ... IILTM[((n_usable_APs-1)*n_newx)+(n_newx-1)]
+    // header with dimensions
+    file.printf("%i;%i\n",n_newx, n_usable_APs);
+    // save newx_array
+    for(int x=0; x < n_newx; ++x){
+      file.printf("%.6f\n",newx_array[x]);
+    }
+    // save BSSIDLT array (BSSID;channel)
+    char BSSID[bssid_text_size];
+    for(int i=0; i < n_usable_APs; ++i){
+      bssid_format(BSSIDLT[i], BSSID);
+      file.printf("%s;%i\n",BSSID, floor_data.channels()[i]);
+    }
+    // save IILTM array
+    for(int x=0; x < n_newx; ++x){
+      file.printf("\n%.*f", map_text_decimals, map_decode(IILTM[(x*IILTM_stride)+0]));
+      for(int i=1; i < n_usable_APs; ++i){
+        file.printf(";%.*f", map_text_decimals, map_decode(IILTM[(x*IILTM_stride)+i]));
+      }
+    }
+    file.printf("\n");
+    file.close();
+  }
+  return true;
+}
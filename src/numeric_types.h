@@ -0,0 +1,134 @@
+/***************************************************
+ *
+ * Numeric types of the fits and the fingerprint map
+ *
+ * Hague Nusseck @ electricidea
+ *
+ * The ESP32 has a single precision FPU. All double
+ * operations are calculated in software. Therefore the
+ * numeric types can be selected with build flags:
+ *
+ * fit_scalar (sums and coefficients of the fits):
+ *   default           --> double
+ *   -D FIT_SCALAR_FLOAT --> float
+ *
+ * map_scalar (values of the IILTM) and map_accum
+ * (sum of the squared differences of the matching):
+ *   default              --> int8_t / int32_t
+ *                            offset -60dBm, step 0.5dBm
+ *                            (-124dBm ... -3.5dBm)
+ *   -D MAP_SCALAR_INT16  --> int16_t / int64_t
+ *                            Q11.4 fixed point, step 1/16dBm
+ *                            (one difference squared needs up to
+ *                            32 bits, the sum of many APs more)
+ *   -D MAP_SCALAR_FLOAT  --> float / float
+ *   -D MAP_SCALAR_DOUBLE --> double / double
+ *
+ * With the integer types the matching is calculated with
+ * integer math only. map_encode() and map_decode() convert
+ * between RSSI values in dBm and the map_scalar values:
+ *
+ *   rssi = map_offset + (value * map_step)
+ *
+ * Distributed as-is; no warranty is given.
+ *
+ * ************************************************/
+
+#ifndef NUMERIC_TYPES_H
+#define NUMERIC_TYPES_H
+
+#include <stdint.h>
+#include <math.h>
+
+#ifdef FIT_SCALAR_FLOAT
+typedef float fit_scalar;
+#else
+typedef double fit_scalar;
+#endif
+
+// MAP_SCALAR_FIXED was renamed, an old build flag would
+// silently select the int8 map
+#if defined(MAP_SCALAR_FIXED)
+#error "use MAP_SCALAR_INT16"
+#endif
+
+#if defined(MAP_SCALAR_DOUBLE)
+typedef double map_scalar;
+typedef double map_accum;
+const double map_accum_max = HUGE_VAL;
+// type of the IILTM values in binary files
+const uint8_t map_type_id = 4;
+const double map_offset = 0.0;
+const double map_step = 1.0;
+// number of decimals of the IILTM values in text files
+const int map_text_decimals = 6;
+#elif defined(MAP_SCALAR_FLOAT)
+typedef float map_scalar;
+typedef float map_accum;
+const float map_accum_max = HUGE_VALF;
+const uint8_t map_type_id = 3;
+const double map_offset = 0.0;
+const double map_step = 1.0;
+const int map_text_decimals = 6;
+#elif defined(MAP_SCALAR_INT16)
+#define MAP_SCALAR_INTEGER
+typedef int16_t map_scalar;
+typedef int64_t map_accum;
+const int64_t map_accum_max = INT64_MAX;
+const uint8_t map_type_id = 2;
+const double map_offset = 0.0;
+const double map_step = 1.0/16.0;
+const int32_t map_value_min = INT16_MIN;
+const int32_t map_value_max = INT16_MAX;
+const int map_text_decimals = 4;
+#else
+#define MAP_SCALAR_INTEGER
+typedef int8_t map_scalar;
+typedef int32_t map_accum;
+const int32_t map_accum_max = INT32_MAX;
+const uint8_t map_type_id = 1;
+const double map_offset = -60.0;
+const double map_step = 0.5;
+const int32_t map_value_min = INT8_MIN;
+const int32_t map_value_max = INT8_MAX;
+const int map_text_decimals = 1;
+#endif
+
+//==============================================================
+// convert a RSSI value in dBm into the map representation
+// values outside the range of an integer map_scalar are clipped
+inline map_scalar map_encode(double rssi) {
+#ifdef MAP_SCALAR_INTEGER
+    double q = round((rssi - map_offset) / map_step);
+    if(q > map_value_max)
+        q = map_value_max;
+    if(q < map_value_min)
+        q = map_value_min;
+    return (map_scalar) q;
+#else
+    return (map_scalar) rssi;
+#endif
+}
+
+//==============================================================
+// convert a map value back into a RSSI value in dBm
+inline double map_decode(map_scalar value) {
+#ifdef MAP_SCALAR_INTEGER
+    return map_offset + (value * map_step);
+#else
+    return (double) value;
+#endif
+}
+
+//==============================================================
+// convert a sum of squared map differences into dBm^2
+// (the offset cancels out in the differences)
+inline double map_decode_square(map_accum value) {
+#ifdef MAP_SCALAR_INTEGER
+    return value * map_step * map_step;
+#else
+    return (double) value;
+#endif
+}
+
+#endif
@@ -0,0 +1,333 @@
+/**************************************************************************
+ * Run jobs in parallel on all cores
+ *
+ * Hague Nusseck @ electricidea
+ * https://github.com/electricidea/M5Stack-Hotel-room-finder
+ *
+ * Distributed as-is; no warranty is given.
+ *
+ ***************************************************************************/
+
+#include <stdlib.h>
+#include "parallel.h"
+
+#ifdef ARDUINO
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+
+// stack size of the worker tasks in bytes
+const uint32_t parallel_stack_size = 8192;
+
+// parameter of a worker task
+struct parallel_task {
+    parallel_job job;
+    void *context;
+    int index;
+    SemaphoreHandle_t done;
+};
+
+//==============================================================
+// FreeRTOS task function: run the job and signal the end
+static void parallel_task_function(void *parameter) {
+    parallel_task *task = (parallel_task*) parameter;
+    task->job(task->index, task->context);
+    xSemaphoreGive(task->done);
+    vTaskDelete(NULL);
+}
+
+//==============================================================
+// number of jobs that can run at the same time
+int parallel_workers() {
+    return portNUM_PROCESSORS;
+}
+
+//==============================================================
+// run job(0) ... job(n_jobs-1) in parallel
+// the jobs 0 .. n_jobs-2 run in new tasks, distributed over
+// the cores. The last job runs in the calling task
+void parallel_for(int n_jobs, parallel_job job, void *context) {
+    if(n_jobs > parallel_max_jobs)
+        n_jobs = parallel_max_jobs;
+    if(n_jobs < 1)
+        return;
+    parallel_task tasks[parallel_max_jobs];
+    SemaphoreHandle_t done = xSemaphoreCreateCounting(parallel_max_jobs, 0);
+    int n_started = 0;
+    for(int i = 0; i < n_jobs-1; ++i) {
+        tasks[i].job = job;
+        tasks[i].context = context;
+        tasks[i].index = i;
+        tasks[i].done = done;
+        // if no task can be created, the job runs in the calling task
+        if(done && xTaskCreatePinnedToCore(parallel_task_function, "parallel", parallel_stack_size,
+                                           &tasks[i], uxTaskPriorityGet(NULL), NULL,
+                                           i % portNUM_PROCESSORS) == pdPASS)
+            ++n_started;
+        else
+            job(i, context);
+    }
+    job(n_jobs-1, context);
+    // wait for all started tasks
+    for(int i = 0; i < n_started; ++i)
+        xSemaphoreTake(done, portMAX_DELAY);
+    if(done)
+        vSemaphoreDelete(done);
+}
+
+// one worker task of a team
+struct parallel_worker {
+    parallel_team_state *team;
+    int index;
+    // given by run() for each job, and by stop()
+    SemaphoreHandle_t go;
+    bool started;
+};
+
+// the worker tasks of a team
+struct parallel_team_state {
+    parallel_worker workers[parallel_max_jobs];
+    // given by each worker after its job
+    SemaphoreHandle_t done;
+    int n_started;
+    // the job of the current run() (NULL = stop)
+    parallel_job job;
+    void *context;
+};
+
+//==============================================================
+// FreeRTOS task function of a team: wait for the next job,
+// run it and signal the end, until the team stops
+static void parallel_worker_function(void *parameter) {
+    parallel_worker *worker = (parallel_worker*) parameter;
+    parallel_team_state *team = worker->team;
+    for(;;) {
+        xSemaphoreTake(worker->go, portMAX_DELAY);
+        if(!team->job)
+            break;
+        team->job(worker->index, team->context);
+        xSemaphoreGive(team->done);
+    }
+    xSemaphoreGive(team->done);
+    vTaskDelete(NULL);
+}
+
+//==============================================================
+// create the tasks of the jobs 0 .. n_jobs-2, distributed over
+// the cores, the last job runs in the calling task
+// if a task can't be created, its job runs in the calling task
+// return false if the memory allocation fails
+bool parallel_team::start(int jobs) {
+    stop();
+    if(jobs > parallel_max_jobs)
+        jobs = parallel_max_jobs;
+    if(jobs < 1)
+        return false;
+    state = (parallel_team_state*) malloc(sizeof(parallel_team_state));
+    if(!state)
+        return false;
+    state->done = xSemaphoreCreateCounting(parallel_max_jobs, 0);
+    state->n_started = 0;
+    state->job = NULL;
+    state->context = NULL;
+    for(int i = 0; i < jobs-1; ++i) {
+        parallel_worker &worker = state->workers[i];
+        worker.team = state;
+        worker.index = i;
+        worker.go = state->done ? xSemaphoreCreateBinary() : NULL;
+        worker.started = worker.go &&
+                         xTaskCreatePinnedToCore(parallel_worker_function, "parallel", parallel_stack_size,
+                                                 &worker, uxTaskPriorityGet(NULL), NULL,
+                                                 i % portNUM_PROCESSORS) == pdPASS;
+        if(worker.started)
+            ++state->n_started;
+    }
+    n_jobs = jobs;
+    return true;
+}
+
+//==============================================================
+// run job(0) ... job(n_jobs-1) on the tasks of the team
+// return after all jobs are finished
+void parallel_team::run(parallel_job job, void *context) {
+    if(!state)
+        return;
+    state->job = job;
+    state->context = context;
+    for(int i = 0; i < n_jobs-1; ++i) {
+        if(state->workers[i].started)
+            xSemaphoreGive(state->workers[i].go);
+        else
+            job(i, context);
+    }
+    job(n_jobs-1, context);
+    for(int i = 0; i < state->n_started; ++i)
+        xSemaphoreTake(state->done, portMAX_DELAY);
+}
+
+//==============================================================
+// end the tasks of the team
+void parallel_team::stop() {
+    if(!state)
+        return;
+    state->job = NULL;
+    for(int i = 0; i < n_jobs-1; ++i)
+        if(state->workers[i].started)
+            xSemaphoreGive(state->workers[i].go);
+    for(int i = 0; i < state->n_started; ++i)
+        xSemaphoreTake(state->done, portMAX_DELAY);
+    for(int i = 0; i < n_jobs-1; ++i)
+        if(state->workers[i].go)
+            vSemaphoreDelete(state->workers[i].go);
+    if(state->done)
+        vSemaphoreDelete(state->done);
+    free(state);
+    state = NULL;
+    n_jobs = 0;
+}
+
+#else
+
+#include <thread>
+#include <vector>
+#include <mutex>
+#include <condition_variable>
+
+//==============================================================
+// number of jobs that can run at the same time
+int parallel_workers() {
+    int n = std::thread::hardware_concurrency();
+    if(n < 1)
+        n = 1;
+    if(n > parallel_max_jobs)
+        n = parallel_max_jobs;
+    return n;
+}
+
+//==============================================================
+// run job(0) ... job(n_jobs-1) in parallel threads
+// The last job runs in the calling thread
+void parallel_for(int n_jobs, parallel_job job, void *context) {
+    if(n_jobs > parallel_max_jobs)
+        n_jobs = parallel_max_jobs;
+    if(n_jobs < 1)
+        return;
+    std::vector<std::thread> threads;
+    for(int i = 0; i < n_jobs-1; ++i)
+        threads.push_back(std::thread(job, i, context));
+    job(n_jobs-1, context);
+    for(size_t i = 0; i < threads.size(); ++i)
+        threads[i].join();
+}
+
+// the worker threads of a team
+struct parallel_team_state {
+    std::vector<std::thread> threads;
+    std::mutex mutex;
+    // wakes the workers for a new job or the stop
+    std::condition_variable wake;
+    // wakes run() after the last job
+    std::condition_variable finished;
+    // the job of the current run(), counted by generation
+    parallel_job job;
+    void *context;
+    unsigned generation;
+    int pending;
+    bool stopping;
+};
+
+//==============================================================
+// thread function of a team: wait for the next job, run it and
+// signal the end, until the team stops
+static void parallel_worker_function(parallel_team_state *team, int index) {
+    unsigned generation = 0;
+    std::unique_lock<std::mutex> lock(team->mutex);
+    for(;;) {
+        while(!team->stopping && team->generation == generation)
+            team->wake.wait(lock);
+        if(team->stopping)
+            return;
+        generation = team->generation;
+        parallel_job job = team->job;
+        void *context = team->context;
+        lock.unlock();
+        job(index, context);
+        lock.lock();
+        if(--team->pending == 0)
+            team->finished.notify_one();
+    }
+}
+
+//==============================================================
+// start the threads of the jobs 0 .. n_jobs-2
+// the last job runs in the calling thread
+bool parallel_team::start(int jobs) {
+    stop();
+    if(jobs > parallel_max_jobs)
+        jobs = parallel_max_jobs;
+    if(jobs < 1)
+        return false;
+    state = new parallel_team_state();
+    state->job = NULL;
+    state->context = NULL;
+    state->generation = 0;
+    state->pending = 0;
+    state->stopping = false;
+    for(int i = 0; i < jobs-1; ++i)
+        state->threads.push_back(std::thread(parallel_worker_function, state, i));
+    n_jobs = jobs;
+    return true;
+}
+
+//==============================================================
+// run job(0) ... job(n_jobs-1) on the threads of the team
+// return after all jobs are finished
+void parallel_team::run(parallel_job job, void *context) {
+    if(!state)
+        return;
+    {
+        std::lock_guard<std::mutex> lock(state->mutex);
+        state->job = job;
+        state->context = context;
+        state->pending = n_jobs-1;
+        ++state->generation;
+    }
+    state->wake.notify_all();
+    job(n_jobs-1, context);
+    std::unique_lock<std::mutex> lock(state->mutex);
+    while(state->pending > 0)
+        state->finished.wait(lock);
+}
+
+//==============================================================
+// end the threads of the team
+void parallel_team::stop() {
+    if(!state)
+        return;
+    {
+        std::lock_guard<std::mutex> lock(state->mutex);
+        state->stopping = true;
+    }
+    state->wake.notify_all();
+    for(size_t i = 0; i < state->threads.size(); ++i)
+        state->threads[i].join();
+    delete state;
+    state = NULL;
+    n_jobs = 0;
+}
+
+#endif
+
+//==============================================================
+// the constructor
+parallel_team::parallel_team() {
+    n_jobs = 0;
+    state = NULL;
+}
+
+//==============================================================
+// the destructor
+parallel_team::~parallel_team() {
+    stop();
+}
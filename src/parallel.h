@@ -0,0 +1,59 @@
+/***************************************************
+ *
+ * Run jobs in parallel on all cores
+ *
+ * Hague Nusseck @ electricidea
+ *
+ * On the ESP32 each job runs in its own FreeRTOS task,
+ * pinned to one of the two cores. On other systems
+ * (host tools) std::thread is used.
+ *
+ *          parallel_for(parallel_workers(), job, &context);
+ *
+ * calls job(0, &context) ... job(n_jobs-1, &context) in
+ * parallel and returns after all jobs are finished.
+ * The last job runs in the calling task.
+ *
+ * For many short calls (e.g. one per batch of a file), the
+ * tasks of a parallel_team are created only once and wait
+ * between the calls:
+ *
+ *          parallel_team team;
+ *          team.start(parallel_workers());
+ *          for(...)
+ *              team.run(job, &context);
+ *          team.stop();
+ *
+ * Distributed as-is; no warranty is given.
+ *
+ * ************************************************/
+
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+// maximum number of parallel jobs of one parallel_for() call
+const int parallel_max_jobs = 16;
+
+typedef void (*parallel_job)(int index, void *context);
+
+int parallel_workers();
+void parallel_for(int n_jobs, parallel_job job, void *context);
+
+// the state of the worker tasks (depends on the system)
+struct parallel_team_state;
+
+// class definition
+class parallel_team {
+    public:
+        parallel_team();
+        ~parallel_team();
+        bool start(int n_jobs);
+        void run(parallel_job job, void *context);
+        void stop();
+        int jobs() const { return n_jobs; }
+    private:
+        int n_jobs;
+        parallel_team_state *state;
+};
+
+#endif
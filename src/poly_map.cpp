@@ -0,0 +1,387 @@
+/**************************************************************************
+ * Floor map out of the coefficients of the fits
+ *
+ * The IILTM samples the polynomial of each AP on the grid of the
+ * floor. The memory grows with n_x * n_aps and the position is
+ * quantized to the grid. The poly_map stores only the coefficients
+ * of the fits (about 70 bytes per AP) and finds the position
+ * directly on the polynomials.
+ *
+ * For a scan with the RSSI values q_i of the found APs, the sum of
+ * the squared differences is a function of the position x:
+ *
+ *     S(x) = SUM( (p_i(x) - q_i)^2 )
+ *
+ * Each p_i is a polynomial of degree d_i inside of the learned range
+ * of the AP and outside_rssi (same as the IILTM) outside of it.
+ * Therefore S is a piecewise polynomial: the borders of the learned
+ * ranges split the floor into segments, and inside of a segment S is
+ * one polynomial of degree 2*max(d_i). Its coefficients are the sums
+ * of the squares of the polynomials p_i - q_i.
+ *
+ * The minimum of a segment is at a root of the derivative of S inside
+ * of the segment or at one of its borders. The polynomial of a
+ * segment is only valid inside of it: at a border, the APs of both
+ * neighbour segments can be found (the learned ranges include their
+ * borders, same as the IILTM). Therefore the roots are searched in
+ * the open segment only (poly_interior_minimum()), and the borders
+ * are scored with all APs at the border (border_sum()). S can jump
+ * at a border, so the ends of each segment are scored as well, just
+ * inside of the segment (poly_map_inside in u). The smallest
+ * sum is the position, with the full resolution of the fits.
+ *
+ * The work is about n_segments * n_found * d^2. It doesn't depend on
+ * the length of the floor.
+ *
+ * The file format is the same as the memory block (like floor_map):
+ *
+ *   offset 0:  poly_map_header (64 bytes)
+ *   BSSIDs:    n_aps uint64_t values
+ *   channels:  n_aps uint8_t values
+ *   degrees:   n_aps uint8_t values
+ *   ranges:    2 * n_aps fit_scalar values (min and max in u)
+ *   coefficients: (order+1) * n_aps fit_scalar values
+ *   windows:   2 * n_aps fit_scalar values (origin and span)
+ *
+ * The floor is in u = (x - x_center) / x_scale (about the middle of
+ * the floor and its half length, see build()). The coefficients of each AP are the
+ * coefficients of its fit: a polynomial in v = (x - origin) / span
+ * (see fit_bank). They are moved into u in double when a scan is
+ * solved (poly_substitute), so float coefficients keep their
+ * precision.
+ *
+ * Each section begins at a 16 byte boundary.
+ *
+ * Hague Nusseck @ electricidea
+ * v1.0
+ * https://github.com/electricidea/M5Stack-Hotel-room-finder
+ *
+ * Distributed as-is; no warranty is given.
+ *
+ **************************************************************************
+ *
+ * ==== How to use it: ====
+ *
+ * 1.) build the map out of the used fits and save it:
+ *
+ *          poly_map map;
+ *          map.build(fits, min_pos, max_pos, -95.0);
+ *          File file = SD.open("/floor_poly.bin", FILE_WRITE);
+ *          map.save(file);
+ *
+ * 2.) load the map and find the position of a scan:
+ *
+ *          map.load(file);
+ *          map.clear_query();
+ *          map.set_rssi(AP_index, RSSI);
+ *          double pos = map.solve(NULL);
+ *
+ ***************************************************************************/
+
+#include <stdlib.h>
+#include <string.h>
+#include "poly_math.h"
+#include "poly_map.h"
+
+//==============================================================
+// round up to the next multiple of the alignment
+static size_t poly_map_align(size_t size) {
+    return (size + poly_map_alignment - 1) & ~(poly_map_alignment - 1);
+}
+
+//==============================================================
+// size of the sections of a map (= file size)
+static size_t poly_map_size(const poly_map_header &file_header, size_t *offsets) {
+    size_t sizes[6] = {
+        file_header.n_aps * sizeof(uint64_t),                           // bssids
+        file_header.n_aps * sizeof(uint8_t),                            // channels
+        file_header.n_aps * sizeof(uint8_t),                            // degree
+        2 * file_header.n_aps * sizeof(fit_scalar),                     // range
+        (size_t) (file_header.order+1) * file_header.n_aps * sizeof(fit_scalar),  // a
+        2 * file_header.n_aps * sizeof(fit_scalar)                      // window
+    };
+    size_t size = poly_map_align(sizeof(poly_map_header));
+    for(int i = 0; i < 6; ++i) {
+        offsets[i] = size;
+        size += poly_map_align(sizes[i]);
+    }
+    return size;
+}
+
+//==============================================================
+// the constructor
+poly_map::poly_map() {
+    block = NULL;
+    release();
+}
+
+//==============================================================
+// the destructor
+poly_map::~poly_map() {
+    release();
+}
+
+//==============================================================
+// free the memory
+void poly_map::release() {
+    free(block);
+    block = NULL;
+    base = NULL;
+    size = 0;
+    block_size = 0;
+    header = NULL;
+    bssids_ = NULL;
+    channels_ = NULL;
+    degree = NULL;
+    range = NULL;
+    a = NULL;
+    window = NULL;
+    query = NULL;
+    found = NULL;
+    borders = NULL;
+    n_segments = 0;
+}
+
+//==============================================================
+// check a header and allocate the memory block for it
+// the header is copied to the begin of the block
+bool poly_map::allocate(const poly_map_header &file_header) {
+    release();
+    if(file_header.magic != poly_map_magic ||
+       file_header.version != poly_map_version ||
+       file_header.header_size != sizeof(poly_map_header) ||
+       file_header.scalar_size != sizeof(fit_scalar) ||
+       file_header.order > CURVE_FIT_MAX_DEGREE ||
+       file_header.n_aps == 0 || !(file_header.x_scale > 0))
+        return false;
+    size_t offsets[6];
+    size_t map_size = poly_map_size(file_header, offsets);
+    // the query behind the map: RSSI values, found flags and the
+    // borders of the segments
+    size_t query_offset = map_size;
+    size_t found_offset = query_offset + poly_map_align(file_header.n_aps * sizeof(double));
+    size_t borders_offset = found_offset + poly_map_align(file_header.n_aps * sizeof(uint8_t));
+    size_t total = borders_offset + (2*file_header.n_aps + 2) * sizeof(double);
+    // malloc only guarantees an 8 byte alignment
+    block = (uint8_t*) malloc(total + poly_map_alignment);
+    if(!block)
+        return false;
+    block_size = total + poly_map_alignment;
+    base = (uint8_t*) poly_map_align((size_t) block);
+    size = map_size;
+    memcpy(base, &file_header, sizeof(poly_map_header));
+    header = (poly_map_header*) base;
+    bssids_ = (uint64_t*) (base + offsets[0]);
+    channels_ = (uint8_t*) (base + offsets[1]);
+    degree = (uint8_t*) (base + offsets[2]);
+    range = (fit_scalar*) (base + offsets[3]);
+    a = (fit_scalar*) (base + offsets[4]);
+    window = (fit_scalar*) (base + offsets[5]);
+    query = (double*) (base + query_offset);
+    found = (uint8_t*) (base + found_offset);
+    borders = (double*) (base + borders_offset);
+    clear_query();
+    return true;
+}
+
+//==============================================================
+// FNV-1a checksum of all data behind the header
+uint32_t poly_map::checksum() const {
+    uint32_t hash = 2166136261UL;
+    for(size_t i = sizeof(poly_map_header); i < size; ++i) {
+        hash ^= base[i];
+        hash *= 16777619UL;
+    }
+    return hash;
+}
+
+//==============================================================
+// copy the coefficients of all used fits into a new map
+// the APs have the same order as in the floor map
+// (used fits in the order of their index)
+// return false if there is no used fit or no memory
+bool poly_map::build(fit_bank &fits, double min_x, double max_x, double outside_rssi) {
+    poly_map_header new_header;
+    memset(&new_header, 0, sizeof(new_header));
+    new_header.magic = poly_map_magic;
+    new_header.version = poly_map_version;
+    new_header.scalar_size = sizeof(fit_scalar);
+    new_header.header_size = sizeof(poly_map_header);
+    new_header.n_aps = fits.size();
+    new_header.order = 0;
+    for(int i = 0; i < fits.capacity(); ++i)
+        if(fits.used(i) && fits.get_order(i) > new_header.order)
+            new_header.order = fits.get_order(i);
+    new_header.min_x = min_x;
+    new_header.max_x = max_x;
+    // power of two scale and center in steps of scale/4 (same as
+    // the windows of the fit bank): the borders of the learned
+    // ranges are exact in u, also for float
+    new_header.x_scale = 1.0;
+    while(new_header.x_scale < (max_x - min_x) / 2)
+        new_header.x_scale *= 2;
+    double step = new_header.x_scale / 4;
+    new_header.x_center = floor((min_x + max_x) / 2 / step + 0.5) * step;
+    new_header.outside_rssi = outside_rssi;
+    if(!allocate(new_header))
+        return false;
+    memset(base + sizeof(poly_map_header), 0, size - sizeof(poly_map_header));
+    const int k = header->order + 1;
+    uint32_t ap = 0;
+    for(int i = 0; i < fits.capacity(); ++i) {
+        if(!fits.used(i))
+            continue;
+        bssids_[ap] = fits.bssid(i);
+        channels_[ap] = fits.channel(i);
+        degree[ap] = fits.get_order(i);
+        range[2*ap] = (fits.min_x(i) - header->x_center) / header->x_scale;
+        range[2*ap+1] = (fits.max_x(i) - header->x_center) / header->x_scale;
+        const fit_scalar *coefficients = fits.coefficients(i);
+        for(int n = 0; n <= degree[ap]; ++n)
+            a[ap*k + n] = coefficients[n];
+        window[2*ap] = fits.x_origin(i);
+        window[2*ap+1] = fits.x_span(i);
+        ++ap;
+    }
+    return true;
+}
+
+//==============================================================
+// forget all RSSI values of the last scan
+void poly_map::clear_query() {
+    for(uint32_t ap = 0; ap < n_aps(); ++ap)
+        found[ap] = 0;
+}
+
+//==============================================================
+// set the RSSI value of a found AP
+void poly_map::set_rssi(int ap, double rssi) {
+    if(ap < 0 || (uint32_t) ap >= n_aps())
+        return;
+    query[ap] = rssi;
+    found[ap] = 1;
+}
+
+//==============================================================
+// sum of the squared differences at the position u
+double poly_map::border_sum(double u) const {
+    const int k = header->order + 1;
+    double sum = 0;
+    for(uint32_t ap = 0; ap < header->n_aps; ++ap) {
+        if(!found[ap])
+            continue;
+        double y = header->outside_rssi;
+        if(u >= range[2*ap] && u <= range[2*ap+1]) {
+            // Horner in v and double (a can be float)
+            double v = (header->x_center + u * header->x_scale - window[2*ap]) / window[2*ap+1];
+            y = 0;
+            for(int n = degree[ap]; n >= 0; --n)
+                y = y*v + a[ap*k + n];
+        }
+        sum += (y - query[ap]) * (y - query[ap]);
+    }
+    return sum;
+}
+
+//==============================================================
+// find the position with the smallest sum of squared differences
+// between the RSSI values of the scan and the polynomials
+// return the position and the sum in square_sum
+double poly_map::solve(double *square_sum) {
+    n_segments = 0;
+    if(!header)
+        return 0;
+    const int k = header->order + 1;
+    double lo = (header->min_x - header->x_center) / header->x_scale;
+    double hi = (header->max_x - header->x_center) / header->x_scale;
+    // the borders of the segments: the range of the floor and the
+    // learned ranges of the found APs inside of it (sorted, unique)
+    int n_borders = 0;
+    borders[n_borders++] = lo;
+    borders[n_borders++] = hi;
+    for(uint32_t ap = 0; ap < header->n_aps; ++ap) {
+        if(!found[ap])
+            continue;
+        for(int side = 0; side < 2; ++side) {
+            double border = range[2*ap + side];
+            if(border > lo && border < hi)
+                borders[n_borders++] = border;
+        }
+    }
+    for(int i = 1; i < n_borders; ++i) {
+        double border = borders[i];
+        int j = i;
+        while(j > 0 && borders[j-1] > border) {
+            borders[j] = borders[j-1];
+            --j;
+        }
+        borders[j] = border;
+    }
+    double best_u = lo;
+    double best_sum = border_sum(lo);
+    for(int s = 0; s+1 < n_borders; ++s) {
+        double l = borders[s];
+        double r = borders[s+1];
+        if(!(r > l))
+            continue;
+        ++n_segments;
+        // the polynomial S(u) of this segment
+        double c[2*CURVE_FIT_MAX_DEGREE+1];
+        for(int n = 0; n < 2*k-1; ++n)
+            c[n] = 0;
+        int c_order = 0;
+        double middle = (l + r) / 2;
+        for(uint32_t ap = 0; ap < header->n_aps; ++ap) {
+            if(!found[ap])
+                continue;
+            if(middle >= range[2*ap] && middle <= range[2*ap+1]) {
+                // (p(u) - q)^2, p(v) with v = alpha*u + beta
+                double p[CURVE_FIT_MAX_DEGREE+1];
+                int d = degree[ap];
+                double alpha = header->x_scale / window[2*ap+1];
+                double beta = (header->x_center - window[2*ap]) / window[2*ap+1];
+                poly_substitute(&a[ap*k], d, alpha, beta, p);
+                p[0] -= query[ap];
+                for(int i = 0; i <= d; ++i)
+                    for(int j = 0; j <= d; ++j)
+                        c[i+j] += p[i] * p[j];
+                if(2*d > c_order)
+                    c_order = 2*d;
+            } else {
+                double diff = header->outside_rssi - query[ap];
+                c[0] += diff * diff;
+            }
+        }
+        // the minimum inside of the segment
+        double u = l, sum = 0;
+        if(poly_interior_minimum(c, c_order, l, r, &u, &sum) && sum < best_sum) {
+            best_sum = sum;
+            best_u = u;
+        }
+        // the ends of the segment from the inside
+        double inside = (poly_map_inside < (r - l) / 4) ? poly_map_inside : (r - l) / 4;
+        double ends[2] = {l + inside, r - inside};
+        for(int e = 0; e < 2; ++e) {
+            sum = border_sum(ends[e]);
+            if(sum < best_sum) {
+                best_sum = sum;
+                best_u = ends[e];
+            }
+        }
+        // the border itself (the APs of both segments can be found)
+        sum = border_sum(r);
+        if(sum < best_sum) {
+            best_sum = sum;
+            best_u = r;
+        }
+    }
+    if(square_sum)
+        *square_sum = best_sum;
+    return header->x_center + best_u * header->x_scale;
+}
+
+//==============================================================
+// return the memory footprint in bytes
+size_t poly_map::memory_bytes() const {
+    return sizeof(poly_map) + block_size;
+}
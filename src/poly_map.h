@@ -0,0 +1,140 @@
+/***************************************************
+ *
+ * Floor map out of the coefficients of the fits
+ * (continuous position without IILTM)
+ *
+ * Hague Nusseck @ electricidea
+ *
+ * --> see poly_map.cpp for more details on how it
+ * works and how to use it.
+ *
+ * Distributed as-is; no warranty is given.
+ *
+ * ************************************************/
+
+#ifndef POLY_MAP_H
+#define POLY_MAP_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "numeric_types.h"
+#include "fit_bank.h"
+
+// "FPOL" as little endian number
+const uint32_t poly_map_magic = 0x4C4F5046;
+const uint16_t poly_map_version = 2;
+// alignment of the sections
+const size_t poly_map_alignment = 16;
+// the ends of a segment are scored this distance (in u) inside of
+// it, S can jump at the borders of the segments
+// (far below the resolution of the fits, above the rounding of
+// float fits)
+const double poly_map_inside = 1e-5;
+
+// header at the begin of the file (64 bytes)
+struct poly_map_header {
+    uint32_t magic;
+    uint16_t version;
+    // sizeof(fit_scalar) of the coefficients
+    uint8_t scalar_size;
+    uint8_t header_size;
+    uint32_t n_aps;
+    // number of coefficients of each AP - 1
+    uint32_t order;
+    // range of the floor
+    double min_x;
+    double max_x;
+    // the floor is in u = (x - x_center) / x_scale
+    double x_center;
+    double x_scale;
+    // RSSI outside of the learned range of an AP
+    double outside_rssi;
+    // FNV-1a checksum of all data behind the header
+    uint32_t checksum;
+    uint32_t reserved;
+};
+
+// class definition
+class poly_map {
+    public:
+        poly_map();
+        ~poly_map();
+        bool build(fit_bank &fits, double min_x, double max_x, double outside_rssi);
+        void release();
+        template<typename Source> bool load(Source &file);
+        template<typename Sink> bool save(Sink &file);
+        uint32_t n_aps() const { return header ? header->n_aps : 0; }
+        double min_x() const { return header ? header->min_x : 0; }
+        double max_x() const { return header ? header->max_x : 0; }
+        uint64_t *bssids() const { return bssids_; }
+        uint8_t *channels() const { return channels_; }
+        // matching of a scan
+        void clear_query();
+        void set_rssi(int ap, double rssi);
+        double solve(double *square_sum);
+        int segments() const { return n_segments; }
+        size_t file_size() const { return size; }
+        size_t memory_bytes() const;
+    private:
+        bool allocate(const poly_map_header &file_header);
+        uint32_t checksum() const;
+        double border_sum(double u) const;
+        // the memory block: the file and the query
+        uint8_t *block;
+        uint8_t *base;
+        size_t size;
+        size_t block_size;
+        poly_map_header *header;
+        uint64_t *bssids_;
+        uint8_t *channels_;
+        // selected degree of each AP
+        uint8_t *degree;
+        // learned range of each AP in u (min, max)
+        fit_scalar *range;
+        // coefficients, order+1 per AP
+        fit_scalar *a;
+        // window of each AP (origin, span): a is in (x - origin) / span
+        fit_scalar *window;
+        // RSSI value of each AP, found flag
+        double *query;
+        uint8_t *found;
+        // borders of the segments of the last solve
+        double *borders;
+        int n_segments;
+};
+
+//==============================================================
+// load the map from a file with one bulk read
+// Source needs a function read(uint8_t *data, size_t size)
+// that returns the number of bytes read (e.g. File)
+// return false if the file is no valid polynomial map of the
+// fit_scalar type of this build
+template<typename Source>
+bool poly_map::load(Source &file) {
+    poly_map_header file_header;
+    if(file.read((uint8_t*) &file_header, sizeof(file_header)) != sizeof(file_header))
+        return false;
+    if(!allocate(file_header))
+        return false;
+    size_t rest = size - sizeof(poly_map_header);
+    if(file.read(base + sizeof(poly_map_header), rest) != rest ||
+       checksum() != header->checksum) {
+        release();
+        return false;
+    }
+    return true;
+}
+
+//==============================================================
+// save the map into a file with one bulk write
+// Sink needs a function write(const uint8_t *data, size_t size)
+// that returns the number of bytes written (e.g. File)
+template<typename Sink>
+bool poly_map::save(Sink &file) {
+    if(!header)
+        return false;
+    header->checksum = checksum();
+    return file.write(base, size) == size;
+}
+
+#endif
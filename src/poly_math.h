@@ -0,0 +1,546 @@
+/***************************************************
+ *
+ * Basic polynomial math for the fitting classes
+ *
+ * Hague Nusseck @ electricidea
+ *
+ * All functions work on plain arrays with a given order
+ * and do not allocate any memory. They are used by the
+ * runtime degree class curve_fit and by the compile time
+ * template static_curve_fit. If the order is a constant,
+ * the compiler is able to unroll all loops.
+ *
+ * The least square fit is stored as the sums of the
+ * normal equations. Because every element of the matrix
+ * M only depends on i+j, the matrix can be stored as
+ * 2k+1 sums of the powers of x:
+ *
+ *  Sx[n]  = SUM(xi^n)      n = 0 .. 2k
+ *  Sxy[n] = SUM(xi^n*yi)   n = 0 .. k
+ *
+ *  M[i][j] = Sx[i+j]
+ *  b[i]    = Sxy[i]
+ *
+ * Distributed as-is; no warranty is given.
+ *
+ * ************************************************/
+
+#ifndef POLY_MATH_H
+#define POLY_MATH_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <math.h>
+#include <limits>
+
+// maximum degree of the fitted polynomials
+// from the 6th or 7th degree on, the floating-point
+// arithmetic reaches its limits anyway
+#ifndef CURVE_FIT_MAX_DEGREE
+#define CURVE_FIT_MAX_DEGREE 7
+#endif
+
+// criteria for the selection of the polynomial degree
+// (see poly_select_degree)
+#define FIT_CRITERION_AIC 0
+#define FIT_CRITERION_BIC 1
+#define FIT_CRITERION_GCV 2
+
+//==============================================================
+// relative limit for the round-off errors of the sums
+// (about 1e-12 for double and 5e-4 for float)
+template <typename Scalar>
+inline Scalar poly_tolerance() {
+    return std::numeric_limits<Scalar>::epsilon() * 4096;
+}
+
+//==============================================================
+// add a new pair of x and y values to the sums
+// the powers of x are build by repeated multiplication
+template <typename Scalar>
+inline void poly_accumulate(Scalar *Sx, Scalar *Sxy, int order, Scalar x, Scalar y) {
+    Scalar xn = 1;
+    for(int n = 0; n <= order; ++n) {
+        Sx[n] += xn;
+        Sxy[n] += xn * y;
+        xn *= x;
+    }
+    for(int n = order+1; n <= 2*order; ++n) {
+        Sx[n] += xn;
+        xn *= x;
+    }
+}
+
+//==============================================================
+// add n pairs of x and y values to the sums in one pass
+// The values are processed in blocks of poly_lanes values. Each
+// lane has its own partial sums, so the inner loops have no
+// dependencies and can be vectorized by the compiler.
+// The powers of x are build by repeated multiplication.
+const size_t poly_lanes = 8;
+
+template <typename Scalar>
+inline void poly_accumulate_many(Scalar *Sx, Scalar *Sxy, int order,
+                                 const Scalar *xs, const Scalar *ys, size_t n) {
+    if(order < 0)
+        return;
+    // partial sums of each lane
+    Scalar lane_Sx[2*CURVE_FIT_MAX_DEGREE+1][poly_lanes];
+    Scalar lane_Sxy[CURVE_FIT_MAX_DEGREE+1][poly_lanes];
+    for(int p = 0; p <= 2*order; ++p)
+        for(size_t i = 0; i < poly_lanes; ++i)
+            lane_Sx[p][i] = 0;
+    for(int p = 0; p <= order; ++p)
+        for(size_t i = 0; i < poly_lanes; ++i)
+            lane_Sxy[p][i] = 0;
+    size_t start = 0;
+    for(; start + poly_lanes <= n; start += poly_lanes) {
+        const Scalar *x = xs + start;
+        const Scalar *y = ys + start;
+        // running power product x^p for each lane
+        Scalar xp[poly_lanes];
+        for(size_t i = 0; i < poly_lanes; ++i)
+            xp[i] = 1;
+        for(int p = 0; p <= order; ++p) {
+            for(size_t i = 0; i < poly_lanes; ++i) {
+                lane_Sx[p][i] += xp[i];
+                lane_Sxy[p][i] += xp[i] * y[i];
+                xp[i] *= x[i];
+            }
+        }
+        for(int p = order+1; p <= 2*order; ++p) {
+            for(size_t i = 0; i < poly_lanes; ++i) {
+                lane_Sx[p][i] += xp[i];
+                xp[i] *= x[i];
+            }
+        }
+    }
+    // add the partial sums of all lanes
+    for(int p = 0; p <= 2*order; ++p)
+        for(size_t i = 0; i < poly_lanes; ++i)
+            Sx[p] += lane_Sx[p][i];
+    for(int p = 0; p <= order; ++p)
+        for(size_t i = 0; i < poly_lanes; ++i)
+            Sxy[p] += lane_Sxy[p][i];
+    // the remaining values one by one
+    for(; start < n; ++start)
+        poly_accumulate(Sx, Sxy, order, xs[start], ys[start]);
+}
+
+//==============================================================
+// move the sums of the powers of x to the powers of
+// v = (x - shift) / scale (binomial expansion of (x - shift)^n):
+//
+//  SUM(vi^n) = SUM( C(n,k) * (-shift)^(n-k) * SUM(xi^k) ) / scale^n
+//
+// The sums are calculated in double, so only the result is rounded
+// to Scalar. A fit of x values far away from 0 loses its precision
+// in the sums of float, but not in the sums of v around 0.
+template <typename Scalar>
+inline void poly_shift_sums(Scalar *Sx, Scalar *Sxy, int order, double shift, double scale) {
+    if(order < 0)
+        return;
+    double binomial[2*CURVE_FIT_MAX_DEGREE+1];
+    double minus_shift[2*CURVE_FIT_MAX_DEGREE+1];
+    double new_Sx[2*CURVE_FIT_MAX_DEGREE+1];
+    double new_Sxy[CURVE_FIT_MAX_DEGREE+1];
+    minus_shift[0] = 1.0;
+    for(int n = 1; n <= 2*order; ++n)
+        minus_shift[n] = minus_shift[n-1] * -shift;
+    double scale_n = 1.0;
+    for(int n = 0; n <= 2*order; ++n) {
+        // row n of Pascal's triangle
+        binomial[n] = 1.0;
+        for(int k = n-1; k > 0; --k)
+            binomial[k] += binomial[k-1];
+        double sum_x = 0.0, sum_xy = 0.0;
+        for(int k = 0; k <= n; ++k) {
+            sum_x += binomial[k] * minus_shift[n-k] * Sx[k];
+            if(n <= order)
+                sum_xy += binomial[k] * minus_shift[n-k] * Sxy[k];
+        }
+        new_Sx[n] = sum_x / scale_n;
+        if(n <= order)
+            new_Sxy[n] = sum_xy / scale_n;
+        scale_n *= scale;
+    }
+    for(int n = 0; n <= 2*order; ++n)
+        Sx[n] = (Scalar) new_Sx[n];
+    for(int n = 0; n <= order; ++n)
+        Sxy[n] = (Scalar) new_Sxy[n];
+}
+
+//==============================================================
+// LDL^T factorization of the symmetric matrix M = Sx[i+j]
+// L is a lower triangle matrix with ones on the diagonal
+// and D a diagonal matrix.
+// The factorization of the leading (d+1)x(d+1) part of M is
+// the leading part of L and D. Therefore one factorization
+// can be used for all degrees d <= order.
+// If M is (nearly) singular (less different x values than order+1)
+// the diagonal elements of the missing dimensions are set to 0.0
+template <typename Scalar>
+inline void poly_factorize(const Scalar *Sx, int order,
+                           Scalar L[][CURVE_FIT_MAX_DEGREE+1], Scalar *D) {
+    for (int j = 0; j <= order; ++j) {
+        // diagonal element d_j = M_jj - SUM(L_jk^2 * d_k)
+        Scalar d = Sx[2*j];
+        for (int k = 0; k < j; ++k)
+            d -= L[j][k] * L[j][k] * D[k];
+        // important:
+        // there is no unique solution, if the pivot element is zero!
+        // the relative limit catches round-off errors of the sums
+        if (!(d > poly_tolerance<Scalar>() * fabs(Sx[2*j])))
+            d = 0;
+        D[j] = d;
+        // elements of column j below the diagonal
+        for (int i = j + 1; i <= order; ++i) {
+            Scalar l = Sx[i+j];
+            for (int k = 0; k < j; ++k)
+                l -= L[i][k] * L[j][k] * D[k];
+            L[i][j] = (d == 0) ? Scalar(0) : l / d;
+        }
+    }
+}
+
+//==============================================================
+// solve the linear system of equations M*a = b with a LDL^T
+// factorization of the symmetric matrix M = Sx[i+j].
+// the coefficients of the missing dimensions of a singular
+// matrix M are set to 0.0
+template <typename Scalar>
+inline void poly_solve(const Scalar *Sx, const Scalar *Sxy, Scalar *a, int order) {
+    // L (lower triangle part) and D (diagonal)
+    Scalar L[CURVE_FIT_MAX_DEGREE+1][CURVE_FIT_MAX_DEGREE+1];
+    Scalar D[CURVE_FIT_MAX_DEGREE+1];
+    poly_factorize(Sx, order, L, D);
+    // forward substitution L*z = b
+    for (int i = 0; i <= order; ++i) {
+        Scalar z = Sxy[i];
+        for (int k = 0; k < i; ++k)
+            z -= L[i][k] * a[k];
+        a[i] = z;
+    }
+    // division by the diagonal D*w = z
+    for (int i = 0; i <= order; ++i)
+        a[i] = (D[i] == 0) ? Scalar(0) : a[i] / D[i];
+    // backward substitution L^T*a = w
+    for (int i = order; i >= 0; --i) {
+        for (int k = i + 1; k <= order; ++k)
+            a[i] -= L[k][i] * a[k];
+    }
+}
+
+//==============================================================
+// residual sum of squares SUM((yi - p(xi))^2) of the least 
+// square fits of all degrees 0 .. order, calculated out of the
+// sums only (Syy = SUM(yi^2)):
+//
+//  RSS(d) = Syy - a^T*b = Syy - SUM(z_i^2 / D_i)   i = 0 .. d
+//
+// with z = L^-1 * b. One factorization for all degrees.
+template <typename Scalar>
+inline void poly_rss(const Scalar *Sx, const Scalar *Sxy, Scalar Syy, int order, Scalar *rss) {
+    Scalar L[CURVE_FIT_MAX_DEGREE+1][CURVE_FIT_MAX_DEGREE+1];
+    Scalar D[CURVE_FIT_MAX_DEGREE+1];
+    Scalar z[CURVE_FIT_MAX_DEGREE+1];
+    poly_factorize(Sx, order, L, D);
+    Scalar sum = Syy;
+    for (int i = 0; i <= order; ++i) {
+        z[i] = Sxy[i];
+        for (int k = 0; k < i; ++k)
+            z[i] -= L[i][k] * z[k];
+        if(D[i] != 0)
+            sum -= z[i] * z[i] / D[i];
+        // round-off errors could lead to negative values
+        rss[i] = (sum > 0) ? sum : Scalar(0);
+    }
+}
+
+//==============================================================
+// select the degree with the best score of the given criterion
+// out of the residual sums of squares rss[0 .. order] of N values
+// Only degrees with less coefficients than values are used.
+// AIC = N*ln(RSS/N) + 2*p
+// BIC = N*ln(RSS/N) + p*ln(N)
+// GCV = (RSS/N) / (1 - p/N)^2
+// with p = degree+1 (number of coefficients)
+template <typename Scalar>
+inline int poly_select_degree(const Scalar *rss, int order, uint32_t N, uint8_t criterion) {
+    int best_degree = 0;
+    Scalar best_score = 0;
+    for(int d = 0; d <= order; ++d) {
+        Scalar p = d+1;
+        if(d > 0 && p >= N)
+            break;
+        // limit for a perfect fit (RSS = 0)
+        Scalar mse = rss[d] / N;
+        if(mse < Scalar(1e-12))
+            mse = Scalar(1e-12);
+        Scalar score;
+        if(criterion == FIT_CRITERION_AIC)
+            score = N * log(mse) + 2*p;
+        else if(criterion == FIT_CRITERION_GCV)
+            score = mse / ((1 - p/N) * (1 - p/N));
+        else
+            score = N * log(mse) + p * log((Scalar)N);
+        if(d == 0 || score < best_score) {
+            best_score = score;
+            best_degree = d;
+        }
+    }
+    return best_degree;
+}
+
+//==============================================================
+// evaluate the polynomial y = a[n]*x^n + ... + a[1]*x + a[0]
+// with Horner's scheme
+template <typename Scalar>
+inline Scalar poly_eval(const Scalar *a, int order, Scalar x) {
+    if(order < 0)
+        return 0;
+    Scalar y = a[order];
+    for(int i = order-1; i >= 0; --i)
+        y = y * x + a[i];
+    return y;
+}
+
+//==============================================================
+// evaluate the polynomial for n values of x with Horner's scheme
+// The outer loop goes over the coefficients and the inner loop
+// over the x values. The inner loop has no dependencies between
+// the values, so the compiler is able to vectorize it.
+template <typename Scalar>
+inline void poly_eval_many(const Scalar *a, int order, const Scalar *__restrict xs, Scalar *__restrict ys, size_t n) {
+    const Scalar a_n = (order < 0) ? Scalar(0) : a[order];
+    for(size_t i = 0; i < n; ++i)
+        ys[i] = a_n;
+    for(int k = order-1; k >= 0; --k) {
+        const Scalar a_k = a[k];
+        for(size_t i = 0; i < n; ++i)
+            ys[i] = ys[i] * xs[i] + a_k;
+    }
+}
+
+//==============================================================
+// same as poly_eval_many(), but all y values with an x value 
+// outside of [min_x .. max_x] are replaced with outside_value
+template <typename Scalar>
+inline void poly_eval_many(const Scalar *a, int order, const Scalar *__restrict xs, Scalar *__restrict ys, size_t n,
+                           Scalar min_x, Scalar max_x, Scalar outside_value) {
+    poly_eval_many(a, order, xs, ys, n);
+    for(size_t i = 0; i < n; ++i)
+        ys[i] = (xs[i] > max_x || xs[i] < min_x) ? outside_value : ys[i];
+}
+
+//==============================================================
+// calculate the coefficients b[] of the polynomial q(u) = p(alpha*u + beta)
+// (same order) with Horner's scheme on polynomials
+// e.g. to move a polynomial into an other coordinate system
+template <typename Scalar>
+inline void poly_substitute(const Scalar *a, int order, double alpha, double beta, double *b) {
+    if(order < 0)
+        return;
+    for(int i = 0; i <= order; ++i)
+        b[i] = 0.0;
+    b[0] = a[order];
+    // q = q * (alpha*u + beta) + a[n]
+    for(int n = order-1; n >= 0; --n) {
+        for(int i = order - n; i > 0; --i)
+            b[i] = b[i] * beta + b[i-1] * alpha;
+        b[0] = b[0] * beta + a[n];
+    }
+}
+
+//==============================================================
+// calculate the coefficients da[] of the derivative
+// of the polynomial a[] (order of da = order-1)
+template <typename Scalar>
+inline void poly_derivative(const Scalar *a, int order, Scalar *da) {
+    for(int i = 1; i <= order; ++i)
+        da[i-1] = a[i] * i;
+}
+
+//==============================================================
+// find the root of the polynomial inside of the bracket [l .. r]
+// the values fl = p(l) and fr = p(r) need to have different signs
+// Regula falsi with the Illinois modification
+template <typename Scalar>
+inline Scalar poly_bracketed_root(const Scalar *a, int order, Scalar l, Scalar r, Scalar fl, Scalar fr) {
+    Scalar m = l;
+    Scalar last_m = r;
+    int side = 0;
+    for(int iteration = 0; iteration < 64; ++iteration) {
+        m = (fl*r - fr*l) / (fl - fr);
+        Scalar fm = poly_eval(a, order, m);
+        if(fm == 0 || fabs(m - last_m) <= Scalar(1e-12) * (fabs(l) + fabs(r)))
+            break;
+        last_m = m;
+        if((fm > 0) == (fr > 0)) {
+            r = m;
+            fr = fm;
+            // the left side was kept twice --> halve its value
+            if(side == -1)
+                fl /= 2;
+            side = -1;
+        } else {
+            l = m;
+            fl = fm;
+            if(side == 1)
+                fr /= 2;
+            side = 1;
+        }
+    }
+    return m;
+}
+
+//==============================================================
+// find all real roots of the polynomial inside of (lo .. hi)
+// the roots are returned in ascending order, the return value
+// is the number of roots (max. order)
+// order <= 2 --> closed form
+// order  > 2 --> the roots of the derivative split the range into
+//                monotone parts, each with max. one root
+template <typename Scalar>
+inline int poly_real_roots(const Scalar *a, int order, Scalar lo, Scalar hi, Scalar *roots) {
+    // leading zero coefficients reduce the order
+    while(order > 0 && a[order] == 0)
+        --order;
+    if(order <= 0)
+        return 0;
+    int n = 0;
+    if(order == 1) {
+        Scalar r = -a[0] / a[1];
+        if(r > lo && r < hi)
+            roots[n++] = r;
+        return n;
+    }
+    if(order == 2) {
+        Scalar discriminant = a[1]*a[1] - 4*a[2]*a[0];
+        if(discriminant < 0)
+            return 0;
+        // numerically stable form of the quadratic formula
+        Scalar q = (a[1] < 0) ? (-a[1] + sqrt(discriminant)) / 2 : (-a[1] - sqrt(discriminant)) / 2;
+        Scalar r1 = q / a[2];
+        Scalar r2 = (q != 0) ? a[0] / q : r1;
+        if(r1 > r2) {
+            Scalar t = r1;
+            r1 = r2;
+            r2 = t;
+        }
+        if(r1 > lo && r1 < hi)
+            roots[n++] = r1;
+        if(r2 > lo && r2 < hi && r2 != r1)
+            roots[n++] = r2;
+        return n;
+    }
+    // roots of the derivative (extrema of the polynomial)
+    Scalar da[2*CURVE_FIT_MAX_DEGREE];
+    Scalar critical[2*CURVE_FIT_MAX_DEGREE];
+    poly_derivative(a, order, da);
+    int n_critical = poly_real_roots(da, order-1, lo, hi, critical);
+    // max. one root between two extrema
+    Scalar l = lo;
+    Scalar fl = poly_eval(a, order, lo);
+    for(int i = 0; i <= n_critical; ++i) {
+        Scalar r = (i < n_critical) ? critical[i] : hi;
+        Scalar fr = poly_eval(a, order, r);
+        if((fl < 0 && fr > 0) || (fl > 0 && fr < 0))
+            roots[n++] = poly_bracketed_root(a, order, l, r, fl, fr);
+        else if(fr == 0 && i < n_critical)
+            roots[n++] = r;
+        l = r;
+        fl = fr;
+    }
+    return n;
+}
+
+//==============================================================
+// calculate the exact min and max y values over the range 
+// [min_x .. max_x]. Candidates are the borders of the range
+// and all roots of the derivative inside of the range.
+template <typename Scalar>
+inline void poly_range_extrema(const Scalar *a, int order, Scalar min_x, Scalar max_x,
+                               Scalar *min_y, Scalar *max_y) {
+    *min_y = *max_y = poly_eval(a, order, min_x);
+    Scalar y = poly_eval(a, order, max_x);
+    if(y < *min_y)
+        *min_y = y;
+    if(y > *max_y)
+        *max_y = y;
+    if(order < 2)
+        return;
+    Scalar da[2*CURVE_FIT_MAX_DEGREE];
+    Scalar critical[2*CURVE_FIT_MAX_DEGREE];
+    poly_derivative(a, order, da);
+    int n_critical = poly_real_roots(da, order-1, min_x, max_x, critical);
+    for(int i = 0; i < n_critical; ++i) {
+        y = poly_eval(a, order, critical[i]);
+        if(y < *min_y)
+            *min_y = y;
+        if(y > *max_y)
+            *max_y = y;
+    }
+}
+
+//==============================================================
+// calculate the min y value over the range [min_x .. max_x] and
+// its x value. Candidates are the borders of the range and all
+// roots of the derivative inside of the range. The first x value
+// is used if the minimum is reached more than once.
+template <typename Scalar>
+inline Scalar poly_range_minimum(const Scalar *a, int order, Scalar min_x, Scalar max_x, Scalar *x_min) {
+    Scalar best_x = min_x;
+    Scalar best_y = poly_eval(a, order, min_x);
+    if(order >= 2) {
+        Scalar da[2*CURVE_FIT_MAX_DEGREE];
+        Scalar critical[2*CURVE_FIT_MAX_DEGREE];
+        poly_derivative(a, order, da);
+        int n_critical = poly_real_roots(da, order-1, min_x, max_x, critical);
+        for(int i = 0; i < n_critical; ++i) {
+            Scalar y = poly_eval(a, order, critical[i]);
+            if(y < best_y) {
+                best_y = y;
+                best_x = critical[i];
+            }
+        }
+    }
+    Scalar y = poly_eval(a, order, max_x);
+    if(y < best_y) {
+        best_y = y;
+        best_x = max_x;
+    }
+    *x_min = best_x;
+    return best_y;
+}
+
+//==============================================================
+// calculate the min y value over the roots of the derivative
+// strictly inside of the range (min_x .. max_x) and its x value.
+// The borders are no candidates (e.g. if the polynomial is only
+// valid inside of the range).
+// return false if there is no root inside of the range
+template <typename Scalar>
+inline bool poly_interior_minimum(const Scalar *a, int order, Scalar min_x, Scalar max_x,
+                                  Scalar *x_min, Scalar *y_min) {
+    if(order < 2)
+        return false;
+    Scalar da[2*CURVE_FIT_MAX_DEGREE];
+    Scalar critical[2*CURVE_FIT_MAX_DEGREE];
+    poly_derivative(a, order, da);
+    int n_critical = poly_real_roots(da, order-1, min_x, max_x, critical);
+    bool found = false;
+    for(int i = 0; i < n_critical; ++i) {
+        if(!(critical[i] > min_x && critical[i] < max_x))
+            continue;
+        Scalar y = poly_eval(a, order, critical[i]);
+        if(!found || y < *y_min) {
+            *y_min = y;
+            *x_min = critical[i];
+            found = true;
+        }
+    }
+    return found;
+}
+
+#endif
@@ -0,0 +1,179 @@
+/**************************************************************************
+ * Tracking of the position along the floor
+ *
+ * The position is a probability distribution over the grid of the
+ * floor map (newx_array). Each scan updates it with one step of the
+ * forward algorithm of a hidden Markov model:
+ *
+ *   predict:  the user walks between two scans. The distribution is
+ *             convolved with a Gaussian motion kernel (step_sigma
+ *             grid cells, cut off at 3 sigma).
+ *   correct:  the square sums of the RSSI differences between the
+ *             scan and the IILTM (same as the position check) are
+ *             the likelihood of each grid cell:
+ *
+ *                  L(x) = exp(-square_sum(x) / (2 * rssi_sigma^2))
+ *
+ *   The distribution is normalized to a sum of 1 afterwards.
+ *
+ * The first update starts with a uniform distribution. Therefore one
+ * scan already gives the same estimate as the square sums alone,
+ * and every further scan refines it.
+ *
+ * The cost of one update is n_x * (2*radius+1) for the prediction
+ * plus n_x for the correction, independent of the number of updates.
+ *
+ * Hague Nusseck @ electricidea
+ * v1.0
+ * https://github.com/electricidea/M5Stack-Hotel-room-finder
+ *
+ * Distributed as-is; no warranty is given.
+ *
+ **************************************************************************
+ *
+ * ==== How to use it: ====
+ *
+ * 1.) allocate the tracker for the grid:
+ *
+ *          position_tracker tracker;
+ *          tracker.init(n_newx, 3.0, 6.0);
+ *
+ * 2.) after each scan, calculate the square sums of all cells
+ *     (fingerprint_matcher::square_sums())
+ *     and update the tracker:
+ *
+ *          tracker.update(square_sum_array);
+ *          double pos = newx_array[tracker.best()];
+ *
+ ***************************************************************************/
+
+#include <stdlib.h>
+#include <math.h>
+#include "position_tracker.h"
+
+//==============================================================
+// the constructor
+position_tracker::position_tracker() {
+    n_x = 0;
+    radius = 0;
+    rssi_weight = 0;
+    belief = NULL;
+    predicted = NULL;
+    kernel = NULL;
+    n_updates = 0;
+}
+
+//==============================================================
+// the destructor
+position_tracker::~position_tracker() {
+    release();
+}
+
+//==============================================================
+// free the memory
+void position_tracker::release() {
+    // one memory block for all arrays
+    free(belief);
+    belief = NULL;
+    predicted = NULL;
+    kernel = NULL;
+    n_x = 0;
+}
+
+//==============================================================
+// allocate the arrays for a grid with n_x cells
+// step_sigma: standard deviation of the movement between two
+//             scans in grid cells
+// rssi_sigma: standard deviation of the RSSI values in dBm
+// return false if the memory allocation fails
+bool position_tracker::init(int grid_size, float step_sigma, float rssi_sigma) {
+    release();
+    if(grid_size < 1 || rssi_sigma <= 0)
+        return false;
+    radius = (int) ceil(3.0f * step_sigma);
+    if(radius < 0)
+        radius = 0;
+    belief = (float*) malloc((2*grid_size + 2*radius + 1) * sizeof(float));
+    if(!belief)
+        return false;
+    predicted = &belief[grid_size];
+    kernel = &belief[2*grid_size];
+    n_x = grid_size;
+    rssi_weight = 1.0f / (2.0f * rssi_sigma * rssi_sigma);
+    float sum = 0;
+    for(int k = -radius; k <= radius; ++k) {
+        kernel[k+radius] = (step_sigma > 0) ? expf(-(float)(k*k) / (2.0f * step_sigma * step_sigma)) : 1.0f;
+        sum += kernel[k+radius];
+    }
+    for(int k = 0; k <= 2*radius; ++k)
+        kernel[k] /= sum;
+    reset();
+    return true;
+}
+
+//==============================================================
+// forget the position: uniform distribution
+void position_tracker::reset() {
+    for(int x = 0; x < n_x; ++x)
+        belief[x] = 1.0f / n_x;
+    n_updates = 0;
+}
+
+//==============================================================
+// one step of the forward algorithm with the square sums of a scan
+void position_tracker::update(const map_accum *square_sums) {
+    if(n_x == 0)
+        return;
+    // predict: convolution with the motion kernel
+    // the first update starts with the uniform distribution
+    if(n_updates > 0) {
+        for(int x = 0; x < n_x; ++x) {
+            float p = 0;
+            int k_begin = (x - radius < 0) ? radius - x : 0;
+            int k_end = (x + radius >= n_x) ? radius + (n_x - 1 - x) : 2*radius;
+            for(int k = k_begin; k <= k_end; ++k)
+                p += kernel[k] * belief[x - radius + k];
+            predicted[x] = p;
+        }
+    } else {
+        for(int x = 0; x < n_x; ++x)
+            predicted[x] = belief[x];
+    }
+    // correct: likelihood of the square sums
+    // relative to the smallest square sum (no underflow of the best cell)
+    map_accum min_sum = square_sums[0];
+    for(int x = 1; x < n_x; ++x)
+        if(square_sums[x] < min_sum)
+            min_sum = square_sums[x];
+    float sum = 0;
+    for(int x = 0; x < n_x; ++x) {
+        float distance = (float) map_decode_square(square_sums[x] - min_sum);
+        belief[x] = predicted[x] * expf(-distance * rssi_weight);
+        sum += belief[x];
+    }
+    if(sum > 0) {
+        for(int x = 0; x < n_x; ++x)
+            belief[x] /= sum;
+    } else {
+        // the scan does not fit to the last position at all
+        for(int x = 0; x < n_x; ++x)
+            belief[x] = 1.0f / n_x;
+    }
+    ++n_updates;
+}
+
+//==============================================================
+// grid cell with the highest probability
+int position_tracker::best() const {
+    int best_x = 0;
+    for(int x = 1; x < n_x; ++x)
+        if(belief[x] > belief[best_x])
+            best_x = x;
+    return best_x;
+}
+
+//==============================================================
+// return the memory footprint in bytes
+size_t position_tracker::memory_bytes() const {
+    return sizeof(position_tracker) + (n_x ? (2*n_x + 2*radius + 1) * sizeof(float) : 0);
+}
@@ -0,0 +1,49 @@
+/***************************************************
+ *
+ * Tracking of the position along the floor
+ * (HMM forward pass over the new-x grid)
+ *
+ * Hague Nusseck @ electricidea
+ *
+ * --> see position_tracker.cpp for more details on how it
+ * works and how to use it.
+ *
+ * Distributed as-is; no warranty is given.
+ *
+ * ************************************************/
+
+#ifndef POSITION_TRACKER_H
+#define POSITION_TRACKER_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "numeric_types.h"
+
+// class definition
+class position_tracker {
+    public:
+        position_tracker();
+        ~position_tracker();
+        bool init(int grid_size, float step_sigma, float rssi_sigma);
+        void reset();
+        void update(const map_accum *square_sums);
+        int best() const;
+        float probability(int x) const { return belief[x]; }
+        int updates() const { return n_updates; }
+        size_t memory_bytes() const;
+    private:
+        void release();
+        int n_x;
+        // radius of the motion kernel in grid cells
+        int radius;
+        // 1 / (2 * rssi_sigma^2)
+        float rssi_weight;
+        // probability of each grid cell
+        float *belief;
+        float *predicted;
+        // motion kernel, 2*radius+1 values
+        float *kernel;
+        int n_updates;
+};
+
+#endif
@@ -0,0 +1,209 @@
+/***************************************************
+ *
+ * Fitting of a Polynomial with a fixed degree
+ *
+ * Hague Nusseck @ electricidea
+ *
+ * Header only version of curve_fit with the degree and
+ * the numeric type as template parameters:
+ *
+ *          static_curve_fit<1> fit_1;
+ *          static_curve_fit<5, float> fit_5;
+ *
+ * All sums and coefficients are stored in fixed size
+ * arrays inside the object. There is no heap allocation
+ * and the loop bounds are known at compile time.
+ *
+ * --> see curve_fit.cpp for more details on how it
+ * works and how to use it.
+ *
+ * Distributed as-is; no warranty is given.
+ *
+ * ************************************************/
+
+#ifndef STATIC_CURVE_FIT_H
+#define STATIC_CURVE_FIT_H
+
+#include <array>
+#include "poly_math.h"
+
+template <uint8_t Degree, typename Scalar = double>
+class static_curve_fit {
+    static_assert(Degree <= CURVE_FIT_MAX_DEGREE, "degree is larger than CURVE_FIT_MAX_DEGREE");
+    public:
+        static constexpr int order = Degree;
+
+        static_curve_fit() { reset(); }
+
+        //==============================================================
+        // clear all sums and coefficients to start a new calculation
+        void reset() {
+            Sx.fill(0);
+            Sxy.fill(0);
+            a.fill(0);
+            N = 0;
+            solved = true;
+            range_valid = false;
+            max_x_ = 0;
+            min_x_ = 0;
+        }
+
+        //==============================================================
+        // add a new pair of x and y values
+        void learn(Scalar x, Scalar y) {
+            ++N;
+            solved = false;
+            range_valid = false;
+            if(N == 1) {
+                max_x_ = x;
+                min_x_ = x;
+            } else {
+                if(x < min_x_)
+                    min_x_ = x;
+                if(x > max_x_)
+                    max_x_ = x;
+            }
+            poly_accumulate(Sx.data(), Sxy.data(), order, x, y);
+        }
+
+        //==============================================================
+        // add n pairs of x and y values in one pass
+        void learn_batch(const Scalar *xs, const Scalar *ys, size_t n) {
+            if(n == 0)
+                return;
+            solved = false;
+            range_valid = false;
+            size_t i = 0;
+            if(N == 0) {
+                max_x_ = xs[0];
+                min_x_ = xs[0];
+                i = 1;
+            }
+            for(; i < n; ++i) {
+                if(xs[i] < min_x_)
+                    min_x_ = xs[i];
+                if(xs[i] > max_x_)
+                    max_x_ = xs[i];
+            }
+            N += n;
+            poly_accumulate_many(Sx.data(), Sxy.data(), order, xs, ys, n);
+        }
+
+        //==============================================================
+        // add all learned values of an other fit
+        // (same result as learning all values in this fit)
+        void merge(const static_curve_fit &other) {
+            if(other.N == 0)
+                return;
+            if(N == 0) {
+                max_x_ = other.max_x_;
+                min_x_ = other.min_x_;
+            } else {
+                if(other.min_x_ < min_x_)
+                    min_x_ = other.min_x_;
+                if(other.max_x_ > max_x_)
+                    max_x_ = other.max_x_;
+            }
+            N += other.N;
+            for(int n = 0; n <= 2*order; ++n)
+                Sx[n] += other.Sx[n];
+            for(int n = 0; n <= order; ++n)
+                Sxy[n] += other.Sxy[n];
+            solved = false;
+            range_valid = false;
+        }
+
+        //==============================================================
+        // predicted y value of a given x value
+        Scalar predict(Scalar x) {
+            if(!solved)
+                solve();
+            return poly_eval(a.data(), order, x);
+        }
+
+        //==============================================================
+        // predicted y value or outside_value if x is outside
+        // the learned range
+        Scalar predict(Scalar x, Scalar outside_value) {
+            if(x > max_x_ || x < min_x_)
+                return outside_value;
+            return predict(x);
+        }
+
+        //==============================================================
+        // predicted y values of n given x values
+        void predict_many(const Scalar *xs, Scalar *ys, size_t n) {
+            if(!solved)
+                solve();
+            poly_eval_many(a.data(), order, xs, ys, n);
+        }
+
+        //==============================================================
+        // predicted y values of n given x values or outside_value 
+        // if x is outside the learned range
+        void predict_many(const Scalar *xs, Scalar *ys, size_t n, Scalar outside_value) {
+            if(!solved)
+                solve();
+            poly_eval_many(a.data(), order, xs, ys, n, min_x_, max_x_, outside_value);
+        }
+
+        //==============================================================
+        // Fills the given field with the current coefficients.
+        // the values field need to have a size of Degree+1
+        void get_coefficients(Scalar values[]) {
+            if(!solved)
+                solve();
+            for(int i = 0; i <= order; ++i)
+                values[i] = a[i];
+        }
+
+        //==============================================================
+        // exact max y value over the learned x range
+        // the parameter steps is not used (compatibility to curve_fit)
+        Scalar estimate_max_y(uint32_t /* steps */ = 100) {
+            if(!range_valid)
+                update_range();
+            return max_y_;
+        }
+
+        //==============================================================
+        // exact min y value over the learned x range
+        // the parameter steps is not used (compatibility to curve_fit)
+        Scalar estimate_min_y(uint32_t /* steps */ = 100) {
+            if(!range_valid)
+                update_range();
+            return min_y_;
+        }
+
+        uint32_t get_order() const { return order; }
+        Scalar max_x() const { return max_x_; }
+        Scalar min_x() const { return min_x_; }
+        int count() const { return N; }
+
+    private:
+        void solve() {
+            poly_solve(Sx.data(), Sxy.data(), a.data(), order);
+            solved = true;
+        }
+        void update_range() {
+            if(!solved)
+                solve();
+            poly_range_extrema(a.data(), order, min_x_, max_x_, &min_y_, &max_y_);
+            range_valid = true;
+        }
+        // Sx[n] = SUM(xi^n) and Sxy[n] = SUM(xi^n*yi)
+        std::array<Scalar, 2*Degree+1> Sx;
+        std::array<Scalar, Degree+1> Sxy;
+        // y = a[n]*x^n + ... + a[1]*x + a[0]
+        std::array<Scalar, Degree+1> a;
+        // Number of learned x, y pairs
+        uint32_t N;
+        // false, if new values are learned but not solved yet
+        bool solved;
+        // true, if min_y_ and max_y_ are up to date
+        bool range_valid;
+        Scalar max_x_, min_x_;
+        Scalar max_y_, min_y_;
+};
+
+#endif
@@ -0,0 +1,243 @@
+/**************************************************************************
+ * Parallel learning of the fits out of a survey file
+ * and parallel building of the floor map
+ *
+ * The analysis of a survey has three stages. Each stage is split
+ * into jobs that run in parallel on all cores (parallel_for() or
+ * parallel_team):
+ *
+ *   1.) learn:  survey_pipeline reads the file in batches of
+ *               survey_pipeline_batch values. While one batch is
+ *               parsed out of the file (in the calling task, which
+ *               owns the file), the fits learn the last batch. The
+ *               learning is split by the fits: each job learns only
+ *               the values of its part of the fit bank. Between the
+ *               batches, the new BSSIDs are added to the fit bank in
+ *               the calling task (the fit bank can grow). The tasks
+ *               are created once by learn() (parallel_team) and get
+ *               the jobs of each batch with semaphores, so a batch
+ *               doesn't pay for the creation of tasks.
+ *   2.) select: fits_select_parallel() selects the degree of each
+ *               fit and calculates its coefficients and min/max
+ *               values, split by the fits.
+ *   3.) build:  fits_build_cells_parallel() calculates the
+ *               fingerprints of the IILTM, split by the cells.
+ *
+ * Each fit is only changed by one job, and it learns its values in
+ * the same order as a sequential read of the file. The same
+ * functions of the fit bank calculate the same numbers. Therefore
+ * the results are bit for bit the same as the sequential ones, with
+ * any number of jobs.
+ *
+ * Hague Nusseck @ electricidea
+ * v1.0
+ * https://github.com/electricidea/M5Stack-Hotel-room-finder
+ *
+ * Distributed as-is; no warranty is given.
+ *
+ **************************************************************************
+ *
+ * ==== How to use it: ====
+ *
+ * 1.) learn the fits out of the survey file:
+ *
+ *          fits.init(40, 5);
+ *          survey_pipeline pipeline(fits);
+ *          File file = SD.open("/WiFi_data.txt");
+ *          pipeline.learn(file);
+ *          double min_pos = pipeline.min_pos();
+ *
+ * 2.) select the degree and solve all fits:
+ *
+ *          fits_select_parallel(fits, FIT_CRITERION_BIC);
+ *
+ * 3.) build the fingerprints of the IILTM (cell-major, see
+ *     floor_map.cpp) with the fits aps[0 .. n_aps-1]:
+ *
+ *          fits_build_cells_parallel(fits, aps, n_aps, newx_fit, n_newx,
+ *                                    -95.0, IILTM, IILTM_stride);
+ *
+ ***************************************************************************/
+
+#include "survey_pipeline.h"
+
+//==============================================================
+// the constructor
+// a pipeline learns one file
+survey_pipeline::survey_pipeline(fit_bank &fits) : fits(fits), reader(add_record, this) {
+    buffers = NULL;
+    fill_index = 0;
+    learn_index = 0;
+    n_learners = 1;
+    source = NULL;
+    end_of_file = false;
+    n_lost = 0;
+    n_batches = 0;
+    min_pos_ = 99999;
+    max_pos_ = -99999;
+}
+
+//==============================================================
+// callback of the survey_reader: add one value to the batch
+void survey_pipeline::add_record(const survey_record &record, void *context) {
+    survey_pipeline *pipeline = (survey_pipeline*) context;
+    if(record.pos > pipeline->max_pos_)
+        pipeline->max_pos_ = record.pos;
+    if(record.pos < pipeline->min_pos_)
+        pipeline->min_pos_ = record.pos;
+    survey_values &batch = pipeline->buffers[pipeline->fill_index];
+    if(batch.n == survey_pipeline_batch + survey_pipeline_margin) {
+        ++pipeline->n_lost;
+        return;
+    }
+    survey_value &value = batch.values[batch.n++];
+    value.bssid = bssid_parse(record.bssid);
+    value.x = record.pos;
+    value.rssi = record.rssi;
+    value.ap = -1;
+    value.channel = (record.channel > 0) ? record.channel : 0;
+}
+
+//==============================================================
+// find or add the fits of the values of a batch
+void survey_pipeline::resolve(survey_values &batch) {
+    for(int i = 0; i < batch.n; ++i) {
+        survey_value &value = batch.values[i];
+        value.ap = fits.add(value.bssid);
+        if(value.ap > -1 && value.channel > 0)
+            fits.set_channel(value.ap, value.channel);
+    }
+}
+
+//==============================================================
+// learn the values of one part of the fits
+// (consecutive fits: no shared cache lines of the sums)
+void survey_pipeline::learn_part(int part) {
+    const survey_values &batch = buffers[learn_index];
+    int begin = (int) ((long) fits.capacity() * part / n_learners);
+    int end = (int) ((long) fits.capacity() * (part+1) / n_learners);
+    int aps[survey_pipeline_scan];
+    fit_scalar ys[survey_pipeline_scan];
+    fit_scalar x = 0;
+    int n = 0;
+    for(int i = 0; i < batch.n; ++i) {
+        const survey_value &value = batch.values[i];
+        if(value.ap < begin || value.ap >= end)
+            continue;
+        if(n > 0 && (value.x != x || n == survey_pipeline_scan)) {
+            fits.learn_scan(x, aps, ys, n);
+            n = 0;
+        }
+        x = value.x;
+        aps[n] = value.ap;
+        ys[n] = value.rssi;
+        ++n;
+    }
+    if(n > 0)
+        fits.learn_scan(x, aps, ys, n);
+}
+
+//==============================================================
+// context of the jobs of fits_select_parallel()
+// and fits_build_cells_parallel()
+struct fits_jobs {
+    fit_bank *fits;
+    int n_jobs;
+    uint8_t criterion;
+    const int *aps;
+    int n_aps;
+    const fit_scalar *xs;
+    int n_x;
+    fit_scalar outside_value;
+    map_scalar *cells;
+    int stride;
+};
+
+//==============================================================
+// number of jobs for n parts of work
+static int fits_jobs_count(int n_workers, int n) {
+    if(n_workers <= 0)
+        n_workers = parallel_workers();
+    if(n_workers > parallel_max_jobs)
+        n_workers = parallel_max_jobs;
+    if(n_workers > n)
+        n_workers = n;
+    return (n_workers < 1) ? 1 : n_workers;
+}
+
+//==============================================================
+// select the degree of one part of the fits (parallel job)
+static void fits_select_job(int index, void *context) {
+    fits_jobs *jobs = (fits_jobs*) context;
+    fit_bank &fits = *jobs->fits;
+    int begin = (int) ((long) fits.capacity() * index / jobs->n_jobs);
+    int end = (int) ((long) fits.capacity() * (index+1) / jobs->n_jobs);
+    for(int ap = begin; ap < end; ++ap) {
+        if(!fits.used(ap) || fits.count(ap) == 0)
+            continue;
+        fits.select_degree(ap, jobs->criterion);
+        // solves the coefficients and caches the min and max values
+        fits.estimate_min_y(ap);
+        fits.estimate_max_y(ap);
+    }
+}
+
+//==============================================================
+// select the degree of all used fits with the criterion, solve
+// them and calculate their min and max values in parallel
+// n_workers = 0 --> one job per core
+void fits_select_parallel(fit_bank &fits, uint8_t criterion, int n_workers) {
+    fits_jobs jobs;
+    jobs.fits = &fits;
+    jobs.n_jobs = fits_jobs_count(n_workers, fits.capacity());
+    jobs.criterion = criterion;
+    parallel_for(jobs.n_jobs, fits_select_job, &jobs);
+}
+
+//==============================================================
+// calculate the fingerprints of one part of the cells (parallel job)
+// each job writes its own cells, the values of one AP are predicted
+// in blocks and written with the stride of the fingerprints
+static void fits_cells_job(int index, void *context) {
+    fits_jobs *jobs = (fits_jobs*) context;
+    const int block_size = 64;
+    fit_scalar ys[block_size];
+    int begin = jobs->n_x * index / jobs->n_jobs;
+    int end = jobs->n_x * (index+1) / jobs->n_jobs;
+    for(int start = begin; start < end; start += block_size) {
+        int n = (end - start < block_size) ? end - start : block_size;
+        map_scalar *cells = &jobs->cells[(size_t) start * jobs->stride];
+        for(int a = 0; a < jobs->n_aps; ++a) {
+            jobs->fits->predict_many(jobs->aps[a], &jobs->xs[start], ys, n, jobs->outside_value);
+            for(int i = 0; i < n; ++i)
+                cells[(size_t) i * jobs->stride + a] = map_encode(ys[i]);
+        }
+        // the padding values are 0
+        for(int i = 0; i < n; ++i)
+            for(int a = jobs->n_aps; a < jobs->stride; ++a)
+                cells[(size_t) i * jobs->stride + a] = 0;
+    }
+}
+
+//==============================================================
+// calculate the fingerprints of the cells xs[0 .. n_x-1] with the
+// fits aps[0 .. n_aps-1] in parallel
+// cell x begins at cells[x*stride], the value of aps[a] is
+// cells[x*stride + a] (cell-major IILTM, see floor_map.cpp)
+// the fits need to be solved before (fits_select_parallel())
+// n_workers = 0 --> one job per core
+void fits_build_cells_parallel(fit_bank &fits, const int *aps, int n_aps,
+                               const fit_scalar *xs, int n_x, fit_scalar outside_value,
+                               map_scalar *cells, int stride, int n_workers) {
+    fits_jobs jobs;
+    jobs.fits = &fits;
+    jobs.n_jobs = fits_jobs_count(n_workers, n_x);
+    jobs.aps = aps;
+    jobs.n_aps = n_aps;
+    jobs.xs = xs;
+    jobs.n_x = n_x;
+    jobs.outside_value = outside_value;
+    jobs.cells = cells;
+    jobs.stride = stride;
+    parallel_for(jobs.n_jobs, fits_cells_job, &jobs);
+}
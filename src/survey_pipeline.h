@@ -0,0 +1,163 @@
+/***************************************************
+ *
+ * Parallel learning of the fits out of a survey file
+ * and parallel building of the floor map
+ *
+ * Hague Nusseck @ electricidea
+ *
+ * --> see survey_pipeline.cpp for more details on how it
+ * works and how to use it.
+ *
+ * Distributed as-is; no warranty is given.
+ *
+ * ************************************************/
+
+#ifndef SURVEY_PIPELINE_H
+#define SURVEY_PIPELINE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include "numeric_types.h"
+#include "fit_bank.h"
+#include "survey_reader.h"
+#include "parallel.h"
+
+// number of values of one batch of the pipeline
+const int survey_pipeline_batch = 256;
+// maximum number of records of one block of the file
+// (each line has at least a BSSID and a line end)
+const int survey_pipeline_margin = survey_block_size / 18 + 2;
+// values with the same position are learned in scans of this size
+const int survey_pipeline_scan = 32;
+
+// one parsed value of the survey file
+struct survey_value {
+    uint64_t bssid;
+    fit_scalar x;
+    fit_scalar rssi;
+    // index of the fit (-1 = no fit)
+    int ap;
+    uint8_t channel;
+};
+
+// one batch of values
+struct survey_values {
+    survey_value values[survey_pipeline_batch + survey_pipeline_margin];
+    int n;
+};
+
+// class definition
+class survey_pipeline {
+    public:
+        survey_pipeline(fit_bank &fits);
+        template<typename Source> bool learn(Source &file, int n_workers = 0);
+        double min_pos() const { return min_pos_; }
+        double max_pos() const { return max_pos_; }
+        uint32_t records() const { return reader.records(); }
+        uint32_t skipped() const { return reader.skipped(); }
+        uint32_t batches() const { return n_batches; }
+    private:
+        template<typename Source> void parse(Source &file);
+        template<typename Source> static void stage_job(int index, void *context);
+        static void add_record(const survey_record &record, void *context);
+        void resolve(survey_values &batch);
+        void learn_part(int part);
+        fit_bank &fits;
+        survey_reader reader;
+        // two batches: one is parsed while the other is learned
+        survey_values *buffers;
+        int fill_index;
+        int learn_index;
+        int n_learners;
+        void *source;
+        bool end_of_file;
+        uint32_t n_lost;
+        uint32_t n_batches;
+        double min_pos_;
+        double max_pos_;
+};
+
+void fits_select_parallel(fit_bank &fits, uint8_t criterion, int n_workers = 0);
+void fits_build_cells_parallel(fit_bank &fits, const int *aps, int n_aps,
+                               const fit_scalar *xs, int n_x, fit_scalar outside_value,
+                               map_scalar *cells, int stride, int n_workers = 0);
+
+//==============================================================
+// parse the next batch of values out of the file
+template<typename Source>
+void survey_pipeline::parse(Source &file) {
+    survey_values &batch = buffers[fill_index];
+    batch.n = 0;
+    char block[survey_block_size];
+    while(batch.n < survey_pipeline_batch && !end_of_file) {
+        size_t length = file.read((uint8_t*) block, sizeof(block));
+        if(length == 0 || length > sizeof(block)) {
+            reader.finish();
+            end_of_file = true;
+        } else {
+            reader.feed(block, length);
+        }
+    }
+}
+
+//==============================================================
+// the jobs of one stage of the pipeline
+// the last job parses the next batch (in the calling task, which
+// owns the file), the other jobs learn the current batch
+template<typename Source>
+void survey_pipeline::stage_job(int index, void *context) {
+    survey_pipeline *pipeline = (survey_pipeline*) context;
+    if(index == pipeline->n_learners)
+        pipeline->parse(*(Source*) pipeline->source);
+    else
+        pipeline->learn_part(index);
+}
+
+//==============================================================
+// learn all values of a survey file (pos;n;name;id;RSSI;channel)
+// n_workers = 0 --> one job per core
+// Source needs a function read(uint8_t *data, size_t size)
+// that returns the number of bytes read (e.g. File)
+// return false if the memory allocation fails
+template<typename Source>
+bool survey_pipeline::learn(Source &file, int n_workers) {
+    if(n_workers <= 0)
+        n_workers = parallel_workers();
+    // one job parses, the others learn
+    n_learners = (n_workers > 2) ? n_workers - 1 : 1;
+    if(n_learners > parallel_max_jobs - 1)
+        n_learners = parallel_max_jobs - 1;
+    buffers = (survey_values*) malloc(2*sizeof(survey_values));
+    if(!buffers)
+        return false;
+    // the tasks are created once for all batches
+    parallel_team team;
+    if(n_workers > 1 && !team.start(n_learners + 1))
+        n_workers = 1;
+    source = &file;
+    fill_index = 0;
+    parse(file);
+    while(buffers[fill_index].n > 0) {
+        learn_index = fill_index;
+        // the new APs are added before the learning starts
+        // (the fit bank can grow)
+        resolve(buffers[learn_index]);
+        fill_index = 1 - learn_index;
+        if(n_workers > 1) {
+            team.run(stage_job<Source>, this);
+        } else {
+            // one core: no tasks, one stage after the other
+            learn_part(0);
+            parse(file);
+        }
+        ++n_batches;
+    }
+    team.stop();
+    free(buffers);
+    buffers = NULL;
+    source = NULL;
+    return n_lost == 0;
+}
+
+#endif
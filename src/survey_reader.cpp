@@ -0,0 +1,192 @@
+/**************************************************************************
+ * Buffered reader for WiFi survey files
+ *
+ * Reads the lines of a survey file (/WiFi_data.txt or /pos_data.txt)
+ * in blocks and splits them into the fields
+ *
+ *          pos;n;name;id;RSSI;channel
+ *
+ * Older files without the channel field are read as well (the
+ * channel of the records is 0 then).
+ * The lines are parsed in place: the separators are replaced by
+ * string terminations and the numbers are converted directly out of
+ * the block. Only the begin of a line at the end of a block is copied
+ * into a fixed buffer. There is no heap allocation at all.
+ *
+ * The SSID (name) can contain the ';' character. Therefore pos and n
+ * are the first two fields and id, RSSI (and channel) the last fields
+ * of a line. Everything in between is the name. The id field is found
+ * by its BSSID format.
+ *
+ * Hague Nusseck @ electricidea
+ * v1.0
+ * https://github.com/electricidea/M5Stack-Hotel-room-finder
+ *
+ * Distributed as-is; no warranty is given.
+ *
+ **************************************************************************
+ *
+ * ==== How to use it: ====
+ *
+ * 1.) write a callback function for the records:
+ *
+ *          void learn_record(const survey_record &record, void *context) {
+ *              ...record.pos, record.bssid, record.rssi...
+ *          }
+ *
+ * 2.) read the file:
+ *
+ *          survey_reader reader(learn_record, &context);
+ *          File file = SD.open("/WiFi_data.txt");
+ *          reader.read(file);
+ *
+ *     or feed the data block by block and finish the last line:
+ *
+ *          reader.feed(block, length);
+ *          reader.finish();
+ *
+ * Lines without a number as position (e.g. the header line), lines
+ * with less than 5 fields and lines longer than survey_buffer_size
+ * are skipped and counted by skipped().
+ *
+ ***************************************************************************/
+
+#include <stdlib.h>
+#include <string.h>
+#include "survey_reader.h"
+#include "bssid_key.h"
+
+//==============================================================
+// the constructor
+survey_reader::survey_reader(survey_callback callback, void *context) {
+    this->callback = callback;
+    this->context = context;
+    fill = 0;
+    overflow = false;
+    n_records = 0;
+    n_skipped = 0;
+}
+
+//==============================================================
+// parse all complete lines of a block of data
+// the data is modified (the separators are replaced by 0)
+void survey_reader::feed(char *data, size_t length) {
+    size_t start = 0;
+    for(size_t i = 0; i < length; ++i) {
+        // CRLF = \r\n = ASCII code 13 and then ASCII code 10
+        if(data[i] != '\r' && data[i] != '\n')
+            continue;
+        if(fill > 0 || overflow) {
+            // the line started in the last block
+            size_t part = i - start;
+            if(!overflow && fill + part <= survey_buffer_size) {
+                memcpy(&buffer[fill], &data[start], part);
+                parse_line(buffer, fill + part);
+            } else {
+                ++n_skipped;
+            }
+            fill = 0;
+            overflow = false;
+        } else if(i > start) {
+            parse_line(&data[start], i - start);
+        }
+        start = i + 1;
+    }
+    // keep the begin of the unfinished line
+    size_t part = length - start;
+    if(part > 0) {
+        if(!overflow && fill + part <= survey_buffer_size) {
+            memcpy(&buffer[fill], &data[start], part);
+            fill += part;
+        } else {
+            overflow = true;
+        }
+    }
+}
+
+//==============================================================
+// parse the last line, if the data does not end with CR or LF
+void survey_reader::finish() {
+    if(overflow)
+        ++n_skipped;
+    else if(fill > 0)
+        parse_line(buffer, fill);
+    fill = 0;
+    overflow = false;
+}
+
+//==============================================================
+// true, if the characters from begin to end are a BSSID
+static bool survey_is_bssid(const char *begin, const char *end) {
+    if(end - begin != bssid_text_size - 1)
+        return false;
+    for(int i = 0; i < bssid_text_size - 1; ++i) {
+        if(i % 3 == 2) {
+            if(begin[i] != ':' && begin[i] != '-')
+                return false;
+        } else if(bssid_hex_digit(begin[i]) < 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+//==============================================================
+// search the last separator in front of a position
+// (but behind the limit)
+static char *survey_separator_before(char *position, char *limit) {
+    for(char *c = position - 1; c > limit; --c) {
+        if(*c == ';')
+            return c;
+    }
+    return NULL;
+}
+
+//==============================================================
+// split one line into the fields and call the callback function
+// line[length] is overwritten with the string termination
+void survey_reader::parse_line(char *line, size_t length) {
+    line[length] = 0;
+    char *first = strchr(line, ';');
+    char *second = first ? strchr(first + 1, ';') : NULL;
+    // the separators in front of the last three fields
+    char *last = second ? strrchr(line, ';') : NULL;
+    char *before_last = (last && last > second) ? survey_separator_before(last, second) : NULL;
+    if(!before_last) {
+        ++n_skipped;
+        return;
+    }
+    // pos;n;name;id;RSSI or pos;n;name;id;RSSI;channel
+    char *id_separator = before_last;
+    char *rssi_separator = last;
+    char *channel_separator = NULL;
+    if(!survey_is_bssid(before_last + 1, last)) {
+        char *third = survey_separator_before(before_last, second);
+        if(third && survey_is_bssid(third + 1, before_last)) {
+            id_separator = third;
+            rssi_separator = before_last;
+            channel_separator = last;
+        }
+    }
+    *first = 0;
+    *second = 0;
+    *id_separator = 0;
+    *rssi_separator = 0;
+    if(channel_separator)
+        *channel_separator = 0;
+    survey_record record;
+    char *end;
+    record.pos = strtod(line, &end);
+    // no number (e.g. the header line "pos;n;name;id;RSSI")
+    if(end == line) {
+        ++n_skipped;
+        return;
+    }
+    record.n = (int) strtol(first + 1, NULL, 10);
+    record.name = second + 1;
+    record.bssid = id_separator + 1;
+    record.rssi = strtod(rssi_separator + 1, NULL);
+    record.channel = channel_separator ? (int) strtol(channel_separator + 1, NULL, 10) : 0;
+    ++n_records;
+    callback(record, context);
+}
@@ -0,0 +1,76 @@
+/***************************************************
+ *
+ * Buffered reader for WiFi survey files
+ *
+ * Hague Nusseck @ electricidea
+ *
+ * --> see survey_reader.cpp for more details on how it
+ * works and how to use it.
+ *
+ * Distributed as-is; no warranty is given.
+ *
+ * ************************************************/
+
+#ifndef SURVEY_READER_H
+#define SURVEY_READER_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// size of the line buffer = maximum length of one line
+const size_t survey_buffer_size = 256;
+// size of the blocks read from a file by read()
+const size_t survey_block_size = 512;
+
+// one line of a survey file: pos;n;name;id;RSSI;channel
+// name and bssid point into the buffer of the reader and
+// are only valid inside of the callback function
+struct survey_record {
+    double pos;
+    int n;
+    const char *name;
+    const char *bssid;
+    double rssi;
+    // primary channel of the AP (0 = unknown)
+    int channel;
+};
+
+typedef void (*survey_callback)(const survey_record &record, void *context);
+
+// class definition
+class survey_reader {
+    public:
+        survey_reader(survey_callback callback, void *context);
+        void feed(char *data, size_t length);
+        void finish();
+        template<typename Source> void read(Source &source);
+        uint32_t records() const { return n_records; }
+        uint32_t skipped() const { return n_skipped; }
+    private:
+        void parse_line(char *line, size_t length);
+        survey_callback callback;
+        void *context;
+        // the begin of a line that is not finished by the
+        // last block of data (+1 for the string termination)
+        char buffer[survey_buffer_size+1];
+        size_t fill;
+        // true, if the current line is too long for the buffer
+        bool overflow;
+        uint32_t n_records;
+        uint32_t n_skipped;
+};
+
+//==============================================================
+// read all data from a source in blocks
+// Source needs a function read(uint8_t *data, size_t size)
+// that returns the number of bytes read (e.g. File)
+template<typename Source>
+void survey_reader::read(Source &source) {
+    char block[survey_block_size];
+    size_t length;
+    while((length = source.read((uint8_t*) block, sizeof(block))) > 0 && length <= sizeof(block))
+        feed(block, length);
+    finish();
+}
+
+#endif
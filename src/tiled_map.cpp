@@ -0,0 +1,487 @@
+/**************************************************************************
+ * Tiled floor map, paged from the SD card with an LRU tile cache
+ *
+ * A floor map (floor_map.cpp) is loaded completely into the memory.
+ * The size of a building is therefore limited by the heap. The tiled
+ * map keeps only a small resident part in the memory and reads the
+ * fingerprints tile by tile from the SD card when they are needed:
+ *
+ *   offset 0:      tiled_map_header (48 bytes)
+ *   grid:          n_x double values, the positions along the floor
+ *   BSSIDs:        n_aps uint64_t values, packed BSSIDs
+ *   channels:      n_aps uint8_t values, WiFi channels of the APs
+ *   index:         for each tile the minimum and the maximum value
+ *                  of each AP over the cells of the tile
+ *                  (2 * ap_stride map_scalar values)
+ *   --- resident part, padded to 512 bytes ---
+ *   tiles:         n_tiles tiles of tile_cells fingerprints
+ *                  (cell-major, ap_stride values per cell, see
+ *                  fingerprint_matcher.cpp), each tile padded to a
+ *                  multiple of 512 bytes (SD card blocks)
+ *
+ * Each section of the resident part begins at a 16 byte boundary.
+ * The resident part is loaded with one single read and checked with
+ * a FNV-1a checksum.
+ *
+ * Tile cache: a fixed number of tiles (cache_bytes / tile size) is
+ * kept in the memory. A missing tile is read from the file into the
+ * least recently used slot.
+ *
+ * What stays in the memory: the cache is fixed, but the resident part
+ * grows with the floor. The grid needs 8 bytes per cell, the BSSIDs
+ * and channels 9 bytes per AP, the index 2 * ap_stride values per
+ * tile, the search order and the slot of each tile 12 (integer map)
+ * or 20 (double map) bytes per tile. E.g. 2000 cells and 40 APs
+ * (int8 map, 64 cells per tile): 16kB grid and 3kB index in the
+ * memory, 96kB fingerprints on the SD card.
+ *
+ * Saving: the fingerprints don't have to be in the memory either. The
+ * second save() calculates them tile by tile with a function (e.g.
+ * out of the fits), once for the index of the resident part and once
+ * more for the tiles in the file. Only the resident part and one tile
+ * are in the memory.
+ *
+ * Search: the distance of the scan to the ranges of the index is a
+ * lower bound of the sums of all cells of a tile (same bound as the
+ * bound pyramid of the fingerprint_matcher). The search begins with
+ * the tile of the last position, then the tiles are read in the order
+ * of their bounds, and the search stops at the first tile with a
+ * bound bigger than the best sum. Only the tiles around the position
+ * are read from the file, and the result is the same cell as the
+ * search over the whole map.
+ *
+ * The number of cache hits and misses (tiles read from the file) and
+ * the time of the page-ins are counted.
+ *
+ * Hague Nusseck @ electricidea
+ * v1.0
+ * https://github.com/electricidea/M5Stack-Hotel-room-finder
+ *
+ * Distributed as-is; no warranty is given.
+ *
+ **************************************************************************
+ *
+ * ==== How to use it: ====
+ *
+ * 1.) save a floor map as tiled map:
+ *
+ *          File file = SD.open("/floor_tiles.bin", FILE_WRITE);
+ *          tiled_map::save(floor_data, file);
+ *
+ *     or calculate the fingerprints tile by tile:
+ *
+ *          bool cells(void *context, int begin, int end, int stride, map_scalar *cells) {
+ *              ... cells[(x-begin)*stride + ap] for begin <= x < end
+ *              return true;
+ *          }
+ *
+ *          tiled_map::save(n_x, n_aps, x, bssids, channels, cells, NULL, file);
+ *
+ * 2.) open the tiled map with a function for the random access
+ *     to the file and 32kB of tile cache:
+ *
+ *          bool read_file(void *context, uint32_t offset, uint8_t *data, size_t size) {
+ *              File *file = (File*) context;
+ *              return file->seek(offset) && file->read(data, size) == size;
+ *          }
+ *
+ *          File file = SD.open("/floor_tiles.bin");
+ *          tiled_map map;
+ *          map.open(read_file, &file, 32768);
+ *
+ *     the file must stay open as long as the map is used
+ *
+ * 3.) search the position of a scan:
+ *
+ *          map.clear_query();
+ *          map.set_rssi(AP_index, map_encode(RSSI));
+ *          int best_x = map.match(last_x, NULL);
+ *          Serial.printf("%u hits, %u page-ins, %u us\n", map.hits(),
+ *                        map.misses(), map.page_in_us());
+ *
+ ***************************************************************************/
+
+#include <stdlib.h>
+#include <string.h>
+#include "tiled_map.h"
+
+#ifdef ARDUINO
+#include "Arduino.h"
+#else
+#include <chrono>
+#endif
+
+//==============================================================
+// microseconds since the start
+static uint32_t tiled_map_micros() {
+#ifdef ARDUINO
+    return micros();
+#else
+    static std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+    return (uint32_t) std::chrono::duration_cast<std::chrono::microseconds>(
+                          std::chrono::steady_clock::now() - begin).count();
+#endif
+}
+
+//==============================================================
+// round up to the next multiple of the alignment
+static size_t tiled_map_align(size_t size, size_t alignment) {
+    return (size + alignment - 1) & ~(alignment - 1);
+}
+
+//==============================================================
+// offsets of the sections of the resident part
+// return the size of the resident part (= offset of the first tile)
+static size_t tiled_map_layout(const tiled_map_header &file_header, size_t *grid, size_t *bssids,
+                               size_t *channels, size_t *index) {
+    size_t offset = tiled_map_align(sizeof(tiled_map_header), matcher_alignment);
+    *grid = offset;
+    offset += tiled_map_align(file_header.n_x * sizeof(double), matcher_alignment);
+    *bssids = offset;
+    offset += tiled_map_align(file_header.n_aps * sizeof(uint64_t), matcher_alignment);
+    *channels = offset;
+    offset += tiled_map_align(file_header.n_aps * sizeof(uint8_t), matcher_alignment);
+    *index = offset;
+    offset += (size_t) 2 * file_header.n_tiles * file_header.ap_stride * sizeof(map_scalar);
+    return tiled_map_align(offset, tiled_map_block);
+}
+
+//==============================================================
+// FNV-1a checksum of the resident part behind the header
+static uint32_t tiled_map_checksum(const uint8_t *prefix, size_t size) {
+    uint32_t hash = 2166136261UL;
+    for(size_t i = sizeof(tiled_map_header); i < size; ++i) {
+        hash ^= prefix[i];
+        hash *= 16777619UL;
+    }
+    return hash;
+}
+
+//==============================================================
+// build the resident part of the tiled file: header, grid,
+// BSSIDs and channels, the index is filled by
+// tiled_map_index_tile() and the header by tiled_map_close_prefix()
+// the header is copied to file_header
+// return the memory block (free() it) or NULL
+uint8_t *tiled_map_prefix(int n_x, int n_aps, const double *x, const uint64_t *bssids,
+                          const uint8_t *channels, int tile_cells, tiled_map_header *file_header) {
+    if(n_x < 1 || n_aps < 1 || tile_cells < 1)
+        return NULL;
+    tiled_map_header &h = *file_header;
+    memset(&h, 0, sizeof(h));
+    h.magic = tiled_map_magic;
+    h.version = tiled_map_version;
+    h.value_type = map_type_id;
+    h.header_size = sizeof(tiled_map_header);
+    h.n_x = n_x;
+    h.n_aps = n_aps;
+    h.ap_stride = matcher_stride(h.n_aps);
+    h.tile_cells = tile_cells;
+    h.n_tiles = (h.n_x + tile_cells - 1) / tile_cells;
+    h.tile_bytes = tiled_map_align((size_t) tile_cells * h.ap_stride * sizeof(map_scalar), tiled_map_block);
+    h.value_offset = map_offset;
+    h.value_step = map_step;
+    size_t grid, bssids_offset, channels_offset, index;
+    h.tiles_offset = tiled_map_layout(h, &grid, &bssids_offset, &channels_offset, &index);
+    uint8_t *prefix = (uint8_t*) calloc(h.tiles_offset, 1);
+    if(!prefix)
+        return NULL;
+    memcpy(prefix + grid, x, h.n_x * sizeof(double));
+    memcpy(prefix + bssids_offset, bssids, h.n_aps * sizeof(uint64_t));
+    memcpy(prefix + channels_offset, channels, h.n_aps * sizeof(uint8_t));
+    return prefix;
+}
+
+//==============================================================
+// calculate the cells of one tile into the buffer
+// (tile_bytes, the padding values are 0)
+// return false if the cells can't be calculated
+bool tiled_map_fill_tile(const tiled_map_header &file_header, int tile, tiled_map_cells cells,
+                         void *context, map_scalar *buffer) {
+    memset(buffer, 0, file_header.tile_bytes);
+    uint32_t begin = tile * file_header.tile_cells;
+    uint32_t end = (begin + file_header.tile_cells < file_header.n_x) ? begin + file_header.tile_cells : file_header.n_x;
+    return cells(context, begin, end, file_header.ap_stride, buffer);
+}
+
+//==============================================================
+// the range of each AP over the cells of a tile into the index
+// of the resident part (the padding values are 0)
+void tiled_map_index_tile(const tiled_map_header &file_header, int tile, const map_scalar *buffer,
+                          uint8_t *prefix) {
+    size_t grid, bssids, channels, index;
+    tiled_map_layout(file_header, &grid, &bssids, &channels, &index);
+    uint32_t stride = file_header.ap_stride;
+    map_scalar *lo = (map_scalar*) (prefix + index) + (size_t) 2 * tile * stride;
+    map_scalar *hi = lo + stride;
+    uint32_t begin = tile * file_header.tile_cells;
+    uint32_t end = (begin + file_header.tile_cells < file_header.n_x) ? begin + file_header.tile_cells : file_header.n_x;
+    for(uint32_t x = begin; x < end; ++x) {
+        const map_scalar *cell = &buffer[(size_t) (x - begin) * stride];
+        for(uint32_t ap = 0; ap < file_header.n_aps; ++ap) {
+            if(x == begin || cell[ap] < lo[ap])
+                lo[ap] = cell[ap];
+            if(x == begin || cell[ap] > hi[ap])
+                hi[ap] = cell[ap];
+        }
+    }
+}
+
+//==============================================================
+// the checksum of the complete resident part into the header
+void tiled_map_close_prefix(tiled_map_header *file_header, uint8_t *prefix) {
+    file_header->checksum = tiled_map_checksum(prefix, file_header->tiles_offset);
+    memcpy(prefix, file_header, sizeof(tiled_map_header));
+}
+
+//==============================================================
+// the cells of a floor map (context) for tiled_map::save()
+// the floor map has the same cell-major layout as the tiles
+bool tiled_map_floor_cells(void *context, int begin, int end, int stride, map_scalar *cells) {
+    const floor_map *map = (const floor_map*) context;
+    if((int) map->stride() != stride)
+        return false;
+    memcpy(cells, map->cell(begin), (size_t) (end - begin) * stride * sizeof(map_scalar));
+    return true;
+}
+
+//==============================================================
+// compare two tiles by their bounds (qsort)
+static int tiled_map_compare(const void *a, const void *b) {
+    const tiled_map_order *order_a = (const tiled_map_order*) a;
+    const tiled_map_order *order_b = (const tiled_map_order*) b;
+    if(order_a->bound < order_b->bound)
+        return -1;
+    if(order_a->bound > order_b->bound)
+        return 1;
+    return order_a->tile - order_b->tile;
+}
+
+//==============================================================
+// the constructor
+tiled_map::tiled_map() {
+    block = NULL;
+    cache = NULL;
+    slot_tile = NULL;
+    order = NULL;
+    release();
+}
+
+//==============================================================
+// the destructor
+tiled_map::~tiled_map() {
+    release();
+}
+
+//==============================================================
+// free the memory
+void tiled_map::release() {
+    free(block);
+    free(cache);
+    // one memory block for slot_tile, slot_used, tile_slot
+    free(slot_tile);
+    free(order);
+    block = NULL;
+    header = NULL;
+    x_ = NULL;
+    bssids_ = NULL;
+    channels_ = NULL;
+    index = NULL;
+    read = NULL;
+    context = NULL;
+    cache = NULL;
+    n_slots = 0;
+    slot_tile = NULL;
+    slot_used = NULL;
+    tile_slot = NULL;
+    use_count = 0;
+    order = NULL;
+    query.release();
+    reset_counters();
+    n_searched = 0;
+}
+
+//==============================================================
+// forget the statistics of the tile cache
+void tiled_map::reset_counters() {
+    n_hits = 0;
+    n_misses = 0;
+    page_in_time = 0;
+}
+
+//==============================================================
+// load the resident part of a tiled map and allocate the cache
+// read:        function for the random access to the file
+// cache_bytes: memory of the tile cache (at least one tile)
+// return false if the file is no valid tiled map of the map_scalar
+// type of this build or the memory allocation fails
+bool tiled_map::open(tiled_map_read read_file, void *read_context, size_t cache_bytes) {
+    release();
+    tiled_map_header file_header;
+    if(!read_file(read_context, 0, (uint8_t*) &file_header, sizeof(file_header)))
+        return false;
+    if(file_header.magic != tiled_map_magic ||
+       file_header.version != tiled_map_version ||
+       file_header.header_size != sizeof(tiled_map_header) ||
+       file_header.value_type != map_type_id ||
+       file_header.value_offset != (float) map_offset ||
+       file_header.value_step != (float) map_step ||
+       file_header.n_x == 0 || file_header.n_aps == 0 || file_header.tile_cells == 0 ||
+       file_header.ap_stride != (uint32_t) matcher_stride(file_header.n_aps) ||
+       file_header.n_tiles != (file_header.n_x + file_header.tile_cells - 1) / file_header.tile_cells ||
+       file_header.tile_bytes < file_header.tile_cells * file_header.ap_stride * sizeof(map_scalar))
+        return false;
+    size_t grid, bssids, channels, index_offset;
+    if(file_header.tiles_offset != tiled_map_layout(file_header, &grid, &bssids, &channels, &index_offset))
+        return false;
+    // the resident part with one read
+    // malloc only guarantees an 8 byte alignment
+    uint8_t *prefix = (uint8_t*) malloc(file_header.tiles_offset + matcher_alignment);
+    if(!prefix)
+        return false;
+    block = prefix;
+    uint8_t *base = (uint8_t*) tiled_map_align((size_t) prefix, matcher_alignment);
+    if(!read_file(read_context, 0, base, file_header.tiles_offset) ||
+       tiled_map_checksum(base, file_header.tiles_offset) != file_header.checksum) {
+        release();
+        return false;
+    }
+    header = (tiled_map_header*) base;
+    x_ = (double*) (base + grid);
+    bssids_ = (uint64_t*) (base + bssids);
+    channels_ = (uint8_t*) (base + channels);
+    index = (map_scalar*) (base + index_offset);
+    // the tile cache
+    n_slots = cache_bytes / header->tile_bytes;
+    if(n_slots < 1)
+        n_slots = 1;
+    if((uint32_t) n_slots > header->n_tiles)
+        n_slots = header->n_tiles;
+    cache = (uint8_t*) malloc((size_t) n_slots * header->tile_bytes + matcher_alignment);
+    slot_tile = (int*) malloc((2*n_slots + header->n_tiles) * sizeof(int));
+    order = (tiled_map_order*) malloc(header->n_tiles * sizeof(tiled_map_order));
+    if(!cache || !slot_tile || !order || !query.init_query(header->n_aps)) {
+        release();
+        return false;
+    }
+    slot_used = (uint32_t*) &slot_tile[n_slots];
+    tile_slot = &slot_tile[2*n_slots];
+    for(int s = 0; s < n_slots; ++s) {
+        slot_tile[s] = -1;
+        slot_used[s] = 0;
+    }
+    for(uint32_t t = 0; t < header->n_tiles; ++t)
+        tile_slot[t] = -1;
+    read = read_file;
+    context = read_context;
+    return true;
+}
+
+//==============================================================
+// the fingerprints of a tile (tile_cells * ap_stride values)
+// the tile is read from the file, if it is not in the cache
+// return NULL if the tile can't be read
+const map_scalar *tiled_map::tile(int t) {
+    if(!header || t < 0 || (uint32_t) t >= header->n_tiles)
+        return NULL;
+    uint8_t *slots = (uint8_t*) tiled_map_align((size_t) cache, matcher_alignment);
+    int slot = tile_slot[t];
+    if(slot >= 0) {
+        ++n_hits;
+        slot_used[slot] = ++use_count;
+        return (const map_scalar*) (slots + (size_t) slot * header->tile_bytes);
+    }
+    // page in: the empty or the least recently used slot
+    ++n_misses;
+    slot = 0;
+    for(int s = 1; s < n_slots; ++s) {
+        if(slot_used[s] < slot_used[slot])
+            slot = s;
+    }
+    if(slot_tile[slot] >= 0)
+        tile_slot[slot_tile[slot]] = -1;
+    slot_tile[slot] = -1;
+    uint8_t *data = slots + (size_t) slot * header->tile_bytes;
+    uint32_t start_time = tiled_map_micros();
+    bool loaded = read(context, header->tiles_offset + (uint32_t) t * header->tile_bytes, data, header->tile_bytes);
+    page_in_time += tiled_map_micros() - start_time;
+    if(!loaded)
+        return NULL;
+    slot_tile[slot] = t;
+    slot_used[slot] = ++use_count;
+    tile_slot[t] = slot;
+    return (const map_scalar*) data;
+}
+
+//==============================================================
+// search the cell with the smallest sum of squared differences
+// hint: the cell which is calculated first (e.g. the last result)
+// return the index of the cell and its sum in best_sum,
+// or -1 if a tile can't be read
+int tiled_map::match(int hint, map_accum *best_sum) {
+    n_searched = 0;
+    if(!header)
+        return -1;
+    int n_cells = header->n_x;
+    int tile_cells = header->tile_cells;
+    int ap_stride = header->ap_stride;
+    query.select_blocks();
+    if(hint < 0 || hint >= n_cells)
+        hint = 0;
+    // the full sum of the hint cell is the first bound
+    const map_scalar *fingerprints = tile(hint / tile_cells);
+    if(!fingerprints)
+        return -1;
+    int best_x = hint;
+    map_accum best = 0;
+    query.fingerprint_ssd(&fingerprints[(size_t) (hint % tile_cells) * ap_stride], hint, map_accum_max, n_cells, &best);
+    // the lower bounds of all tiles out of the index
+    int n_order = 0;
+    for(uint32_t t = 0; t < header->n_tiles; ++t) {
+        const map_scalar *lo = &index[(size_t) 2 * t * ap_stride];
+        map_accum bound;
+        if(query.range_bound(lo, lo + ap_stride, t * tile_cells, best, best_x, &bound)) {
+            order[n_order].bound = bound;
+            order[n_order].tile = t;
+            ++n_order;
+        }
+    }
+    qsort(order, n_order, sizeof(tiled_map_order), tiled_map_compare);
+    for(int i = 0; i < n_order; ++i) {
+        int t = order[i].tile;
+        // all following tiles have bigger bounds
+        if(order[i].bound > best)
+            break;
+        if(order[i].bound == best && t * tile_cells > best_x)
+            continue;
+        fingerprints = tile(t);
+        if(!fingerprints)
+            return -1;
+        ++n_searched;
+        int end = (t+1) * tile_cells;
+        if(end > n_cells)
+            end = n_cells;
+        for(int x = t * tile_cells; x < end; ++x) {
+            map_accum sum;
+            if(query.fingerprint_ssd(&fingerprints[(size_t) (x - t * tile_cells) * ap_stride], x, best, best_x, &sum)) {
+                best = sum;
+                best_x = x;
+            }
+        }
+    }
+    if(best_sum)
+        *best_sum = best;
+    return best_x;
+}
+
+//==============================================================
+// return the memory footprint in bytes
+size_t tiled_map::memory_bytes() const {
+    if(!header)
+        return sizeof(tiled_map);
+    return sizeof(tiled_map) + header->tiles_offset + matcher_alignment
+         + (size_t) n_slots * header->tile_bytes + matcher_alignment
+         + (2*n_slots + header->n_tiles) * sizeof(int)
+         + header->n_tiles * sizeof(tiled_map_order)
+         + query.memory_bytes() - sizeof(fingerprint_matcher);
+}
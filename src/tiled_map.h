@@ -0,0 +1,189 @@
+/***************************************************
+ *
+ * Tiled floor map, paged from the SD card with an
+ * LRU tile cache
+ *
+ * Hague Nusseck @ electricidea
+ *
+ * --> see tiled_map.cpp for more details on how it
+ * works and how to use it.
+ *
+ * Distributed as-is; no warranty is given.
+ *
+ * ************************************************/
+
+#ifndef TILED_MAP_H
+#define TILED_MAP_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include "numeric_types.h"
+#include "floor_map.h"
+#include "fingerprint_matcher.h"
+
+// "FTIL" as little endian number
+const uint32_t tiled_map_magic = 0x4C495446;
+const uint16_t tiled_map_version = 1;
+// default number of grid positions of one tile
+const int tiled_map_tile_cells = 64;
+// the tiles begin at SD card block boundaries
+const uint32_t tiled_map_block = 512;
+
+// header at the begin of the file (48 bytes)
+struct tiled_map_header {
+    uint32_t magic;
+    uint16_t version;
+    // map_type_id of the fingerprint values
+    uint8_t value_type;
+    uint8_t header_size;
+    // number of grid positions and access points
+    uint32_t n_x;
+    uint32_t n_aps;
+    // number of values of one fingerprint (n_aps + padding)
+    uint32_t ap_stride;
+    // number of grid positions of one tile and number of tiles
+    uint32_t tile_cells;
+    uint32_t n_tiles;
+    // size of one tile in the file (multiple of tiled_map_block)
+    uint32_t tile_bytes;
+    // file offset of the first tile (= size of the resident part)
+    uint32_t tiles_offset;
+    // rssi = value_offset + (value * value_step)
+    float value_offset;
+    float value_step;
+    // FNV-1a checksum of the resident part behind the header
+    uint32_t checksum;
+};
+
+// random access to the file: read size bytes at offset
+// return false if the data can't be read
+typedef bool (*tiled_map_read)(void *context, uint32_t offset, uint8_t *data, size_t size);
+
+// fingerprints of the cells begin..end-1 for the tiled file
+// (cell-major, stride values per cell, the padding values are 0)
+// return false if the cells can't be calculated
+typedef bool (*tiled_map_cells)(void *context, int begin, int end, int stride, map_scalar *cells);
+
+// one entry of the search order of the tiles
+struct tiled_map_order {
+    map_accum bound;
+    int tile;
+};
+
+// class definition
+class tiled_map {
+    public:
+        tiled_map();
+        ~tiled_map();
+        bool open(tiled_map_read read, void *context, size_t cache_bytes);
+        void release();
+        template<typename Sink> static bool save(const floor_map &map, Sink &file,
+                                                 int tile_cells = tiled_map_tile_cells);
+        template<typename Sink> static bool save(int n_x, int n_aps, const double *x, const uint64_t *bssids,
+                                                 const uint8_t *channels, tiled_map_cells cells, void *context,
+                                                 Sink &file, int tile_cells = tiled_map_tile_cells);
+        uint32_t n_x() const { return header ? header->n_x : 0; }
+        uint32_t n_aps() const { return header ? header->n_aps : 0; }
+        uint32_t tiles() const { return header ? header->n_tiles : 0; }
+        int cache_tiles() const { return n_slots; }
+        double *x() const { return x_; }
+        uint64_t *bssids() const { return bssids_; }
+        uint8_t *channels() const { return channels_; }
+        const map_scalar *tile(int t);
+        // matching of a scan
+        void clear_query() { query.clear_query(); }
+        void set_rssi(int ap, map_scalar value) { query.set_rssi(ap, value); }
+        int match(int hint, map_accum *best_sum);
+        int searched() const { return n_searched; }
+        // statistics of the tile cache
+        uint32_t hits() const { return n_hits; }
+        uint32_t misses() const { return n_misses; }
+        uint32_t page_in_us() const { return page_in_time; }
+        void reset_counters();
+        size_t memory_bytes() const;
+    private:
+        // the resident part of the file: header, grid, BSSIDs,
+        // channels and the index of the tiles
+        uint8_t *block;
+        tiled_map_header *header;
+        double *x_;
+        uint64_t *bssids_;
+        uint8_t *channels_;
+        // minimum and maximum values of each tile (2*ap_stride values)
+        map_scalar *index;
+        // the file
+        tiled_map_read read;
+        void *context;
+        // the tile cache: n_slots tiles in memory
+        uint8_t *cache;
+        int n_slots;
+        // tile of each slot (-1 = empty) and time of the last use
+        int *slot_tile;
+        uint32_t *slot_used;
+        // slot of each tile (-1 = not in memory)
+        int *tile_slot;
+        uint32_t use_count;
+        // the search order of the tiles
+        tiled_map_order *order;
+        fingerprint_matcher query;
+        // statistics
+        int n_searched;
+        uint32_t n_hits;
+        uint32_t n_misses;
+        uint32_t page_in_time;
+};
+
+uint8_t *tiled_map_prefix(int n_x, int n_aps, const double *x, const uint64_t *bssids,
+                          const uint8_t *channels, int tile_cells, tiled_map_header *file_header);
+bool tiled_map_fill_tile(const tiled_map_header &file_header, int tile, tiled_map_cells cells,
+                         void *context, map_scalar *buffer);
+void tiled_map_index_tile(const tiled_map_header &file_header, int tile, const map_scalar *buffer,
+                          uint8_t *prefix);
+void tiled_map_close_prefix(tiled_map_header *file_header, uint8_t *prefix);
+bool tiled_map_floor_cells(void *context, int begin, int end, int stride, map_scalar *cells);
+
+//==============================================================
+// save a floor map as tiled map
+// Sink needs a function write(const uint8_t *data, size_t size)
+// that returns the number of bytes written (e.g. File)
+template<typename Sink>
+bool tiled_map::save(const floor_map &map, Sink &file, int tile_cells) {
+    return save(map.n_x(), map.n_aps(), map.x(), map.bssids(), map.channels(), tiled_map_floor_cells,
+                (void*) &map, file, tile_cells);
+}
+
+//==============================================================
+// save a tiled map without a floor map in the memory
+// the fingerprints are calculated tile by tile by the function
+// cells (twice: first for the index, then for the file)
+// the resident part is written with one write, the tiles with
+// one write per tile
+template<typename Sink>
+bool tiled_map::save(int n_x, int n_aps, const double *x, const uint64_t *bssids, const uint8_t *channels,
+                     tiled_map_cells cells, void *context, Sink &file, int tile_cells) {
+    tiled_map_header file_header;
+    uint8_t *prefix = tiled_map_prefix(n_x, n_aps, x, bssids, channels, tile_cells, &file_header);
+    if(!prefix)
+        return false;
+    map_scalar *buffer = (map_scalar*) malloc(file_header.tile_bytes);
+    bool written = buffer != NULL;
+    for(uint32_t t = 0; written && t < file_header.n_tiles; ++t) {
+        written = tiled_map_fill_tile(file_header, t, cells, context, buffer);
+        if(written)
+            tiled_map_index_tile(file_header, t, buffer, prefix);
+    }
+    if(written) {
+        tiled_map_close_prefix(&file_header, prefix);
+        written = file.write(prefix, file_header.tiles_offset) == file_header.tiles_offset;
+    }
+    free(prefix);
+    for(uint32_t t = 0; written && t < file_header.n_tiles; ++t) {
+        written = tiled_map_fill_tile(file_header, t, cells, context, buffer) &&
+                  file.write((uint8_t*) buffer, file_header.tile_bytes) == file_header.tile_bytes;
+    }
+    free(buffer);
+    return written;
+}
+
+#endif
@@ -0,0 +1,384 @@
+/**************************************************************************
+ * WiFi scanner with a hardware and a replay backend
+ *
+ * wifi_scanner is the interface between the WiFi scans and the rest
+ * of the program. A scan is started in the background, and the
+ * results are copied out of the backend when the scan is finished.
+ * Therefore the next scan can run while the results of the last
+ * scan are processed:
+ *
+ *   hardware_scanner   asynchronous scans of the ESP32 WiFi hardware
+ *                      (WiFi.scanNetworks(true) and scanComplete())
+ *   replay_scanner     recorded scans out of a survey file. Runs on
+ *                      the host to test and benchmark the whole
+ *                      pipeline.
+ *
+ * A scan can be limited to some channels (e.g. the channels of the
+ * APs of the floor map) with a time per channel (dwell time). The
+ * hardware scans one channel after the other, the replay waits the
+ * dwell time of all scanned channels and returns only the networks
+ * on these channels. A scan of all channels takes 13 dwell times.
+ *
+ * The hardware backend keeps all networks of a scan (the buffer grows
+ * with the number of networks of scanComplete()). If a scan has more
+ * networks than the results array of take(), the strongest networks
+ * are kept and the others are counted by dropped(). A scan of only
+ * some channels therefore never loses the networks of the last
+ * channels just because the first channels were crowded.
+ *
+ * Hague Nusseck @ electricidea
+ * v1.0
+ * https://github.com/electricidea/M5Stack-Hotel-room-finder
+ *
+ * Distributed as-is; no warranty is given.
+ *
+ **************************************************************************
+ *
+ * ==== How to use it: ====
+ *
+ * 1.) blocking scan:
+ *
+ *          hardware_scanner scanner;
+ *          scan_result results[scanner_max_results];
+ *          int n = scanner.scan(results, scanner_max_results);
+ *          if(scanner.dropped() > 0)
+ *              ... only the strongest networks are in the results
+ *
+ * 2.) pipelined scans:
+ *
+ *          scanner.start();
+ *          for(int scan = 0; scan < n_scans; ++scan) {
+ *              while(scanner.complete() == scanner_running)
+ *                  delay(10);
+ *              int n = scanner.take(results, scanner_max_results);
+ *              if(scan+1 < n_scans)
+ *                  scanner.start();
+ *              ... process the results of this scan
+ *          }
+ *
+ * 3.) replay recorded scans (e.g. a /WiFi_data.txt file):
+ *
+ *          replay_scanner scanner;
+ *          scanner.load(file);
+ *
+ * 4.) scan only the channels 1, 6 and 11 with 120ms per channel:
+ *
+ *          uint8_t channels[3] = {1, 6, 11};
+ *          scanner.set_channels(channels, 3, 120);
+ *
+ ***************************************************************************/
+
+#include <stdlib.h>
+#include <string.h>
+#include "wifi_scanner.h"
+
+#ifdef ARDUINO
+#include "Arduino.h"
+#include "WiFi.h"
+#else
+#include <chrono>
+#include <thread>
+#endif
+
+//==============================================================
+// milliseconds since the start
+uint32_t scanner_millis() {
+#ifdef ARDUINO
+    return millis();
+#else
+    static std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+    return (uint32_t) std::chrono::duration_cast<std::chrono::milliseconds>(
+                          std::chrono::steady_clock::now() - begin).count();
+#endif
+}
+
+//==============================================================
+// wait some milliseconds
+static void scanner_wait(uint32_t ms) {
+#ifdef ARDUINO
+    delay(ms);
+#else
+    std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+#endif
+}
+
+//==============================================================
+// the constructor: scan all channels
+wifi_scanner::wifi_scanner() {
+    n_channels = 0;
+    dwell_ms = scanner_default_dwell;
+    n_dropped = 0;
+}
+
+//==============================================================
+// select the channels and the time per channel of the next scans
+void wifi_scanner::set_channels(const uint8_t *channels, int n, uint32_t dwell) {
+    n_channels = 0;
+    for(int i = 0; i < n && n_channels < scanner_max_channels; ++i) {
+        if(channels[i] > 0 && channels[i] <= scanner_max_channels)
+            channel_list[n_channels++] = channels[i];
+    }
+    dwell_ms = dwell;
+}
+
+//==============================================================
+// add a network to the results of a scan (n results so far)
+// if the results are full, the weakest network is replaced by a
+// stronger one, and one network is counted as dropped
+void wifi_scanner::keep_strongest(scan_result *results, int *n, int max_results, const scan_result &result) {
+    if(*n < max_results) {
+        results[(*n)++] = result;
+        return;
+    }
+    ++n_dropped;
+    if(max_results < 1)
+        return;
+    int weakest = 0;
+    for(int i = 1; i < max_results; ++i) {
+        if(results[i].rssi < results[weakest].rssi)
+            weakest = i;
+    }
+    if(result.rssi > results[weakest].rssi)
+        results[weakest] = result;
+}
+
+//==============================================================
+// start a scan and wait for the results
+// return the number of networks or scanner_failed
+int wifi_scanner::scan(scan_result *results, int max_results) {
+    if(!start())
+        return scanner_failed;
+    int n;
+    while((n = complete()) == scanner_running)
+        scanner_wait(10);
+    if(n < 0)
+        return n;
+    return take(results, max_results);
+}
+
+#ifdef ARDUINO
+
+//==============================================================
+// the constructor
+hardware_scanner::hardware_scanner() {
+    buffer = NULL;
+    buffer_size = 0;
+    n_buffered = 0;
+    channel_index = 0;
+    done = false;
+}
+
+//==============================================================
+// the destructor
+hardware_scanner::~hardware_scanner() {
+    free(buffer);
+}
+
+//==============================================================
+// start an asynchronous scan of the selected channels
+bool hardware_scanner::start() {
+    n_buffered = 0;
+    n_dropped = 0;
+    channel_index = 0;
+    done = false;
+    return start_channel();
+}
+
+//==============================================================
+// start the scan of the next channel (0 = all channels)
+bool hardware_scanner::start_channel() {
+    uint8_t channel = (n_channels > 0) ? channel_list[channel_index] : 0;
+    return WiFi.scanNetworks(true, false, false, dwell_ms, channel) == WIFI_SCAN_RUNNING;
+}
+
+//==============================================================
+// the state of the scan
+// the results of each finished channel are copied into the buffer
+// and the scan of the next channel is started
+int hardware_scanner::complete() {
+    if(done)
+        return n_buffered;
+    int n = WiFi.scanComplete();
+    if(n == WIFI_SCAN_RUNNING)
+        return scanner_running;
+    if(n < 0)
+        return scanner_failed;
+    // room for all networks of this channel
+    if(n_buffered + n > buffer_size) {
+        scan_result *grown = (scan_result*) realloc(buffer, (n_buffered + n) * sizeof(scan_result));
+        if(grown) {
+            buffer = grown;
+            buffer_size = n_buffered + n;
+        }
+    }
+    // without memory, only the strongest networks are kept
+    for(int i = 0; i < n; ++i) {
+        scan_result result;
+        result.bssid = bssid_pack(WiFi.BSSID(i));
+        result.rssi = (int8_t) WiFi.RSSI(i);
+        result.channel = (uint8_t) WiFi.channel(i);
+        strncpy(result.ssid, WiFi.SSID(i).c_str(), scanner_ssid_size-1);
+        result.ssid[scanner_ssid_size-1] = 0;
+        keep_strongest(buffer, &n_buffered, buffer_size, result);
+    }
+    WiFi.scanDelete();
+    ++channel_index;
+    if(channel_index < n_channels) {
+        if(!start_channel())
+            return scanner_failed;
+        return scanner_running;
+    }
+    done = true;
+    return n_buffered;
+}
+
+//==============================================================
+// copy the results of the finished scan
+// if there are more than max_results networks, the strongest
+// ones are copied and the others are counted by dropped()
+int hardware_scanner::take(scan_result *results, int max_results) {
+    int n_scan = complete();
+    if(n_scan < 0)
+        return 0;
+    int n = 0;
+    if(n_scan <= max_results) {
+        memcpy(results, buffer, n_scan*sizeof(scan_result));
+        n = n_scan;
+    } else {
+        for(int i = 0; i < n_scan; ++i)
+            keep_strongest(results, &n, max_results, buffer[i]);
+    }
+    n_buffered = 0;
+    done = false;
+    return n;
+}
+
+#endif
+
+//==============================================================
+// the constructor
+replay_scanner::replay_scanner() {
+    records = NULL;
+    first = NULL;
+    release();
+}
+
+//==============================================================
+// the destructor
+replay_scanner::~replay_scanner() {
+    release();
+}
+
+//==============================================================
+// free all recorded scans
+void replay_scanner::release() {
+    free(records);
+    free(first);
+    records = NULL;
+    n_records = max_records = 0;
+    first = NULL;
+    n_scans = max_scans = 0;
+    out_of_memory = false;
+    next = 0;
+    current = -1;
+    start_time = 0;
+}
+
+//==============================================================
+// callback of the survey_reader: add one network to the records
+void replay_scanner::add_record(const survey_record &record, void *context) {
+    replay_scanner *replay = (replay_scanner*) context;
+    if(replay->out_of_memory)
+        return;
+    // the arrays grow in steps of the double size
+    if(replay->n_records == replay->max_records) {
+        int size = replay->max_records ? 2*replay->max_records : 64;
+        scan_result *grown = (scan_result*) realloc(replay->records, size*sizeof(scan_result));
+        if(!grown) {
+            replay->out_of_memory = true;
+            return;
+        }
+        replay->records = grown;
+        replay->max_records = size;
+    }
+    // n = 1 is the first network of a new scan
+    if(record.n == 1 || replay->n_scans == 0) {
+        if(replay->n_scans == replay->max_scans) {
+            int size = replay->max_scans ? 2*replay->max_scans : 16;
+            int *grown = (int*) realloc(replay->first, (size+1)*sizeof(int));
+            if(!grown) {
+                replay->out_of_memory = true;
+                return;
+            }
+            replay->first = grown;
+            replay->max_scans = size;
+        }
+        replay->first[replay->n_scans++] = replay->n_records;
+    }
+    scan_result &result = replay->records[replay->n_records++];
+    result.bssid = bssid_parse(record.bssid);
+    result.rssi = (int8_t) record.rssi;
+    result.channel = (uint8_t) record.channel;
+    strncpy(result.ssid, record.name, scanner_ssid_size-1);
+    result.ssid[scanner_ssid_size-1] = 0;
+    // end of the last scan
+    replay->first[replay->n_scans] = replay->n_records;
+}
+
+//==============================================================
+// start the replay of the next recorded scan
+// after the last scan, the replay starts again with the first one
+bool replay_scanner::start() {
+    if(n_scans == 0)
+        return false;
+    current = next;
+    next = (next + 1) % n_scans;
+    start_time = scanner_millis();
+    n_dropped = 0;
+    return true;
+}
+
+//==============================================================
+// true, if a network is found by a scan of the selected channels
+// (networks without channel information are always found)
+static bool replay_on_channel(const scan_result &result, const uint8_t *channels, int n_channels) {
+    if(n_channels == 0 || result.channel == 0)
+        return true;
+    for(int i = 0; i < n_channels; ++i) {
+        if(channels[i] == result.channel)
+            return true;
+    }
+    return false;
+}
+
+//==============================================================
+// the scan is finished after the dwell time of all channels
+int replay_scanner::complete() {
+    if(current < 0)
+        return scanner_failed;
+    uint32_t scan_time = dwell_ms * ((n_channels > 0) ? n_channels : scanner_all_channels);
+    if(scanner_millis() - start_time < scan_time)
+        return scanner_running;
+    int n = 0;
+    for(int i = first[current]; i < first[current+1]; ++i) {
+        if(replay_on_channel(records[i], channel_list, n_channels))
+            ++n;
+    }
+    return n;
+}
+
+//==============================================================
+// copy the networks of the replayed scan on the selected channels
+// if there are more than max_results networks, the strongest
+// ones are copied and the others are counted by dropped()
+int replay_scanner::take(scan_result *results, int max_results) {
+    if(complete() < 0)
+        return 0;
+    int n = 0;
+    for(int i = first[current]; i < first[current+1]; ++i) {
+        if(replay_on_channel(records[i], channel_list, n_channels))
+            keep_strongest(results, &n, max_results, records[i]);
+    }
+    current = -1;
+    return n;
+}
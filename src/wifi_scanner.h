@@ -0,0 +1,144 @@
+/***************************************************
+ *
+ * WiFi scanner with a hardware and a replay backend
+ *
+ * Hague Nusseck @ electricidea
+ *
+ * --> see wifi_scanner.cpp for more details on how it
+ * works and how to use it.
+ *
+ * Distributed as-is; no warranty is given.
+ *
+ * ************************************************/
+
+#ifndef WIFI_SCANNER_H
+#define WIFI_SCANNER_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "bssid_key.h"
+#include "survey_reader.h"
+
+// return values of complete()
+const int scanner_running = -1;
+const int scanner_failed = -2;
+// maximum length of a SSID + 0
+const int scanner_ssid_size = 33;
+// number of networks of one scan for the results arrays
+// a scan with more networks keeps the strongest ones
+// (build with -D SCANNER_MAX_RESULTS=n for other sizes)
+#ifndef SCANNER_MAX_RESULTS
+#define SCANNER_MAX_RESULTS 128
+#endif
+const int scanner_max_results = SCANNER_MAX_RESULTS;
+// number of the 2.4GHz WiFi channels (1 ... 14)
+const int scanner_max_channels = 14;
+// channels of a scan over all channels (1 ... 13)
+const int scanner_all_channels = 13;
+// default time per channel (same as WiFi.scanNetworks())
+const uint32_t scanner_default_dwell = 300;
+
+// one network of a scan
+struct scan_result {
+    uint64_t bssid;
+    int8_t rssi;
+    uint8_t channel;
+    char ssid[scanner_ssid_size];
+};
+
+uint32_t scanner_millis();
+
+// interface of all scanner backends
+class wifi_scanner {
+    public:
+        wifi_scanner();
+        virtual ~wifi_scanner() {}
+        // scan only these channels (n_channels = 0: all channels)
+        // with the given time per channel
+        void set_channels(const uint8_t *channels, int n_channels, uint32_t dwell_ms);
+        int channels() const { return n_channels; }
+        // start a new scan in the background
+        virtual bool start() = 0;
+        // number of networks of the finished scan,
+        // scanner_running or scanner_failed
+        virtual int complete() = 0;
+        // copy the networks of the finished scan and release them
+        // in the backend. A new scan can be started afterwards
+        virtual int take(scan_result *results, int max_results) = 0;
+        int scan(scan_result *results, int max_results);
+        // number of networks of the last scan that were dropped
+        // (weaker than the max_results networks of take())
+        int dropped() const { return n_dropped; }
+    protected:
+        void keep_strongest(scan_result *results, int *n, int max_results, const scan_result &result);
+        uint8_t channel_list[scanner_max_channels];
+        int n_channels;
+        uint32_t dwell_ms;
+        int n_dropped;
+};
+
+#ifdef ARDUINO
+// asynchronous scans of the WiFi hardware
+// (one scan for each selected channel)
+class hardware_scanner : public wifi_scanner {
+    public:
+        hardware_scanner();
+        ~hardware_scanner();
+        bool start();
+        int complete();
+        int take(scan_result *results, int max_results);
+    private:
+        bool start_channel();
+        // the networks of the already scanned channels
+        // (grows with the number of networks of scanComplete())
+        scan_result *buffer;
+        int buffer_size;
+        int n_buffered;
+        int channel_index;
+        bool done;
+};
+#endif
+
+// recorded scans (survey file format)
+// the scan time is the dwell time of the scanned channels and
+// only the networks of the scanned channels are found
+class replay_scanner : public wifi_scanner {
+    public:
+        replay_scanner();
+        ~replay_scanner();
+        template<typename Source> bool load(Source &file);
+        int scans() const { return n_scans; }
+        bool start();
+        int complete();
+        int take(scan_result *results, int max_results);
+    private:
+        static void add_record(const survey_record &record, void *context);
+        void release();
+        // all recorded networks, scan after scan
+        scan_result *records;
+        int n_records;
+        int max_records;
+        // index of the first record of each scan
+        int *first;
+        int n_scans;
+        int max_scans;
+        bool out_of_memory;
+        // the next scan to replay
+        int next;
+        int current;
+        uint32_t start_time;
+};
+
+//==============================================================
+// load recorded scans out of a survey file (pos;n;name;id;RSSI)
+// a new scan begins at each line with n = 1
+// Source needs a function read(uint8_t *data, size_t size)
+template<typename Source>
+bool replay_scanner::load(Source &file) {
+    release();
+    survey_reader reader(add_record, this);
+    reader.read(file);
+    return !out_of_memory && n_scans > 0;
+}
+
+#endif
@@ -0,0 +1,44 @@
+/***************************************************
+ *
+ * Arduino definitions for the host tests
+ *
+ * Only the String class of the formula output of
+ * curve_fit.
+ *
+ * Distributed as-is; no warranty is given.
+ *
+ * ************************************************/
+
+#ifndef TEST_STUB_ARDUINO_H
+#define TEST_STUB_ARDUINO_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string>
+
+class String : public std::string {
+    public:
+        String() {}
+        String(const char *text) : std::string(text) {}
+        String(const std::string &text) : std::string(text) {}
+        String(int value) : std::string(std::to_string(value)) {}
+        String(unsigned int value) : std::string(std::to_string(value)) {}
+        String(long value) : std::string(std::to_string(value)) {}
+        String(unsigned long value) : std::string(std::to_string(value)) {}
+        String(double value, unsigned int decimals = 2) {
+            char text[64];
+            snprintf(text, sizeof(text), "%.*f", (int) decimals, value);
+            assign(text);
+        }
+        String operator+(const String &other) const { return String(std::string(*this) + std::string(other)); }
+        String operator+(const char *other) const { return String(std::string(*this) + other); }
+        String operator+(int other) const { return *this + String(other); }
+        String &operator+=(const String &other) { append(other); return *this; }
+        String &operator+=(const char *other) { append(other); return *this; }
+};
+
+inline String operator+(const char *text, const String &other) {
+    return String(std::string(text) + std::string(other));
+}
+
+#endif
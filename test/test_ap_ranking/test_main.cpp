@@ -0,0 +1,69 @@
+/**************************************************************************
+ * Host tests of ap_ranking
+ *
+ * pio test -e native -f test_ap_ranking -v
+ *
+ * Hague Nusseck @ electricidea
+ * https://github.com/electricidea/M5Stack-Hotel-room-finder
+ *
+ * Distributed as-is; no warranty is given.
+ *
+ ***************************************************************************/
+
+#include <unity.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include "Arduino.h"
+#include "fit_bank.h"
+#include "ap_ranking.h"
+
+void setUp(void) {
+}
+
+void tearDown(void) {
+}
+
+//==============================================================
+// learn a linear RSSI profile between from_x and to_x
+static void learn_line(fit_bank &fits, int ap, int from_x, int to_x, double y0, double slope) {
+    for(int sweep = 0; sweep < 3; ++sweep)
+        for(int x = from_x; x <= to_x; ++x)
+            fits.learn(ap, (fit_scalar) x, (fit_scalar) (y0 + slope * x + ((x + 30 + sweep) % 3 - 1) * 0.5));
+}
+
+//==============================================================
+// the gradient is the slope within the learned range of each AP:
+// an AP which is only learned on a part of the floor has no step
+// to -95dBm at the end of its range
+void test_gradient_within_learned_range(void) {
+    fit_bank fits;
+    TEST_ASSERT_TRUE(fits.init(4, 5));
+    int full = fits.add("AA:BB:CC:DD:EE:01");
+    int part = fits.add("AA:BB:CC:DD:EE:02");
+    int flat = fits.add("AA:BB:CC:DD:EE:03");
+    // floor from -20 to 20, the second AP only from -20 to 0
+    learn_line(fits, full, -20, 20, -60.0, -1.0);
+    learn_line(fits, part, -20, 0, -60.0, -1.0);
+    learn_line(fits, flat, -20, 20, -60.0, -0.1);
+    ap_rank ranks[3];
+    TEST_ASSERT_EQUAL(3, rank_aps(fits, -20.0, 20.0, 3, ranks));
+    float gradient[3];
+    for(int i = 0; i < 3; ++i)
+        gradient[ranks[i].ap] = ranks[i].gradient;
+    char message[160];
+    snprintf(message, sizeof(message), "gradient dBm/step: full floor %.3f, half floor %.3f, flat %.3f",
+             gradient[full], gradient[part], gradient[flat]);
+    TEST_MESSAGE(message);
+    TEST_ASSERT_FLOAT_WITHIN(0.05, 1.0, gradient[full]);
+    TEST_ASSERT_FLOAT_WITHIN(0.05, 1.0, gradient[part]);
+    TEST_ASSERT_FLOAT_WITHIN(0.05, 0.1, gradient[flat]);
+    // the flat AP is ranked last
+    TEST_ASSERT_EQUAL(flat, ranks[2].ap);
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_gradient_within_learned_range);
+    return UNITY_END();
+}
@@ -0,0 +1,238 @@
+/**************************************************************************
+ * Host benchmark of the position check (CHECK)
+ *
+ * pio test -e native -f test_check_latency -v
+ *
+ * The scans are replayed (replay_scanner without scan time) on a
+ * synthetic floor map. Two ways of the check are compared:
+ *
+ *   file:   the four scans are written as text lines (like the
+ *           old /pos_data.txt, here into the memory instead of the
+ *           SD card), parsed again by the survey_reader and the
+ *           square sums of all cells are calculated (brute force)
+ *   memory: the scan results are learned directly into the fits
+ *           and the fingerprint_matcher searches the best cell
+ *
+ * The time of the SD card (write, open, read) is not part of the
+ * numbers, on the M5Stack it comes on top of the file way.
+ *
+ * Hague Nusseck @ electricidea
+ * https://github.com/electricidea/M5Stack-Hotel-room-finder
+ *
+ * Distributed as-is; no warranty is given.
+ *
+ ***************************************************************************/
+
+#include <unity.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <chrono>
+#include <string>
+#include "numeric_types.h"
+#include "bssid_key.h"
+#include "fit_bank.h"
+#include "floor_map.h"
+#include "fingerprint_matcher.h"
+#include "survey_reader.h"
+#include "wifi_scanner.h"
+
+// scans of one check (same as position_scans of main.cpp)
+const int check_scans = 4;
+const int n_checks = 50;
+
+void setUp(void) {
+}
+
+void tearDown(void) {
+}
+
+//==============================================================
+// microseconds since the first call
+static double time_us() {
+    static std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+    return std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - begin).count();
+}
+
+//==============================================================
+// text in the memory as file (read() like File)
+struct text_file {
+    std::string text;
+    size_t position;
+    size_t read(uint8_t *data, size_t size) {
+        size_t n = (text.size() - position < size) ? text.size() - position : size;
+        memcpy(data, text.data() + position, n);
+        position += n;
+        return n;
+    }
+};
+
+//==============================================================
+// RSSI of the access point ap at the cell x of a floor with n_x cells
+static double ap_rssi(int ap, int n_aps, int x, int n_x) {
+    double ap_x = (double) ap * n_x / n_aps;
+    return -35.0 - 25.0 * log10(1.0 + fabs(x - ap_x) / 4.0);
+}
+
+//==============================================================
+// synthetic floor map and recorded check scans at random cells
+// the networks of the map are found if they are stronger than
+// -90 dBm, each scan also finds 10 networks of other floors
+static void build_floor(floor_map &map, replay_scanner &scanner, int n_x, int n_aps, int *truth) {
+    TEST_ASSERT_TRUE(map.init(n_x, n_aps));
+    for(int ap = 0; ap < n_aps; ++ap) {
+        map.bssids()[ap] = 0xA42BB0000000ULL + ap;
+        for(int x = 0; x < n_x; ++x)
+            map.cell(x)[ap] = map_encode(ap_rssi(ap, n_aps, x, n_x));
+    }
+    for(int x = 0; x < n_x; ++x)
+        map.x()[x] = x * 0.5;
+    srand(15);
+    text_file file;
+    file.text = "pos;n;name;id;RSSI;channel\n";
+    file.position = 0;
+    char line[96], bssid[bssid_text_size];
+    for(int check = 0; check < n_checks; ++check) {
+        truth[check] = 1 + rand() % (n_x - 2);
+        for(int scan = 0; scan < check_scans; ++scan) {
+            int n = 0;
+            for(int ap = 0; ap < n_aps + 10; ++ap) {
+                double rssi = (ap < n_aps) ? ap_rssi(ap, n_aps, truth[check], n_x) : -70.0 - ap % 20;
+                rssi = round(rssi + (rand() % 100) * 0.08 - 4.0);
+                if(rssi < -90.0)
+                    continue;
+                bssid_format(0xA42BB0000000ULL + ap, bssid);
+                snprintf(line, sizeof(line), "0;%i;Hotel-%i;%s;%i;%i\n", ++n, ap, bssid, (int) rssi, 1 + ap % 13);
+                file.text += line;
+            }
+        }
+    }
+    TEST_ASSERT_TRUE(scanner.load(file));
+    TEST_ASSERT_EQUAL(n_checks * check_scans, scanner.scans());
+    // no scan time: only the processing is measured
+    scanner.set_channels(NULL, 0, 0);
+}
+
+//==============================================================
+// callback of the survey_reader: learn the mean RSSI of the APs
+static void average_record(const survey_record &record, void *context) {
+    fit_bank *fits = (fit_bank*) context;
+    int ap = fits->find(record.bssid);
+    if(ap > -1)
+        fits->learn(ap, 0.0, record.rssi);
+}
+
+//==============================================================
+// check via the text file and the brute force search
+static int check_file(replay_scanner &scanner, const floor_map &map, fit_bank &fits, map_accum *sums) {
+    scan_result results[scanner_max_results];
+    text_file file;
+    file.position = 0;
+    char line[96], bssid[bssid_text_size];
+    for(int scan = 0; scan < check_scans; ++scan) {
+        scanner.start();
+        int n = scanner.take(results, scanner_max_results);
+        for(int i = 0; i < n; ++i) {
+            bssid_format(results[i].bssid, bssid);
+            snprintf(line, sizeof(line), "%i;%i;%s;%s;%i;%i\n", 0, i+1, results[i].ssid, bssid,
+                     results[i].rssi, results[i].channel);
+            file.text += line;
+        }
+    }
+    fits.init(map.n_aps(), 0);
+    for(uint32_t ap = 0; ap < map.n_aps(); ++ap)
+        fits.add(map.bssids()[ap]);
+    survey_reader reader(average_record, &fits);
+    reader.read(file);
+    for(uint32_t x = 0; x < map.n_x(); ++x)
+        sums[x] = 0;
+    for(uint32_t ap = 0; ap < map.n_aps(); ++ap) {
+        if(fits.count(ap) == 0)
+            continue;
+        map_accum rssi = map_encode(fits.predict(ap, 0.0));
+        for(uint32_t x = 0; x < map.n_x(); ++x) {
+            map_accum diff = rssi - (map_accum) map.cell(x)[ap];
+            sums[x] += diff * diff;
+        }
+    }
+    int best_x = 0;
+    for(uint32_t x = 1; x < map.n_x(); ++x)
+        if(sums[x] < sums[best_x])
+            best_x = x;
+    return best_x;
+}
+
+//==============================================================
+// check in the memory with the fingerprint_matcher
+static int check_memory(replay_scanner &scanner, const floor_map &map, fit_bank &fits,
+                        fingerprint_matcher &matcher, int hint) {
+    scan_result results[scanner_max_results];
+    fits.init(map.n_aps(), 0);
+    for(uint32_t ap = 0; ap < map.n_aps(); ++ap)
+        fits.add(map.bssids()[ap]);
+    for(int scan = 0; scan < check_scans; ++scan) {
+        scanner.start();
+        int n = scanner.take(results, scanner_max_results);
+        for(int i = 0; i < n; ++i) {
+            int ap = fits.find(results[i].bssid);
+            if(ap > -1)
+                fits.learn(ap, 0.0, results[i].rssi);
+        }
+    }
+    matcher.clear_query();
+    for(uint32_t ap = 0; ap < map.n_aps(); ++ap)
+        if(fits.count(ap) > 0)
+            matcher.set_rssi(ap, map_encode(fits.predict(ap, 0.0)));
+    return matcher.match(hint, NULL);
+}
+
+//==============================================================
+// both ways find the same cells, the time of each way per check
+static void compare_checks(int n_x, int n_aps) {
+    floor_map map;
+    replay_scanner scanner;
+    int truth[n_checks];
+    build_floor(map, scanner, n_x, n_aps, truth);
+    fingerprint_matcher matcher;
+    TEST_ASSERT_TRUE(matcher.init(map.values(), map.n_x(), map.n_aps(), map.stride()));
+    fit_bank fits;
+    map_accum *sums = (map_accum*) malloc(n_x * sizeof(map_accum));
+    int file_x[n_checks];
+    double start = time_us();
+    for(int check = 0; check < n_checks; ++check)
+        file_x[check] = check_file(scanner, map, fits, sums);
+    double file_time = (time_us() - start) / n_checks;
+    int hint = n_x / 2;
+    int near = 0;
+    start = time_us();
+    for(int check = 0; check < n_checks; ++check) {
+        int best_x = check_memory(scanner, map, fits, matcher, hint);
+        TEST_ASSERT_EQUAL(file_x[check], best_x);
+        if(abs(best_x - truth[check]) <= 2)
+            ++near;
+        hint = best_x;
+    }
+    double memory_time = (time_us() - start) / n_checks;
+    free(sums);
+    char message[200];
+    snprintf(message, sizeof(message), "%i cells, %i APs: file + brute force %.1f us, memory + matcher %.1f us "
+             "per check (%i of %i within 2 cells)", n_x, n_aps, file_time, memory_time, near, n_checks);
+    TEST_MESSAGE(message);
+    TEST_ASSERT_LESS_THAN(file_time, memory_time);
+}
+
+void test_check_small_floor(void) {
+    compare_checks(200, 20);
+}
+
+void test_check_large_floor(void) {
+    compare_checks(2000, 40);
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_check_small_floor);
+    RUN_TEST(test_check_large_floor);
+    return UNITY_END();
+}
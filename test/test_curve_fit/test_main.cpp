@@ -0,0 +1,267 @@
+/**************************************************************************
+ * Host tests and benchmarks of curve_fit
+ *
+ * pio test -e native -f test_curve_fit -v
+ *
+ * Hague Nusseck @ electricidea
+ * https://github.com/electricidea/M5Stack-Hotel-room-finder
+ *
+ * Distributed as-is; no warranty is given.
+ *
+ ***************************************************************************/
+
+#include <unity.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <chrono>
+#include "Arduino.h"
+#include "curve_fit.h"
+#include "static_curve_fit.h"
+
+//==============================================================
+// microseconds since the first call
+static double time_us() {
+    static std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+    return std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - begin).count();
+}
+
+//==============================================================
+// survey like values: RSSI over the distance with noise
+static void survey_values(double *xs, double *ys, int n, unsigned int seed) {
+    srand(seed);
+    for(int i = 0; i < n; ++i) {
+        xs[i] = (i % 40) * 0.5 - 10.0;
+        ys[i] = -40.0 - 1.5 * fabs(xs[i] - 2.0) + (rand() % 100) * 0.04;
+    }
+}
+
+//==============================================================
+// the first version of curve_fit (v1.1): the matrix M and the
+// vector b are updated and solved with Cramer's rule after each
+// learned value (reference of the results and the time)
+struct cramer_fit {
+    int order;
+    double M[(CURVE_FIT_MAX_DEGREE+1)*(CURVE_FIT_MAX_DEGREE+1)];
+    double b[CURVE_FIT_MAX_DEGREE+1];
+    double a[CURVE_FIT_MAX_DEGREE+1];
+    int N;
+
+    cramer_fit(int degree) {
+        order = degree;
+        for(int i = 0; i < (order+1)*(order+1); ++i)
+            M[i] = 0.0;
+        for(int i = 0; i <= order; ++i)
+            a[i] = b[i] = 0.0;
+        N = 0;
+    }
+
+    int index(int i, int j) const { return i*(order+1) + j; }
+
+    // Gaussian elimination with partial pivoting
+    double determinant(const double *matrix) const {
+        double work[(CURVE_FIT_MAX_DEGREE+1)*(CURVE_FIT_MAX_DEGREE+1)];
+        for(int i = 0; i < (order+1)*(order+1); ++i)
+            work[i] = matrix[i];
+        double det = 1.0;
+        for(int i = 0; i <= order; ++i) {
+            int pivot_row = i;
+            for(int row = i+1; row <= order; ++row)
+                if(fabs(work[index(row,i)]) > fabs(work[index(pivot_row,i)]))
+                    pivot_row = row;
+            double pivot = work[index(pivot_row,i)];
+            if(pivot == 0.0)
+                return 0.0;
+            if(pivot_row != i) {
+                for(int k = 0; k <= order; ++k) {
+                    double t = work[index(i,k)];
+                    work[index(i,k)] = work[index(pivot_row,k)];
+                    work[index(pivot_row,k)] = t;
+                }
+                det = -det;
+            }
+            det *= pivot;
+            for(int row = i+1; row <= order; ++row)
+                for(int col = i+1; col <= order; ++col)
+                    work[index(row,col)] -= work[index(row,i)] * work[index(i,col)] / pivot;
+        }
+        return det;
+    }
+
+    void learn(double x, double y) {
+        ++N;
+        for(int i = 0; i <= order; ++i)
+            for(int j = 0; j <= order; ++j)
+                M[index(i,j)] += pow(x, i+j);
+        for(int n = 0; n <= order; ++n)
+            b[n] += pow(x, n) * y;
+        double det_M = determinant(M);
+        double Mn[(CURVE_FIT_MAX_DEGREE+1)*(CURVE_FIT_MAX_DEGREE+1)];
+        for(int n = 0; n <= order; ++n) {
+            for(int i = 0; i <= order; ++i)
+                for(int j = 0; j <= order; ++j)
+                    Mn[index(i,j)] = (j == n) ? b[i] : M[index(i,j)];
+            a[n] = determinant(Mn) / det_M;
+        }
+    }
+
+    double predict(double x) const {
+        double y = 0.0;
+        for(int i = order; i >= 0; --i)
+            y = y*x + a[i];
+        return y;
+    }
+};
+
+void setUp(void) {}
+void tearDown(void) {}
+
+//==============================================================
+// [user-001] the LDL^T solution is the same as Cramer's rule
+// and learning is much faster without a solve per value
+void test_ldl_matches_cramer(void) {
+    const int n = 400;
+    double xs[n], ys[n];
+    survey_values(xs, ys, n, 1);
+    char message[160];
+    for(int degree = 0; degree <= CURVE_FIT_MAX_DEGREE; ++degree) {
+        cramer_fit reference(degree);
+        curve_fit fit(degree);
+        double start = time_us();
+        for(int i = 0; i < n; ++i)
+            reference.learn(xs[i], ys[i]);
+        double cramer_time = time_us() - start;
+        start = time_us();
+        for(int i = 0; i < n; ++i)
+            fit.learn(xs[i], ys[i]);
+        double y = fit.predict(0.0);
+        double ldl_time = time_us() - start;
+        double max_diff = 0.0;
+        for(double x = -10.0; x <= 9.5; x += 0.25) {
+            double diff = fabs(fit.predict(x) - reference.predict(x));
+            if(diff > max_diff)
+                max_diff = diff;
+        }
+        snprintf(message, sizeof(message), "degree %i: %i values, Cramer %.0f us, LDL %.1f us, max |dy| %.2e dBm",
+                 degree, n, cramer_time, ldl_time, max_diff);
+        TEST_MESSAGE(message);
+        TEST_ASSERT_DOUBLE_WITHIN(1e-6, reference.predict(0.0), y);
+        TEST_ASSERT_LESS_OR_EQUAL(1e-6, max_diff);
+    }
+}
+
+//==============================================================
+// [user-002] static_curve_fit<Degree> gives the same results as
+// curve_fit(Degree) without any heap memory
+template <int Degree>
+static void check_static_matches_dynamic(const double *xs, const double *ys, int n) {
+    curve_fit fit(Degree);
+    static_curve_fit<Degree> fixed;
+    static_curve_fit<Degree, float> fixed_float;
+    double start = time_us();
+    for(int i = 0; i < n; ++i)
+        fit.learn(xs[i], ys[i]);
+    double y = fit.predict(1.0);
+    double dynamic_time = time_us() - start;
+    start = time_us();
+    for(int i = 0; i < n; ++i)
+        fixed.learn(xs[i], ys[i]);
+    double y_fixed = fixed.predict(1.0);
+    double static_time = time_us() - start;
+    for(int i = 0; i < n; ++i)
+        fixed_float.learn((float) xs[i], (float) ys[i]);
+    double max_diff = 0.0;
+    double max_diff_float = 0.0;
+    for(double x = -10.0; x <= 9.5; x += 0.25) {
+        max_diff = fmax(max_diff, fabs(fit.predict(x) - fixed.predict(x)));
+        max_diff_float = fmax(max_diff_float, fabs(fit.predict(x) - fixed_float.predict((float) x)));
+    }
+    // the first version allocated a, b (k+1 doubles) and M ((k+1)^2
+    // doubles) on the heap for each fit
+    size_t old_heap = (2*(Degree+1) + (Degree+1)*(Degree+1)) * sizeof(double);
+    char message[200];
+    snprintf(message, sizeof(message), "degree %i: curve_fit %u bytes (first version: + %u heap bytes), "
+             "static_curve_fit %u bytes, float %u bytes", Degree,
+             (unsigned) sizeof(curve_fit), (unsigned) old_heap,
+             (unsigned) sizeof(static_curve_fit<Degree>), (unsigned) sizeof(static_curve_fit<Degree, float>));
+    TEST_MESSAGE(message);
+    snprintf(message, sizeof(message), "degree %i: %i values, curve_fit %.1f us, static_curve_fit %.1f us, "
+             "max |dy| %.2e dBm (double), %.2e dBm (float)", Degree, n, dynamic_time, static_time, max_diff, max_diff_float);
+    TEST_MESSAGE(message);
+    TEST_ASSERT_DOUBLE_WITHIN(1e-9, y, y_fixed);
+    TEST_ASSERT_LESS_OR_EQUAL(1e-9, max_diff);
+    TEST_ASSERT_LESS_OR_EQUAL(0.5, max_diff_float);
+}
+
+void test_static_matches_dynamic(void) {
+    const int n = 400;
+    double xs[n], ys[n];
+    survey_values(xs, ys, n, 2);
+    check_static_matches_dynamic<0>(xs, ys, n);
+    check_static_matches_dynamic<1>(xs, ys, n);
+    check_static_matches_dynamic<2>(xs, ys, n);
+    check_static_matches_dynamic<5>(xs, ys, n);
+}
+
+//==============================================================
+// [user-006] learn_batch() gives the same fit as a loop of learn()
+// from a short walk (100 values) up to a long survey (1M values)
+void test_learn_batch_matches_learn(void) {
+    const int max_n = 1000000;
+    static double xs[max_n], ys[max_n];
+    survey_values(xs, ys, max_n, 6);
+    // one untimed run: the first calls are slowed down by the cold caches
+    curve_fit warm_up(5);
+    warm_up.learn(xs[0], ys[0]);
+    warm_up.learn_batch(xs, ys, 100);
+    char message[160];
+    for(int n = 100; n <= max_n; n *= 10) {
+        curve_fit single(5);
+        curve_fit batch(5);
+        double start = time_us();
+        for(int i = 0; i < n; ++i)
+            single.learn(xs[i], ys[i]);
+        double single_time = time_us() - start;
+        start = time_us();
+        batch.learn_batch(xs, ys, n);
+        double batch_time = time_us() - start;
+        double max_diff = 0.0;
+        for(double x = -10.0; x <= 9.5; x += 0.25)
+            max_diff = fmax(max_diff, fabs(single.predict(x) - batch.predict(x)));
+        snprintf(message, sizeof(message), "degree 5: %i values, learn() %.1f us, learn_batch() %.1f us, max |dy| %.2e dBm",
+                 n, single_time, batch_time, max_diff);
+        TEST_MESSAGE(message);
+        TEST_ASSERT_EQUAL(single.count(), batch.count());
+        TEST_ASSERT_LESS_OR_EQUAL(1e-9, max_diff);
+    }
+}
+
+//==============================================================
+// [user-008] reset() also forgets a selected degree
+void test_reset_restores_degree(void) {
+    const int n = 400;
+    double xs[n], ys[n];
+    survey_values(xs, ys, n, 8);
+    curve_fit fresh(5);
+    curve_fit reused(5);
+    for(int i = 0; i < n; ++i)
+        reused.learn(xs[i], ys[i]);
+    reused.set_degree(1);
+    reused.reset();
+    for(int i = 0; i < n; ++i) {
+        fresh.learn(xs[i], ys[i]);
+        reused.learn(xs[i], ys[i]);
+    }
+    TEST_ASSERT_EQUAL(fresh.get_order(), reused.get_order());
+    for(double x = -10.0; x <= 9.5; x += 0.25)
+        TEST_ASSERT_DOUBLE_WITHIN(1e-9, fresh.predict(x), reused.predict(x));
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_ldl_matches_cramer);
+    RUN_TEST(test_static_matches_dynamic);
+    RUN_TEST(test_learn_batch_matches_learn);
+    RUN_TEST(test_reset_restores_degree);
+    return UNITY_END();
+}
@@ -0,0 +1,184 @@
+/**************************************************************************
+ * Host tests and benchmarks of fingerprint_matcher
+ *
+ * pio test -e native -f test_fingerprint_matcher -v
+ * pio test -e native_float -f test_fingerprint_matcher -v
+ *
+ * The matcher is compared with the brute force search of the old
+ * calculate_position(): AP by AP over all cells of the IILTM and
+ * the smallest square sum afterwards.
+ *
+ * Hague Nusseck @ electricidea
+ * https://github.com/electricidea/M5Stack-Hotel-room-finder
+ *
+ * Distributed as-is; no warranty is given.
+ *
+ ***************************************************************************/
+
+#include <unity.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <chrono>
+#include <vector>
+#include "numeric_types.h"
+#include "floor_map.h"
+#include "fingerprint_matcher.h"
+
+// found APs of one scan
+const int scan_aps = 30;
+
+void setUp(void) {
+}
+
+void tearDown(void) {
+}
+
+//==============================================================
+// microseconds since the first call
+static double time_us() {
+    static std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+    return std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - begin).count();
+}
+
+//==============================================================
+// floor map with one random center of each AP
+static void build_floor(floor_map &map, int n_x, int n_aps) {
+    TEST_ASSERT_TRUE(map.init(n_x, n_aps));
+    for(int ap = 0; ap < n_aps; ++ap) {
+        int center = rand() % n_x;
+        for(int x = 0; x < n_x; ++x)
+            map.cell(x)[ap] = map_encode(-30.0 - abs(x - center) * 0.3 + rand() % 5);
+    }
+}
+
+// one scan: the found APs and their values
+struct test_scan {
+    std::vector<int> found;
+    std::vector<map_scalar> value;
+};
+
+//==============================================================
+// scan of up to scan_aps APs at the cell truth
+static void make_scan(const floor_map &map, int truth, test_scan &scan) {
+    int n_aps = map.n_aps();
+    scan.found.assign(n_aps, 0);
+    scan.value.assign(n_aps, 0);
+    // +-3 dB noise in map units
+    map_accum one_db = (map_accum) map_encode(-40.0) - (map_accum) map_encode(-41.0);
+    for(int i = 0; i < scan_aps; ++i) {
+        int ap = rand() % n_aps;
+        scan.found[ap] = 1;
+        scan.value[ap] = (map_scalar) (map.cell(truth)[ap] + (rand() % 7 - 3) * one_db);
+    }
+}
+
+//==============================================================
+// the brute force search of the old calculate_position()
+static int brute_force(const floor_map &map, const test_scan &scan, map_accum *sums) {
+    int n_x = map.n_x();
+    for(int x = 0; x < n_x; ++x)
+        sums[x] = 0;
+    for(int ap = 0; ap < (int) map.n_aps(); ++ap) {
+        if(!scan.found[ap])
+            continue;
+        for(int x = 0; x < n_x; ++x) {
+            map_accum diff = (map_accum) scan.value[ap] - (map_accum) map.cell(x)[ap];
+            sums[x] += diff * diff;
+        }
+    }
+    int best_x = 0;
+    for(int x = 1; x < n_x; ++x)
+        if(sums[x] < sums[best_x])
+            best_x = x;
+    return best_x;
+}
+
+//==============================================================
+// set the scan as query of the matcher
+static void set_query(fingerprint_matcher &matcher, const test_scan &scan) {
+    matcher.clear_query();
+    for(size_t ap = 0; ap < scan.found.size(); ++ap)
+        if(scan.found[ap])
+            matcher.set_rssi(ap, scan.value[ap]);
+}
+
+//==============================================================
+// match() and square_sums() give the same result as brute force
+void test_matcher_matches_brute_force(void) {
+    const int sizes[][2] = {{60, 20}, {400, 100}, {2000, 300}};
+    srand(19);
+    for(int s = 0; s < 3; ++s) {
+        floor_map map;
+        build_floor(map, sizes[s][0], sizes[s][1]);
+        int n_x = map.n_x();
+        fingerprint_matcher matcher;
+        TEST_ASSERT_TRUE(matcher.init(map.values(), n_x, map.n_aps(), map.stride()));
+        std::vector<map_accum> expected(n_x), sums(n_x);
+        test_scan scan;
+        for(int query = 0; query < 50; ++query) {
+            make_scan(map, rand() % n_x, scan);
+            int expected_x = brute_force(map, scan, &expected[0]);
+            set_query(matcher, scan);
+            map_accum best_sum;
+            int best_x = matcher.match(n_x / 2, &best_sum);
+            // same square sum (two cells can have the same sum)
+            TEST_ASSERT_TRUE(best_sum == expected[expected_x]);
+            TEST_ASSERT_TRUE(expected[best_x] == best_sum);
+            matcher.square_sums(&sums[0]);
+            for(int x = 0; x < n_x; ++x)
+                TEST_ASSERT_TRUE(sums[x] == expected[x]);
+        }
+    }
+}
+
+//==============================================================
+// time of one search for floor sizes
+void test_matcher_time(void) {
+    const int n_xs[] = {200, 1000, 4000};
+    const int n_apss[] = {40, 100, 300};
+    srand(20);
+    for(int i = 0; i < 3; ++i) {
+        for(int j = 0; j < 3; ++j) {
+            floor_map map;
+            build_floor(map, n_xs[i], n_apss[j]);
+            int n_x = map.n_x();
+            fingerprint_matcher matcher;
+            TEST_ASSERT_TRUE(matcher.init(map.values(), n_x, map.n_aps(), map.stride()));
+            const int n_queries = 50;
+            std::vector<test_scan> scans(n_queries);
+            for(int query = 0; query < n_queries; ++query)
+                make_scan(map, rand() % n_x, scans[query]);
+            std::vector<map_accum> sums(n_x);
+            double start = time_us();
+            int brute_x = 0;
+            for(int query = 0; query < n_queries; ++query)
+                brute_x += brute_force(map, scans[query], &sums[0]);
+            double brute_time = (time_us() - start) / n_queries;
+            int hint = n_x / 2;
+            int evaluated = 0, pruned = 0;
+            start = time_us();
+            for(int query = 0; query < n_queries; ++query) {
+                set_query(matcher, scans[query]);
+                hint = matcher.match(hint, NULL);
+                evaluated += matcher.evaluated();
+                pruned += matcher.pruned();
+            }
+            double matcher_time = (time_us() - start) / n_queries;
+            char message[200];
+            snprintf(message, sizeof(message), "%i cells, %i APs: brute force %.1f us, matcher %.1f us "
+                     "(%.0f cells evaluated, %.0f pruned)", n_x, (int) map.n_aps(), brute_time, matcher_time,
+                     (double) evaluated / n_queries, (double) pruned / n_queries);
+            TEST_MESSAGE(message);
+            // keep the brute force search
+            TEST_ASSERT_TRUE(brute_x >= 0);
+        }
+    }
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_matcher_matches_brute_force);
+    RUN_TEST(test_matcher_time);
+    return UNITY_END();
+}
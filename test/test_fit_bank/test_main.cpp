@@ -0,0 +1,284 @@
+/**************************************************************************
+ * Host tests of fit_bank
+ *
+ * pio test -e native -f test_fit_bank -v
+ *
+ * Hague Nusseck @ electricidea
+ * https://github.com/electricidea/M5Stack-Hotel-room-finder
+ *
+ * Distributed as-is; no warranty is given.
+ *
+ ***************************************************************************/
+
+#include <unity.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include "Arduino.h"
+#include "curve_fit.h"
+#include "poly_math.h"
+#include "bssid_key.h"
+#include "fit_bank.h"
+
+// float fits of the 5th order differ up to about 1 dB from the
+// double fits (-D FIT_SCALAR_FLOAT, see numeric_types.h)
+const double fit_tolerance = (sizeof(fit_scalar) == sizeof(double)) ? 1e-3 : 1.0;
+
+void setUp(void) {
+}
+
+void tearDown(void) {
+}
+
+//==============================================================
+// RSSI of the test AP at the position x
+// after "sweeps_before_drift" walks over the floor, the AP
+// is 8 dB weaker (e.g. moved or a door was closed)
+static double drifting_rssi(double x, int sweep) {
+    const int sweeps_before_drift = 20;
+    double offset = (sweep < sweeps_before_drift) ? 0.0 : -8.0;
+    return -50.0 - 1.2 * fabs(x - 8.0) + offset + (rand() % 100) * 0.02;
+}
+
+//==============================================================
+// reference of an exponentially weighted least squares fit:
+// the value i of n has the weight forgetting_factor^(n-1-i)
+// The sums are build directly with the weights and x/10
+// (same solution, better condition of the sums).
+struct weighted_fit {
+    double a[CURVE_FIT_MAX_DEGREE+1];
+
+    weighted_fit(const double *xs, const double *ys, int n, int order, double forgetting_factor) {
+        double Sx[2*CURVE_FIT_MAX_DEGREE+1] = {0};
+        double Sxy[CURVE_FIT_MAX_DEGREE+1] = {0};
+        for(int i = 0; i < n; ++i) {
+            double w = pow(forgetting_factor, n-1-i);
+            double u = xs[i] / 10.0;
+            for(int k = 0; k <= 2*order; ++k)
+                Sx[k] += w * pow(u, k);
+            for(int k = 0; k <= order; ++k)
+                Sxy[k] += w * pow(u, k) * ys[i];
+        }
+        poly_solve(Sx, Sxy, a, order);
+        for(int k = order+1; k <= CURVE_FIT_MAX_DEGREE; ++k)
+            a[k] = 0.0;
+    }
+
+    double predict(double x) const {
+        double u = x / 10.0;
+        double y = 0.0;
+        for(int k = CURVE_FIT_MAX_DEGREE; k >= 0; --k)
+            y = y*u + a[k];
+        return y;
+    }
+};
+
+//==============================================================
+// without a forgetting factor, the fits are the same as curve_fit
+void test_fit_bank_matches_curve_fit(void) {
+    fit_bank fits;
+    TEST_ASSERT_TRUE(fits.init(4, 5));
+    int ap = fits.add("AA:BB:CC:DD:EE:01");
+    curve_fit fit(5);
+    srand(9);
+    for(int sweep = 0; sweep < 30; ++sweep) {
+        for(int x = 0; x < 20; ++x) {
+            double y = drifting_rssi(x, sweep);
+            fits.learn(ap, (fit_scalar) x, (fit_scalar) y);
+            fit.learn(x, y);
+        }
+    }
+    TEST_ASSERT_EQUAL(fit.count(), fits.count(ap));
+    for(double x = 0.0; x <= 19.0; x += 0.5)
+        TEST_ASSERT_DOUBLE_WITHIN(fit_tolerance, fit.predict(x), fits.predict(ap, (fit_scalar) x));
+}
+
+//==============================================================
+// with a forgetting factor, the fits follow a drifting AP like
+// the exponentially weighted least squares fit
+void test_forgetting_factor_follows_drift(void) {
+    const double forgetting_factor = 0.98;
+    fit_bank fits;
+    TEST_ASSERT_TRUE(fits.init(4, 5));
+    fits.set_forgetting_factor(forgetting_factor);
+    int faded = fits.add("AA:BB:CC:DD:EE:01");
+    fit_bank plain_fits;
+    TEST_ASSERT_TRUE(plain_fits.init(4, 5));
+    int plain = plain_fits.add("AA:BB:CC:DD:EE:01");
+    static double xs[600], ys[600];
+    int n_values = 0;
+    srand(4);
+    for(int sweep = 0; sweep < 30; ++sweep) {
+        for(int x = 0; x < 20; ++x) {
+            double y = drifting_rssi(x, sweep);
+            fits.learn(faded, (fit_scalar) x, (fit_scalar) y);
+            plain_fits.learn(plain, (fit_scalar) x, (fit_scalar) y);
+            xs[n_values] = x;
+            ys[n_values++] = y;
+        }
+    }
+    weighted_fit reference(xs, ys, n_values, 5, forgetting_factor);
+    // mean error against the RSSI after the drift (without noise)
+    double faded_error = 0.0, plain_error = 0.0, max_reference_diff = 0.0;
+    int n = 0;
+    for(double x = 0.0; x <= 19.0; x += 0.5, ++n) {
+        double y = -50.0 - 1.2 * fabs(x - 8.0) - 8.0 + 1.0;
+        faded_error += fabs(fits.predict(faded, (fit_scalar) x) - y);
+        plain_error += fabs(plain_fits.predict(plain, (fit_scalar) x) - y);
+        max_reference_diff = fmax(max_reference_diff, fabs(fits.predict(faded, (fit_scalar) x) - reference.predict(x)));
+    }
+    char message[160];
+    snprintf(message, sizeof(message), "after the drift: mean |dy| %.2f dBm (forgetting %.2f), %.2f dBm (no forgetting), "
+             "max |dy| to the weighted reference %.2e dBm", faded_error / n, forgetting_factor, plain_error / n,
+             max_reference_diff);
+    TEST_MESSAGE(message);
+    TEST_ASSERT_LESS_THAN(1.0, faded_error / n);
+    TEST_ASSERT_GREATER_THAN(2.0, plain_error / n);
+    TEST_ASSERT_LESS_THAN(fit_tolerance, max_reference_diff);
+    // the residual uses the sum of the weights: the step of the
+    // drift is only in the residual of the fit without forgetting
+    snprintf(message, sizeof(message), "residual %.2f dBm (forgetting %.2f), %.2f dBm (no forgetting)",
+             fits.residual(faded), forgetting_factor, plain_fits.residual(plain));
+    TEST_MESSAGE(message);
+    TEST_ASSERT_LESS_THAN(plain_fits.residual(plain) / 2, fits.residual(faded));
+}
+
+//==============================================================
+// [user-013] BSSIDs with the same slot of the hash index: find()
+// after the inserts and after removes with the backward shift of
+// the probe sequence, and add() reuses the removed fits
+void test_hash_index_collisions(void) {
+    fit_bank fits;
+    TEST_ASSERT_TRUE(fits.init(8, 2));
+    // 8 fits have a hash index of 16 slots (4 bits): 6 keys with
+    // the same home slot and 2 keys of the next slot, which are
+    // pushed behind the colliding keys
+    const uint64_t first = 0xA42BB0000000ULL;
+    const uint32_t home = bssid_hash(first, 4);
+    uint64_t keys[10];
+    int n_same = 0, n_next = 0;
+    for(uint64_t key = first; n_same < 8 || n_next < 2; ++key) {
+        uint32_t slot = bssid_hash(key, 4);
+        if(slot == home && n_same < 8)
+            keys[n_same++] = key;
+        else if(slot == ((home + 1) & 15) && n_next < 2)
+            keys[8 + n_next++] = key;
+    }
+    // keys[6] and keys[7] are added later
+    const int order[8] = {0, 1, 8, 2, 3, 9, 4, 5};
+    int aps[10];
+    for(int i = 0; i < 8; ++i)
+        aps[order[i]] = fits.add(keys[order[i]]);
+    for(int i = 0; i < 8; ++i) {
+        TEST_ASSERT_EQUAL(i, aps[order[i]]);
+        TEST_ASSERT_EQUAL(aps[order[i]], fits.find(keys[order[i]]));
+    }
+    // remove fits in the middle of the probe sequence
+    fits.clear(aps[1]);
+    fits.clear(aps[3]);
+    fits.clear(aps[8]);
+    TEST_ASSERT_EQUAL(5, fits.size());
+    const int removed[3] = {1, 3, 8};
+    for(int i = 0; i < 3; ++i)
+        TEST_ASSERT_EQUAL(-1, fits.find(keys[removed[i]]));
+    const int kept[5] = {0, 2, 4, 5, 9};
+    for(int i = 0; i < 5; ++i)
+        TEST_ASSERT_EQUAL(aps[kept[i]], fits.find(keys[kept[i]]));
+    // the new keys get the removed fits, the lowest index first
+    TEST_ASSERT_EQUAL(aps[1], fits.add(keys[6]));
+    TEST_ASSERT_EQUAL(aps[8], fits.add(keys[7]));
+    TEST_ASSERT_EQUAL(aps[3], fits.add(keys[1]));
+    TEST_ASSERT_EQUAL(8, fits.size());
+    TEST_ASSERT_EQUAL(8, fits.capacity());
+    TEST_ASSERT_EQUAL(aps[1], fits.find(keys[6]));
+    TEST_ASSERT_EQUAL(aps[8], fits.find(keys[7]));
+    TEST_ASSERT_EQUAL(aps[3], fits.find(keys[1]));
+    for(int i = 0; i < 5; ++i)
+        TEST_ASSERT_EQUAL(aps[kept[i]], fits.find(keys[kept[i]]));
+    TEST_ASSERT_EQUAL(-1, fits.find(keys[3]));
+    TEST_ASSERT_EQUAL(-1, fits.find(keys[8]));
+}
+
+//==============================================================
+// [user-013] random adds and removes: find() is the same as a
+// search of the BSSID in all fits
+void test_hash_index_random(void) {
+    fit_bank fits;
+    TEST_ASSERT_TRUE(fits.init(16, 2));
+    srand(13);
+    const int n_keys = 600;
+    static uint64_t keys[n_keys];
+    for(int i = 0; i < n_keys; ++i)
+        keys[i] = 0xA42BB0000000ULL + (uint64_t) (rand() % 4096);
+    for(int round = 0; round < 2000; ++round) {
+        uint64_t key = keys[rand() % n_keys];
+        if(rand() % 3 == 0) {
+            int ap = fits.find(key);
+            if(ap > -1)
+                fits.clear(ap);
+        } else {
+            TEST_ASSERT_TRUE(fits.add(key) > -1);
+        }
+    }
+    for(int i = 0; i < n_keys; ++i) {
+        int expected = -1;
+        for(int ap = 0; ap < fits.capacity(); ++ap)
+            if(fits.used(ap) && fits.bssid(ap) == keys[i])
+                expected = ap;
+        TEST_ASSERT_EQUAL(expected, fits.find(keys[i]));
+    }
+}
+
+//==============================================================
+// add() doubles the capacity of a full bank, the learned fits,
+// their indices and the hash index are kept
+void test_grow_keeps_fits(void) {
+    const int n_aps = 20;
+    fit_bank fits;
+    fit_bank big_fits;
+    TEST_ASSERT_TRUE(fits.init(4, 5));
+    TEST_ASSERT_TRUE(big_fits.init(32, 5));
+    int expected_capacity = 4;
+    for(int i = 0; i < n_aps; ++i) {
+        uint64_t bssid = 0xA42BB0000000ULL + 97*i;
+        int ap = fits.add(bssid);
+        TEST_ASSERT_EQUAL(i, ap);
+        TEST_ASSERT_EQUAL(i, big_fits.add(bssid));
+        if(i == expected_capacity)
+            expected_capacity *= 2;
+        TEST_ASSERT_EQUAL(expected_capacity, fits.capacity());
+        fits.set_channel(ap, 1 + i % 13);
+        // learn all fits after each add (some before, some after a grow)
+        for(int j = 0; j <= i; ++j) {
+            for(int x = 0; x < 10; ++x) {
+                double y = -50.0 - 0.3 * (x - j) * (x - j) + 0.1 * i;
+                fits.learn(j, (fit_scalar) (x + j), (fit_scalar) y);
+                big_fits.learn(j, (fit_scalar) (x + j), (fit_scalar) y);
+            }
+        }
+    }
+    TEST_ASSERT_EQUAL(32, fits.capacity());
+    TEST_ASSERT_EQUAL(n_aps, fits.size());
+    for(int ap = 0; ap < n_aps; ++ap) {
+        uint64_t bssid = 0xA42BB0000000ULL + 97*ap;
+        TEST_ASSERT_EQUAL(ap, fits.find(bssid));
+        TEST_ASSERT_EQUAL(1 + ap % 13, fits.channel(ap));
+        TEST_ASSERT_EQUAL(big_fits.count(ap), fits.count(ap));
+        TEST_ASSERT_EQUAL(big_fits.min_x(ap), fits.min_x(ap));
+        TEST_ASSERT_EQUAL(big_fits.max_x(ap), fits.max_x(ap));
+        // the same sums give exactly the same fits
+        for(int x = ap; x < ap + 10; ++x)
+            TEST_ASSERT_EQUAL(big_fits.predict(ap, (fit_scalar) x), fits.predict(ap, (fit_scalar) x));
+    }
+    TEST_ASSERT_EQUAL(-1, fits.find((uint64_t) 0xA42BB0000000ULL + 1));
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_fit_bank_matches_curve_fit);
+    RUN_TEST(test_forgetting_factor_follows_drift);
+    RUN_TEST(test_hash_index_collisions);
+    RUN_TEST(test_hash_index_random);
+    RUN_TEST(test_grow_keeps_fits);
+    return UNITY_END();
+}
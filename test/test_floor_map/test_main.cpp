@@ -0,0 +1,173 @@
+/**************************************************************************
+ * Host tests of floor_map
+ *
+ * pio test -e native -f test_floor_map -v
+ * pio test -e native_float -f test_floor_map -v
+ *
+ * The file is written into the memory instead of the SD card, and
+ * into a temporary file for map_file().
+ *
+ * Hague Nusseck @ electricidea
+ * https://github.com/electricidea/M5Stack-Hotel-room-finder
+ *
+ * Distributed as-is; no warranty is given.
+ *
+ ***************************************************************************/
+
+#include <unity.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <vector>
+#include "numeric_types.h"
+#include "floor_map.h"
+
+const uint32_t test_n_x = 37;
+const uint32_t test_n_aps = 21;
+
+void setUp(void) {
+}
+
+void tearDown(void) {
+}
+
+//==============================================================
+// file in the memory (read(), write() and size() like File)
+struct memory_file {
+    std::vector<uint8_t> data;
+    size_t position;
+    memory_file() : position(0) {}
+    size_t write(const uint8_t *bytes, size_t size) {
+        data.insert(data.end(), bytes, bytes + size);
+        return size;
+    }
+    size_t read(uint8_t *bytes, size_t size) {
+        size_t n = (data.size() - position < size) ? data.size() - position : size;
+        memcpy(bytes, &data[position], n);
+        position += n;
+        return n;
+    }
+    size_t size() const { return data.size(); }
+};
+
+//==============================================================
+// a map with different values in all sections
+static void fill_map(floor_map &map) {
+    for(uint32_t x = 0; x < map.n_x(); ++x) {
+        map.x()[x] = 0.5 * x - 3.0;
+        for(uint32_t ap = 0; ap < map.n_aps(); ++ap)
+            map.cell(x)[ap] = map_encode(-40.0 - (double) ((x * 7 + ap * 3) % 50));
+    }
+    for(uint32_t ap = 0; ap < map.n_aps(); ++ap) {
+        map.bssids()[ap] = 0xA42BB0000000ULL + ap;
+        map.channels()[ap] = 1 + ap % 13;
+    }
+}
+
+//==============================================================
+// all sections of two maps are the same
+static void check_same(const floor_map &expected, const floor_map &map) {
+    TEST_ASSERT_EQUAL(expected.n_x(), map.n_x());
+    TEST_ASSERT_EQUAL(expected.n_aps(), map.n_aps());
+    TEST_ASSERT_EQUAL(expected.stride(), map.stride());
+    TEST_ASSERT_EQUAL(expected.file_size(), map.file_size());
+    TEST_ASSERT_EQUAL_MEMORY(expected.x(), map.x(), expected.n_x() * sizeof(double));
+    TEST_ASSERT_EQUAL_MEMORY(expected.bssids(), map.bssids(), expected.n_aps() * sizeof(uint64_t));
+    TEST_ASSERT_EQUAL_MEMORY(expected.channels(), map.channels(), expected.n_aps());
+    TEST_ASSERT_EQUAL_MEMORY(expected.values(), map.values(),
+                             (size_t) expected.n_x() * expected.stride() * sizeof(map_scalar));
+}
+
+//==============================================================
+// load() of a saved map gives the same map
+void test_save_load_round_trip(void) {
+    floor_map map;
+    TEST_ASSERT_TRUE(map.init(test_n_x, test_n_aps));
+    fill_map(map);
+    memory_file file;
+    TEST_ASSERT_TRUE(map.save(file));
+    TEST_ASSERT_EQUAL(floor_map_size(test_n_x, test_n_aps, NULL), file.size());
+    floor_map loaded;
+    TEST_ASSERT_TRUE(loaded.load(file));
+    check_same(map, loaded);
+    // the file can be mapped by host tools as well
+    const char *path = "test_floor_map.bin";
+    FILE *out = fopen(path, "wb");
+    TEST_ASSERT_TRUE(out != NULL);
+    TEST_ASSERT_EQUAL(file.size(), fwrite(&file.data[0], 1, file.size(), out));
+    fclose(out);
+    floor_map mapped;
+    TEST_ASSERT_TRUE(mapped.map_file(path));
+    TEST_ASSERT_TRUE(mapped.is_mapped());
+    check_same(map, mapped);
+    mapped.release();
+    // a truncated file is not mapped
+    out = fopen(path, "wb");
+    fwrite(&file.data[0], 1, file.size() - 1, out);
+    fclose(out);
+    TEST_ASSERT_FALSE(mapped.map_file(path));
+    remove(path);
+}
+
+//==============================================================
+// a changed byte behind the header fails the checksum
+void test_load_rejects_corruption(void) {
+    floor_map map;
+    TEST_ASSERT_TRUE(map.init(test_n_x, test_n_aps));
+    fill_map(map);
+    memory_file saved;
+    TEST_ASSERT_TRUE(map.save(saved));
+    const size_t offsets[3] = {sizeof(floor_map_header), saved.size() / 2, saved.size() - 1};
+    for(int i = 0; i < 3; ++i) {
+        memory_file file;
+        file.data = saved.data;
+        file.data[offsets[i]] ^= 0x10;
+        floor_map loaded;
+        TEST_ASSERT_FALSE(loaded.load(file));
+        TEST_ASSERT_EQUAL(0, loaded.n_x());
+    }
+}
+
+//==============================================================
+// truncated files and headers with dimensions above the file size
+// are not loaded (no allocation of the wrong size)
+void test_load_rejects_truncation(void) {
+    floor_map map;
+    TEST_ASSERT_TRUE(map.init(test_n_x, test_n_aps));
+    fill_map(map);
+    memory_file saved;
+    TEST_ASSERT_TRUE(map.save(saved));
+    const size_t sizes[4] = {0, sizeof(floor_map_header) - 1, sizeof(floor_map_header), saved.size() - 1};
+    for(int i = 0; i < 4; ++i) {
+        memory_file file;
+        file.data.assign(saved.data.begin(), saved.data.begin() + sizes[i]);
+        floor_map loaded;
+        TEST_ASSERT_FALSE(loaded.load(file));
+    }
+    // n_x and n_aps of a broken header: the sizes of the sections
+    // overflow a 32 bit size_t, the header is rejected before that
+    const uint32_t n_x[3] = {0xFFFFFFFFUL, 0x10000001UL, test_n_x + 1};
+    const uint32_t n_aps[3] = {0xFFFFFFF0UL, test_n_aps, test_n_aps};
+    for(int i = 0; i < 3; ++i) {
+        memory_file file;
+        file.data = saved.data;
+        floor_map_header header;
+        memcpy(&header, &file.data[0], sizeof(header));
+        header.n_x = n_x[i];
+        header.n_aps = n_aps[i];
+        floor_map_size(header.n_x, header.n_aps, &header.stride);
+        memcpy(&file.data[0], &header, sizeof(header));
+        floor_map loaded;
+        TEST_ASSERT_FALSE(loaded.load(file));
+        TEST_ASSERT_EQUAL(0, loaded.file_size());
+    }
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_save_load_round_trip);
+    RUN_TEST(test_load_rejects_corruption);
+    RUN_TEST(test_load_rejects_truncation);
+    return UNITY_END();
+}
@@ -0,0 +1,374 @@
+/**************************************************************************
+ * Host tests of the numeric types of the fits and the IILTM
+ *
+ * pio test -e native -f test_numeric_types -v
+ * pio test -e native_float -f test_numeric_types -v
+ *
+ * The first run uses double fits and the int8 map, the second one
+ * float fits and the int16 map (see numeric_types.h). The float and
+ * double maps need -D MAP_SCALAR_FLOAT or -D MAP_SCALAR_DOUBLE in the
+ * build_flags of the native environment.
+ *
+ * Hague Nusseck @ electricidea
+ * https://github.com/electricidea/M5Stack-Hotel-room-finder
+ *
+ * Distributed as-is; no warranty is given.
+ *
+ ***************************************************************************/
+
+#include <unity.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <chrono>
+#include <string>
+#include "Arduino.h"
+#include "numeric_types.h"
+#include "bssid_key.h"
+#include "curve_fit.h"
+#include "fit_bank.h"
+#include "floor_map.h"
+#include "fingerprint_matcher.h"
+#include "survey_reader.h"
+
+// survey: n_APs access points, n_walks over n_positions steps
+// (-n_positions/2 .. n_positions/2-1 steps away from the start)
+const int n_APs = 16;
+const int n_positions = 40;
+const int n_walks = 5;
+// survey file: 3 scans at each of survey_positions positions
+// (0 .. survey_positions-1 steps), survey_aps access points
+const int survey_positions = 60;
+const int survey_aps = 40;
+const int survey_max_records = 3 * survey_positions * survey_aps;
+
+void setUp(void) {
+}
+
+void tearDown(void) {
+}
+
+//==============================================================
+// microseconds since the first call
+static double time_us() {
+    static std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+    return std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - begin).count();
+}
+
+//==============================================================
+// RSSI of the access point ap at the position x (without noise)
+static double ap_rssi(int ap, double x) {
+    double ap_x = (ap * 37) % n_positions - n_positions/2;
+    return -35.0 - 22.0 * log10(1.0 + fabs(x - ap_x));
+}
+
+//==============================================================
+// fit_scalar fits against double fits of the same survey
+// The survey starts at x = 0 and walks into one direction, like
+// the survey in main.cpp. The fit bank centers and scales the
+// positions of each fit itself.
+void test_fit_scalar_accuracy(void) {
+    fit_bank fits;
+    TEST_ASSERT_TRUE(fits.init(n_APs, 5));
+    curve_fit reference[n_APs];
+    int aps[n_APs];
+    for(int ap = 0; ap < n_APs; ++ap) {
+        char bssid[18];
+        snprintf(bssid, sizeof(bssid), "AA:BB:CC:DD:EE:%02X", ap);
+        aps[ap] = fits.add(bssid);
+        reference[ap].init(5);
+    }
+    srand(10);
+    fit_scalar ys[n_APs];
+    for(int walk = 0; walk < n_walks; ++walk) {
+        for(int x = 0; x < n_positions; ++x) {
+            for(int ap = 0; ap < n_APs; ++ap) {
+                double y = ap_rssi(ap, x - n_positions/2) + (rand() % 100) * 0.04 - 2.0;
+                ys[ap] = (fit_scalar) y;
+                reference[ap].learn(x, y);
+            }
+            fits.learn_scan((fit_scalar) x, aps, ys, n_APs);
+        }
+    }
+    double max_diff = 0.0;
+    double sum_diff = 0.0;
+    int n = 0;
+    for(int ap = 0; ap < n_APs; ++ap) {
+        for(double x = 0; x <= n_positions - 1; x += 0.25, ++n) {
+            double diff = fabs(reference[ap].predict(x) - fits.predict(aps[ap], (fit_scalar) x));
+            max_diff = fmax(max_diff, diff);
+            sum_diff += diff;
+        }
+    }
+    // the degrees selected with the BIC out of the same sums
+    int same_degree = 0;
+    for(int ap = 0; ap < n_APs; ++ap)
+        if(fits.select_degree(aps[ap], FIT_CRITERION_BIC) == reference[ap].select_degree(FIT_CRITERION_BIC))
+            ++same_degree;
+    char message[160];
+    snprintf(message, sizeof(message), "%s fits (degree 5, %i APs, x 0..%i): mean |dy| %.2e dBm, max |dy| %.2e dBm, "
+             "%i of %i BIC degrees the same", (sizeof(fit_scalar) == sizeof(double)) ? "double" : "float",
+             n_APs, n_positions - 1, sum_diff / n, max_diff, same_degree, n_APs);
+    TEST_MESSAGE(message);
+    TEST_ASSERT_LESS_THAN((sizeof(fit_scalar) == sizeof(double)) ? 1e-8 : 2e-3, max_diff);
+    TEST_ASSERT_EQUAL(n_APs, same_degree);
+}
+
+//==============================================================
+// rounding error of map_encode() / map_decode()
+void test_map_quantization(void) {
+    double max_error = 0.0;
+    for(double rssi = -100.0; rssi <= -20.0; rssi += 0.01)
+        max_error = fmax(max_error, fabs(map_decode(map_encode(rssi)) - rssi));
+    char message[160];
+    snprintf(message, sizeof(message), "map type %i: step %.4f dBm, max |dRSSI| %.4f dBm (-100 .. -20 dBm)",
+             map_type_id, map_step, max_error);
+    TEST_MESSAGE(message);
+    TEST_ASSERT_LESS_OR_EQUAL(map_step / 2 + 1e-9, max_error);
+    // values outside of the integer range are clipped, not wrapped
+    TEST_ASSERT_LESS_OR_EQUAL(-100.0, map_decode(map_encode(-200.0)));
+}
+
+//==============================================================
+// squared differences of the quantized map against double values
+// and the best matching position of random scans
+void test_map_matching_error(void) {
+    static double exact[n_APs][n_positions];
+    floor_map map;
+    TEST_ASSERT_TRUE(map.init(n_positions, n_APs));
+    for(int ap = 0; ap < n_APs; ++ap) {
+        for(int x = 0; x < n_positions; ++x) {
+            exact[ap][x] = ap_rssi(ap, x - n_positions/2);
+            map.cell(x)[ap] = map_encode(exact[ap][x]);
+        }
+    }
+    fingerprint_matcher matcher;
+    TEST_ASSERT_TRUE(matcher.init(map.values(), map.n_x(), map.n_aps(), map.stride()));
+    srand(11);
+    const int n_scans = 200;
+    int same_position = 0;
+    double max_ssd_error = 0.0;
+    for(int scan = 0; scan < n_scans; ++scan) {
+        int position = rand() % n_positions;
+        map_accum sums[n_positions];
+        double exact_sums[n_positions] = {0};
+        matcher.clear_query();
+        for(int ap = 0; ap < n_APs; ++ap) {
+            // measured RSSI values are integer dBm
+            int rssi = (int) round(ap_rssi(ap, position - n_positions/2) + (rand() % 100) * 0.06 - 3.0);
+            matcher.set_rssi(ap, map_encode(rssi));
+            for(int x = 0; x < n_positions; ++x)
+                exact_sums[x] += (rssi - exact[ap][x]) * (rssi - exact[ap][x]);
+        }
+        matcher.square_sums(sums);
+        int best = 0, exact_best = 0;
+        for(int x = 1; x < n_positions; ++x) {
+            if(sums[x] < sums[best])
+                best = x;
+            if(exact_sums[x] < exact_sums[exact_best])
+                exact_best = x;
+        }
+        if(best == exact_best)
+            ++same_position;
+        for(int x = 0; x < n_positions; ++x)
+            max_ssd_error = fmax(max_ssd_error, fabs(sqrt(map_decode_square(sums[x])) - sqrt(exact_sums[x])));
+    }
+    char message[160];
+    snprintf(message, sizeof(message), "map type %i: %i of %i scans at the same position, max |d sqrt(SSD)| %.3f dBm",
+             map_type_id, same_position, n_scans, max_ssd_error);
+    TEST_MESSAGE(message);
+    TEST_ASSERT_GREATER_OR_EQUAL(n_scans * 95 / 100, same_position);
+    TEST_ASSERT_LESS_OR_EQUAL(sqrt((double) n_APs) * map_step / 2 + 1e-9, max_ssd_error);
+}
+
+//==============================================================
+// survey file in the format of /WiFi_data.txt (pos;n;name;id;RSSI;channel)
+// integer dBm, APs weaker than -92dBm are not found
+static std::string survey_text() {
+    std::string text = "pos;n;name;id;RSSI;channel\n";
+    srand(12);
+    char line[128], bssid[bssid_text_size];
+    for(int pos = 0; pos < survey_positions; ++pos) {
+        for(int scan = 0; scan < 3; ++scan) {
+            int n = 0;
+            for(int ap = 0; ap < survey_aps; ++ap) {
+                double ap_x = (ap * 37) % (survey_positions + 20) - 10;
+                int rssi = (int) round(-35.0 - 22.0 * log10(1.0 + fabs(pos - ap_x)) + (rand() % 100) * 0.06 - 3.0);
+                if(rssi < -92)
+                    continue;
+                bssid_format(0xA42BB0000000ULL + ap, bssid);
+                snprintf(line, sizeof(line), "%i;%i;Hotel-%i;%s;%i;%i\n", pos, ++n, ap, bssid, rssi, 1 + ap % 11);
+                text += line;
+            }
+        }
+    }
+    return text;
+}
+
+// the records of the survey file
+struct survey_log {
+    int n;
+    int pos[survey_max_records];
+    int scan_index[survey_max_records];
+    uint64_t bssid[survey_max_records];
+    int rssi[survey_max_records];
+};
+
+//==============================================================
+// callback of the survey_reader: store the record
+// (a new scan begins with n = 1)
+static void store_record(const survey_record &record, void *context) {
+    survey_log *log = (survey_log*) context;
+    if(log->n == survey_max_records)
+        return;
+    int i = log->n++;
+    log->pos[i] = (int) record.pos;
+    log->scan_index[i] = (record.n == 1 || i == 0) ? i : log->scan_index[i-1];
+    log->bssid[i] = bssid_parse(record.bssid);
+    log->rssi[i] = (int) record.rssi;
+}
+
+//==============================================================
+// timing and accuracy of the numeric types of this build on one
+// survey file: learning, map building and matching of all scans
+// of the file, against double fits and double maps
+// (native: double fits and int8 map, native_float: float fits
+// and Q11.4 int16 map)
+void test_survey_backends(void) {
+    static survey_log log;
+    log.n = 0;
+    std::string text = survey_text();
+    survey_reader reader(store_record, &log);
+    reader.feed(&text[0], text.size());
+    reader.finish();
+    TEST_ASSERT_EQUAL((int) reader.records(), log.n);
+    // learn
+    fit_bank fits;
+    TEST_ASSERT_TRUE(fits.init(16, 5));
+    static int aps[survey_max_records];
+    double start = time_us();
+    for(int i = 0; i < log.n; ++i) {
+        aps[i] = fits.add(log.bssid[i]);
+        fits.learn(aps[i], (fit_scalar) log.pos[i], (fit_scalar) log.rssi[i]);
+    }
+    for(int ap = 0; ap < fits.capacity(); ++ap)
+        if(fits.used(ap))
+            fits.select_degree(ap, FIT_CRITERION_BIC);
+    double learn_time = time_us() - start;
+    int n_aps = fits.size();
+    curve_fit reference[survey_aps];
+    for(int ap = 0; ap < n_aps; ++ap)
+        reference[ap].init(5);
+    for(int i = 0; i < log.n; ++i)
+        reference[aps[i]].learn(log.pos[i], log.rssi[i]);
+    for(int ap = 0; ap < n_aps; ++ap)
+        reference[ap].select_degree(FIT_CRITERION_BIC);
+    // the map of the fits
+    floor_map map;
+    TEST_ASSERT_TRUE(map.init(survey_positions, n_aps));
+    fit_scalar xs[survey_positions], ys[survey_positions];
+    for(int x = 0; x < survey_positions; ++x)
+        xs[x] = (fit_scalar) x;
+    start = time_us();
+    for(int ap = 0; ap < n_aps; ++ap) {
+        fits.predict_many(ap, xs, ys, survey_positions, (fit_scalar) -95.0);
+        for(int x = 0; x < survey_positions; ++x)
+            map.cell(x)[ap] = map_encode(ys[x]);
+    }
+    double map_time = time_us() - start;
+    static double exact[survey_positions][survey_aps];
+    double max_fit_diff = 0.0, max_map_diff = 0.0;
+    for(int ap = 0; ap < n_aps; ++ap) {
+        for(int x = 0; x < survey_positions; ++x) {
+            bool inside = x >= reference[ap].min_x() && x <= reference[ap].max_x();
+            exact[x][ap] = inside ? reference[ap].predict(x) : -95.0;
+            if(!inside)
+                continue;
+            max_fit_diff = fmax(max_fit_diff, fabs(fits.predict(ap, (fit_scalar) x) - exact[x][ap]));
+            max_map_diff = fmax(max_map_diff, fabs(map_decode(map.cell(x)[ap]) - exact[x][ap]));
+        }
+    }
+    // match each scan of the file
+    fingerprint_matcher matcher;
+    TEST_ASSERT_TRUE(matcher.init(map.values(), map.n_x(), map.n_aps(), map.stride()));
+    int n_scans = 0, same_position = 0;
+    double error = 0.0, exact_error = 0.0, match_time = 0.0;
+    for(int begin = 0; begin < log.n; ) {
+        int end = begin + 1;
+        while(end < log.n && log.scan_index[end] == begin)
+            ++end;
+        start = time_us();
+        matcher.clear_query();
+        for(int i = begin; i < end; ++i)
+            matcher.set_rssi(aps[i], map_encode(log.rssi[i]));
+        map_accum best_sum;
+        int best = matcher.match(0, &best_sum);
+        match_time += time_us() - start;
+        // the same scan against the double map
+        int exact_best = 0;
+        double exact_best_sum = HUGE_VAL;
+        for(int x = 0; x < survey_positions; ++x) {
+            double sum = 0.0;
+            for(int i = begin; i < end; ++i)
+                sum += (log.rssi[i] - exact[x][aps[i]]) * (log.rssi[i] - exact[x][aps[i]]);
+            if(sum < exact_best_sum) {
+                exact_best_sum = sum;
+                exact_best = x;
+            }
+        }
+        error += abs(best - log.pos[begin]);
+        exact_error += abs(exact_best - log.pos[begin]);
+        if(best == exact_best)
+            ++same_position;
+        ++n_scans;
+        begin = end;
+    }
+    char message[200];
+    snprintf(message, sizeof(message), "%s fits, map type %i: %i values of %i APs, learn %.0f us, map %.0f us, "
+             "%i matches %.0f us", (sizeof(fit_scalar) == sizeof(double)) ? "double" : "float", map_type_id,
+             log.n, n_aps, learn_time, map_time, n_scans, match_time);
+    TEST_MESSAGE(message);
+    snprintf(message, sizeof(message), "max |dy| fits %.2e dBm, map %.3f dBm, mean position error %.2f steps "
+             "(double map %.2f), %i of %i scans at the same position", max_fit_diff, max_map_diff,
+             error / n_scans, exact_error / n_scans, same_position, n_scans);
+    TEST_MESSAGE(message);
+    TEST_ASSERT_LESS_THAN((sizeof(fit_scalar) == sizeof(double)) ? 1e-8 : 2e-3, max_fit_diff);
+    TEST_ASSERT_LESS_OR_EQUAL(map_step / 2 + max_fit_diff + 1e-9, max_map_diff);
+    // the quantization of the map moves some scans to a neighbour
+    // cell, but not further away from the true position
+    TEST_ASSERT_LESS_OR_EQUAL(exact_error / n_scans + 0.1, error / n_scans);
+}
+
+//==============================================================
+// the sum of squared differences of many APs far away from the
+// map values doesn't overflow map_accum
+// (1000 APs with 100 dB difference: 2.56e9 in Q11.4 units)
+void test_map_accum_range(void) {
+    const int n_aps = 1000;
+    floor_map map;
+    TEST_ASSERT_TRUE(map.init(2, n_aps));
+    for(int x = 0; x < 2; ++x)
+        for(int ap = 0; ap < n_aps; ++ap)
+            map.cell(x)[ap] = map_encode(-120.0);
+    fingerprint_matcher matcher;
+    TEST_ASSERT_TRUE(matcher.init(map.values(), map.n_x(), map.n_aps(), map.stride()));
+    matcher.clear_query();
+    for(int ap = 0; ap < n_aps; ++ap)
+        matcher.set_rssi(ap, map_encode(-20.0));
+    map_accum sums[2];
+    matcher.square_sums(sums);
+    TEST_ASSERT_DOUBLE_WITHIN(1e-6, n_aps * 100.0 * 100.0, map_decode_square(sums[0]));
+    map_accum best_sum;
+    matcher.match(0, &best_sum);
+    TEST_ASSERT_DOUBLE_WITHIN(1e-6, n_aps * 100.0 * 100.0, map_decode_square(best_sum));
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_fit_scalar_accuracy);
+    RUN_TEST(test_map_quantization);
+    RUN_TEST(test_map_matching_error);
+    RUN_TEST(test_survey_backends);
+    RUN_TEST(test_map_accum_range);
+    return UNITY_END();
+}
@@ -0,0 +1,106 @@
+/**************************************************************************
+ * Host tests of poly_map
+ *
+ * pio test -e native -f test_poly_map -v
+ *
+ * The position of poly_map::solve() is compared with a dense search
+ * over the floor, with the fits and -95dBm outside of their learned
+ * ranges (same as the IILTM).
+ *
+ * Hague Nusseck @ electricidea
+ * https://github.com/electricidea/M5Stack-Hotel-room-finder
+ *
+ * Distributed as-is; no warranty is given.
+ *
+ ***************************************************************************/
+
+#include <unity.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include "Arduino.h"
+#include "fit_bank.h"
+#include "poly_map.h"
+
+const int max_aps = 10;
+const double min_pos = 0.0;
+const double max_pos = 40.0;
+// relative difference of the sums (float fits are evaluated in float
+// by the fit_bank and in double by the poly_map)
+const double sum_tolerance = (sizeof(fit_scalar) == sizeof(double)) ? 1e-6 : 1e-4;
+
+void setUp(void) {
+}
+
+void tearDown(void) {
+}
+
+//==============================================================
+// sum of the squared differences of the found APs at x
+static double square_sum(fit_bank &fits, int n_aps, const bool *found, const double *rssi, double x) {
+    double sum = 0;
+    for(int ap = 0; ap < n_aps; ++ap) {
+        if(!found[ap])
+            continue;
+        fit_scalar xs = (fit_scalar) x, y;
+        fits.predict_many(ap, &xs, &y, 1, -95.0);
+        sum += (y - rssi[ap]) * (y - rssi[ap]);
+    }
+    return sum;
+}
+
+//==============================================================
+// random floors: APs with random learned ranges and random scans
+// the sum of solve() is the sum at its position, and no position
+// of the dense search has a smaller sum
+void test_solve_matches_dense_search(void) {
+    const int n_trials = 200;
+    const int n_dense = 20000;
+    int n_segments = 0;
+    double max_gain = 0;
+    for(int trial = 0; trial < n_trials; ++trial) {
+        srand(trial);
+        fit_bank fits;
+        TEST_ASSERT_TRUE(fits.init(max_aps, 5));
+        int n_aps = 3 + rand() % (max_aps - 2);
+        for(int ap = 0; ap < n_aps; ++ap) {
+            int i = fits.add(0xA42BB0000000ULL + ap);
+            double center = rand() % 40, lo = rand() % 20, hi = lo + 10 + rand() % 30;
+            for(double x = lo; x <= hi; x += 0.5)
+                fits.learn(i, (fit_scalar) x, (fit_scalar) (-30.0 - 1.5 * fabs(x - center) + (rand() % 50) * 0.1));
+            fits.select_degree(i, FIT_CRITERION_BIC);
+        }
+        poly_map map;
+        TEST_ASSERT_TRUE(map.build(fits, min_pos, max_pos, -95.0));
+        bool found[max_aps];
+        double rssi[max_aps];
+        map.clear_query();
+        for(int ap = 0; ap < n_aps; ++ap) {
+            found[ap] = rand() % 4 != 0;
+            rssi[ap] = -40 - rand() % 40;
+            if(found[ap])
+                map.set_rssi(ap, rssi[ap]);
+        }
+        double sum;
+        double x = map.solve(&sum);
+        n_segments += map.segments();
+        // the sum belongs to the position
+        double exact = square_sum(fits, n_aps, found, rssi, x);
+        TEST_ASSERT_DOUBLE_WITHIN(sum_tolerance * (1 + exact), exact, sum);
+        double best = 1e300;
+        for(int k = 0; k <= n_dense; ++k)
+            best = fmin(best, square_sum(fits, n_aps, found, rssi, min_pos + (max_pos - min_pos) * k / n_dense));
+        TEST_ASSERT_TRUE(sum <= best + sum_tolerance * (1 + best));
+        max_gain = fmax(max_gain, best - sum);
+    }
+    char message[160];
+    snprintf(message, sizeof(message), "%i scans: %.1f segments per scan, max sum below the dense search %.3g",
+             n_trials, (double) n_segments / n_trials, max_gain);
+    TEST_MESSAGE(message);
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_solve_matches_dense_search);
+    return UNITY_END();
+}
@@ -0,0 +1,180 @@
+/**************************************************************************
+ * Host tests and benchmarks of position_tracker
+ *
+ * pio test -e native -f test_position_tracker -v
+ *
+ * A user walks along a synthetic floor map, every scan is noisy.
+ * The position of each single scan (smallest square sum, like the
+ * position check with one scan) is compared with the position of
+ * the tracker after the same scans.
+ *
+ * Hague Nusseck @ electricidea
+ * https://github.com/electricidea/M5Stack-Hotel-room-finder
+ *
+ * Distributed as-is; no warranty is given.
+ *
+ ***************************************************************************/
+
+#include <unity.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <chrono>
+#include "numeric_types.h"
+#include "floor_map.h"
+#include "fingerprint_matcher.h"
+#include "position_tracker.h"
+
+// same parameters as the tracking in main.cpp
+const float step_sigma = 2.0;
+const float rssi_sigma = 6.0;
+
+void setUp(void) {
+}
+
+void tearDown(void) {
+}
+
+//==============================================================
+// microseconds since the first call
+static double time_us() {
+    static std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+    return std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - begin).count();
+}
+
+//==============================================================
+// RSSI of the access point ap at the cell x of a floor with n_x cells
+static double ap_rssi(int ap, int n_aps, double x, int n_x) {
+    double ap_x = (double) ap * n_x / n_aps;
+    return -35.0 - 25.0 * log10(1.0 + fabs(x - ap_x) / 4.0);
+}
+
+//==============================================================
+// synthetic floor map without noise
+static void build_floor(floor_map &map, int n_x, int n_aps) {
+    TEST_ASSERT_TRUE(map.init(n_x, n_aps));
+    for(int ap = 0; ap < n_aps; ++ap)
+        for(int x = 0; x < n_x; ++x)
+            map.cell(x)[ap] = map_encode(ap_rssi(ap, n_aps, x, n_x));
+}
+
+//==============================================================
+// random value with about the standard deviation sigma
+static double noise(double sigma) {
+    double sum = 0;
+    for(int i = 0; i < 12; ++i)
+        sum += rand() / (double) RAND_MAX;
+    return (sum - 6.0) * sigma;
+}
+
+//==============================================================
+// one noisy scan at the cell x (integer dBm)
+// APs weaker than -90 dBm are not found (0)
+static void scan_at(int n_x, int n_aps, double x, int *rssi) {
+    for(int ap = 0; ap < n_aps; ++ap) {
+        rssi[ap] = (int) round(ap_rssi(ap, n_aps, x, n_x) + noise(4.0));
+        if(rssi[ap] < -90)
+            rssi[ap] = 0;
+    }
+}
+
+//==============================================================
+// square sums of all cells for a scan (like track_position())
+static void scan_square_sums(fingerprint_matcher &matcher, int n_aps, const int *rssi, map_accum *sums) {
+    matcher.clear_query();
+    for(int ap = 0; ap < n_aps; ++ap)
+        if(rssi[ap] != 0)
+            matcher.set_rssi(ap, map_encode(rssi[ap]));
+    matcher.square_sums(sums);
+}
+
+//==============================================================
+// the tracker is closer to the walk than the single scans
+void test_tracker_follows_walk(void) {
+    const int n_x = 200;
+    const int n_aps = 20;
+    floor_map map;
+    build_floor(map, n_x, n_aps);
+    fingerprint_matcher matcher;
+    TEST_ASSERT_TRUE(matcher.init(map.values(), n_x, n_aps, map.stride()));
+    position_tracker tracker;
+    TEST_ASSERT_TRUE(tracker.init(n_x, step_sigma, rssi_sigma));
+    map_accum *sums = (map_accum*) malloc(n_x * sizeof(map_accum));
+    int rssi[n_aps];
+    srand(18);
+    // walk with 1 cell per scan from cell 20 to cell 180
+    double scan_error = 0, track_error = 0;
+    double first_scan_error = 0, first_track_error = 0;
+    int n = 0;
+    for(double x = 20.0; x <= 180.0; x += 1.0, ++n) {
+        scan_at(n_x, n_aps, x, rssi);
+        scan_square_sums(matcher, n_aps, rssi, sums);
+        tracker.update(sums);
+        int scan_best = 0;
+        for(int cell = 1; cell < n_x; ++cell)
+            if(sums[cell] < sums[scan_best])
+                scan_best = cell;
+        scan_error += fabs(scan_best - x);
+        track_error += fabs(tracker.best() - x);
+        // the first update is the single scan
+        if(n == 0) {
+            first_scan_error = fabs(scan_best - x);
+            first_track_error = fabs(tracker.best() - x);
+        }
+    }
+    free(sums);
+    char message[200];
+    snprintf(message, sizeof(message), "walk over %i scans, %i cells, %i APs: mean |dx| single scan %.2f cells, "
+             "tracker %.2f cells", n, n_x, n_aps, scan_error / n, track_error / n);
+    TEST_MESSAGE(message);
+    TEST_ASSERT_EQUAL(first_scan_error, first_track_error);
+    TEST_ASSERT_EQUAL(n, tracker.updates());
+    TEST_ASSERT_LESS_THAN(scan_error / n, track_error / n);
+    TEST_ASSERT_LESS_THAN(3.0, track_error / n);
+}
+
+//==============================================================
+// time of one update (square sums + tracker) for floor sizes
+void test_update_time(void) {
+    const int n_xs[] = {200, 1000, 4000};
+    const int n_apss[] = {20, 60};
+    for(int i = 0; i < 3; ++i) {
+        for(int j = 0; j < 2; ++j) {
+            int n_x = n_xs[i], n_aps = n_apss[j];
+            floor_map map;
+            build_floor(map, n_x, n_aps);
+            fingerprint_matcher matcher;
+            TEST_ASSERT_TRUE(matcher.init(map.values(), n_x, n_aps, map.stride()));
+            position_tracker tracker;
+            TEST_ASSERT_TRUE(tracker.init(n_x, step_sigma, rssi_sigma));
+            map_accum *sums = (map_accum*) malloc(n_x * sizeof(map_accum));
+            int *rssi = (int*) malloc(n_aps * sizeof(int));
+            srand(19);
+            const int n_updates = 200;
+            double sums_time = 0, tracker_time = 0;
+            for(int update = 0; update < n_updates; ++update) {
+                scan_at(n_x, n_aps, n_x / 2 + update % 10, rssi);
+                double start = time_us();
+                scan_square_sums(matcher, n_aps, rssi, sums);
+                double middle = time_us();
+                tracker.update(sums);
+                tracker_time += time_us() - middle;
+                sums_time += middle - start;
+            }
+            free(sums);
+            free(rssi);
+            char message[200];
+            snprintf(message, sizeof(message), "%i cells, %i APs: square sums %.1f us, tracker update %.1f us, "
+                     "tracker memory %u bytes", n_x, n_aps, sums_time / n_updates, tracker_time / n_updates,
+                     (unsigned) tracker.memory_bytes());
+            TEST_MESSAGE(message);
+        }
+    }
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_tracker_follows_walk);
+    RUN_TEST(test_update_time);
+    return UNITY_END();
+}
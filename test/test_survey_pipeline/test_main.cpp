@@ -0,0 +1,287 @@
+/**************************************************************************
+ * Host tests and benchmarks of survey_pipeline and parallel_team
+ *
+ * pio test -e native -f test_survey_pipeline -v
+ * pio test -e native_float -f test_survey_pipeline -v
+ *
+ * The pipeline is compared with the serial learning of the survey
+ * file (survey_reader and fit_bank::learn_scan() in one task, like
+ * learn_survey_scan() of main.cpp).
+ *
+ * Hague Nusseck @ electricidea
+ * https://github.com/electricidea/M5Stack-Hotel-room-finder
+ *
+ * Distributed as-is; no warranty is given.
+ *
+ ***************************************************************************/
+
+#include <unity.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <chrono>
+#include <string>
+#include "Arduino.h"
+#include "bssid_key.h"
+#include "fit_bank.h"
+#include "survey_reader.h"
+#include "survey_pipeline.h"
+#include "parallel.h"
+#include "wifi_scanner.h"
+
+void setUp(void) {
+}
+
+void tearDown(void) {
+}
+
+//==============================================================
+// microseconds since the first call
+static double time_us() {
+    static std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+    return std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - begin).count();
+}
+
+//==============================================================
+// text in the memory as file (read() like File)
+struct text_file {
+    const std::string *text;
+    size_t position;
+    size_t read(uint8_t *data, size_t size) {
+        size_t n = (text->size() - position < size) ? text->size() - position : size;
+        memcpy(data, text->data() + position, n);
+        position += n;
+        return n;
+    }
+};
+
+//==============================================================
+// survey file: 3 scans at each of n_positions positions,
+// n_aps APs, weaker than -92dBm are not found
+static std::string survey_file(int n_positions, int n_aps) {
+    std::string text = "pos;n;name;id;RSSI;channel\n";
+    srand(24);
+    char line[128], bssid[bssid_text_size];
+    for(int pos = 0; pos < n_positions; ++pos) {
+        for(int scan = 0; scan < 3; ++scan) {
+            int n = 0;
+            for(int ap = 0; ap < n_aps; ++ap) {
+                double rssi = -30.0 - 1.2 * fabs(pos - (ap * 7) % n_positions) + rand() % 8;
+                if(rssi < -92.0)
+                    continue;
+                bssid_format(0xA42BB0000000ULL + ap, bssid);
+                snprintf(line, sizeof(line), "%i;%i;Hotel-%i;%s;%i;%i\n", pos, ++n, ap, bssid, (int) rssi, 1 + ap % 11);
+                text += line;
+            }
+        }
+    }
+    return text;
+}
+
+// the scan of the serial learning
+struct serial_scan {
+    fit_bank *fits;
+    int aps[survey_pipeline_scan];
+    fit_scalar rssi[survey_pipeline_scan];
+    int n;
+    double pos;
+};
+
+//==============================================================
+// callback of the survey_reader: learn the values scan by scan
+static void learn_record(const survey_record &record, void *context) {
+    serial_scan *scan = (serial_scan*) context;
+    fit_bank &fits = *scan->fits;
+    if(scan->n > 0 && (record.pos != scan->pos || scan->n == survey_pipeline_scan)) {
+        fits.learn_scan(scan->pos, scan->aps, scan->rssi, scan->n);
+        scan->n = 0;
+    }
+    scan->pos = record.pos;
+    int ap = fits.add(bssid_parse(record.bssid));
+    if(ap < 0)
+        return;
+    if(record.channel > 0)
+        fits.set_channel(ap, record.channel);
+    scan->aps[scan->n] = ap;
+    scan->rssi[scan->n] = record.rssi;
+    ++scan->n;
+}
+
+//==============================================================
+// learn the file in one task
+static void learn_serial(const std::string &text, fit_bank &fits) {
+    serial_scan scan;
+    scan.fits = &fits;
+    scan.n = 0;
+    scan.pos = 0;
+    text_file file = {&text, 0};
+    survey_reader reader(learn_record, &scan);
+    reader.read(file);
+    if(scan.n > 0)
+        fits.learn_scan(scan.pos, scan.aps, scan.rssi, scan.n);
+}
+
+//==============================================================
+// the pipeline learns the same fits as the serial learning, bit
+// for bit, with any number of workers
+void test_pipeline_matches_serial(void) {
+    std::string text = survey_file(200, 80);
+    fit_bank serial;
+    TEST_ASSERT_TRUE(serial.init(40, 5));
+    double start = time_us();
+    learn_serial(text, serial);
+    double serial_time = time_us() - start;
+    const int workers[] = {1, 2, 4};
+    for(int w = 0; w < 3; ++w) {
+        fit_bank fits;
+        TEST_ASSERT_TRUE(fits.init(40, 5));
+        survey_pipeline pipeline(fits);
+        text_file file = {&text, 0};
+        start = time_us();
+        TEST_ASSERT_TRUE(pipeline.learn(file, workers[w]));
+        double pipeline_time = time_us() - start;
+        TEST_ASSERT_EQUAL(serial.capacity(), fits.capacity());
+        TEST_ASSERT_EQUAL(serial.size(), fits.size());
+        for(int ap = 0; ap < serial.capacity(); ++ap) {
+            TEST_ASSERT_EQUAL(serial.used(ap), fits.used(ap));
+            if(!serial.used(ap))
+                continue;
+            TEST_ASSERT_TRUE(serial.bssid(ap) == fits.bssid(ap));
+            TEST_ASSERT_EQUAL(serial.channel(ap), fits.channel(ap));
+            TEST_ASSERT_EQUAL(serial.count(ap), fits.count(ap));
+            TEST_ASSERT_EQUAL_MEMORY(serial.coefficients(ap), fits.coefficients(ap), 6 * sizeof(fit_scalar));
+        }
+        char message[200];
+        snprintf(message, sizeof(message), "%u values, %u batches: serial %.1f ms, pipeline with %i workers %.1f ms",
+                 (unsigned) pipeline.records(), (unsigned) pipeline.batches(), serial_time / 1000.0, workers[w],
+                 pipeline_time / 1000.0);
+        TEST_MESSAGE(message);
+    }
+}
+
+//==============================================================
+// the fits learned scan by scan during the survey (like
+// learn_survey_scan() of main.cpp) are the same, bit for bit, as
+// the fits the pipeline learns out of the text log of these scans
+// (like load_measurement() of main.cpp)
+void test_scans_match_log(void) {
+    const int n_aps = 70;
+    const fit_scalar forgetting_factors[2] = {1.0, (fit_scalar) 0.98};
+    for(int f = 0; f < 2; ++f) {
+        fit_bank scan_fits;
+        TEST_ASSERT_TRUE(scan_fits.init(40, 5));
+        scan_fits.set_forgetting_factor(forgetting_factors[f]);
+        std::string text = "pos;n;name;id;RSSI;channel\n";
+        srand(25);
+        scan_result results[scanner_max_results];
+        char line[128], bssid[bssid_text_size];
+        // forward and back again, like ADD and the < button
+        int measure_position = 0;
+        for(int step = 0; step < 90; ++step) {
+            measure_position += (step < 60) ? 1 : -1;
+            int n = 0;
+            for(int ap = 0; ap < n_aps && n < scanner_max_results; ++ap) {
+                int rssi = -30 - (int) (1.5 * abs(measure_position - ap)) + rand() % 8;
+                if(rssi < -92)
+                    continue;
+                results[n].bssid = 0xA42BB0000000ULL + ap;
+                results[n].rssi = (int8_t) rssi;
+                results[n].channel = 1 + ap % 11;
+                snprintf(results[n].ssid, scanner_ssid_size, "Hotel-%i", ap);
+                ++n;
+            }
+            // the log of the scan
+            for(int i = 0; i < n; ++i) {
+                bssid_format(results[i].bssid, bssid);
+                snprintf(line, sizeof(line), "%i;%i;%s;%s;%i;%i\n", measure_position, i+1, results[i].ssid, bssid,
+                         results[i].rssi, results[i].channel);
+                text += line;
+            }
+            // learn the scan
+            int aps[scanner_max_results];
+            fit_scalar rssi[scanner_max_results];
+            for(int i = 0; i < n; ++i) {
+                aps[i] = scan_fits.add(results[i].bssid);
+                TEST_ASSERT_TRUE(aps[i] > -1);
+                scan_fits.set_channel(aps[i], results[i].channel);
+                rssi[i] = results[i].rssi;
+            }
+            scan_fits.learn_scan(measure_position, aps, rssi, n);
+        }
+        fit_bank log_fits;
+        TEST_ASSERT_TRUE(log_fits.init(40, 5));
+        log_fits.set_forgetting_factor(forgetting_factors[f]);
+        survey_pipeline pipeline(log_fits);
+        text_file file = {&text, 0};
+        TEST_ASSERT_TRUE(pipeline.learn(file));
+        // only the header line is skipped
+        TEST_ASSERT_EQUAL(1, (int) pipeline.skipped());
+        TEST_ASSERT_EQUAL(scan_fits.capacity(), log_fits.capacity());
+        TEST_ASSERT_EQUAL(n_aps, log_fits.size());
+        for(int ap = 0; ap < scan_fits.capacity(); ++ap) {
+            TEST_ASSERT_EQUAL(scan_fits.used(ap), log_fits.used(ap));
+            if(!scan_fits.used(ap))
+                continue;
+            TEST_ASSERT_TRUE(scan_fits.bssid(ap) == log_fits.bssid(ap));
+            TEST_ASSERT_EQUAL(scan_fits.channel(ap), log_fits.channel(ap));
+            TEST_ASSERT_EQUAL(scan_fits.count(ap), log_fits.count(ap));
+            TEST_ASSERT_EQUAL(scan_fits.min_x(ap), log_fits.min_x(ap));
+            TEST_ASSERT_EQUAL(scan_fits.max_x(ap), log_fits.max_x(ap));
+            TEST_ASSERT_EQUAL(scan_fits.x_origin(ap), log_fits.x_origin(ap));
+            TEST_ASSERT_EQUAL(scan_fits.x_span(ap), log_fits.x_span(ap));
+            // the moment sums are exactly the same
+            fit_scalar scan_Sx[2*CURVE_FIT_MAX_DEGREE+1], scan_Sxy[CURVE_FIT_MAX_DEGREE+1];
+            fit_scalar log_Sx[2*CURVE_FIT_MAX_DEGREE+1], log_Sxy[CURVE_FIT_MAX_DEGREE+1];
+            scan_fits.gather_sums(ap, scan_Sx, scan_Sxy);
+            log_fits.gather_sums(ap, log_Sx, log_Sxy);
+            TEST_ASSERT_EQUAL_MEMORY(scan_Sx, log_Sx, 11 * sizeof(fit_scalar));
+            TEST_ASSERT_EQUAL_MEMORY(scan_Sxy, log_Sxy, 6 * sizeof(fit_scalar));
+            TEST_ASSERT_EQUAL(scan_fits.select_degree(ap), log_fits.select_degree(ap));
+            TEST_ASSERT_TRUE(scan_fits.residual(ap) == log_fits.residual(ap));
+        }
+    }
+}
+
+//==============================================================
+// job of the overhead benchmark: count the calls
+static void count_job(int index, void *context) {
+    int *counts = (int*) context;
+    ++counts[index];
+}
+
+//==============================================================
+// the team runs every job once per run(), and its overhead per
+// run() against the creation of the threads by parallel_for()
+void test_team_overhead(void) {
+    const int n_jobs = 4;
+    const int n_runs = 2000;
+    int counts[n_jobs] = {0};
+    double start = time_us();
+    for(int run = 0; run < n_runs; ++run)
+        parallel_for(n_jobs, count_job, counts);
+    double for_time = (time_us() - start) / n_runs;
+    parallel_team team;
+    TEST_ASSERT_TRUE(team.start(n_jobs));
+    TEST_ASSERT_EQUAL(n_jobs, team.jobs());
+    start = time_us();
+    for(int run = 0; run < n_runs; ++run)
+        team.run(count_job, counts);
+    double team_time = (time_us() - start) / n_runs;
+    team.stop();
+    for(int i = 0; i < n_jobs; ++i)
+        TEST_ASSERT_EQUAL(2 * n_runs, counts[i]);
+    char message[160];
+    snprintf(message, sizeof(message), "%i jobs: parallel_for() %.1f us, parallel_team::run() %.1f us per call",
+             n_jobs, for_time, team_time);
+    TEST_MESSAGE(message);
+    TEST_ASSERT_LESS_THAN(for_time, team_time);
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_pipeline_matches_serial);
+    RUN_TEST(test_scans_match_log);
+    RUN_TEST(test_team_overhead);
+    return UNITY_END();
+}
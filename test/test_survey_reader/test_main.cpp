@@ -0,0 +1,212 @@
+/**************************************************************************
+ * Host tests and benchmarks of survey_reader
+ *
+ * pio test -e native -f test_survey_reader -v
+ *
+ * Hague Nusseck @ electricidea
+ * https://github.com/electricidea/M5Stack-Hotel-room-finder
+ *
+ * Distributed as-is; no warranty is given.
+ *
+ ***************************************************************************/
+
+#include <unity.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <string>
+#include <vector>
+#include "survey_reader.h"
+
+// one parsed line (pos, n, bssid, RSSI)
+struct parsed_line {
+    double pos;
+    int n;
+    std::string bssid;
+    double rssi;
+};
+
+void setUp(void) {
+}
+
+void tearDown(void) {
+}
+
+//==============================================================
+// microseconds since the first call
+static double time_us() {
+    static std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+    return std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - begin).count();
+}
+
+//==============================================================
+// survey file like collect_WiFi_data() writes it:
+// header line, n_scans scans of 1..20 networks, CRLF
+static std::string survey_file(int n_scans, bool with_channel) {
+    std::string text = with_channel ? "pos;n;name;id;RSSI;channel\r\n" : "pos;n;name;id;RSSI\r\n";
+    srand(12);
+    char line[128];
+    for(int scan = 0; scan < n_scans; ++scan) {
+        int pos = scan / 4 - 20;
+        int n_networks = 1 + rand() % 20;
+        for(int i = 0; i < n_networks; ++i) {
+            int ap = (scan + i * 7) % 60;
+            int rssi = -30 - rand() % 65;
+            if(with_channel)
+                snprintf(line, sizeof(line), "%i;%i;Hotel-%i;A4:2B:B0:%02X:1C:%02X;%i;%i\r\n",
+                         pos, i + 1, ap, ap, ap * 3, rssi, 1 + ap % 13);
+            else
+                snprintf(line, sizeof(line), "%i;%i;Hotel-%i;A4:2B:B0:%02X:1C:%02X;%i\r\n",
+                         pos, i + 1, ap, ap, ap * 3, rssi);
+            text += line;
+        }
+    }
+    return text;
+}
+
+//==============================================================
+// field "location" of a line (the old split() of main.cpp)
+static std::string split(const std::string &source, char delimiter, int location) {
+    size_t from = 0;
+    for(int i = 0; i < location; ++i) {
+        from = source.find(delimiter, from);
+        if(from == std::string::npos)
+            return "";
+        ++from;
+    }
+    size_t to = source.find(delimiter, from);
+    return source.substr(from, (to == std::string::npos) ? std::string::npos : to - from);
+}
+
+//==============================================================
+// the parser before survey_reader (main.cpp, load_measurement):
+// the line is built character by character and each field is
+// searched again with split()
+static void split_parse(const std::string &text, std::vector<parsed_line> &lines) {
+    std::string line = "";
+    for(size_t i = 0; i < text.size(); ++i) {
+        char chread = text[i];
+        // ASCII printable characters (character code 32-127)
+        if(chread >= 32)
+            line = line + std::string(1, chread);
+        if((chread == '\r' || chread == '\n') && (line.length() > 0)) {
+            std::string BSSID = split(line, ';', 3);
+            // skip the header line
+            if(BSSID != "id") {
+                parsed_line parsed;
+                parsed.pos = atof(split(line, ';', 0).c_str());
+                parsed.n = atoi(split(line, ';', 1).c_str());
+                parsed.bssid = BSSID;
+                parsed.rssi = atof(split(line, ';', 4).c_str());
+                lines.push_back(parsed);
+            }
+            line = "";
+        }
+    }
+}
+
+//==============================================================
+// callback of survey_reader: collect the records
+static void collect_record(const survey_record &record, void *context) {
+    std::vector<parsed_line> *lines = (std::vector<parsed_line> *) context;
+    parsed_line parsed;
+    parsed.pos = record.pos;
+    parsed.n = record.n;
+    parsed.bssid = record.bssid;
+    parsed.rssi = record.rssi;
+    lines->push_back(parsed);
+}
+
+//==============================================================
+// feed the text in blocks of random sizes (1 .. max_block bytes)
+static void feed_blocks(survey_reader &reader, const std::string &text, size_t max_block) {
+    std::vector<char> data(text.begin(), text.end());
+    size_t start = 0;
+    while(start < data.size()) {
+        size_t length = 1 + rand() % max_block;
+        if(length > data.size() - start)
+            length = data.size() - start;
+        reader.feed(&data[start], length);
+        start += length;
+    }
+    reader.finish();
+}
+
+//==============================================================
+// compare two lists of parsed lines
+static void assert_same_lines(const std::vector<parsed_line> &expected, const std::vector<parsed_line> &actual) {
+    TEST_ASSERT_EQUAL(expected.size(), actual.size());
+    for(size_t i = 0; i < expected.size(); ++i) {
+        TEST_ASSERT_EQUAL(expected[i].pos, actual[i].pos);
+        TEST_ASSERT_EQUAL(expected[i].n, actual[i].n);
+        TEST_ASSERT_EQUAL_STRING(expected[i].bssid.c_str(), actual[i].bssid.c_str());
+        TEST_ASSERT_EQUAL(expected[i].rssi, actual[i].rssi);
+    }
+}
+
+//==============================================================
+// survey_reader gives the same records as the split() parser,
+// for every block size and for files with and without channel
+void test_reader_matches_split(void) {
+    for(int with_channel = 0; with_channel < 2; ++with_channel) {
+        std::string text = survey_file(400, with_channel == 1);
+        std::vector<parsed_line> expected;
+        split_parse(text, expected);
+        const size_t max_blocks[] = {1, 7, 64, survey_block_size};
+        for(size_t b = 0; b < sizeof(max_blocks) / sizeof(max_blocks[0]); ++b) {
+            std::vector<parsed_line> actual;
+            survey_reader reader(collect_record, &actual);
+            feed_blocks(reader, text, max_blocks[b]);
+            assert_same_lines(expected, actual);
+            // only the header line is skipped
+            TEST_ASSERT_EQUAL(1, reader.skipped());
+        }
+    }
+}
+
+//==============================================================
+// a ';' in the SSID moves the fields of split(), but not of
+// survey_reader; lines without an end of line are read as well
+void test_reader_ssid_with_separator(void) {
+    std::string text = "3;1;Cafe;Bar;A4:2B:B0:01:02:03;-67;11\r\n3;2;x;A4:2B:B0:01:02:04;-70";
+    std::vector<parsed_line> actual;
+    survey_reader reader(collect_record, &actual);
+    feed_blocks(reader, text, 5);
+    TEST_ASSERT_EQUAL(2, actual.size());
+    TEST_ASSERT_EQUAL_STRING("A4:2B:B0:01:02:03", actual[0].bssid.c_str());
+    TEST_ASSERT_EQUAL(-67.0, actual[0].rssi);
+    TEST_ASSERT_EQUAL(-70.0, actual[1].rssi);
+    TEST_ASSERT_EQUAL(0, reader.skipped());
+}
+
+//==============================================================
+// parsing time of a large survey file
+void test_reader_time(void) {
+    std::string text = survey_file(8000, true);
+    std::vector<parsed_line> expected;
+    expected.reserve(100000);
+    double start = time_us();
+    split_parse(text, expected);
+    double split_time = time_us() - start;
+    std::vector<parsed_line> actual;
+    actual.reserve(100000);
+    survey_reader reader(collect_record, &actual);
+    start = time_us();
+    feed_blocks(reader, text, survey_block_size);
+    double reader_time = time_us() - start;
+    assert_same_lines(expected, actual);
+    char message[160];
+    snprintf(message, sizeof(message), "%u lines, %u kB: split() %.1f ms, survey_reader %.1f ms",
+             (unsigned) actual.size(), (unsigned) (text.size() / 1024), split_time / 1000.0, reader_time / 1000.0);
+    TEST_MESSAGE(message);
+    TEST_ASSERT_LESS_THAN(split_time, reader_time);
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_reader_matches_split);
+    RUN_TEST(test_reader_ssid_with_separator);
+    RUN_TEST(test_reader_time);
+    return UNITY_END();
+}
@@ -0,0 +1,131 @@
+/**************************************************************************
+ * Host tests of tiled_map
+ *
+ * pio test -e native -f test_tiled_map -v
+ * pio test -e native_float -f test_tiled_map -v
+ *
+ * The file is written into the memory instead of the SD card.
+ *
+ * Hague Nusseck @ electricidea
+ * https://github.com/electricidea/M5Stack-Hotel-room-finder
+ *
+ * Distributed as-is; no warranty is given.
+ *
+ ***************************************************************************/
+
+#include <unity.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <vector>
+#include "numeric_types.h"
+#include "floor_map.h"
+#include "tiled_map.h"
+
+void setUp(void) {
+}
+
+void tearDown(void) {
+}
+
+//==============================================================
+// file in the memory (write() like File)
+struct memory_file {
+    std::vector<uint8_t> data;
+    size_t write(const uint8_t *bytes, size_t size) {
+        data.insert(data.end(), bytes, bytes + size);
+        return size;
+    }
+};
+
+//==============================================================
+// random access to the memory file
+static bool read_memory(void *context, uint32_t offset, uint8_t *data, size_t size) {
+    memory_file *file = (memory_file*) context;
+    if(offset + size > file->data.size())
+        return false;
+    memcpy(data, &file->data[offset], size);
+    return true;
+}
+
+//==============================================================
+// RSSI of the access point ap at the cell x of a floor with n_x cells
+static double ap_rssi(int ap, int n_aps, int x, int n_x) {
+    double ap_x = (double) ap * n_x / n_aps;
+    return -35.0 - 25.0 * log10(1.0 + fabs(x - ap_x) / 4.0);
+}
+
+//==============================================================
+// the fingerprints calculated cell by cell (like out of the fits)
+// context: number of APs and cells
+static int calculated_cells = 0;
+static bool floor_cells(void *context, int begin, int end, int stride, map_scalar *cells) {
+    const int *size = (const int*) context;
+    for(int x = begin; x < end; ++x) {
+        for(int ap = 0; ap < size[1]; ++ap)
+            cells[(x-begin)*stride + ap] = map_encode(ap_rssi(ap, size[1], x, size[0]));
+        ++calculated_cells;
+    }
+    return true;
+}
+
+//==============================================================
+// the same floor as floor map
+static void build_floor(floor_map &map, int n_x, int n_aps) {
+    TEST_ASSERT_TRUE(map.init(n_x, n_aps));
+    for(int ap = 0; ap < n_aps; ++ap) {
+        map.bssids()[ap] = 0xA42BB0000000ULL + ap;
+        map.channels()[ap] = 1 + ap % 13;
+        for(int x = 0; x < n_x; ++x)
+            map.cell(x)[ap] = map_encode(ap_rssi(ap, n_aps, x, n_x));
+    }
+    for(int x = 0; x < n_x; ++x)
+        map.x()[x] = x * 0.5;
+}
+
+//==============================================================
+// the file calculated tile by tile is the same as the file of
+// the floor map, and the search gives the same cells
+void test_tiles_without_floor_map(void) {
+    const int sizes[][2] = {{100, 8}, {2000, 40}};
+    for(int s = 0; s < 2; ++s) {
+        int n_x = sizes[s][0], n_aps = sizes[s][1];
+        floor_map map;
+        build_floor(map, n_x, n_aps);
+        memory_file map_file;
+        TEST_ASSERT_TRUE(tiled_map::save(map, map_file));
+        memory_file streamed_file;
+        calculated_cells = 0;
+        int size[2] = {n_x, n_aps};
+        TEST_ASSERT_TRUE(tiled_map::save(n_x, n_aps, map.x(), map.bssids(), map.channels(), floor_cells, size,
+                                         streamed_file));
+        // each cell twice: for the index and for the file
+        TEST_ASSERT_EQUAL(2 * n_x, calculated_cells);
+        TEST_ASSERT_EQUAL(map_file.data.size(), streamed_file.data.size());
+        TEST_ASSERT_TRUE(map_file.data == streamed_file.data);
+        tiled_map tiles;
+        TEST_ASSERT_TRUE(tiles.open(read_memory, &streamed_file, 4096));
+        TEST_ASSERT_EQUAL(n_x, (int) tiles.n_x());
+        TEST_ASSERT_EQUAL(n_aps, (int) tiles.n_aps());
+        for(int truth = 0; truth < n_x; truth += n_x / 10) {
+            tiles.clear_query();
+            for(int ap = 0; ap < n_aps; ++ap)
+                tiles.set_rssi(ap, map.cell(truth)[ap]);
+            map_accum best_sum;
+            TEST_ASSERT_EQUAL(truth, tiles.match(n_x / 2, &best_sum));
+            TEST_ASSERT_TRUE(best_sum == 0);
+        }
+        char message[200];
+        snprintf(message, sizeof(message), "%i cells, %i APs: floor map %u bytes, tiled map %u bytes in memory "
+                 "(%u tiles, %i cached)", n_x, n_aps, (unsigned) map.memory_bytes(), (unsigned) tiles.memory_bytes(),
+                 tiles.tiles(), tiles.cache_tiles());
+        TEST_MESSAGE(message);
+    }
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_tiles_without_floor_map);
+    return UNITY_END();
+}
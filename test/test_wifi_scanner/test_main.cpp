@@ -0,0 +1,113 @@
+/**************************************************************************
+ * Host tests of the scan results of wifi_scanner
+ *
+ * pio test -e native -f test_wifi_scanner -v
+ *
+ * The scans are replayed (replay_scanner), the hardware_scanner uses
+ * the same keep_strongest() for scans with too many networks.
+ *
+ * Hague Nusseck @ electricidea
+ * https://github.com/electricidea/M5Stack-Hotel-room-finder
+ *
+ * Distributed as-is; no warranty is given.
+ *
+ ***************************************************************************/
+
+#include <unity.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include "bssid_key.h"
+#include "wifi_scanner.h"
+
+void setUp(void) {
+}
+
+void tearDown(void) {
+}
+
+//==============================================================
+// text in the memory as file (read() like File)
+struct text_file {
+    std::string text;
+    size_t position;
+    size_t read(uint8_t *data, size_t size) {
+        size_t n = (text.size() - position < size) ? text.size() - position : size;
+        memcpy(data, text.data() + position, n);
+        position += n;
+        return n;
+    }
+};
+
+//==============================================================
+// one recorded scan of n_networks networks
+// the network i has the RSSI -30-i dBm and is on the channel
+// 1 + i%13, the crowded channels come first in the file
+static void load_scan(replay_scanner &scanner, int n_networks) {
+    text_file file;
+    file.text = "pos;n;name;id;RSSI;channel\n";
+    file.position = 0;
+    char line[96], bssid[bssid_text_size];
+    for(int i = 0; i < n_networks; ++i) {
+        // the weakest networks first (like channel by channel)
+        int network = n_networks - 1 - i;
+        bssid_format(0xA42BB0000000ULL + network, bssid);
+        snprintf(line, sizeof(line), "0;%i;Hotel-%i;%s;%i;%i\n", i+1, network, bssid, -30 - network, 1 + network % 13);
+        file.text += line;
+    }
+    TEST_ASSERT_TRUE(scanner.load(file));
+    scanner.set_channels(NULL, 0, 0);
+}
+
+//==============================================================
+// a scan that fits into the results is copied completely
+void test_scan_without_drops(void) {
+    replay_scanner scanner;
+    load_scan(scanner, 20);
+    scan_result results[scanner_max_results];
+    TEST_ASSERT_EQUAL(20, scanner.scan(results, scanner_max_results));
+    TEST_ASSERT_EQUAL(0, scanner.dropped());
+}
+
+//==============================================================
+// a scan with more networks keeps the strongest ones and counts
+// the others, even if the strongest networks are at the end
+void test_scan_keeps_strongest(void) {
+    const int n_networks = 50;
+    const int max_results = 16;
+    replay_scanner scanner;
+    load_scan(scanner, n_networks);
+    scan_result results[max_results];
+    int n = scanner.scan(results, max_results);
+    TEST_ASSERT_EQUAL(max_results, n);
+    TEST_ASSERT_EQUAL(n_networks - max_results, scanner.dropped());
+    // the networks 0..max_results-1 are the strongest
+    bool found[max_results] = {false};
+    for(int i = 0; i < n; ++i) {
+        int network = (int) (results[i].bssid - 0xA42BB0000000ULL);
+        TEST_ASSERT_LESS_THAN(max_results, network);
+        TEST_ASSERT_EQUAL(-30 - network, results[i].rssi);
+        found[network] = true;
+    }
+    for(int i = 0; i < max_results; ++i)
+        TEST_ASSERT_TRUE(found[i]);
+    // a scan of a few channels only counts the networks on them
+    const uint8_t channels[] = {1, 2};
+    scanner.set_channels(channels, 2, 0);
+    n = scanner.scan(results, 4);
+    TEST_ASSERT_EQUAL(4, n);
+    // 8 networks on the channels 1 and 2 (0, 1, 13, 14, 26, 27, 39, 40)
+    TEST_ASSERT_EQUAL(8 - 4, scanner.dropped());
+    for(int i = 0; i < n; ++i) {
+        int network = (int) (results[i].bssid - 0xA42BB0000000ULL);
+        TEST_ASSERT_TRUE(network == 0 || network == 1 || network == 13 || network == 14);
+    }
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_scan_without_drops);
+    RUN_TEST(test_scan_keeps_strongest);
+    return UNITY_END();
+}